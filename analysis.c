@@ -0,0 +1,408 @@
+#include "analysis.h"
+#include "linkedlist.h"
+#include "ptrmap.h"
+#include "talloc.h"
+#include <string.h>
+
+// Lambda expressions analyzed so far, mapped to their FreeVariables.
+static PtrMap *analyzed = NULL;
+// Expressions checked by mayCreateClosures(), mapped to CREATES_CLOSURES or
+// CREATES_NONE.
+static PtrMap *closureMakers = NULL;
+#define CREATES_CLOSURES ((void *) 1)
+#define CREATES_NONE ((void *) 2)
+// Loops analyzed so far, mapped to their LoopAnalysis.
+static PtrMap *loops = NULL;
+
+static void forgetAnalysis(void *expression) {
+    FreeVariables *variables;
+    if (analyzed != NULL && ptrMapGet(analyzed, expression, (void **) &variables)) {
+        ptrMapRemove(analyzed, expression);
+        free(variables->symbols);
+        free(variables);
+    }
+    if (closureMakers != NULL) {
+        ptrMapRemove(closureMakers, expression);
+    }
+    LoopAnalysis *loop;
+    if (loops != NULL && ptrMapGet(loops, expression, (void **) &loop)) {
+        ptrMapRemove(loops, expression);
+        free(loop->counters);
+        free(loop);
+    }
+}
+
+/*
+ * Sets up the side tables the first time they are needed.
+ */
+static void startAnalysis() {
+    if (analyzed == NULL) {
+        analyzed = newPtrMap();
+        closureMakers = newPtrMap();
+        loops = newPtrMap();
+        addFreeHook(forgetAnalysis);
+    }
+}
+
+static bool isQuotation(Value *tree) {
+    return car(tree)->type == SYMBOL_TYPE && strcmp(car(tree)->s, "quote") == 0;
+}
+
+/*
+ * Returns whether a symbol with the same name is among the first count.
+ */
+static bool containsName(Value **symbols, int count, Value *symbol) {
+    for (int i = 0; i < count; i++) {
+        if (strcmp(symbols[i]->s, symbol->s) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Returns whether a symbol names one of a lambda's parameters, given as a
+ * list or, for a variadic lambda, a single symbol.
+ */
+static bool isParameter(Value *parameters, Value *symbol) {
+    if (parameters->type == SYMBOL_TYPE) {
+        return strcmp(parameters->s, symbol->s) == 0;
+    }
+    while (parameters->type == CONS_TYPE) {
+        if (car(parameters)->type == SYMBOL_TYPE && strcmp(car(parameters)->s, symbol->s) == 0) {
+            return true;
+        }
+        parameters = cdr(parameters);
+    }
+    return false;
+}
+
+static void *growArray(void *array, int *capacity, size_t itemSize) {
+    *capacity = *capacity == 0 ? 16 : *capacity * 2;
+    array = realloc(array, *capacity * itemSize);
+    if (array == NULL) {
+        outOfMemoryError();
+    }
+    return array;
+}
+
+/*
+ * Collects the symbols in a body, walking lists in a loop and keeping
+ * nested ones on a stack.
+ */
+static FreeVariables *analyze(Value *parameters, Value *body) {
+    FreeVariables *variables = malloc(sizeof(FreeVariables));
+    if (variables == NULL) {
+        outOfMemoryError();
+    }
+    variables->symbols = NULL;
+    variables->count = 0;
+    int capacity = 0;
+    Value **pending = NULL;
+    int pendingCount = 0;
+    int pendingCapacity = 0;
+    Value *tree = body;
+    while (true) {
+        if (tree->type == SYMBOL_TYPE) {
+            if (!isParameter(parameters, tree) && !containsName(variables->symbols, variables->count, tree)) {
+                if (variables->count == capacity) {
+                    variables->symbols = growArray(variables->symbols, &capacity, sizeof(Value *));
+                }
+                variables->symbols[variables->count++] = tree;
+            }
+        } else if (tree->type == CONS_TYPE && !isQuotation(tree)) {
+            for (; tree->type == CONS_TYPE; tree = cdr(tree)) {
+                if (pendingCount == pendingCapacity) {
+                    pending = growArray(pending, &pendingCapacity, sizeof(Value *));
+                }
+                pending[pendingCount++] = car(tree);
+            }
+            continue;
+        }
+        if (pendingCount == 0) {
+            break;
+        }
+        tree = pending[--pendingCount];
+    }
+    free(pending);
+    return variables;
+}
+
+FreeVariables *freeVariables(Value *lambda) {
+    FreeVariables *variables;
+    startAnalysis();
+    if (ptrMapGet(analyzed, lambda, (void **) &variables)) {
+        return variables;
+    }
+    variables = analyze(car(lambda), car(cdr(lambda)));
+    ptrMapPut(analyzed, lambda, variables);
+    return variables;
+}
+
+static bool isNamedLet(Value *tree) {
+    return car(tree)->type == SYMBOL_TYPE && strcmp(car(tree)->s, "let") == 0
+        && cdr(tree)->type == CONS_TYPE && car(cdr(tree))->type == SYMBOL_TYPE;
+}
+
+/*
+ * Looks for a symbol outside quoted data, and if namedLets is set for a
+ * named let too, walking lists in a loop and keeping nested ones on a stack.
+ */
+static bool search(Value *expression, char *name, bool namedLets) {
+    Value **pending = NULL;
+    int pendingCount = 0;
+    int pendingCapacity = 0;
+    Value *tree = expression;
+    bool found = false;
+    while (!found) {
+        if (tree->type == SYMBOL_TYPE) {
+            found = strcmp(tree->s, name) == 0;
+        } else if (tree->type == CONS_TYPE && namedLets && isNamedLet(tree)) {
+            found = true;
+        } else if (tree->type == CONS_TYPE && !isQuotation(tree)) {
+            for (; tree->type == CONS_TYPE; tree = cdr(tree)) {
+                if (pendingCount == pendingCapacity) {
+                    pending = growArray(pending, &pendingCapacity, sizeof(Value *));
+                }
+                pending[pendingCount++] = car(tree);
+            }
+            continue;
+        }
+        if (pendingCount == 0) {
+            break;
+        }
+        tree = pending[--pendingCount];
+    }
+    free(pending);
+    return found;
+}
+
+static bool mentions(Value *expression, char *name) {
+    return search(expression, name, false);
+}
+
+/*
+ * Looks for lambda, or a named let, which may be called as a procedure
+ * (see evalNamedLet()) and so make a closure without lambda appearing.
+ */
+static bool makesClosures(Value *expression) {
+    return search(expression, "lambda", true);
+}
+
+bool mayCreateClosures(Value *expression) {
+    void *answer;
+    startAnalysis();
+    if (!ptrMapGet(closureMakers, expression, &answer)) {
+        answer = makesClosures(expression) ? CREATES_CLOSURES : CREATES_NONE;
+        ptrMapPut(closureMakers, expression, answer);
+    }
+    return answer == CREATES_CLOSURES;
+}
+
+bool isForm(Value *expression, char *name) {
+    return expression->type == CONS_TYPE && car(expression)->type == SYMBOL_TYPE
+        && strcmp(car(expression)->s, name) == 0;
+}
+
+/*
+ * Returns whether a list has exactly count elements.
+ */
+static bool hasLength(Value *list, int count) {
+    while (list->type == CONS_TYPE && count > 0) {
+        list = cdr(list);
+        count--;
+    }
+    return list->type == NULL_TYPE && count == 0;
+}
+
+bool isCounterExpression(Value *expression) {
+    if (expression->type == INT_TYPE || expression->type == SYMBOL_TYPE) {
+        return true;
+    }
+    return (isForm(expression, "+") || isForm(expression, "-")) && hasLength(expression, 3)
+        && isCounterExpression(car(cdr(expression))) && isCounterExpression(car(cdr(cdr(expression))));
+}
+
+bool isCounterTest(Value *expression) {
+    return (isForm(expression, "=") || isForm(expression, "<=")) && hasLength(expression, 3)
+        && isCounterExpression(car(cdr(expression))) && isCounterExpression(car(cdr(cdr(expression))));
+}
+
+/*
+ * The variables of a loop being analyzed, and which of them have turned up
+ * somewhere a counter can't be.
+ */
+typedef struct LoopVariables {
+    Value **names;
+    bool *unsafe;
+    int count;
+} LoopVariables;
+
+/*
+ * Notes every variable an expression mentions as not a counter.
+ */
+static void markUses(LoopVariables *variables, Value *expression) {
+    for (int i = 0; i < variables->count; i++) {
+        if (!variables->unsafe[i] && mentions(expression, variables->names[i]->s)) {
+            variables->unsafe[i] = true;
+        }
+    }
+}
+
+/*
+ * Notes the variables a test or step mentions as not counters, unless it
+ * has the form counters may appear in.
+ */
+static void checkTest(LoopVariables *variables, Value *test) {
+    if (!isCounterTest(test)) {
+        markUses(variables, test);
+    }
+}
+
+static void checkStep(LoopVariables *variables, Value *step) {
+    if (!isCounterExpression(step)) {
+        markUses(variables, step);
+    }
+}
+
+/*
+ * Gathers the variable names from a list of bindings or do specs, each a
+ * list starting with the name.
+ */
+static LoopVariables *newLoopVariables(Value *bindings) {
+    LoopVariables *variables = malloc(sizeof(LoopVariables));
+    if (variables == NULL) {
+        outOfMemoryError();
+    }
+    variables->count = 0;
+    for (Value *remaining = bindings; remaining->type == CONS_TYPE; remaining = cdr(remaining)) {
+        variables->count++;
+    }
+    variables->names = malloc((variables->count + 1) * sizeof(Value *));
+    variables->unsafe = calloc(variables->count + 1, sizeof(bool));
+    if (variables->names == NULL || variables->unsafe == NULL) {
+        outOfMemoryError();
+    }
+    int i = 0;
+    for (Value *remaining = bindings; remaining->type == CONS_TYPE; remaining = cdr(remaining)) {
+        variables->names[i++] = car(car(remaining));
+    }
+    return variables;
+}
+
+/*
+ * Turns what was found into a LoopAnalysis and remembers it.
+ */
+static LoopAnalysis *finishLoop(Value *args, LoopVariables *variables, bool inPlace) {
+    LoopAnalysis *loop = malloc(sizeof(LoopAnalysis));
+    if (loop == NULL) {
+        outOfMemoryError();
+    }
+    loop->inPlace = inPlace;
+    loop->count = variables->count;
+    loop->counters = variables->unsafe;
+    for (int i = 0; i < loop->count; i++) {
+        loop->counters[i] = inPlace && !variables->unsafe[i];
+    }
+    free(variables->names);
+    free(variables);
+    ptrMapPut(loops, args, loop);
+    return loop;
+}
+
+LoopAnalysis *analyzeDo(Value *args) {
+    LoopAnalysis *loop;
+    startAnalysis();
+    if (ptrMapGet(loops, args, (void **) &loop)) {
+        return loop;
+    }
+    LoopVariables *variables = newLoopVariables(car(args));
+    bool inPlace = !makesClosures(args);
+    for (Value *specs = car(args); specs->type == CONS_TYPE; specs = cdr(specs)) {
+        Value *step = cdr(cdr(car(specs)));
+        if (step->type == CONS_TYPE) {
+            checkStep(variables, car(step));
+        }
+    }
+    // The results are left out: they are evaluated once the loop is over.
+    checkTest(variables, car(car(cdr(args))));
+    markUses(variables, cdr(cdr(args)));
+    return finishLoop(args, variables, inPlace);
+}
+
+/*
+ * Checks that a named let's body only calls it in tail position, noting the
+ * variables it uses where counters can't be.  The forms looked through are
+ * those evalNamedLet() treats as tail contexts.
+ */
+static bool onlyTailCalls(Value *expression, Value *name, int arity, LoopVariables *variables) {
+    if (isForm(expression, "if") && cdr(expression)->type == CONS_TYPE && cdr(cdr(expression))->type == CONS_TYPE) {
+        Value *args = cdr(expression);
+        if (mentions(car(args), name->s)) {
+            return false;
+        }
+        checkTest(variables, car(args));
+        return onlyTailCalls(car(cdr(args)), name, arity, variables)
+            && (cdr(cdr(args))->type != CONS_TYPE || onlyTailCalls(car(cdr(cdr(args))), name, arity, variables));
+    } else if (isForm(expression, "cond")) {
+        for (Value *clauses = cdr(expression); clauses->type == CONS_TYPE; clauses = cdr(clauses)) {
+            Value *clause = car(clauses);
+            if (clause->type != CONS_TYPE || mentions(car(clause), name->s)) {
+                return false;
+            }
+            if (cdr(clause)->type == CONS_TYPE) {
+                checkTest(variables, car(clause));
+                if (!onlyTailCalls(car(cdr(clause)), name, arity, variables)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    } else if (isForm(expression, "begin")) {
+        Value *remaining = cdr(expression);
+        while (remaining->type == CONS_TYPE && cdr(remaining)->type == CONS_TYPE) {
+            if (mentions(car(remaining), name->s)) {
+                return false;
+            }
+            markUses(variables, car(remaining));
+            remaining = cdr(remaining);
+        }
+        return remaining->type != CONS_TYPE || onlyTailCalls(car(remaining), name, arity, variables);
+    } else if (isForm(expression, name->s)) {
+        if (!hasLength(cdr(expression), arity)) {
+            return false;
+        }
+        for (Value *args = cdr(expression); args->type == CONS_TYPE; args = cdr(args)) {
+            if (mentions(car(args), name->s)) {
+                return false;
+            }
+            checkStep(variables, car(args));
+        }
+        return true;
+    }
+    // Anything else is the loop's result, evaluated as the loop ends.
+    return !mentions(expression, name->s);
+}
+
+LoopAnalysis *analyzeNamedLet(Value *args) {
+    LoopAnalysis *loop;
+    startAnalysis();
+    if (ptrMapGet(loops, args, (void **) &loop)) {
+        return loop;
+    }
+    Value *name = car(args);
+    LoopVariables *variables = newLoopVariables(car(cdr(args)));
+    bool inPlace = !makesClosures(cdr(cdr(args)));
+    for (int i = 0; i < variables->count && inPlace; i++) {
+        inPlace = strcmp(variables->names[i]->s, name->s) != 0;
+    }
+    // The body is looked at as if it were a begin.
+    Value *remaining = cdr(cdr(args));
+    while (inPlace && cdr(remaining)->type == CONS_TYPE) {
+        inPlace = !mentions(car(remaining), name->s);
+        markUses(variables, car(remaining));
+        remaining = cdr(remaining);
+    }
+    inPlace = inPlace && onlyTailCalls(car(remaining), name, variables->count, variables);
+    return finishLoop(args, variables, inPlace);
+}
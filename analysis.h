@@ -0,0 +1,96 @@
+#include <stdbool.h>
+#include "value.h"
+
+#ifndef ANALYSIS_H
+#define ANALYSIS_H
+
+/*
+ * Static analysis of lambda bodies, let forms and loops, done the first time
+ * each one is evaluated and kept in side tables keyed by the expression's
+ * address.  Like source locations (see location.h), the tables forget an
+ * expression when the collector frees it.
+ */
+
+/*
+ * The symbols a lambda body refers to other than its own parameters, each
+ * name once.  This is conservative: symbols bound by inner lambdas and lets,
+ * and the names of special forms, are included too, which only means the
+ * closure looks for them in the enclosing frames.  Quoted data is skipped.
+ */
+typedef struct FreeVariables {
+    Value **symbols;
+    int count;
+} FreeVariables;
+
+/*
+ * Returns the free variables of a lambda expression, given its arguments
+ * (the parameters followed by the body).  The result is owned by the table
+ * and stays valid as long as the expression does.
+ */
+FreeVariables *freeVariables(Value *lambda);
+
+/*
+ * Returns whether evaluating an expression could make a closure, which is
+ * to say whether lambda or a named let (which may run as a procedure, see
+ * evalNamedLet()) appears in it anywhere outside quoted data.  When
+ * it cannot, no closure can capture the bindings of frames it makes, so
+ * those frames can live in the region (see region.h).  An expression that
+ * gets at lambda through another name, as in (define fn lambda), is missed;
+ * closures made that way copy any bindings they capture from the region.
+ */
+bool mayCreateClosures(Value *expression);
+
+/*
+ * What the analysis found about a loop: a do, or a named let.
+ *
+ * A loop runs in place, in one frame whose bindings are assigned each time
+ * round, when it makes no closures, which could otherwise see a variable
+ * change under them.  A named let also has to call itself only in tail
+ * position (through if, cond and begin) and never mention its name
+ * otherwise, or it is run as an ordinary recursive procedure.
+ *
+ * A counter is a variable that only appears, while the loop goes round, as
+ * an operand of two-operand +, -, = and <= calls in tests and steps made of
+ * nothing but those calls, variables and integer literals, e.g. i in
+ * (do ((i 0 (+ i 1))) ((= i n) i) ...).  Nothing but those primitives ever
+ * sees its value before the loop ends, so the loop can keep it in an integer
+ * of its own and overwrite that instead of allocating a new one.
+ */
+typedef struct LoopAnalysis {
+    bool inPlace;
+    // For each variable, in order of the bindings.
+    bool *counters;
+    int count;
+} LoopAnalysis;
+
+/*
+ * Analyzes a do loop, given its arguments (the variable specs, the test and
+ * result clause, then the commands), which must be well formed.
+ */
+LoopAnalysis *analyzeDo(Value *args);
+
+/*
+ * Analyzes a named let, given its arguments (the name, the bindings, then
+ * the body), which must be well formed.
+ */
+LoopAnalysis *analyzeNamedLet(Value *args);
+
+/*
+ * Returns whether an expression is a list whose first element is the symbol
+ * with the given name, e.g. a call of it.
+ */
+bool isForm(Value *expression, char *name);
+
+/*
+ * Returns whether an expression has the form a counter's step must have:
+ * an integer literal, a variable, or a two-operand + or - of those.
+ */
+bool isCounterExpression(Value *expression);
+
+/*
+ * Returns whether an expression has the form a test of counters must have:
+ * a two-operand = or <= of counter expressions.
+ */
+bool isCounterTest(Value *expression);
+
+#endif
@@ -0,0 +1,330 @@
+/*
+ * Benchmark harness for the interpreter.
+ *
+ * Usage: bench [-n runs] [-b baseline.json] [-o results.json] [-t percent] [-c]
+ *              interpreter program.scm...
+ *
+ * Each program is fed to the interpreter on stdin runs times.  For every
+ * program the harness reports the median and 95th percentile wall time, the
+ * peak resident set size and the allocation counts the interpreter writes to
+ * SCHEME_STATS, as JSON.  Given a baseline (an earlier output), it exits with
+ * status 1 if any program got more than the tolerance slower or allocates
+ * more than it used to.
+ *
+ * With -c, each program's results also include the hardware counter totals
+ * per interpreter phase from its last run (see perfcounters.h), as
+ * "counters".
+ */
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <libgen.h>
+#include <time.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#define MAX_BENCHMARKS 64
+#define MAX_NAME 64
+#define MAX_COUNTERS 2048
+
+typedef struct Result {
+    char name[MAX_NAME];
+    double medianMs;
+    double p95Ms;
+    long peakRssKb;
+    unsigned long allocations;
+    unsigned long allocatedBytes;
+    char counters[MAX_COUNTERS];
+} Result;
+
+static double elapsedMs(struct timespec *start, struct timespec *end) {
+    return (end->tv_sec - start->tv_sec) * 1000.0 + (end->tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int compareDoubles(const void *a, const void *b) {
+    double x = *(const double *) a;
+    double y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/*
+ * Runs the interpreter once on a program, storing its wall time and peak RSS.
+ * Returns false if it could not be run or did not exit cleanly.
+ */
+static bool runOnce(char *interpreter, char *program, char *statsPath, char *countersPath,
+                    double *ms, long *rssKb) {
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    pid_t pid = fork();
+    if (pid == -1) {
+        perror("fork");
+        return false;
+    }
+    if (pid == 0) {
+        int in = open(program, O_RDONLY);
+        int out = open("/dev/null", O_WRONLY);
+        if (in == -1 || out == -1) {
+            perror(program);
+            _exit(127);
+        }
+        dup2(in, STDIN_FILENO);
+        dup2(out, STDOUT_FILENO);
+        setenv("SCHEME_STATS", statsPath, 1);
+        if (countersPath != NULL) {
+            setenv("SCHEME_PERF_COUNTERS", countersPath, 1);
+        }
+        execl(interpreter, interpreter, (char *) NULL);
+        perror(interpreter);
+        _exit(127);
+    }
+    int status;
+    struct rusage usage;
+    if (wait4(pid, &status, 0, &usage) == -1) {
+        perror("wait4");
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    *ms = elapsedMs(&start, &end);
+    *rssKb = usage.ru_maxrss;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        fprintf(stderr, "%s: interpreter did not exit cleanly\n", program);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Reads the allocation counts the interpreter wrote on its way out.
+ */
+static bool readStats(char *statsPath, Result *result) {
+    FILE *stats = fopen(statsPath, "r");
+    if (stats == NULL) {
+        return false;
+    }
+    int matched = fscanf(stats, " {\"allocations\": %lu, \"allocated_bytes\": %lu",
+                         &result->allocations, &result->allocatedBytes);
+    fclose(stats);
+    return matched == 2;
+}
+
+/*
+ * Reads the one-line JSON object of counters the interpreter wrote.
+ */
+static bool readCounters(char *countersPath, Result *result) {
+    FILE *counters = fopen(countersPath, "r");
+    if (counters == NULL) {
+        return false;
+    }
+    bool ok = fgets(result->counters, MAX_COUNTERS, counters) != NULL;
+    fclose(counters);
+    result->counters[strcspn(result->counters, "\n")] = '\0';
+    return ok;
+}
+
+static bool makeTemporary(char *path) {
+    int fd = mkstemp(path);
+    if (fd == -1) {
+        perror("mkstemp");
+        return false;
+    }
+    close(fd);
+    return true;
+}
+
+static bool runBenchmark(char *interpreter, char *program, int runs, bool counters, Result *result) {
+    char statsPath[] = "/tmp/scheme-bench-XXXXXX";
+    char countersPath[] = "/tmp/scheme-counters-XXXXXX";
+    if (!makeTemporary(statsPath) || (counters && !makeTemporary(countersPath))) {
+        return false;
+    }
+
+    char *copy = strdup(program);
+    char *name = basename(copy);
+    char *dot = strrchr(name, '.');
+    if (dot != NULL) {
+        *dot = '\0';
+    }
+    snprintf(result->name, MAX_NAME, "%s", name);
+    free(copy);
+
+    double *times = malloc(runs * sizeof(double));
+    bool ok = times != NULL;
+    result->peakRssKb = 0;
+    for (int i = 0; ok && i < runs; i++) {
+        long rssKb;
+        ok = runOnce(interpreter, program, statsPath, counters ? countersPath : NULL, &times[i], &rssKb);
+        if (rssKb > result->peakRssKb) {
+            result->peakRssKb = rssKb;
+        }
+    }
+    if (ok && !readStats(statsPath, result)) {
+        fprintf(stderr, "%s: no allocation counts in %s\n", program, statsPath);
+        ok = false;
+    }
+    result->counters[0] = '\0';
+    if (ok && counters && !readCounters(countersPath, result)) {
+        fprintf(stderr, "%s: no counters in %s\n", program, countersPath);
+        ok = false;
+    }
+    if (ok) {
+        qsort(times, runs, sizeof(double), compareDoubles);
+        result->medianMs = runs % 2 ? times[runs / 2] : (times[runs / 2 - 1] + times[runs / 2]) / 2;
+        // Nearest rank: the smallest time at least 95% of runs are within.
+        result->p95Ms = times[(runs * 95 + 99) / 100 - 1];
+    }
+    free(times);
+    unlink(statsPath);
+    if (counters) {
+        unlink(countersPath);
+    }
+    return ok;
+}
+
+static void writeResults(FILE *out, Result *results, int count, int runs) {
+    fprintf(out, "{\n  \"runs\": %d,\n  \"benchmarks\": [\n", runs);
+    for (int i = 0; i < count; i++) {
+        fprintf(out, "    {\"name\": \"%s\", \"median_ms\": %.3f, \"p95_ms\": %.3f, "
+                "\"peak_rss_kb\": %ld, \"allocations\": %lu, \"allocated_bytes\": %lu",
+                results[i].name, results[i].medianMs, results[i].p95Ms, results[i].peakRssKb,
+                results[i].allocations, results[i].allocatedBytes);
+        if (results[i].counters[0] != '\0') {
+            fprintf(out, ", \"counters\": %s", results[i].counters);
+        }
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "  ]\n}\n");
+}
+
+/*
+ * Reads a file written by writeResults(), one benchmark per line.  Returns
+ * the number of benchmarks, or -1 if the file cannot be opened.
+ */
+static int readBaseline(char *path, Result *baseline) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int count = 0;
+    char line[4096];
+    while (count < MAX_BENCHMARKS && fgets(line, sizeof(line), file) != NULL) {
+        Result *entry = &baseline[count];
+        if (sscanf(line, " {\"name\": \"%63[^\"]\", \"median_ms\": %lf, \"p95_ms\": %lf, "
+                   "\"peak_rss_kb\": %ld, \"allocations\": %lu, \"allocated_bytes\": %lu",
+                   entry->name, &entry->medianMs, &entry->p95Ms, &entry->peakRssKb,
+                   &entry->allocations, &entry->allocatedBytes) == 6) {
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+/*
+ * Prints how each result compares with the baseline.  Returns the number of
+ * regressions: times beyond the tolerance, or any growth in allocations
+ * (which are deterministic, so need no tolerance).
+ */
+static int compare(Result *results, int count, Result *baseline, int baselineCount, double tolerance) {
+    int regressions = 0;
+    for (int i = 0; i < count; i++) {
+        Result *old = NULL;
+        for (int j = 0; j < baselineCount; j++) {
+            if (strcmp(baseline[j].name, results[i].name) == 0) {
+                old = &baseline[j];
+            }
+        }
+        if (old == NULL) {
+            fprintf(stderr, "%-10s  not in baseline\n", results[i].name);
+            continue;
+        }
+        double change = (results[i].medianMs - old->medianMs) / old->medianMs * 100;
+        bool slower = change > tolerance;
+        bool moreAllocations = results[i].allocations > old->allocations;
+        fprintf(stderr, "%-10s  %9.1f ms (%+6.1f%%)  %10lu allocations (baseline %lu)%s\n",
+                results[i].name, results[i].medianMs, change, results[i].allocations,
+                old->allocations, slower || moreAllocations ? "  REGRESSION" : "");
+        if (slower || moreAllocations) {
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void usage(char *program) {
+    fprintf(stderr, "Usage: %s [-n runs] [-b baseline.json] [-o results.json] [-t percent] [-c] "
+            "interpreter program.scm...\n", program);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    int runs = 5;
+    char *baselinePath = NULL;
+    char *outputPath = NULL;
+    double tolerance = 10;
+    bool counters = false;
+    int option;
+    while ((option = getopt(argc, argv, "n:b:o:t:c")) != -1) {
+        switch (option) {
+            case 'n':
+                runs = atoi(optarg);
+                break;
+            case 'b':
+                baselinePath = optarg;
+                break;
+            case 'o':
+                outputPath = optarg;
+                break;
+            case 't':
+                tolerance = atof(optarg);
+                break;
+            case 'c':
+                counters = true;
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+    int count = argc - optind - 1;
+    if (runs < 1 || count < 1 || count > MAX_BENCHMARKS) {
+        usage(argv[0]);
+    }
+    char *interpreter = argv[optind];
+
+    Result results[MAX_BENCHMARKS];
+    for (int i = 0; i < count; i++) {
+        if (!runBenchmark(interpreter, argv[optind + 1 + i], runs, counters, &results[i])) {
+            return 1;
+        }
+    }
+
+    writeResults(stdout, results, count, runs);
+    fflush(stdout);
+    if (outputPath != NULL) {
+        FILE *out = fopen(outputPath, "w");
+        if (out == NULL) {
+            perror(outputPath);
+            return 1;
+        }
+        writeResults(out, results, count, runs);
+        fclose(out);
+    }
+
+    if (baselinePath != NULL) {
+        Result baseline[MAX_BENCHMARKS];
+        int baselineCount = readBaseline(baselinePath, baseline);
+        if (baselineCount == -1) {
+            fprintf(stderr, "No baseline at %s; run make bench-baseline to save one\n", baselinePath);
+            return 0;
+        }
+        int regressions = compare(results, count, baseline, baselineCount, tolerance);
+        if (regressions > 0) {
+            fprintf(stderr, "%d benchmark%s regressed\n", regressions, regressions == 1 ? "" : "s");
+            return 1;
+        }
+    }
+    return 0;
+}
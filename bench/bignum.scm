@@ -0,0 +1,11 @@
+; Factorials past 64 bits: bignum multiplication (Karatsuba once the
+; operands are long) and the exact comparisons and remainders around it.
+
+(define fact
+  (lambda (n)
+    (if (= n 0)
+        1
+        (* n (fact (+ n -1))))))
+
+(define f (fact 600))
+(modulo (* f f) (+ (fact 300) 1))
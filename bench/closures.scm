@@ -0,0 +1,30 @@
+; Closures made inside frames holding data they never use, kept across
+; collections, then called.
+
+(define make-handler
+  (lambda (id)
+    (let ((scratch (make-vector 200 id)))
+      (lambda (x) (+ x id)))))
+
+(define make-handlers
+  (lambda (n handlers)
+    (if (= n 0)
+        handlers
+        (make-handlers (- n 1) (cons (make-handler n) handlers)))))
+
+(define handlers (make-handlers 2000 (quote ())))
+
+(define call-all
+  (lambda (handlers total)
+    (if (null? handlers)
+        total
+        (call-all (cdr handlers) ((car handlers) total)))))
+
+(call-all handlers 0)
+(call-all handlers 1)
+(call-all handlers 2)
+(call-all handlers 3)
+(call-all handlers 4)
+(call-all handlers 5)
+(call-all handlers 6)
+(call-all handlers 7)
@@ -0,0 +1,28 @@
+; Symbolic differentiation of a sum of products, repeated: builds many
+; short-lived lists and compares symbols.
+
+(define cadr (lambda (x) (car (cdr x))))
+(define caddr (lambda (x) (car (cdr (cdr x)))))
+
+(define deriv
+  (lambda (e)
+    (if (pair? e)
+        (cond ((eq? (car e) (quote +))
+               (list (quote +) (deriv (cadr e)) (deriv (caddr e))))
+              ((eq? (car e) (quote *))
+               (list (quote +)
+                     (list (quote *) (cadr e) (deriv (caddr e)))
+                     (list (quote *) (deriv (cadr e)) (caddr e))))
+              (else 0))
+        (if (eq? e (quote x)) 1 0))))
+
+(define expression
+  (quote (+ (* 3 (* x x)) (+ (* a (* x x)) (+ (* b x) (* x (* x (* x 5))))))))
+
+(define repeat
+  (lambda (n)
+    (if (= n 0)
+        (deriv expression)
+        (begin (deriv expression) (repeat (+ n -1))))))
+
+(repeat 200)
@@ -0,0 +1,10 @@
+; Bulk numeric vector kernels: element-wise arithmetic, dot products,
+; sums, extremes and prefix sums over a million unboxed doubles.
+
+(define ones (make-f64vector 1000000 1))
+(define v (f64vector-prefix-sum ones))
+(define w (f64vector-scale v 0.5))
+(f64vector-dot v w)
+(f64vector-sum (f64vector-add v w))
+(f64vector-max (f64vector-sub v w))
+(f64vector-min (f64vector-mul v w))
@@ -0,0 +1,15 @@
+; Doubles in and out: reads a list of double literals with full precision
+; and prints the running sums of a long f64vector, each in its shortest
+; round-trip form.
+
+(define data (list 0.1 -2.5e-3 3.14159 2.718281828459045 1e10 -7.25 6.02214076e23 1.602176634e-19
+                   0.5 0.25 -0.125 123456.789 9.87654321e-5 1.4142135623730951 -1.7320508075688772 42.0))
+
+(define sum
+  (lambda (lst total)
+    (if (null? lst)
+        total
+        (sum (cdr lst) (+ total (car lst))))))
+
+(sum data 0.0)
+(f64vector-prefix-sum (make-f64vector 200000 0.1))
@@ -0,0 +1,26 @@
+; Keeps a large list alive across many top-level forms, each of which makes
+; garbage, so that every collection has to trace the live cells.
+
+(define make-list
+  (lambda (n)
+    (if (= n 0)
+        (quote ())
+        (cons n (make-list (+ n -1))))))
+
+(define live (make-list 500))
+
+(define churn
+  (lambda (n)
+    (if (= n 0)
+        0
+        (begin (cons n n) (churn (+ n -1))))))
+
+(churn 200)
+(churn 200)
+(churn 200)
+(churn 200)
+(churn 200)
+(churn 200)
+(churn 200)
+(churn 200)
+(car live)
@@ -0,0 +1,30 @@
+; Keyed lookups in a hash table of a few hundred entries, with some keys
+; deleted and added back: hashing, probing and growing the table.
+
+(define table (make-hash-table))
+
+(define fill
+  (lambda (n)
+    (if (= n 0)
+        0
+        (begin (hash-table-set! table (list n (quote key)) n) (fill (+ n -1))))))
+
+(define probe
+  (lambda (n total)
+    (if (= n 0)
+        total
+        (probe (+ n -1) (+ total (hash-table-ref table (list n (quote key)) 0))))))
+
+(define churn
+  (lambda (n)
+    (if (= n 0)
+        0
+        (begin (hash-table-delete! table (list n (quote key)))
+               (hash-table-set! table (list n (quote key)) n)
+               (churn (+ n -2))))))
+
+(fill 400)
+(probe 400 0)
+(churn 400)
+(probe 400 0)
+(hash-table-count table)
@@ -0,0 +1,18 @@
+; Counting loops written with do and named let, the second summing into an
+; accumulator as it goes.
+
+(define count-do
+  (lambda (n)
+    (do ((i 0 (+ i 1))) ((= i n) i))))
+
+(define sum-named-let
+  (lambda (n)
+    (let loop ((i 0) (sum 0))
+      (if (= i n)
+          sum
+          (loop (+ i 1) (+ sum i))))))
+
+(count-do 25000)
+(sum-named-let 25000)
+(count-do 25000)
+(sum-named-let 25000)
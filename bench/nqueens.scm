@@ -0,0 +1,30 @@
+; Counts the solutions to the n-queens problem by backtracking over lists.
+
+(define safe?
+  (lambda (row distance placed)
+    (if (null? placed)
+        #t
+        (if (= (car placed) (+ row distance))
+            #f
+            (if (= (car placed) (+ row (* distance -1)))
+                #f
+                (if (= (car placed) row)
+                    #f
+                    (safe? row (+ distance 1) (cdr placed))))))))
+
+(define try-rows
+  (lambda (row column n placed)
+    (if (<= row 0)
+        0
+        (+ (if (safe? row 1 placed)
+               (place (+ column 1) n (cons row placed))
+               0)
+           (try-rows (+ row -1) column n placed)))))
+
+(define place
+  (lambda (column n placed)
+    (if (<= column n)
+        (try-rows n column n placed)
+        1)))
+
+(place 1 6 (quote ()))
@@ -0,0 +1,9 @@
+; Deep non-tail recursion: every call stays on the stack until the bottom.
+
+(define depth
+  (lambda (n)
+    (if (= n 0)
+        0
+        (+ 1 (depth (+ n -1))))))
+
+(depth 10000)
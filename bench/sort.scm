@@ -0,0 +1,45 @@
+; Merge sort of a list of pseudo-random integers.
+
+(define random-list
+  (lambda (n seed)
+    (if (= n 0)
+        (quote ())
+        (cons (modulo seed 1000)
+              (random-list (+ n -1) (modulo (+ (* seed 1103) 12345) 65536))))))
+
+(define split
+  (lambda (lst left right)
+    (if (null? lst)
+        (cons left right)
+        (split (cdr lst) right (cons (car lst) left)))))
+
+(define merge
+  (lambda (a b)
+    (if (null? a)
+        b
+        (if (null? b)
+            a
+            (if (<= (car a) (car b))
+                (cons (car a) (merge (cdr a) b))
+                (cons (car b) (merge a (cdr b))))))))
+
+(define sort
+  (lambda (lst)
+    (if (null? lst)
+        lst
+        (if (null? (cdr lst))
+            lst
+            (let ((halves (split lst (quote ()) (quote ()))))
+              (merge (sort (car halves)) (sort (cdr halves))))))))
+
+(define sorted?
+  (lambda (lst)
+    (if (null? lst)
+        #t
+        (if (null? (cdr lst))
+            #t
+            (if (<= (car lst) (car (cdr lst)))
+                (sorted? (cdr lst))
+                #f)))))
+
+(sorted? (sort (random-list 400 42)))
@@ -0,0 +1,31 @@
+; Text built by appending thousands of short pieces to a string builder,
+; then sliced: linear in the output, where appending strings to each other
+; would copy it all again every time.
+
+(define b (make-string-builder))
+
+(define piece
+  (lambda (n)
+    (if (= (modulo n 3) 0)
+        "fizz "
+        (if (= (modulo n 5) 0)
+            "buzz "
+            "number "))))
+
+(define line
+  (lambda (n)
+    (if (= n 0)
+        (string-builder-append! b "\n")
+        (let ((x (string-builder-append! b (piece n))))
+          (line (+ n -1))))))
+
+(define lines
+  (lambda (n)
+    (if (= n 0)
+        (string-builder-length b)
+        (let ((x (line 1000)))
+          (lines (+ n -1))))))
+
+(lines 4)
+(define text (string-builder->string b))
+(string-length (substring text 1000 (+ (string-length text) -1000)))
@@ -0,0 +1,24 @@
+; Builds a long list of string pieces by repeated appending, the way text is
+; assembled before there are string primitives to join it.
+
+(define piece
+  (lambda (n)
+    (if (= (modulo n 3) 0)
+        (list "fizz" " ")
+        (if (= (modulo n 5) 0)
+            (list "buzz" " ")
+            (list "number" " ")))))
+
+(define build
+  (lambda (n text)
+    (if (= n 0)
+        text
+        (build (+ n -1) (append (piece n) text)))))
+
+(define count
+  (lambda (lst total)
+    (if (null? lst)
+        total
+        (count (cdr lst) (+ total 1)))))
+
+(count (build 300 (quote ())) 0)
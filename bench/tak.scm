@@ -0,0 +1,11 @@
+; Takeuchi's function: deep, non-tail calls with three arguments.
+
+(define tak
+  (lambda (x y z)
+    (if (<= x y)
+        z
+        (tak (tak (+ x -1) y z)
+             (tak (+ y -1) z x)
+             (tak (+ z -1) x y)))))
+
+(tak 16 10 5)
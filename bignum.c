@@ -0,0 +1,544 @@
+#include "bignum.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+// Operands shorter than this (in digits) are multiplied the schoolbook way.
+#define KARATSUBA_THRESHOLD 32
+// The largest power of ten that fits in a digit, for decimal conversion.
+#define DECIMAL_BASE 1000000000u
+#define DECIMAL_DIGITS 9
+
+typedef uint32_t digit;
+
+/*
+ * An integer's sign and magnitude, pointing into a bignum or, for a fixnum,
+ * into small.  Zero has length 0.
+ */
+typedef struct Integer {
+    digit *digits;
+    int length;
+    bool negative;
+    digit small[2];
+} Integer;
+
+/*
+ * Print an error message indicating the program is out of memory.
+ */
+static void bignumOutOfMemory() {
+    printf("Out of memory!");
+    texit(1);
+}
+
+/*
+ * Allocates zeroed scratch space for count digits, outside the talloc heap.
+ */
+static digit *newDigits(int count) {
+    digit *digits = calloc(count > 0 ? count : 1, sizeof(digit));
+    if (digits == NULL) {
+        bignumOutOfMemory();
+    }
+    return digits;
+}
+
+static int trimmed(const digit *digits, int length) {
+    while (length > 0 && digits[length - 1] == 0) {
+        length--;
+    }
+    return length;
+}
+
+static void load(Value *value, Integer *n) {
+    if (value->type == BIGNUM_TYPE) {
+        n->digits = value->b.digits;
+        n->length = value->b.length;
+        n->negative = value->b.negative;
+        return;
+    }
+    uint64_t magnitude = value->i < 0 ? -(uint64_t) value->i : (uint64_t) value->i;
+    n->small[0] = (digit) magnitude;
+    n->small[1] = (digit) (magnitude >> 32);
+    n->digits = n->small;
+    n->length = trimmed(n->small, 2);
+    n->negative = value->i < 0;
+}
+
+/*
+ * Makes a value of a sign and magnitude, as a fixnum if it fits in one.
+ */
+static Value *store(const digit *digits, int length, bool negative) {
+    length = trimmed(digits, length);
+    if (length <= 2) {
+        uint64_t magnitude = length == 0 ? 0 : digits[0] | (length == 2 ? (uint64_t) digits[1] << 32 : 0);
+        if (magnitude <= INT64_MAX) {
+            return makeInteger(negative ? -(int64_t) magnitude : (int64_t) magnitude);
+        } else if (negative && magnitude == (uint64_t) INT64_MAX + 1) {
+            return makeInteger(INT64_MIN);
+        }
+    }
+    Value *value = makeNull();
+    value->type = BIGNUM_TYPE;
+    value->b.digits = tallocKind(length * sizeof(digit), BIGNUM_ALLOCATION);
+    memcpy(value->b.digits, digits, length * sizeof(digit));
+    value->b.length = length;
+    value->b.negative = negative;
+    return value;
+}
+
+Value *makeInteger(int64_t n) {
+    Value *value = makeNull();
+    value->type = INT_TYPE;
+    value->i = n;
+    return value;
+}
+
+bool isInteger(Value *value) {
+    return value->type == INT_TYPE || value->type == BIGNUM_TYPE;
+}
+
+static int compareMagnitudes(const digit *a, int an, const digit *b, int bn) {
+    if (an != bn) {
+        return an < bn ? -1 : 1;
+    }
+    for (int i = an - 1; i >= 0; i--) {
+        if (a[i] != b[i]) {
+            return a[i] < b[i] ? -1 : 1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * r = a + b, where r has room for one digit more than the longer operand.
+ * Returns the length of r.
+ */
+static int addMagnitudes(digit *r, const digit *a, int an, const digit *b, int bn) {
+    if (an < bn) {
+        const digit *t = a;
+        a = b;
+        b = t;
+        int tn = an;
+        an = bn;
+        bn = tn;
+    }
+    uint64_t carry = 0;
+    for (int i = 0; i < an; i++) {
+        carry += (uint64_t) a[i] + (i < bn ? b[i] : 0);
+        r[i] = (digit) carry;
+        carry >>= 32;
+    }
+    r[an] = (digit) carry;
+    return an + 1;
+}
+
+/*
+ * r = a - b, where a is at least b and r has room for an digits.
+ */
+static void subtractMagnitudes(digit *r, const digit *a, int an, const digit *b, int bn) {
+    int64_t borrow = 0;
+    for (int i = 0; i < an; i++) {
+        int64_t t = (int64_t) a[i] - (i < bn ? b[i] : 0) - borrow;
+        r[i] = (digit) t;
+        borrow = t < 0;
+    }
+}
+
+/*
+ * dst += src, where dst (dn digits) is long enough for the sum.
+ */
+static void addInto(digit *dst, int dn, const digit *src, int sn) {
+    uint64_t carry = 0;
+    int i = 0;
+    for (; i < sn; i++) {
+        carry += (uint64_t) dst[i] + src[i];
+        dst[i] = (digit) carry;
+        carry >>= 32;
+    }
+    for (; carry != 0 && i < dn; i++) {
+        carry += dst[i];
+        dst[i] = (digit) carry;
+        carry >>= 32;
+    }
+}
+
+/*
+ * dst -= src, where dst (dn digits) is at least src.
+ */
+static void subtractFrom(digit *dst, int dn, const digit *src, int sn) {
+    int64_t borrow = 0;
+    int i = 0;
+    for (; i < sn; i++) {
+        int64_t t = (int64_t) dst[i] - src[i] - borrow;
+        dst[i] = (digit) t;
+        borrow = t < 0;
+    }
+    for (; borrow != 0 && i < dn; i++) {
+        int64_t t = (int64_t) dst[i] - borrow;
+        dst[i] = (digit) t;
+        borrow = t < 0;
+    }
+}
+
+static void schoolbookMultiply(digit *r, const digit *a, int an, const digit *b, int bn) {
+    memset(r, 0, (an + bn) * sizeof(digit));
+    for (int i = 0; i < an; i++) {
+        uint64_t carry = 0;
+        for (int j = 0; j < bn; j++) {
+            carry += (uint64_t) a[i] * b[j] + r[i + j];
+            r[i + j] = (digit) carry;
+            carry >>= 32;
+        }
+        r[i + bn] = (digit) carry;
+    }
+}
+
+/*
+ * r = a * b, where r has room for an + bn digits and overlaps neither.
+ */
+static void multiplyMagnitudes(digit *r, const digit *a, int an, const digit *b, int bn) {
+    if (an < bn) {
+        multiplyMagnitudes(r, b, bn, a, an);
+        return;
+    }
+    if (bn < KARATSUBA_THRESHOLD) {
+        schoolbookMultiply(r, a, an, b, bn);
+        return;
+    }
+    // Split a = a1 B^m + a0, with B the digit base.
+    int m = an / 2;
+    memset(r, 0, (an + bn) * sizeof(digit));
+    if (bn <= m) {
+        // Too lopsided to split b as well: r = a0 b + a1 b B^m.
+        digit *high = newDigits(an - m + bn);
+        multiplyMagnitudes(r, a, m, b, bn);
+        multiplyMagnitudes(high, a + m, an - m, b, bn);
+        addInto(r + m, an + bn - m, high, an - m + bn);
+        free(high);
+        return;
+    }
+    // r = z2 B^2m + z1 B^m + z0, where z1 = (a0 + a1)(b0 + b1) - z0 - z2
+    // takes one multiplication instead of two.
+    int a1n = an - m;
+    int b1n = bn - m;
+    digit *z0 = newDigits(2 * m);
+    digit *z2 = newDigits(a1n + b1n);
+    digit *aSum = newDigits(a1n + 1);
+    digit *bSum = newDigits((b1n > m ? b1n : m) + 1);
+    multiplyMagnitudes(z0, a, m, b, m);
+    multiplyMagnitudes(z2, a + m, a1n, b + m, b1n);
+    int aSumLength = addMagnitudes(aSum, a, m, a + m, a1n);
+    int bSumLength = addMagnitudes(bSum, b, m, b + m, b1n);
+    digit *z1 = newDigits(aSumLength + bSumLength);
+    multiplyMagnitudes(z1, aSum, aSumLength, bSum, bSumLength);
+    subtractFrom(z1, aSumLength + bSumLength, z0, 2 * m);
+    subtractFrom(z1, aSumLength + bSumLength, z2, a1n + b1n);
+    memcpy(r, z0, 2 * m * sizeof(digit));
+    memcpy(r + 2 * m, z2, (a1n + b1n) * sizeof(digit));
+    addInto(r + m, an + bn - m, z1, trimmed(z1, aSumLength + bSumLength));
+    free(z0);
+    free(z2);
+    free(aSum);
+    free(bSum);
+    free(z1);
+}
+
+/*
+ * q = a / divisor, where q may be a itself.  Returns the remainder.
+ */
+static digit divideSmall(digit *q, const digit *a, int an, digit divisor) {
+    uint64_t remainder = 0;
+    for (int i = an - 1; i >= 0; i--) {
+        uint64_t current = (remainder << 32) | a[i];
+        q[i] = (digit) (current / divisor);
+        remainder = current % divisor;
+    }
+    return (digit) remainder;
+}
+
+/*
+ * q = a / b and r = a % b, where an >= bn >= 2 and b's top digit is not
+ * zero.  q has room for an - bn + 1 digits and r for bn.  This is Knuth's
+ * Algorithm D, as given in Hacker's Delight.
+ */
+static void divideMagnitudes(digit *q, digit *r, const digit *a, int an, const digit *b, int bn) {
+    // Shift both so that the divisor's top bit is set, which keeps each
+    // estimated quotient digit at most two too big.
+    int shift = __builtin_clz(b[bn - 1]);
+    digit *u = newDigits(an + 1);
+    digit *v = newDigits(bn);
+    for (int i = bn - 1; i > 0; i--) {
+        v[i] = (b[i] << shift) | (digit) ((uint64_t) b[i - 1] >> (32 - shift));
+    }
+    v[0] = b[0] << shift;
+    u[an] = (digit) ((uint64_t) a[an - 1] >> (32 - shift));
+    for (int i = an - 1; i > 0; i--) {
+        u[i] = (a[i] << shift) | (digit) ((uint64_t) a[i - 1] >> (32 - shift));
+    }
+    u[0] = a[0] << shift;
+
+    const uint64_t base = (uint64_t) 1 << 32;
+    for (int j = an - bn; j >= 0; j--) {
+        uint64_t numerator = ((uint64_t) u[j + bn] << 32) | u[j + bn - 1];
+        uint64_t qhat = numerator / v[bn - 1];
+        uint64_t rhat = numerator % v[bn - 1];
+        while (qhat >= base || qhat * v[bn - 2] > ((rhat << 32) | u[j + bn - 2])) {
+            qhat--;
+            rhat += v[bn - 1];
+            if (rhat >= base) {
+                break;
+            }
+        }
+        // Subtract qhat times the divisor from the current window.
+        int64_t borrow = 0;
+        int64_t t;
+        for (int i = 0; i < bn; i++) {
+            uint64_t product = qhat * v[i];
+            t = (int64_t) u[i + j] - borrow - (int64_t) (product & 0xffffffff);
+            u[i + j] = (digit) t;
+            borrow = (int64_t) (product >> 32) - (t >> 32);
+        }
+        t = (int64_t) u[j + bn] - borrow;
+        u[j + bn] = (digit) t;
+        q[j] = (digit) qhat;
+        if (t < 0) {
+            // qhat was one too big: add the divisor back.
+            q[j]--;
+            uint64_t carry = 0;
+            for (int i = 0; i < bn; i++) {
+                carry += (uint64_t) u[i + j] + v[i];
+                u[i + j] = (digit) carry;
+                carry >>= 32;
+            }
+            u[j + bn] += (digit) carry;
+        }
+    }
+    for (int i = 0; i < bn - 1; i++) {
+        r[i] = (u[i] >> shift) | (digit) ((uint64_t) u[i + 1] << (32 - shift));
+    }
+    r[bn - 1] = u[bn - 1] >> shift;
+    free(u);
+    free(v);
+}
+
+static Value *addIntegers(Integer *x, Integer *y) {
+    int length = (x->length > y->length ? x->length : y->length) + 1;
+    digit *r = newDigits(length);
+    Value *result;
+    if (x->negative == y->negative) {
+        addMagnitudes(r, x->digits, x->length, y->digits, y->length);
+        result = store(r, length, x->negative);
+    } else if (compareMagnitudes(x->digits, x->length, y->digits, y->length) >= 0) {
+        subtractMagnitudes(r, x->digits, x->length, y->digits, y->length);
+        result = store(r, x->length, x->negative);
+    } else {
+        subtractMagnitudes(r, y->digits, y->length, x->digits, x->length);
+        result = store(r, y->length, y->negative);
+    }
+    free(r);
+    return result;
+}
+
+Value *integerAdd(Value *a, Value *b) {
+    int64_t sum;
+    if (a->type == INT_TYPE && b->type == INT_TYPE && !__builtin_add_overflow(a->i, b->i, &sum)) {
+        return makeInteger(sum);
+    }
+    Integer x;
+    Integer y;
+    load(a, &x);
+    load(b, &y);
+    return addIntegers(&x, &y);
+}
+
+Value *integerSubtract(Value *a, Value *b) {
+    int64_t difference;
+    if (a->type == INT_TYPE && b->type == INT_TYPE && !__builtin_sub_overflow(a->i, b->i, &difference)) {
+        return makeInteger(difference);
+    }
+    Integer x;
+    Integer y;
+    load(a, &x);
+    load(b, &y);
+    y.negative = y.length > 0 && !y.negative;
+    return addIntegers(&x, &y);
+}
+
+Value *integerNegate(Value *a) {
+    if (a->type == INT_TYPE && a->i != INT64_MIN) {
+        return makeInteger(-a->i);
+    }
+    Integer x;
+    load(a, &x);
+    return store(x.digits, x.length, x.length > 0 && !x.negative);
+}
+
+Value *integerMultiply(Value *a, Value *b) {
+    int64_t product;
+    if (a->type == INT_TYPE && b->type == INT_TYPE && !__builtin_mul_overflow(a->i, b->i, &product)) {
+        return makeInteger(product);
+    }
+    Integer x;
+    Integer y;
+    load(a, &x);
+    load(b, &y);
+    if (x.length == 0 || y.length == 0) {
+        return makeInteger(0);
+    }
+    digit *r = newDigits(x.length + y.length);
+    multiplyMagnitudes(r, x.digits, x.length, y.digits, y.length);
+    Value *result = store(r, x.length + y.length, x.negative != y.negative);
+    free(r);
+    return result;
+}
+
+void integerDivide(Value *a, Value *b, Value **quotient, Value **remainder) {
+    if (a->type == INT_TYPE && b->type == INT_TYPE && !(a->i == INT64_MIN && b->i == -1)) {
+        if (quotient != NULL) {
+            *quotient = makeInteger(a->i / b->i);
+        }
+        if (remainder != NULL) {
+            *remainder = makeInteger(a->i % b->i);
+        }
+        return;
+    }
+    Integer x;
+    Integer y;
+    load(a, &x);
+    load(b, &y);
+    bool negative = x.negative != y.negative;
+    if (compareMagnitudes(x.digits, x.length, y.digits, y.length) < 0) {
+        if (quotient != NULL) {
+            *quotient = makeInteger(0);
+        }
+        if (remainder != NULL) {
+            *remainder = a;
+        }
+        return;
+    }
+    digit *q = newDigits(x.length);
+    digit *r = newDigits(y.length);
+    if (y.length == 1) {
+        r[0] = divideSmall(q, x.digits, x.length, y.digits[0]);
+    } else {
+        divideMagnitudes(q, r, x.digits, x.length, y.digits, y.length);
+    }
+    if (quotient != NULL) {
+        *quotient = store(q, x.length - y.length + 1, negative);
+    }
+    if (remainder != NULL) {
+        *remainder = store(r, y.length, x.negative);
+    }
+    free(q);
+    free(r);
+}
+
+int integerCompare(Value *a, Value *b) {
+    if (a->type == INT_TYPE && b->type == INT_TYPE) {
+        return (a->i > b->i) - (a->i < b->i);
+    }
+    Integer x;
+    Integer y;
+    load(a, &x);
+    load(b, &y);
+    if (x.negative != y.negative) {
+        return x.negative ? -1 : 1;
+    }
+    int order = compareMagnitudes(x.digits, x.length, y.digits, y.length);
+    return x.negative ? -order : order;
+}
+
+bool integerIsZero(Value *integer) {
+    return integer->type == INT_TYPE && integer->i == 0;
+}
+
+bool integerIsNegative(Value *integer) {
+    return integer->type == INT_TYPE ? integer->i < 0 : integer->b.negative;
+}
+
+double integerToDouble(Value *integer) {
+    if (integer->type == INT_TYPE) {
+        return (double) integer->i;
+    }
+    double result = 0;
+    for (int i = integer->b.length - 1; i >= 0; i--) {
+        result = result * 4294967296.0 + integer->b.digits[i];
+    }
+    return integer->b.negative ? -result : result;
+}
+
+Value *parseInteger(char *text) {
+    errno = 0;
+    long long n = strtoll(text, NULL, 10);
+    if (errno != ERANGE) {
+        return makeInteger(n);
+    }
+    bool negative = *text == '-';
+    if (*text == '-' || *text == '+') {
+        text++;
+    }
+    int length = strlen(text);
+    digit *r = newDigits(length / DECIMAL_DIGITS + 2);
+    int used = 0;
+    // Take the digits nine at a time: r = r * 10^9 + chunk.
+    int chunkLength = length % DECIMAL_DIGITS == 0 ? DECIMAL_DIGITS : length % DECIMAL_DIGITS;
+    while (*text != '\0') {
+        uint64_t scale = 1;
+        uint64_t carry = 0;
+        for (int i = 0; i < chunkLength; i++) {
+            scale *= 10;
+            carry = carry * 10 + (*text++ - '0');
+        }
+        for (int i = 0; i < used; i++) {
+            carry += (uint64_t) r[i] * scale;
+            r[i] = (digit) carry;
+            carry >>= 32;
+        }
+        if (carry != 0) {
+            r[used++] = (digit) carry;
+        }
+        chunkLength = DECIMAL_DIGITS;
+    }
+    Value *result = store(r, used, negative);
+    free(r);
+    return result;
+}
+
+char *integerToString(Value *integer) {
+    if (integer->type == INT_TYPE) {
+        char *text = malloc(24);
+        if (text == NULL) {
+            bignumOutOfMemory();
+        }
+        sprintf(text, "%lld", (long long) integer->i);
+        return text;
+    }
+    int length = integer->b.length;
+    digit *work = newDigits(length);
+    memcpy(work, integer->b.digits, length * sizeof(digit));
+    // A digit holds fewer than 10 decimal digits, so this many chunks of 9
+    // is plenty.
+    digit *chunks = newDigits(2 * length + 1);
+    int count = 0;
+    while (length > 0) {
+        chunks[count++] = divideSmall(work, work, length, DECIMAL_BASE);
+        length = trimmed(work, length);
+    }
+    char *text = malloc(count * DECIMAL_DIGITS + 2);
+    if (text == NULL) {
+        bignumOutOfMemory();
+    }
+    char *end = text;
+    if (integer->b.negative) {
+        *end++ = '-';
+    }
+    end += sprintf(end, "%u", chunks[count - 1]);
+    for (int i = count - 2; i >= 0; i--) {
+        end += sprintf(end, "%09u", chunks[i]);
+    }
+    free(work);
+    free(chunks);
+    return text;
+}
@@ -0,0 +1,75 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef BIGNUM_H
+#define BIGNUM_H
+
+/*
+ * Exact integers of any size.
+ *
+ * Integers that fit in 64 bits are INT_TYPE values; anything bigger is a
+ * BIGNUM_TYPE value holding a sign and a magnitude in base 2^32, least
+ * significant digit first, in a talloc'ed array.  Every function here
+ * returns the smallest representation, so a bignum is never equal to an
+ * INT_TYPE value and callers only need the fast 64-bit path until an
+ * operation overflows.
+ *
+ * Multiplication switches from the schoolbook method to Karatsuba's once
+ * both operands are a few dozen digits long.  Division is Knuth's
+ * Algorithm D.
+ */
+
+/*
+ * Create an INT_TYPE value.
+ */
+struct Value *makeInteger(int64_t n);
+
+/*
+ * Returns whether a value is an exact integer (INT_TYPE or BIGNUM_TYPE).
+ */
+bool isInteger(struct Value *value);
+
+/*
+ * Parses an optionally signed string of decimal digits.
+ */
+struct Value *parseInteger(char *text);
+
+/*
+ * Returns the decimal form of an integer in a malloc'ed string.
+ */
+char *integerToString(struct Value *integer);
+
+/*
+ * Returns the nearest double to an integer.
+ */
+double integerToDouble(struct Value *integer);
+
+/*
+ * Arithmetic on integers, returning new values.
+ */
+struct Value *integerAdd(struct Value *a, struct Value *b);
+struct Value *integerSubtract(struct Value *a, struct Value *b);
+struct Value *integerMultiply(struct Value *a, struct Value *b);
+struct Value *integerNegate(struct Value *a);
+
+/*
+ * Divides a by b (which must not be zero), truncating towards zero.  Stores
+ * the quotient and the remainder (which has the sign of a) in *quotient and
+ * *remainder, either of which may be NULL.
+ */
+void integerDivide(struct Value *a, struct Value *b, struct Value **quotient, struct Value **remainder);
+
+/*
+ * Returns a negative number, zero or a positive number as a is less than,
+ * equal to or greater than b.
+ */
+int integerCompare(struct Value *a, struct Value *b);
+
+/*
+ * Returns whether an integer is zero, or negative.
+ */
+bool integerIsZero(struct Value *integer);
+bool integerIsNegative(struct Value *integer);
+
+#endif
@@ -0,0 +1,239 @@
+#include "census.h"
+#include "linkedlist.h"
+#include "ptrmap.h"
+#include "talloc.h"
+#include <stdlib.h>
+#include <string.h>
+
+static char *typeNames[] = {
+    "pointer", "integer", "double", "string", "pair", "null", "open", "close",
+    "boolean", "symbol", "closure", "primitive", "void", "quote", "vector",
+    "hash-table", "bignum", "f64vector", "s64vector", "string-builder",
+};
+
+#define TYPE_COUNT ((int) (sizeof(typeNames) / sizeof(typeNames[0])))
+#define FRAME_LABEL TYPE_COUNT
+#define STRING_LABEL (TYPE_COUNT + 1)
+#define VECTOR_LABEL (TYPE_COUNT + 2)
+#define HASH_LABEL (TYPE_COUNT + 3)
+#define BIGNUM_LABEL (TYPE_COUNT + 4)
+#define RAW_LABEL (TYPE_COUNT + 5)
+#define LABEL_COUNT (TYPE_COUNT + 6)
+
+static Census *snapshot = NULL;
+
+/*
+ * A census being counted: for each label, a map from site to the position
+ * (plus one) of its entry.
+ */
+typedef struct Counting {
+    Census *census;
+    int capacity;
+    PtrMap *bySite[LABEL_COUNT];
+} Counting;
+
+static int labelOf(void *pointer, allocationKind kind) {
+    if (kind == VALUE_ALLOCATION || kind == CONS_ALLOCATION) {
+        valueType type = ((Value *) pointer)->type;
+        return type >= 0 && (int) type < TYPE_COUNT ? (int) type : RAW_LABEL;
+    } else if (kind == FRAME_ALLOCATION) {
+        return FRAME_LABEL;
+    } else if (kind == STRING_ALLOCATION) {
+        return STRING_LABEL;
+    } else if (kind == VECTOR_ALLOCATION) {
+        return VECTOR_LABEL;
+    } else if (kind == HASH_ALLOCATION) {
+        return HASH_LABEL;
+    } else if (kind == BIGNUM_ALLOCATION) {
+        return BIGNUM_LABEL;
+    }
+    return RAW_LABEL;
+}
+
+static char *labelName(int label) {
+    if (label < TYPE_COUNT) {
+        return typeNames[label];
+    }
+    switch (label) {
+        case FRAME_LABEL: return "frame";
+        case STRING_LABEL: return "string-data";
+        case VECTOR_LABEL: return "vector-data";
+        case HASH_LABEL: return "hash-data";
+        case BIGNUM_LABEL: return "bignum-data";
+    }
+    return "raw";
+}
+
+static void count(void *pointer, size_t size, allocationKind kind, char *site, void *context) {
+    Counting *counting = context;
+    Census *census = counting->census;
+    int label = labelOf(pointer, kind);
+    void *position;
+    if (!ptrMapGet(counting->bySite[label], site, &position)) {
+        if (census->count == counting->capacity) {
+            counting->capacity = counting->capacity * 2 + 16;
+            census->entries = realloc(census->entries, counting->capacity * sizeof(CensusEntry));
+            if (census->entries == NULL) {
+                fprintf(stderr, "Out of memory!\n");
+                exit(1);
+            }
+        }
+        census->entries[census->count] = (CensusEntry) {labelName(label), site, 0, 0};
+        position = (void *) (intptr_t) ++census->count;
+        ptrMapPut(counting->bySite[label], site, position);
+    }
+    CensusEntry *entry = &census->entries[(intptr_t) position - 1];
+    entry->objects++;
+    entry->bytes += size;
+}
+
+static int64_t magnitude(int64_t n) {
+    return n < 0 ? -n : n;
+}
+
+static int compareEntries(const void *a, const void *b) {
+    const CensusEntry *x = a;
+    const CensusEntry *y = b;
+    if (magnitude(x->bytes) != magnitude(y->bytes)) {
+        return magnitude(x->bytes) < magnitude(y->bytes) ? 1 : -1;
+    }
+    int order = strcmp(x->type, y->type);
+    return order != 0 ? order : strcmp(x->site, y->site);
+}
+
+Census *takeCensus() {
+    Counting counting = {0};
+    counting.census = calloc(1, sizeof(Census));
+    if (counting.census == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(1);
+    }
+    for (int label = 0; label < LABEL_COUNT; label++) {
+        counting.bySite[label] = newPtrMap();
+    }
+    forEachAllocation(count, &counting);
+    for (int label = 0; label < LABEL_COUNT; label++) {
+        freePtrMap(counting.bySite[label]);
+    }
+    qsort(counting.census->entries, counting.census->count, sizeof(CensusEntry), compareEntries);
+    return counting.census;
+}
+
+void freeCensus(Census *census) {
+    if (census != NULL) {
+        free(census->entries);
+        free(census);
+    }
+}
+
+static Value *makeCount(int64_t n) {
+    Value *value = makeNull();
+    value->type = INT_TYPE;
+    value->i = n;
+    return value;
+}
+
+static Value *makeText(char *text, valueType type) {
+    if (type == STR_TYPE) {
+        return makeString(text, strlen(text));
+    }
+    Value *value = makeNull();
+    value->type = type;
+    value->s = tallocKind(strlen(text) + 1, STRING_ALLOCATION);
+    strcpy(value->s, text);
+    return value;
+}
+
+Value *censusList(Census *census) {
+    Value *list = makeNull();
+    for (int i = census->count - 1; i >= 0; i--) {
+        CensusEntry *entry = &census->entries[i];
+        Value *row = cons(makeCount(entry->bytes), makeNull());
+        row = cons(makeCount(entry->objects), row);
+        row = cons(makeText(entry->site, STR_TYPE), row);
+        row = cons(makeText(entry->type, SYMBOL_TYPE), row);
+        list = cons(row, list);
+    }
+    return list;
+}
+
+void takeHeapSnapshot() {
+    freeCensus(snapshot);
+    snapshot = takeCensus();
+}
+
+static CensusEntry *findEntry(Census *census, CensusEntry *like) {
+    for (int i = 0; i < census->count; i++) {
+        CensusEntry *entry = &census->entries[i];
+        if (entry->type == like->type && entry->site == like->site) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+Value *heapDiffList() {
+    if (snapshot == NULL) {
+        return NULL;
+    }
+    Census *now = takeCensus();
+    Census diff = {0};
+    diff.entries = malloc((now->count + snapshot->count + 1) * sizeof(CensusEntry));
+    if (diff.entries == NULL) {
+        fprintf(stderr, "Out of memory!\n");
+        exit(1);
+    }
+    for (int i = 0; i < now->count; i++) {
+        CensusEntry change = now->entries[i];
+        CensusEntry *before = findEntry(snapshot, &change);
+        if (before != NULL) {
+            change.objects -= before->objects;
+            change.bytes -= before->bytes;
+        }
+        if (change.objects != 0 || change.bytes != 0) {
+            diff.entries[diff.count++] = change;
+        }
+    }
+    for (int i = 0; i < snapshot->count; i++) {
+        CensusEntry gone = snapshot->entries[i];
+        if (findEntry(now, &gone) == NULL) {
+            gone.objects = -gone.objects;
+            gone.bytes = -gone.bytes;
+            diff.entries[diff.count++] = gone;
+        }
+    }
+    qsort(diff.entries, diff.count, sizeof(CensusEntry), compareEntries);
+    freeCensus(now);
+    Value *list = censusList(&diff);
+    free(diff.entries);
+    return list;
+}
+
+void writeCensus(FILE *out, Census *census) {
+    int64_t objects = 0;
+    int64_t bytes = 0;
+    fprintf(out, "%10s %12s  %-12s %s\n", "objects", "bytes", "type", "site");
+    for (int i = 0; i < census->count; i++) {
+        CensusEntry *entry = &census->entries[i];
+        fprintf(out, "%10lld %12lld  %-12s %s\n", (long long) entry->objects,
+                (long long) entry->bytes, entry->type, entry->site);
+        objects += entry->objects;
+        bytes += entry->bytes;
+    }
+    fprintf(out, "%10lld %12lld  total\n", (long long) objects, (long long) bytes);
+}
+
+void writeCensusReport() {
+    char *path = getenv("SCHEME_CENSUS");
+    if (path == NULL) {
+        return;
+    }
+    FILE *report = fopen(path, "w");
+    if (report == NULL) {
+        return;
+    }
+    Census *census = takeCensus();
+    writeCensus(report, census);
+    freeCensus(census);
+    fclose(report);
+}
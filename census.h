@@ -0,0 +1,79 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef CENSUS_H
+#define CENSUS_H
+
+/*
+ * A heap census: every live talloc'ed object, grouped by what it is and
+ * where it was allocated.
+ *
+ * What it is comes from the allocation kind (see gcstats.h) and, for values
+ * and pairs, the type of the Value itself: "integer", "pair", "closure" and
+ * so on, or "frame", "string-data" (the characters of strings and symbols),
+ * "vector-data" (the element arrays of vectors, f64vectors and s64vectors),
+ * "hash-data" (hash tables and their slot arrays), "bignum-data" (the digits
+ * of bignums) and "raw".
+ * Where it was allocated is the allocation site talloc recorded (see
+ * talloc.h): the primitive or special form being evaluated at the time, or
+ * "tokenize", "parse" and the like outside eval().
+ *
+ * The census counts whatever has not been collected yet, so garbage from the
+ * current top-level form shows up until the next collection.
+ */
+typedef struct CensusEntry {
+    char *type;
+    char *site;
+    int64_t objects;
+    int64_t bytes;
+} CensusEntry;
+
+typedef struct Census {
+    CensusEntry *entries;
+    int count;
+} Census;
+
+/*
+ * Counts the live heap, largest groups (by bytes) first.  The census is
+ * malloc'ed, so taking it does not change what it counts.
+ */
+Census *takeCensus();
+
+/*
+ * Frees a census.
+ */
+void freeCensus(Census *census);
+
+/*
+ * Returns a census as a list of (type site objects bytes) lists, with the
+ * type a symbol and the site a string.
+ */
+Value *censusList(Census *census);
+
+/*
+ * Remembers a census of the heap as it is now, for heapDiffList().
+ */
+void takeHeapSnapshot();
+
+/*
+ * Returns how the heap has changed since the last takeHeapSnapshot(), in the
+ * form of censusList() but with the change in objects and bytes, for the
+ * groups that changed, biggest change first.  Returns NULL if no snapshot
+ * has been taken.
+ */
+Value *heapDiffList();
+
+/*
+ * Writes a census as a text table.
+ */
+void writeCensus(FILE *out, Census *census);
+
+/*
+ * Writes a census of the heap to the file named by SCHEME_CENSUS, if it is
+ * set.  Meant to run as a teardown hook (see talloc.h), so it sees the heap
+ * as the program left it.
+ */
+void writeCensusReport();
+
+#endif
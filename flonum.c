@@ -0,0 +1,407 @@
+#include "flonum.h"
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MANTISSA_BITS 52
+#define EXPONENT_BIAS 1023
+// Ryu keeps 5^i, and 2^k / 5^i, to this many significant bits.
+#define POW5_BITCOUNT 125
+#define POW5_INV_BITCOUNT 125
+// Entries needed to cover every double exponent.
+#define POW5_COUNT 326
+#define POW5_INV_COUNT 342
+// The exact arithmetic that fills the tables works in 32-bit limbs, on
+// numbers up to 2^TABLE_SCALE, which is above 2^k for every k needed.
+#define TABLE_LIMBS 33
+#define TABLE_SCALE 1024
+// Integers up to here are exact as doubles.
+#define MAX_EXACT_INTEGER (UINT64_C(1) << 53)
+
+/*
+ * 5^i and 2^k / 5^i (rounded up), scaled to POW5_BITCOUNT and
+ * POW5_INV_BITCOUNT bits, low word first.  Filled in the first time a
+ * double needs them.
+ */
+static uint64_t pow5Split[POW5_COUNT][2];
+static uint64_t pow5InvSplit[POW5_INV_COUNT][2];
+static bool tablesFilled = false;
+
+static const double powersOfTen[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+    1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22,
+};
+
+/*
+ * A double as output * 10^exponent.
+ */
+typedef struct Decimal {
+    uint64_t output;
+    int exponent;
+} Decimal;
+
+/*
+ * The number of bits in 5^e, and floor(log10(2^e)) and floor(log10(5^e)),
+ * for the exponents a double can need.
+ */
+static int pow5Bits(int e) {
+    return (int) (((uint32_t) e * 1217359) >> 19) + 1;
+}
+
+static int log10Pow2(int e) {
+    return (int) (((uint32_t) e * 78913) >> 18);
+}
+
+static int log10Pow5(int e) {
+    return (int) (((uint32_t) e * 732923) >> 20);
+}
+
+/*
+ * Copies the 128 bits of a number in little-endian 32-bit limbs that start
+ * at bit shift (which may be negative, to shift left) into words.
+ */
+static void takeBits(uint32_t *limbs, int shift, uint64_t words[2]) {
+    words[0] = 0;
+    words[1] = 0;
+    for (int bit = 0; bit < 128; bit++) {
+        int source = shift + bit;
+        if (source >= 0 && source < TABLE_LIMBS * 32 && (limbs[source / 32] >> (source % 32) & 1)) {
+            words[bit / 64] |= UINT64_C(1) << (bit % 64);
+        }
+    }
+}
+
+/*
+ * Computes the tables exactly: 5^i by repeated multiplication, and 2^k / 5^i
+ * from 2^TABLE_SCALE by repeated division, since dividing the floor again
+ * loses nothing.
+ */
+static void fillTables() {
+    uint32_t power[TABLE_LIMBS] = {1};
+    uint32_t inverse[TABLE_LIMBS] = {0};
+    inverse[TABLE_SCALE / 32] = 1;
+    for (int i = 0; i < POW5_INV_COUNT; i++) {
+        int length = pow5Bits(i);
+        if (i < POW5_COUNT) {
+            takeBits(power, length - POW5_BITCOUNT, pow5Split[i]);
+        }
+        takeBits(inverse, TABLE_SCALE - (length - 1 + POW5_INV_BITCOUNT), pow5InvSplit[i]);
+        if (++pow5InvSplit[i][0] == 0) {
+            pow5InvSplit[i][1]++;
+        }
+        uint64_t carry = 0;
+        for (int j = 0; j < TABLE_LIMBS; j++) {
+            uint64_t product = (uint64_t) power[j] * 5 + carry;
+            power[j] = (uint32_t) product;
+            carry = product >> 32;
+        }
+        uint64_t remainder = 0;
+        for (int j = TABLE_LIMBS - 1; j >= 0; j--) {
+            uint64_t dividend = remainder << 32 | inverse[j];
+            inverse[j] = (uint32_t) (dividend / 5);
+            remainder = dividend % 5;
+        }
+    }
+    tablesFilled = true;
+}
+
+/*
+ * (m * mul) >> j, for a 128-bit mul and j of at least 64.
+ */
+static uint64_t mulShift64(uint64_t m, uint64_t *mul, int j) {
+    unsigned __int128 low = (unsigned __int128) m * mul[0];
+    unsigned __int128 high = (unsigned __int128) m * mul[1];
+    return (uint64_t) (((low >> 64) + high) >> (j - 64));
+}
+
+static int pow5Factor(uint64_t value) {
+    int count = 0;
+    while (value % 5 == 0) {
+        value /= 5;
+        count++;
+    }
+    return count;
+}
+
+static int decimalLength(uint64_t value) {
+    int length = 1;
+    while (value >= 10) {
+        value /= 10;
+        length++;
+    }
+    return length;
+}
+
+/*
+ * Handles doubles that are integers below 2^53, which need no tables: the
+ * integer with its trailing zeros moved into the exponent.
+ */
+static bool smallInteger(uint64_t ieeeMantissa, int ieeeExponent, Decimal *decimal) {
+    uint64_t m2 = (UINT64_C(1) << MANTISSA_BITS) | ieeeMantissa;
+    int e2 = ieeeExponent - EXPONENT_BIAS - MANTISSA_BITS;
+    if (ieeeExponent == 0 || e2 > 0 || e2 < -MANTISSA_BITS) {
+        return false;
+    }
+    if ((m2 & ((UINT64_C(1) << -e2) - 1)) != 0) {
+        return false;
+    }
+    decimal->output = m2 >> -e2;
+    decimal->exponent = 0;
+    while (decimal->output % 10 == 0) {
+        decimal->output /= 10;
+        decimal->exponent++;
+    }
+    return true;
+}
+
+/*
+ * Ryu: finds the shortest decimal in the interval of reals that round to a
+ * finite, non-zero double.  vr is the double scaled by a power of ten, and
+ * vp and vm are the interval's ends scaled the same way; digits are dropped
+ * from all three until they would no longer be distinct.
+ */
+static Decimal shortestDecimal(uint64_t ieeeMantissa, int ieeeExponent) {
+    int e2;
+    uint64_t m2;
+    if (ieeeExponent == 0) {
+        e2 = 1 - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = ieeeMantissa;
+    } else {
+        e2 = ieeeExponent - EXPONENT_BIAS - MANTISSA_BITS - 2;
+        m2 = (UINT64_C(1) << MANTISSA_BITS) | ieeeMantissa;
+    }
+    // Round to even: the interval includes its ends when the mantissa is.
+    bool acceptBounds = (m2 & 1) == 0;
+    uint64_t mv = 4 * m2;
+    // The gap below is half as wide at a power of two.
+    int mmShift = ieeeMantissa != 0 || ieeeExponent <= 1;
+    uint64_t vr, vp, vm;
+    int e10;
+    bool vmIsTrailingZeros = false;
+    bool vrIsTrailingZeros = false;
+    if (e2 >= 0) {
+        int q = log10Pow2(e2) - (e2 > 3);
+        e10 = q;
+        int k = POW5_INV_BITCOUNT + pow5Bits(q) - 1;
+        int i = -e2 + q + k;
+        vr = mulShift64(mv, pow5InvSplit[q], i);
+        vp = mulShift64(mv + 2, pow5InvSplit[q], i);
+        vm = mulShift64(mv - 1 - mmShift, pow5InvSplit[q], i);
+        if (q <= 21) {
+            // Only one of mv, mv + 2 and mv - 1 - mmShift can be a
+            // multiple of 5.
+            if (mv % 5 == 0) {
+                vrIsTrailingZeros = pow5Factor(mv) >= q;
+            } else if (acceptBounds) {
+                vmIsTrailingZeros = pow5Factor(mv - 1 - mmShift) >= q;
+            } else {
+                vp -= pow5Factor(mv + 2) >= q;
+            }
+        }
+    } else {
+        int q = log10Pow5(-e2) - (-e2 > 1);
+        e10 = q + e2;
+        int i = -e2 - q;
+        int k = pow5Bits(i) - POW5_BITCOUNT;
+        int j = q - k;
+        vr = mulShift64(mv, pow5Split[i], j);
+        vp = mulShift64(mv + 2, pow5Split[i], j);
+        vm = mulShift64(mv - 1 - mmShift, pow5Split[i], j);
+        if (q <= 1) {
+            // mv has at least q trailing zero bits, having two.
+            vrIsTrailingZeros = true;
+            if (acceptBounds) {
+                vmIsTrailingZeros = mmShift == 1;
+            } else {
+                vp--;
+            }
+        } else if (q < 63) {
+            vrIsTrailingZeros = (mv & ((UINT64_C(1) << q) - 1)) == 0;
+        }
+    }
+    int removed = 0;
+    int lastRemovedDigit = 0;
+    uint64_t output;
+    if (vmIsTrailingZeros || vrIsTrailingZeros) {
+        // The rare case where the ends or the value itself may be exact.
+        while (vp / 10 > vm / 10) {
+            vmIsTrailingZeros &= vm % 10 == 0;
+            vrIsTrailingZeros &= lastRemovedDigit == 0;
+            lastRemovedDigit = vr % 10;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        if (vmIsTrailingZeros) {
+            while (vm % 10 == 0) {
+                vrIsTrailingZeros &= lastRemovedDigit == 0;
+                lastRemovedDigit = vr % 10;
+                vr /= 10;
+                vp /= 10;
+                vm /= 10;
+                removed++;
+            }
+        }
+        if (vrIsTrailingZeros && lastRemovedDigit == 5 && vr % 2 == 0) {
+            // Exactly halfway: round to even.
+            lastRemovedDigit = 4;
+        }
+        output = vr + ((vr == vm && (!acceptBounds || !vmIsTrailingZeros)) || lastRemovedDigit >= 5);
+    } else {
+        bool roundUp = false;
+        while (vp / 10 > vm / 10) {
+            roundUp = vr % 10 >= 5;
+            vr /= 10;
+            vp /= 10;
+            vm /= 10;
+            removed++;
+        }
+        output = vr + (vr == vm || roundUp);
+    }
+    return (Decimal) {output, e10 + removed};
+}
+
+int formatDouble(double d, char *text) {
+    uint64_t bits;
+    memcpy(&bits, &d, sizeof(bits));
+    bool negative = bits >> 63;
+    uint64_t ieeeMantissa = bits & ((UINT64_C(1) << MANTISSA_BITS) - 1);
+    int ieeeExponent = (int) (bits >> MANTISSA_BITS) & 0x7ff;
+    if (ieeeExponent == 0x7ff) {
+        strcpy(text, ieeeMantissa != 0 ? "+nan.0" : negative ? "-inf.0" : "+inf.0");
+        return strlen(text);
+    }
+    char *end = text;
+    if (negative) {
+        *end++ = '-';
+    }
+    if (ieeeExponent == 0 && ieeeMantissa == 0) {
+        strcpy(end, "0.0");
+        return end + 3 - text;
+    }
+    Decimal decimal;
+    if (!smallInteger(ieeeMantissa, ieeeExponent, &decimal)) {
+        if (!tablesFilled) {
+            fillTables();
+        }
+        decimal = shortestDecimal(ieeeMantissa, ieeeExponent);
+    }
+    char digits[20];
+    int length = decimalLength(decimal.output);
+    for (int i = length - 1; i >= 0; i--) {
+        digits[i] = '0' + decimal.output % 10;
+        decimal.output /= 10;
+    }
+    // How many of the digits come before the point.
+    int point = length + decimal.exponent;
+    if (point > -6 && point <= 21) {
+        if (point <= 0) {
+            *end++ = '0';
+            *end++ = '.';
+            memset(end, '0', -point);
+            end += -point;
+            memcpy(end, digits, length);
+            end += length;
+        } else if (point < length) {
+            memcpy(end, digits, point);
+            end += point;
+            *end++ = '.';
+            memcpy(end, digits + point, length - point);
+            end += length - point;
+        } else {
+            memcpy(end, digits, length);
+            end += length;
+            memset(end, '0', point - length);
+            end += point - length;
+            *end++ = '.';
+            *end++ = '0';
+        }
+    } else {
+        *end++ = digits[0];
+        if (length > 1) {
+            *end++ = '.';
+            memcpy(end, digits + 1, length - 1);
+            end += length - 1;
+        }
+        *end++ = 'e';
+        int exponent = point - 1;
+        if (exponent < 0) {
+            *end++ = '-';
+            exponent = -exponent;
+        }
+        char exponentDigits[4];
+        int exponentLength = 0;
+        do {
+            exponentDigits[exponentLength++] = '0' + exponent % 10;
+            exponent /= 10;
+        } while (exponent != 0);
+        while (exponentLength > 0) {
+            *end++ = exponentDigits[--exponentLength];
+        }
+    }
+    *end = '\0';
+    return end - text;
+}
+
+double parseDouble(char *text) {
+    char *p = text;
+    bool negative = *p == '-';
+    if (*p == '+' || *p == '-') {
+        p++;
+    }
+    uint64_t mantissa = 0;
+    int digits = 0;
+    int exponent = 0;
+    bool afterPoint = false;
+    for (; (*p >= '0' && *p <= '9') || *p == '.'; p++) {
+        if (*p == '.') {
+            afterPoint = true;
+            continue;
+        }
+        if (digits == 19) {
+            // Too many digits for the mantissa to be exact.
+            return strtod(text, NULL);
+        }
+        // Leading zeros are not significant.
+        if (mantissa != 0 || *p != '0') {
+            mantissa = mantissa * 10 + (*p - '0');
+            digits++;
+        }
+        if (afterPoint) {
+            exponent--;
+        }
+    }
+    if (*p == 'e' || *p == 'E') {
+        p++;
+        bool negativeExponent = *p == '-';
+        if (*p == '+' || *p == '-') {
+            p++;
+        }
+        int value = 0;
+        for (; *p >= '0' && *p <= '9'; p++) {
+            // Anything this big is zero or infinity regardless.
+            if (value < 100000) {
+                value = value * 10 + (*p - '0');
+            }
+        }
+        exponent += negativeExponent ? -value : value;
+    }
+    if (mantissa == 0) {
+        return negative ? -0.0 : 0.0;
+    }
+    // Move powers of ten past 10^22 into the mantissa while it stays exact.
+    while (exponent > 22 && mantissa <= MAX_EXACT_INTEGER / 10) {
+        mantissa *= 10;
+        exponent--;
+    }
+    if (mantissa <= MAX_EXACT_INTEGER && exponent >= -22 && exponent <= 22) {
+        // Both operands are exact, so IEEE rounding of the one operation
+        // gives the correctly rounded result.
+        double result = (double) mantissa;
+        result = exponent < 0 ? result / powersOfTen[-exponent] : result * powersOfTen[exponent];
+        return negative ? -result : result;
+    }
+    return strtod(text, NULL);
+}
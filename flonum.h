@@ -0,0 +1,37 @@
+#ifndef FLONUM_H
+#define FLONUM_H
+
+/*
+ * Conversion of doubles to and from decimal text.
+ *
+ * Doubles print as the shortest decimal that reads back as the same double
+ * (choosing the one nearest the exact value when there are several), found
+ * with Ulf Adams' Ryu algorithm rather than by trying precisions with
+ * printf.  Numbers from 1e-6 up to 1e21 are written out in full, with at
+ * least one digit after the point ("100.0", "0.001"); the rest use an
+ * exponent ("1e21", "2.5e-7").  Infinities and NaN print as +inf.0, -inf.0
+ * and +nan.0.
+ *
+ * Parsing is exact: decimals with at most 19 significant digits and a small
+ * enough exponent are converted with a single correctly rounded
+ * multiplication or division (Clinger's fast path), and anything else goes
+ * to strtod().
+ */
+
+// Room for any formatted double and its terminating NUL.
+#define FLONUM_LENGTH 32
+
+/*
+ * Writes the shortest round-trip form of d into text, which must hold
+ * FLONUM_LENGTH characters, and returns its length.
+ */
+int formatDouble(double d, char *text);
+
+/*
+ * Parses a NUL-terminated decimal: an optional sign, digits with an
+ * optional point, and an optional exponent (e or E, an optional sign and
+ * digits).  The text must have that form.
+ */
+double parseDouble(char *text);
+
+#endif
@@ -0,0 +1,178 @@
+#include "gcstats.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <time.h>
+
+// Collections remembered for the heap-over-time history.
+#define HISTORY_LENGTH 1024
+
+GcStats gcStats;
+
+static Collection history[HISTORY_LENGTH];
+static double startMs = -1;
+
+static char *kindNames[ALLOCATION_KINDS] = {"raw", "value", "cons", "frame", "string", "vector", "hash", "bignum"};
+
+double gcClockMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    double ms = now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+    if (startMs < 0) {
+        startMs = ms;
+    }
+    return ms - startMs;
+}
+
+void resetGcStats() {
+    memset(&gcStats, 0, sizeof(gcStats));
+}
+
+void noteAllocation(allocationKind kind, size_t size) {
+    gcStats.allocations[kind]++;
+    gcStats.allocatedBytes[kind] += size;
+    gcStats.heapObjects++;
+    gcStats.heapBytes += size;
+    if (gcStats.heapBytes > gcStats.peakHeapBytes) {
+        gcStats.peakHeapBytes = gcStats.heapBytes;
+    }
+}
+
+void noteFree(size_t size) {
+    gcStats.heapObjects--;
+    gcStats.heapBytes -= size;
+}
+
+void noteCollection(Collection *collection) {
+    history[gcStats.collections % HISTORY_LENGTH] = *collection;
+    gcStats.collections++;
+    gcStats.freedObjects += collection->freedObjects;
+    gcStats.freedBytes += collection->freedBytes;
+    gcStats.totalPauseMs += collection->pauseMs;
+    if (collection->pauseMs > gcStats.maxPauseMs) {
+        gcStats.maxPauseMs = collection->pauseMs;
+    }
+    gcStats.last = *collection;
+}
+
+static uint64_t totalAllocations() {
+    uint64_t total = 0;
+    for (int kind = 0; kind < ALLOCATION_KINDS; kind++) {
+        total += gcStats.allocations[kind];
+    }
+    return total;
+}
+
+static uint64_t totalAllocatedBytes() {
+    uint64_t total = 0;
+    for (int kind = 0; kind < ALLOCATION_KINDS; kind++) {
+        total += gcStats.allocatedBytes[kind];
+    }
+    return total;
+}
+
+/*
+ * Conses (name . number) onto an association list.  Counts too big for an
+ * integer become doubles.
+ */
+static Value *addStat(Value *list, char *name, double number) {
+    Value *symbol = makeNull();
+    symbol->type = SYMBOL_TYPE;
+    symbol->s = tallocKind(strlen(name) + 1, STRING_ALLOCATION);
+    strcpy(symbol->s, name);
+    Value *value = makeNull();
+    if (number == (int) number && number <= INT_MAX) {
+        value->type = INT_TYPE;
+        value->i = (int) number;
+    } else {
+        value->type = DOUBLE_TYPE;
+        value->d = number;
+    }
+    return cons(cons(symbol, value), list);
+}
+
+Value *gcStatsList() {
+    // Read everything first, since building the list allocates.
+    GcStats stats = gcStats;
+    uint64_t allocations = totalAllocations();
+    uint64_t allocatedBytes = totalAllocatedBytes();
+    Value *list = makeNull();
+    list = addStat(list, "last-retained-bytes", stats.last.retainedBytes);
+    list = addStat(list, "last-retained-objects", stats.last.retainedObjects);
+    list = addStat(list, "last-freed-bytes", stats.last.freedBytes);
+    list = addStat(list, "last-freed-objects", stats.last.freedObjects);
+    list = addStat(list, "last-scanned-bytes", stats.last.scannedBytes);
+    list = addStat(list, "last-scanned-objects", stats.last.scannedObjects);
+    list = addStat(list, "last-marked", stats.last.marked);
+    list = addStat(list, "last-pause-ms", stats.last.pauseMs);
+    list = addStat(list, "max-pause-ms", stats.maxPauseMs);
+    list = addStat(list, "total-pause-ms", stats.totalPauseMs);
+    list = addStat(list, "freed-bytes", stats.freedBytes);
+    list = addStat(list, "freed-objects", stats.freedObjects);
+    list = addStat(list, "collections", stats.collections);
+    list = addStat(list, "peak-heap-bytes", stats.peakHeapBytes);
+    list = addStat(list, "heap-bytes", stats.heapBytes);
+    list = addStat(list, "heap-objects", stats.heapObjects);
+    for (int kind = ALLOCATION_KINDS - 1; kind >= 0; kind--) {
+        char name[32];
+        sprintf(name, "%s-bytes", kindNames[kind]);
+        list = addStat(list, name, stats.allocatedBytes[kind]);
+        sprintf(name, "%s-allocations", kindNames[kind]);
+        list = addStat(list, name, stats.allocations[kind]);
+    }
+    list = addStat(list, "allocated-bytes", allocatedBytes);
+    list = addStat(list, "allocations", allocations);
+    return list;
+}
+
+static void writeCollection(FILE *out, Collection *collection) {
+    fprintf(out, "{\"start_ms\": %.3f, \"pause_ms\": %.3f, \"marked\": %llu, "
+            "\"scanned_objects\": %llu, \"scanned_bytes\": %llu, "
+            "\"freed_objects\": %llu, \"freed_bytes\": %llu, "
+            "\"retained_objects\": %llu, \"retained_bytes\": %llu, \"heap_bytes_after\": %llu}",
+            collection->startMs, collection->pauseMs, (unsigned long long) collection->marked,
+            (unsigned long long) collection->scannedObjects, (unsigned long long) collection->scannedBytes,
+            (unsigned long long) collection->freedObjects, (unsigned long long) collection->freedBytes,
+            (unsigned long long) collection->retainedObjects, (unsigned long long) collection->retainedBytes,
+            (unsigned long long) collection->heapBytesAfter);
+}
+
+void writeGcStats(FILE *out) {
+    // The first two keys stay first; bench/bench.c reads them with fscanf.
+    fprintf(out, "{\"allocations\": %llu, \"allocated_bytes\": %llu,\n",
+            (unsigned long long) totalAllocations(), (unsigned long long) totalAllocatedBytes());
+    fprintf(out, " \"by_kind\": {");
+    for (int kind = 0; kind < ALLOCATION_KINDS; kind++) {
+        fprintf(out, "%s\"%s\": {\"allocations\": %llu, \"bytes\": %llu}", kind > 0 ? ", " : "",
+                kindNames[kind], (unsigned long long) gcStats.allocations[kind],
+                (unsigned long long) gcStats.allocatedBytes[kind]);
+    }
+    fprintf(out, "},\n \"heap\": {\"objects\": %llu, \"bytes\": %llu, \"peak_bytes\": %llu},\n",
+            (unsigned long long) gcStats.heapObjects, (unsigned long long) gcStats.heapBytes,
+            (unsigned long long) gcStats.peakHeapBytes);
+    fprintf(out, " \"gc\": {\"collections\": %llu, \"freed_objects\": %llu, \"freed_bytes\": %llu, "
+            "\"total_pause_ms\": %.3f, \"max_pause_ms\": %.3f,\n  \"history\": [",
+            (unsigned long long) gcStats.collections, (unsigned long long) gcStats.freedObjects,
+            (unsigned long long) gcStats.freedBytes, gcStats.totalPauseMs, gcStats.maxPauseMs);
+    uint64_t first = gcStats.collections > HISTORY_LENGTH ? gcStats.collections - HISTORY_LENGTH : 0;
+    for (uint64_t i = first; i < gcStats.collections; i++) {
+        fprintf(out, "%s\n   ", i > first ? "," : "");
+        writeCollection(out, &history[i % HISTORY_LENGTH]);
+    }
+    fprintf(out, "]}}\n");
+}
+
+void writeStatsReport() {
+    char *path = getenv("SCHEME_STATS");
+    if (path == NULL) {
+        return;
+    }
+    FILE *report = fopen(path, "w");
+    if (report == NULL) {
+        return;
+    }
+    writeGcStats(report);
+    fclose(report);
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef GCSTATS_H
+#define GCSTATS_H
+
+/*
+ * What an allocation is for, so allocation counts can be broken down.
+ */
+typedef enum {
+   RAW_ALLOCATION,
+   VALUE_ALLOCATION,
+   CONS_ALLOCATION,
+   FRAME_ALLOCATION,
+   STRING_ALLOCATION,
+   VECTOR_ALLOCATION,
+   HASH_ALLOCATION,
+   BIGNUM_ALLOCATION,
+   ALLOCATION_KINDS,
+} allocationKind;
+
+/*
+ * What one garbage collection did.  Scanned counts the allocations the sweep
+ * looked at (everything but the frozen heap), and marked the objects it
+ * found reachable.
+ */
+typedef struct Collection {
+    double startMs;
+    double pauseMs;
+    uint64_t marked;
+    uint64_t scannedObjects;
+    uint64_t scannedBytes;
+    uint64_t freedObjects;
+    uint64_t freedBytes;
+    uint64_t retainedObjects;
+    uint64_t retainedBytes;
+    uint64_t heapBytesAfter;
+} Collection;
+
+/*
+ * Running totals kept by talloc() and sweep().  The heap figures cover every
+ * live talloc'ed object, frozen ones included.
+ */
+typedef struct GcStats {
+    uint64_t allocations[ALLOCATION_KINDS];
+    uint64_t allocatedBytes[ALLOCATION_KINDS];
+    uint64_t heapObjects;
+    uint64_t heapBytes;
+    uint64_t peakHeapBytes;
+    uint64_t collections;
+    uint64_t freedObjects;
+    uint64_t freedBytes;
+    double totalPauseMs;
+    double maxPauseMs;
+    Collection last;
+} GcStats;
+
+extern GcStats gcStats;
+
+/*
+ * Zeroes every count, e.g. after tfree() has emptied the heap.  The
+ * collection history is forgotten too.
+ */
+void resetGcStats();
+
+/*
+ * Counts an allocation of size bytes.
+ */
+void noteAllocation(allocationKind kind, size_t size);
+
+/*
+ * Counts an object of size bytes being freed.
+ */
+void noteFree(size_t size);
+
+/*
+ * Adds a finished collection to the totals and the history.
+ */
+void noteCollection(Collection *collection);
+
+/*
+ * Milliseconds since the first allocation, from a monotonic clock.
+ */
+double gcClockMs();
+
+/*
+ * Returns the statistics as an association list of (name . number) pairs,
+ * for the gc-stats primitive.
+ */
+Value *gcStatsList();
+
+/*
+ * Writes the statistics, including the heap size before and after each of
+ * the most recent collections, as JSON.
+ */
+void writeGcStats(FILE *out);
+
+/*
+ * Writes the statistics as JSON to the file named by the SCHEME_STATS
+ * environment variable, if it is set.  main() registers this with atexit().
+ */
+void writeStatsReport();
+
+#endif
@@ -0,0 +1,510 @@
+/*
+ * Golden-test runner.
+ *
+ * Usage: golden_test [-b budgets] [-w budgets] [-a percent] [-t percent]
+ *
+ * Runs every test.tokenizer.input.*, test.parser.input.* and
+ * test.eval.input.* in the current directory in this one process, resetting
+ * the interpreter between them, and compares what each prints with the
+ * matching test.*.output.* file (ignoring carriage returns and a missing
+ * final newline).  Errors end a case rather than the run, since texit()
+ * jumps back here.
+ *
+ * Each line of a test.server.input.* is one request to a server (see
+ * server.h) forked for the case, and the case prints the responses.  Only
+ * the client side runs in this process, so those cases measure next to no
+ * allocations.
+ *
+ * Each case's allocations, peak heap and time are checked against the
+ * budgets file, one line per case:
+ *
+ *   test.eval.input.01  allocations  peak-heap-bytes  milliseconds  [xfail]
+ *
+ * A case fails if its output differs, or it allocates more than -a percent
+ * (default 10) more objects or peak heap than its budget, or takes more than
+ * -t percent (default 200) longer plus a few milliseconds.  xfail marks a
+ * case whose output is known to be wrong; it is reported but does not fail
+ * the run.  -w writes the measurements of this run as new budgets, keeping
+ * the xfail marks.  Exits with status 1 if anything failed.
+ *
+ * Parse caches (*.scmc, see loader.h) in the current directory are deleted
+ * before each case, so a case that loads a file always starts from a cold
+ * cache whatever earlier runs left behind.  Eval cases that need a scratch
+ * file get its path, private to this run, in the variable temporary-file.
+ */
+#define _GNU_SOURCE
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "talloc.h"
+#include "gcstats.h"
+#include "linkedlist.h"
+#include "server.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <glob.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAX_NAME 64
+#define TIMEOUT_SECONDS 10
+// Slack on time budgets, which are too small to measure reliably otherwise.
+#define TIME_SLACK_MS 5.0
+#define CONNECT_ATTEMPTS 1000
+
+typedef enum {
+    TOKENIZER_TEST,
+    PARSER_TEST,
+    EVAL_TEST,
+    SERVER_TEST,
+} testKind;
+
+typedef struct Budget {
+    char name[MAX_NAME];
+    uint64_t allocations;
+    uint64_t peakHeapBytes;
+    double ms;
+    bool xfail;
+} Budget;
+
+typedef struct Measurement {
+    uint64_t allocations;
+    uint64_t peakHeapBytes;
+    double ms;
+} Measurement;
+
+static int savedStderr = -1;
+
+static void timedOut(int signum) {
+    char message[] = "golden_test: case timed out\n";
+    write(savedStderr, message, sizeof(message) - 1);
+    _exit(1);
+}
+
+static double nowMs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+}
+
+/*
+ * Reads a whole stream into a malloc'ed string, dropping carriage returns
+ * and ending it with a newline unless it is empty.
+ */
+static char *readNormalized(FILE *stream) {
+    size_t capacity = 4096;
+    size_t length = 0;
+    char *text = malloc(capacity);
+    int c;
+    while (text != NULL && (c = fgetc(stream)) != EOF) {
+        if (c == '\r') {
+            continue;
+        }
+        if (length + 2 >= capacity) {
+            capacity *= 2;
+            text = realloc(text, capacity);
+            if (text == NULL) {
+                break;
+            }
+        }
+        text[length++] = c;
+    }
+    if (text == NULL) {
+        fprintf(stderr, "golden_test: out of memory\n");
+        exit(2);
+    }
+    if (length > 0 && text[length - 1] != '\n') {
+        text[length++] = '\n';
+    }
+    text[length] = '\0';
+    return text;
+}
+
+static char *readExpected(char *path) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return NULL;
+    }
+    char *text = readNormalized(file);
+    fclose(file);
+    return text;
+}
+
+/*
+ * Deletes the parse caches left in the current directory by earlier cases
+ * or runs.
+ */
+static void removeCaches() {
+    glob_t caches;
+    if (glob("*.scmc", 0, NULL, &caches) == 0) {
+        for (size_t i = 0; i < caches.gl_pathc; i++) {
+            unlink(caches.gl_pathv[i]);
+        }
+    }
+    globfree(&caches);
+}
+
+/*
+ * Binds temporary-file in the global environment to a path.
+ */
+static void bindTemporaryFile(char *path) {
+    Frame *global = globalEnvironment();
+    Value *symbol = makeNull();
+    symbol->type = SYMBOL_TYPE;
+    symbol->s = "temporary-file";
+    global->bindings = cons(cons(symbol, makeString(path, strlen(path))), global->bindings);
+}
+
+/*
+ * Connects to the server listening at socketPath, waiting for it to start.
+ * Returns -1 if it never does.
+ */
+static int connectToServer(char *socketPath) {
+    struct sockaddr_un address;
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    snprintf(address.sun_path, sizeof(address.sun_path), "%s", socketPath);
+    for (int attempt = 0; attempt < CONNECT_ATTEMPTS; attempt++) {
+        int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (fd == -1) {
+            return -1;
+        }
+        if (connect(fd, (struct sockaddr *) &address, sizeof(address)) == 0) {
+            return fd;
+        }
+        close(fd);
+        usleep(1000);
+    }
+    return -1;
+}
+
+/*
+ * Sends each line of input to the server at socketPath as a request and
+ * prints each response.  Returns false if the server stops answering.
+ */
+static bool sendRequests(FILE *input, char *socketPath) {
+    int fd = connectToServer(socketPath);
+    if (fd == -1) {
+        return false;
+    }
+    char *line = NULL;
+    size_t capacity = 0;
+    ssize_t length;
+    bool ok = true;
+    while (ok && (length = getline(&line, &capacity, input)) != -1) {
+        unsigned char header[4] = {length >> 24, length >> 16, length >> 8, length};
+        ok = write(fd, header, 4) == 4 && write(fd, line, length) == length
+             && recv(fd, header, 4, MSG_WAITALL) == 4;
+        size_t responseLength = ((size_t) header[0] << 24) | (header[1] << 16) | (header[2] << 8) | header[3];
+        // recv() of nothing would wait for the next response.
+        char *response = ok ? malloc(responseLength + 1) : NULL;
+        ok = response != NULL && (responseLength == 0
+             || recv(fd, response, responseLength, MSG_WAITALL) == (ssize_t) responseLength);
+        if (ok) {
+            fwrite(response, 1, responseLength, stdout);
+        }
+        free(response);
+    }
+    free(line);
+    close(fd);
+    return ok;
+}
+
+/*
+ * Runs a server case: forks a server with a fresh global environment as its
+ * prelude, sends it the requests and stops it.
+ */
+static void runServerCase(FILE *input, char *temporaryPath) {
+    char socketPath[64];
+    snprintf(socketPath, sizeof(socketPath), "%s.socket", temporaryPath);
+    globalEnvironment();
+    fflush(stdout);
+    pid_t server = fork();
+    if (server == 0) {
+        _exit(runServer(socketPath));
+    }
+    if (server == -1 || !sendRequests(input, socketPath)) {
+        printf("golden_test: no response from the server\n");
+    }
+    if (server != -1) {
+        kill(server, SIGTERM);
+        waitpid(server, NULL, 0);
+    }
+}
+
+/*
+ * Runs one case with stdout captured and stderr discarded, returning what
+ * it printed.
+ */
+static char *runCase(char *path, testKind kind, char *temporaryPath, Measurement *measurement) {
+    FILE *input = fopen(path, "r");
+    FILE *captured = tmpfile();
+    int devNull = open("/dev/null", O_WRONLY);
+    if (input == NULL || captured == NULL || devNull == -1) {
+        perror(path);
+        exit(2);
+    }
+    resetInterpreter();
+    removeCaches();
+    resetGcStats();
+    if (kind == EVAL_TEST) {
+        bindTemporaryFile(temporaryPath);
+    }
+
+    fflush(stdout);
+    fflush(stderr);
+    int savedStdout = dup(STDOUT_FILENO);
+    dup2(fileno(captured), STDOUT_FILENO);
+    dup2(devNull, STDERR_FILENO);
+    close(devNull);
+
+    jmp_buf recovery;
+    double start = nowMs();
+    alarm(TIMEOUT_SECONDS);
+    setRecoveryPoint(&recovery);
+    if (setjmp(recovery) == 0) {
+        if (kind == SERVER_TEST) {
+            runServerCase(input, temporaryPath);
+        } else {
+            Value *tokens = tokenizeStream(input, path);
+            if (kind == TOKENIZER_TEST) {
+                displayTokens(tokens);
+            } else if (kind == PARSER_TEST) {
+                printTree(parse(tokens));
+                printf("\n");
+            } else {
+                interpret(parse(tokens));
+            }
+        }
+    }
+    setRecoveryPoint(NULL);
+    alarm(0);
+    measurement->ms = nowMs() - start;
+    measurement->allocations = 0;
+    for (int i = 0; i < ALLOCATION_KINDS; i++) {
+        measurement->allocations += gcStats.allocations[i];
+    }
+    measurement->peakHeapBytes = gcStats.peakHeapBytes;
+
+    fflush(stdout);
+    fflush(stderr);
+    dup2(savedStdout, STDOUT_FILENO);
+    dup2(savedStderr, STDERR_FILENO);
+    close(savedStdout);
+    fclose(input);
+    rewind(captured);
+    char *output = readNormalized(captured);
+    fclose(captured);
+    return output;
+}
+
+/*
+ * Prints the first line where the output differs from what was expected.
+ */
+static void showDifference(char *expected, char *actual) {
+    int line = 1;
+    size_t lineStart = 0;
+    size_t i = 0;
+    while (expected[i] != '\0' && expected[i] == actual[i]) {
+        if (expected[i] == '\n') {
+            line++;
+            lineStart = i + 1;
+        }
+        i++;
+    }
+    expected += lineStart;
+    actual += lineStart;
+    int expectedLength = strcspn(expected, "\n");
+    int actualLength = strcspn(actual, "\n");
+    printf("    line %d\n    expected: %.*s\n    actual:   %.*s\n", line,
+           expectedLength, expected, actualLength, actual);
+}
+
+static int readBudgets(char *path, Budget *budgets, int capacity) {
+    FILE *file = fopen(path, "r");
+    if (file == NULL) {
+        return -1;
+    }
+    int count = 0;
+    char line[256];
+    while (count < capacity && fgets(line, sizeof(line), file) != NULL) {
+        Budget *budget = &budgets[count];
+        char mark[16] = "";
+        if (line[0] == '#') {
+            continue;
+        }
+        if (sscanf(line, "%63s %lu %lu %lf %15s", budget->name, &budget->allocations,
+                   &budget->peakHeapBytes, &budget->ms, mark) >= 4) {
+            budget->xfail = !strcmp(mark, "xfail");
+            count++;
+        }
+    }
+    fclose(file);
+    return count;
+}
+
+static Budget *findBudget(Budget *budgets, int count, char *name) {
+    for (int i = 0; i < count; i++) {
+        if (!strcmp(budgets[i].name, name)) {
+            return &budgets[i];
+        }
+    }
+    return NULL;
+}
+
+static bool over(double measured, double budget, double tolerance) {
+    return measured > budget * (1 + tolerance / 100);
+}
+
+static void usage(char *program) {
+    fprintf(stderr, "Usage: %s [-b budgets] [-w budgets] [-a percent] [-t percent]\n", program);
+    exit(2);
+}
+
+int main(int argc, char **argv) {
+    char *budgetPath = "test.budgets";
+    char *writePath = NULL;
+    double allocationTolerance = 10;
+    double timeTolerance = 200;
+    int option;
+    while ((option = getopt(argc, argv, "b:w:a:t:")) != -1) {
+        switch (option) {
+            case 'b':
+                budgetPath = optarg;
+                break;
+            case 'w':
+                writePath = optarg;
+                break;
+            case 'a':
+                allocationTolerance = atof(optarg);
+                break;
+            case 't':
+                timeTolerance = atof(optarg);
+                break;
+            default:
+                usage(argv[0]);
+        }
+    }
+
+    static char *patterns[] = {"test.tokenizer.input.*", "test.parser.input.*", "test.eval.input.*",
+                               "test.server.input.*"};
+    glob_t cases;
+    int flags = 0;
+    for (int kind = 0; kind < 4; kind++) {
+        glob(patterns[kind], flags, NULL, &cases);
+        flags = GLOB_APPEND;
+    }
+    Budget *budgets = calloc(cases.gl_pathc + 1, sizeof(Budget));
+    Budget *measured = calloc(cases.gl_pathc + 1, sizeof(Budget));
+    if (budgets == NULL || measured == NULL) {
+        fprintf(stderr, "golden_test: out of memory\n");
+        return 2;
+    }
+    int budgetCount = readBudgets(budgetPath, budgets, cases.gl_pathc);
+    if (budgetCount == -1 && writePath == NULL) {
+        fprintf(stderr, "No budgets at %s; run make test-budgets to save some\n", budgetPath);
+    }
+
+    char temporaryPath[] = "/tmp/golden_test.XXXXXX";
+    int temporaryFile = mkstemp(temporaryPath);
+    if (temporaryFile == -1) {
+        perror("golden_test: temporary file");
+        return 2;
+    }
+    close(temporaryFile);
+
+    savedStderr = dup(STDERR_FILENO);
+    signal(SIGALRM, timedOut);
+    int failures = 0;
+    int expectedFailures = 0;
+    for (size_t i = 0; i < cases.gl_pathc; i++) {
+        char *path = cases.gl_pathv[i];
+        testKind kind = strstr(path, ".tokenizer.") ? TOKENIZER_TEST
+                        : strstr(path, ".parser.") ? PARSER_TEST
+                        : strstr(path, ".server.") ? SERVER_TEST : EVAL_TEST;
+        char *input = strstr(path, ".input.");
+        char *expectedPath = malloc(strlen(path) + 2);
+        sprintf(expectedPath, "%.*s.output.%s", (int) (input - path), path, input + strlen(".input."));
+        char *expected = readExpected(expectedPath);
+
+        Measurement measurement;
+        char *actual = runCase(path, kind, temporaryPath, &measurement);
+        Budget *budget = findBudget(budgets, budgetCount, path);
+        bool xfail = budget != NULL && budget->xfail;
+        bool matched = expected != NULL && !strcmp(expected, actual);
+        bool overAllocations = budget != NULL
+                               && over(measurement.allocations, budget->allocations, allocationTolerance);
+        bool overHeap = budget != NULL
+                        && over(measurement.peakHeapBytes, budget->peakHeapBytes, allocationTolerance);
+        bool overTime = budget != NULL
+                        && over(measurement.ms, budget->ms + TIME_SLACK_MS, timeTolerance);
+
+        char *verdict = "ok";
+        if (!matched && xfail) {
+            verdict = "XFAIL";
+            expectedFailures++;
+        } else if (!matched || overAllocations || overHeap || overTime) {
+            verdict = "FAIL";
+            failures++;
+        } else if (xfail) {
+            verdict = "XPASS";
+        }
+        printf("%-24s %-5s %10lu allocations %10lu peak bytes %8.2f ms\n", path, verdict,
+               measurement.allocations, measurement.peakHeapBytes, measurement.ms);
+        if (expected == NULL) {
+            printf("    no %s\n", expectedPath);
+        } else if (!matched && !xfail) {
+            showDifference(expected, actual);
+        }
+        if (overAllocations) {
+            printf("    allocations over budget of %lu\n", budget->allocations);
+        }
+        if (overHeap) {
+            printf("    peak heap over budget of %lu bytes\n", budget->peakHeapBytes);
+        }
+        if (overTime) {
+            printf("    time over budget of %.2f ms\n", budget->ms);
+        }
+
+        Budget *entry = &measured[i];
+        snprintf(entry->name, MAX_NAME, "%s", path);
+        entry->allocations = measurement.allocations;
+        entry->peakHeapBytes = measurement.peakHeapBytes;
+        entry->ms = measurement.ms;
+        entry->xfail = xfail;
+        free(expectedPath);
+        free(expected);
+        free(actual);
+    }
+    resetInterpreter();
+    removeCaches();
+    unlink(temporaryPath);
+
+    printf("%zu cases, %d failed, %d expected failures\n", cases.gl_pathc, failures, expectedFailures);
+    if (writePath != NULL) {
+        FILE *out = fopen(writePath, "w");
+        if (out == NULL) {
+            perror(writePath);
+            return 2;
+        }
+        fprintf(out, "# case                 allocations  peak-heap-bytes  ms  [xfail]\n");
+        for (size_t i = 0; i < cases.gl_pathc; i++) {
+            fprintf(out, "%-24s %10lu %10lu %8.2f%s\n", measured[i].name, measured[i].allocations,
+                    measured[i].peakHeapBytes, measured[i].ms, measured[i].xfail ? " xfail" : "");
+        }
+        fclose(out);
+    }
+    globfree(&cases);
+    free(budgets);
+    free(measured);
+    return failures > 0 && writePath == NULL ? 1 : 0;
+}
@@ -0,0 +1,291 @@
+#include "hashtable.h"
+#include "interpreter.h"
+#include "talloc.h"
+#include <stdint.h>
+#include <string.h>
+
+#define INITIAL_CAPACITY 8
+// Old slots moved across on every write while the table is growing.  With
+// the new array twice the size, a growth finishes long before it fills up.
+#define MIGRATION_STEP 16
+// Pairs and vector elements an equal? hash looks at, at most.
+#define HASH_BUDGET 32
+
+/*
+ * Stands in for the key of an entry removed from the old array, so that
+ * probes for later entries in the same run still go past it.
+ */
+static Value deletedKey;
+
+static uint64_t mix(uint64_t hash) {
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ULL;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+static uint64_t combine(uint64_t hash, uint64_t more) {
+    return mix(hash ^ (more + 0x9e3779b97f4a7c15ULL + (hash << 6) + (hash >> 2)));
+}
+
+static uint64_t hashBytes(char *bytes, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char) bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Hashes a key so that keys the table considers the same hash the same.
+ * Budget counts down the pairs and elements an equal? hash may still visit.
+ */
+static uint64_t hashValue(Value *value, hashKind kind, int *budget) {
+    uint64_t hash = value->type;
+    switch (value->type) {
+        case INT_TYPE:
+            return combine(hash, (uint64_t) value->i);
+        case DOUBLE_TYPE: {
+            // 0.0 and -0.0 are the same number but not the same bits.
+            double d = value->d == 0 ? 0 : value->d;
+            uint64_t bits;
+            memcpy(&bits, &d, sizeof(bits));
+            return combine(hash, bits);
+        }
+        case STR_TYPE:
+            return combine(hash, hashBytes(value->str.chars, value->str.length));
+        case SYMBOL_TYPE:
+        case BOOL_TYPE:
+            return combine(hash, hashBytes(value->s, strlen(value->s)));
+        case PRIMITIVE_TYPE:
+        case CLOSURE_TYPE:
+            // eq? compares these by their first field.
+            return combine(hash, (uint64_t) (uintptr_t) value->s);
+        case PTR_TYPE:
+            return combine(hash, (uint64_t) (uintptr_t) value->p);
+        case BIGNUM_TYPE:
+            hash = combine(hash, value->b.negative);
+            for (int i = 0; i < value->b.length; i++) {
+                hash = combine(hash, value->b.digits[i]);
+            }
+            return hash;
+        case CONS_TYPE:
+            if (kind == EQ_HASH) {
+                break;
+            }
+            while (value->type == CONS_TYPE && *budget > 0) {
+                (*budget)--;
+                hash = combine(hash, hashValue(value->c.car, kind, budget));
+                value = value->c.cdr;
+            }
+            return *budget > 0 ? combine(hash, hashValue(value, kind, budget)) : hash;
+        case VECTOR_TYPE:
+            if (kind == EQ_HASH) {
+                break;
+            }
+            hash = combine(hash, value->v.length);
+            for (int i = 0; i < value->v.length && *budget > 0; i++) {
+                (*budget)--;
+                hash = combine(hash, hashValue(value->v.items[i], kind, budget));
+            }
+            return hash;
+        case F64VECTOR_TYPE:
+        case S64VECTOR_TYPE:
+            if (kind == EQ_HASH) {
+                break;
+            }
+            hash = combine(hash, value->n.length);
+            for (int i = 0; i < value->n.length && *budget > 0; i++) {
+                (*budget)--;
+                if (value->type == F64VECTOR_TYPE) {
+                    double d = value->n.f64[i] == 0 ? 0 : value->n.f64[i];
+                    uint64_t bits;
+                    memcpy(&bits, &d, sizeof(bits));
+                    hash = combine(hash, bits);
+                } else {
+                    hash = combine(hash, (uint64_t) value->n.s64[i]);
+                }
+            }
+            return hash;
+        case NULL_TYPE:
+            return mix(hash);
+        default:
+            // equal? holds for any two of the remaining types' values.
+            if (kind == EQUAL_HASH && value->type != HASH_TYPE && value->type != STRING_BUILDER_TYPE) {
+                return mix(hash);
+            }
+            break;
+    }
+    return combine(hash, (uint64_t) (uintptr_t) value);
+}
+
+static uint64_t hashKey(hashKind kind, Value *key) {
+    int budget = HASH_BUDGET;
+    return hashValue(key, kind, &budget);
+}
+
+static bool keysMatch(hashKind kind, Value *key1, Value *key2) {
+    return key1 == key2 || (kind == EQ_HASH ? valuesAreEq(key1, key2) : treesAreEqual(key1, key2));
+}
+
+static HashSlot *newSlots(int capacity) {
+    HashSlot *slots = tallocKind(capacity * sizeof(HashSlot), HASH_ALLOCATION);
+    memset(slots, 0, capacity * sizeof(HashSlot));
+    return slots;
+}
+
+HashTable *newHashTable(hashKind kind) {
+    HashTable *table = tallocKind(sizeof(HashTable), HASH_ALLOCATION);
+    table->kind = kind;
+    table->count = 0;
+    table->used = 0;
+    table->capacity = INITIAL_CAPACITY;
+    table->slots = newSlots(table->capacity);
+    table->oldSlots = NULL;
+    table->oldCapacity = 0;
+    table->migrated = 0;
+    return table;
+}
+
+/*
+ * Finds the slot holding a key in one array, ignoring slots before start.
+ */
+static HashSlot *findIn(HashSlot *slots, int capacity, int start, hashKind kind, Value *key, uint64_t hash) {
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask; slots[i].key != NULL; i = (i + 1) & mask) {
+        HashSlot *slot = &slots[i];
+        if ((int) i >= start && slot->key != &deletedKey && slot->hash == hash && keysMatch(kind, slot->key, key)) {
+            return slot;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Finds the slot holding a key in either array, or returns NULL.
+ */
+static HashSlot *find(HashTable *table, Value *key, uint64_t hash) {
+    HashSlot *slot = findIn(table->slots, table->capacity, 0, table->kind, key, hash);
+    if (slot == NULL && table->oldSlots != NULL) {
+        slot = findIn(table->oldSlots, table->oldCapacity, table->migrated, table->kind, key, hash);
+    }
+    return slot;
+}
+
+/*
+ * Adds an entry that is not in the table yet to the current array.
+ */
+static void insert(HashTable *table, HashSlot entry) {
+    size_t mask = table->capacity - 1;
+    size_t i = entry.hash & mask;
+    while (table->slots[i].key != NULL) {
+        i = (i + 1) & mask;
+    }
+    table->slots[i] = entry;
+    table->used++;
+}
+
+/*
+ * Moves up to steps slots of the old array into the current one, dropping
+ * the old array once it is empty.
+ */
+static void migrate(HashTable *table, int steps) {
+    while (table->oldSlots != NULL && steps-- > 0) {
+        HashSlot entry = table->oldSlots[table->migrated++];
+        if (entry.key != NULL && entry.key != &deletedKey) {
+            insert(table, entry);
+        }
+        if (table->migrated == table->oldCapacity) {
+            table->oldSlots = NULL;
+            table->oldCapacity = 0;
+            table->migrated = 0;
+        }
+    }
+}
+
+/*
+ * Starts moving the entries into an array twice the size.
+ */
+static void grow(HashTable *table) {
+    // Only one growth runs at a time; this one is rarely still going.
+    migrate(table, table->oldCapacity);
+    table->oldSlots = table->slots;
+    table->oldCapacity = table->capacity;
+    table->migrated = 0;
+    table->capacity *= 2;
+    table->slots = newSlots(table->capacity);
+    table->used = 0;
+}
+
+Value *hashTableGet(HashTable *table, Value *key) {
+    HashSlot *slot = find(table, key, hashKey(table->kind, key));
+    return slot == NULL ? NULL : slot->value;
+}
+
+void hashTablePut(HashTable *table, Value *key, Value *value) {
+    uint64_t hash = hashKey(table->kind, key);
+    migrate(table, MIGRATION_STEP);
+    HashSlot *slot = find(table, key, hash);
+    if (slot != NULL) {
+        slot->value = value;
+        return;
+    }
+    // Keep the load factor under 3/4 so probe sequences stay short.
+    if ((table->used + 1) * 4 > table->capacity * 3) {
+        grow(table);
+    }
+    insert(table, (HashSlot) {key, value, hash});
+    table->count++;
+}
+
+bool hashTableRemove(HashTable *table, Value *key) {
+    uint64_t hash = hashKey(table->kind, key);
+    migrate(table, MIGRATION_STEP);
+    HashSlot *slot = findIn(table->slots, table->capacity, 0, table->kind, key, hash);
+    if (slot == NULL) {
+        if (table->oldSlots == NULL) {
+            return false;
+        }
+        slot = findIn(table->oldSlots, table->oldCapacity, table->migrated, table->kind, key, hash);
+        if (slot == NULL) {
+            return false;
+        }
+        slot->key = &deletedKey;
+        slot->value = NULL;
+        table->count--;
+        return true;
+    }
+    // Shift later members of the probe run back instead of leaving a
+    // tombstone, as ptrmap.c does.
+    size_t mask = table->capacity - 1;
+    size_t hole = slot - table->slots;
+    size_t next = (hole + 1) & mask;
+    while (table->slots[next].key != NULL) {
+        size_t home = table->slots[next].hash & mask;
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            table->slots[hole] = table->slots[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    table->slots[hole] = (HashSlot) {NULL, NULL, 0};
+    table->used--;
+    table->count--;
+    return true;
+}
+
+void forEachHashEntry(HashTable *table, void (*visit)(Value *key, Value *value, void *context), void *context) {
+    for (int i = 0; i < table->capacity; i++) {
+        if (table->slots[i].key != NULL) {
+            visit(table->slots[i].key, table->slots[i].value, context);
+        }
+    }
+    for (int i = table->migrated; i < table->oldCapacity; i++) {
+        if (table->oldSlots[i].key != NULL && table->oldSlots[i].key != &deletedKey) {
+            visit(table->oldSlots[i].key, table->oldSlots[i].value, context);
+        }
+    }
+}
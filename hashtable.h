@@ -0,0 +1,81 @@
+#include <stdbool.h>
+#include <stdint.h>
+#include "value.h"
+
+#ifndef HASHTABLE_H
+#define HASHTABLE_H
+
+/*
+ * Hash tables for Scheme code, keyed by any value.
+ *
+ * Keys are compared like eq? or like equal?, and hashed consistently with
+ * that: an eq? table hashes pairs, vectors and procedures by address and
+ * numbers (bignums included), strings and symbols by content (since eq?
+ * compares those by value here), and an equal? table hashes structure as
+ * well, up to a fixed number of elements so that long or circular lists
+ * hash in bounded time.
+ *
+ * The table uses open addressing with linear probing, and lives in the
+ * talloc heap so the collector frees it with its Value.  Growing is
+ * incremental: the old slot array stays in place while every write moves a
+ * few more of its slots across, so no single insertion pays for rehashing
+ * the whole table.  Until then lookups search both arrays.
+ */
+typedef enum {
+    EQ_HASH,
+    EQUAL_HASH,
+} hashKind;
+
+/*
+ * An entry, or an empty slot if key is NULL.  The hash is kept so that
+ * moving entries never has to hash a key again.
+ */
+typedef struct HashSlot {
+    struct Value *key;
+    struct Value *value;
+    uint64_t hash;
+} HashSlot;
+
+typedef struct HashTable {
+    hashKind kind;
+    // Live entries, in either array.
+    int count;
+    // Entries in slots, which is capacity long (a power of two).
+    int used;
+    int capacity;
+    HashSlot *slots;
+    // The array being moved into slots, or NULL.  Its slots before migrated
+    // have been moved already.
+    HashSlot *oldSlots;
+    int oldCapacity;
+    int migrated;
+} HashTable;
+
+/*
+ * Create an empty table.
+ */
+HashTable *newHashTable(hashKind kind);
+
+/*
+ * Look up a key, returning its value or NULL if it is not present.
+ */
+struct Value *hashTableGet(HashTable *table, struct Value *key);
+
+/*
+ * Add a key, or replace its value if it is already present.
+ */
+void hashTablePut(HashTable *table, struct Value *key, struct Value *value);
+
+/*
+ * Remove a key if it is present.  Returns whether it was.
+ */
+bool hashTableRemove(HashTable *table, struct Value *key);
+
+/*
+ * Calls visit with every key and value in the table, in no particular order.
+ * The table must not change until it returns.
+ */
+void forEachHashEntry(HashTable *table, void (*visit)(struct Value *key, struct Value *value, void *context),
+                      void *context);
+
+#endif
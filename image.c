@@ -0,0 +1,567 @@
+#include "image.h"
+#include "ptrmap.h"
+#include "value.h"
+#include "interpreter.h"
+#include "hashtable.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define IMAGE_MAGIC "SCMIMG2"
+#define IMAGE_PAGE 4096
+#define IMAGE_BASE ((uint64_t) 0x500000000000ULL)
+
+typedef struct ImageHeader {
+    char magic[8];
+    uint64_t base;
+    uint64_t dataLength;
+    uint64_t top;
+    uint64_t relocationCount;
+    uint64_t fixupCount;
+    uint64_t tableCount;
+    uint64_t valueSize;
+    uint64_t frameSize;
+    uint64_t primitiveCount;
+} ImageHeader;
+
+typedef enum {
+    IMAGE_VALUE,
+    IMAGE_FRAME,
+    IMAGE_STRING,
+    IMAGE_ITEMS,
+    // Arrays without pointers: the digits of bignums and the elements of
+    // f64vectors and s64vectors.
+    IMAGE_DATA,
+    // The entries of a hash table: its kind and count, then each key and
+    // value, so that loading can put them in a new table.
+    IMAGE_ENTRIES,
+} imageObjectKind;
+
+/*
+ * One heap object being written to an image, and where it goes.
+ */
+typedef struct ImageObject {
+    void *address;
+    imageObjectKind kind;
+    uint64_t size;
+    uint64_t offset;
+} ImageObject;
+
+/*
+ * The state of an image being written: the objects found so far (indexed by
+ * address), the data block, and the tables that go after it.
+ */
+typedef struct ImageWriter {
+    ImageObject *objects;
+    size_t objectCount;
+    size_t objectCapacity;
+    PtrMap *indices;
+    uint64_t dataLength;
+    char *data;
+    uint64_t *relocations;
+    size_t relocationCount;
+    size_t relocationCapacity;
+    uint64_t *fixups;
+    size_t fixupCount;
+    size_t fixupCapacity;
+    uint64_t *tables;
+    size_t tableCount;
+    size_t tableCapacity;
+    // Character buffers and how much of each is used, laid out once every
+    // string sharing them has been found.
+    PtrMap *bufferIndices;
+    ImageObject *buffers;
+    size_t bufferCount;
+    size_t bufferCapacity;
+} ImageWriter;
+
+static uint64_t roundUp(uint64_t n, uint64_t multiple) {
+    return (n + multiple - 1) / multiple * multiple;
+}
+
+/*
+ * Grows a malloc'ed array of fixed-size elements if it is full. Returns false
+ * if memory runs out.
+ */
+static bool reserve(void **array, size_t count, size_t *capacity, size_t elementSize) {
+    if (count < *capacity) {
+        return true;
+    }
+    size_t newCapacity = *capacity == 0 ? 256 : *capacity * 2;
+    void *newArray = realloc(*array, newCapacity * elementSize);
+    if (newArray == NULL) {
+        return false;
+    }
+    *array = newArray;
+    *capacity = newCapacity;
+    return true;
+}
+
+/*
+ * Adds an object of the given size to the image (once), giving it the next
+ * free offset in the data block. Returns false if memory runs out.
+ */
+static bool addObject(ImageWriter *writer, void *address, imageObjectKind kind, uint64_t size) {
+    if (address == NULL || ptrMapGet(writer->indices, address, NULL)) {
+        return true;
+    }
+    if (!reserve((void **) &writer->objects, writer->objectCount, &writer->objectCapacity, sizeof(ImageObject))) {
+        return false;
+    }
+    ImageObject *object = &writer->objects[writer->objectCount];
+    object->address = address;
+    object->kind = kind;
+    object->size = size;
+    object->offset = roundUp(writer->dataLength, 8);
+    writer->dataLength = object->offset + object->size;
+    ptrMapPut(writer->indices, address, (void *) (uintptr_t) writer->objectCount);
+    writer->objectCount++;
+    return true;
+}
+
+/*
+ * Adds a value or frame to the image (once).
+ */
+static bool discover(ImageWriter *writer, void *address, imageObjectKind kind) {
+    if (kind == IMAGE_VALUE) {
+        return addObject(writer, address, kind, sizeof(Value));
+    }
+    return addObject(writer, address, kind, sizeof(Frame));
+}
+
+/*
+ * Notes that the first size bytes of a character buffer are used.  Strings
+ * may hold NULs, and substrings share their parent's buffer, so a buffer's
+ * size is the most any string using it needs.
+ */
+static bool discoverBuffer(ImageWriter *writer, char *buffer, uint64_t size) {
+    void *index;
+    if (buffer == NULL) {
+        return true;
+    }
+    if (ptrMapGet(writer->bufferIndices, buffer, &index)) {
+        ImageObject *known = &writer->buffers[(uintptr_t) index];
+        known->size = size > known->size ? size : known->size;
+        return true;
+    }
+    if (!reserve((void **) &writer->buffers, writer->bufferCount, &writer->bufferCapacity, sizeof(ImageObject))) {
+        return false;
+    }
+    writer->buffers[writer->bufferCount] = (ImageObject) {buffer, IMAGE_STRING, size, 0};
+    ptrMapPut(writer->bufferIndices, buffer, (void *) (uintptr_t) writer->bufferCount);
+    writer->bufferCount++;
+    return true;
+}
+
+/*
+ * Returns true for value types whose s field points at a string.
+ */
+static bool hasString(Value *value) {
+    return value->type == SYMBOL_TYPE || value->type == BOOL_TYPE
+        || value->type == OPEN_TYPE || value->type == CLOSE_TYPE || value->type == QUOTE_TYPE;
+}
+
+/*
+ * A hash table's entries being discovered or copied: next is the offset of
+ * the next key's slot, and ok turns false if memory runs out.
+ */
+typedef struct EntryWriter {
+    ImageWriter *writer;
+    uint64_t next;
+    bool ok;
+} EntryWriter;
+
+static void discoverEntry(Value *key, Value *value, void *context) {
+    EntryWriter *entries = context;
+    entries->ok = entries->ok && discover(entries->writer, key, IMAGE_VALUE)
+        && discover(entries->writer, value, IMAGE_VALUE);
+}
+
+/*
+ * Finds every object reachable from the objects already discovered. The
+ * object array doubles as the work list, so this never recurses.  Character
+ * buffers go last, when their sizes are known.
+ */
+static bool discoverAll(ImageWriter *writer) {
+    for (size_t i = 0; i < writer->objectCount; i++) {
+        ImageObject object = writer->objects[i];
+        bool ok = true;
+        if (object.kind == IMAGE_FRAME) {
+            Frame *frame = object.address;
+            ok = discover(writer, frame->bindings, IMAGE_VALUE) && discover(writer, frame->parent, IMAGE_FRAME);
+        } else if (object.kind == IMAGE_VALUE) {
+            Value *value = object.address;
+            if (value->type == CONS_TYPE) {
+                ok = discover(writer, value->c.car, IMAGE_VALUE) && discover(writer, value->c.cdr, IMAGE_VALUE);
+            } else if (value->type == CLOSURE_TYPE) {
+                ok = discover(writer, value->cl.parameters, IMAGE_VALUE) && discover(writer, value->cl.body, IMAGE_VALUE)
+                    && discover(writer, value->cl.frame, IMAGE_FRAME);
+            } else if (value->type == VECTOR_TYPE) {
+                ok = addObject(writer, value->v.items, IMAGE_ITEMS, value->v.length * sizeof(Value *));
+            } else if (value->type == BIGNUM_TYPE) {
+                ok = addObject(writer, value->b.digits, IMAGE_DATA, value->b.length * sizeof(uint32_t));
+            } else if (value->type == F64VECTOR_TYPE || value->type == S64VECTOR_TYPE) {
+                ok = addObject(writer, value->n.f64, IMAGE_DATA, value->n.length * sizeof(double));
+            } else if (value->type == STR_TYPE) {
+                // Up to the byte after the characters, which stringChars()
+                // looks at.
+                ok = discoverBuffer(writer, value->str.buffer,
+                                    value->str.chars - value->str.buffer + value->str.length + 1);
+            } else if (value->type == STRING_BUILDER_TYPE) {
+                ok = discoverBuffer(writer, value->sb.buffer, value->sb.length + 1);
+            } else if (value->type == HASH_TYPE) {
+                ok = addObject(writer, value->h, IMAGE_ENTRIES, (2 + 2 * (uint64_t) value->h->count) * sizeof(uint64_t));
+            } else if (hasString(value)) {
+                ok = discoverBuffer(writer, value->s, strlen(value->s) + 1);
+            }
+        } else if (object.kind == IMAGE_ITEMS) {
+            Value **items = object.address;
+            for (size_t j = 0; ok && j < object.size / sizeof(Value *); j++) {
+                ok = discover(writer, items[j], IMAGE_VALUE);
+            }
+        } else if (object.kind == IMAGE_ENTRIES) {
+            EntryWriter entries = {writer, 0, true};
+            forEachHashEntry(object.address, discoverEntry, &entries);
+            ok = entries.ok;
+        }
+        if (!ok) {
+            return false;
+        }
+    }
+    for (size_t i = 0; i < writer->bufferCount; i++) {
+        ImageObject *buffer = &writer->buffers[i];
+        if (!addObject(writer, buffer->address, buffer->kind, buffer->size)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Rewrites the pointer slot at offset in the data block to where delta bytes
+ * into target will live in the image, recording a relocation for it.
+ */
+static bool relocateInto(ImageWriter *writer, uint64_t offset, void *target, uint64_t delta) {
+    uint64_t address = 0;
+    if (target != NULL) {
+        void *index;
+        ptrMapGet(writer->indices, target, &index);
+        address = IMAGE_BASE + writer->objects[(uintptr_t) index].offset + delta;
+        if (!reserve((void **) &writer->relocations, writer->relocationCount, &writer->relocationCapacity, sizeof(uint64_t))) {
+            return false;
+        }
+        writer->relocations[writer->relocationCount++] = offset;
+    }
+    memcpy(writer->data + offset, &address, sizeof(address));
+    return true;
+}
+
+/*
+ * Rewrites the pointer slot at offset in the data block to where target will
+ * live in the image, recording a relocation for it.
+ */
+static bool relocate(ImageWriter *writer, uint64_t offset, void *target) {
+    return relocateInto(writer, offset, target, 0);
+}
+
+static void copyEntry(Value *key, Value *value, void *context) {
+    EntryWriter *entries = context;
+    entries->ok = entries->ok && relocate(entries->writer, entries->next, key)
+        && relocate(entries->writer, entries->next + sizeof(uint64_t), value);
+    entries->next += 2 * sizeof(uint64_t);
+}
+
+/*
+ * Copies one object into the data block and rewrites its pointers.
+ */
+static bool copyObject(ImageWriter *writer, ImageObject *object) {
+    uint64_t base = object->offset;
+    if (object->kind == IMAGE_ENTRIES) {
+        HashTable *table = object->address;
+        uint64_t header[2] = {table->kind, table->count};
+        memcpy(writer->data + base, header, sizeof(header));
+        EntryWriter entries = {writer, base + sizeof(header), true};
+        forEachHashEntry(table, copyEntry, &entries);
+        return entries.ok;
+    }
+    memcpy(writer->data + object->offset, object->address, object->size);
+    if (object->kind == IMAGE_FRAME) {
+        Frame *frame = object->address;
+        return relocate(writer, base + offsetof(Frame, bindings), frame->bindings)
+            && relocate(writer, base + offsetof(Frame, parent), frame->parent);
+    } else if (object->kind == IMAGE_STRING || object->kind == IMAGE_DATA) {
+        return true;
+    } else if (object->kind == IMAGE_ITEMS) {
+        Value **items = object->address;
+        bool ok = true;
+        for (size_t i = 0; ok && i < object->size / sizeof(Value *); i++) {
+            ok = relocate(writer, base + i * sizeof(Value *), items[i]);
+        }
+        return ok;
+    }
+    Value *value = object->address;
+    if (value->type == CONS_TYPE) {
+        return relocate(writer, base + offsetof(Value, c.car), value->c.car)
+            && relocate(writer, base + offsetof(Value, c.cdr), value->c.cdr);
+    } else if (value->type == CLOSURE_TYPE) {
+        return relocate(writer, base + offsetof(Value, cl.parameters), value->cl.parameters)
+            && relocate(writer, base + offsetof(Value, cl.body), value->cl.body)
+            && relocate(writer, base + offsetof(Value, cl.frame), value->cl.frame);
+    } else if (value->type == VECTOR_TYPE) {
+        return relocate(writer, base + offsetof(Value, v.items), value->v.items);
+    } else if (value->type == STR_TYPE) {
+        return relocate(writer, base + offsetof(Value, str.buffer), value->str.buffer)
+            && relocateInto(writer, base + offsetof(Value, str.chars), value->str.buffer,
+                            value->str.chars - value->str.buffer);
+    } else if (value->type == STRING_BUILDER_TYPE) {
+        // Only the characters so far are saved, so the next append has to
+        // move them to a bigger buffer.
+        int capacity = value->sb.length;
+        memcpy(writer->data + base + offsetof(Value, sb.capacity), &capacity, sizeof(capacity));
+        return relocate(writer, base + offsetof(Value, sb.buffer), value->sb.buffer);
+    } else if (hasString(value)) {
+        return relocate(writer, base + offsetof(Value, s), value->s);
+    } else if (value->type == PRIMITIVE_TYPE) {
+        int index = primitiveIndex(value->pf);
+        if (index == -1) {
+            printf("Image error: cannot save a non-builtin primitive\n");
+            return false;
+        }
+        if (!reserve((void **) &writer->fixups, writer->fixupCount + 1, &writer->fixupCapacity, sizeof(uint64_t))) {
+            return false;
+        }
+        writer->fixups[writer->fixupCount++] = base + offsetof(Value, pf);
+        writer->fixups[writer->fixupCount++] = index;
+        memset(writer->data + base + offsetof(Value, pf), 0, sizeof(value->pf));
+    } else if (value->type == BIGNUM_TYPE) {
+        return relocate(writer, base + offsetof(Value, b.digits), value->b.digits);
+    } else if (value->type == F64VECTOR_TYPE || value->type == S64VECTOR_TYPE) {
+        return relocate(writer, base + offsetof(Value, n.f64), value->n.f64);
+    } else if (value->type == HASH_TYPE) {
+        // eq? tables hash keys by address, which an image changes, so only
+        // the entries are saved and loading builds the table again.
+        if (!reserve((void **) &writer->tables, writer->tableCount, &writer->tableCapacity, sizeof(uint64_t))) {
+            return false;
+        }
+        writer->tables[writer->tableCount++] = base;
+        return relocate(writer, base + offsetof(Value, h), value->h);
+    } else if (value->type == PTR_TYPE) {
+        memset(writer->data + base + offsetof(Value, p), 0, sizeof(value->p));
+    }
+    return true;
+}
+
+/*
+ * Writes the header, data block and tables to a file.
+ */
+static bool writeImageFile(ImageWriter *writer, char *path, Frame *frame) {
+    FILE *file = fopen(path, "wb");
+    if (file == NULL) {
+        printf("Image error: cannot write '%s'\n", path);
+        return false;
+    }
+    void *index;
+    ptrMapGet(writer->indices, frame, &index);
+    ImageHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC));
+    header.base = IMAGE_BASE;
+    header.dataLength = writer->dataLength;
+    header.top = IMAGE_BASE + writer->objects[(uintptr_t) index].offset;
+    header.relocationCount = writer->relocationCount;
+    header.fixupCount = writer->fixupCount / 2;
+    header.tableCount = writer->tableCount;
+    header.valueSize = sizeof(Value);
+    header.frameSize = sizeof(Frame);
+    header.primitiveCount = primitiveCount();
+    char page[IMAGE_PAGE];
+    memset(page, 0, sizeof(page));
+    memcpy(page, &header, sizeof(header));
+    uint64_t paddedLength = roundUp(writer->dataLength, IMAGE_PAGE);
+    bool ok = fwrite(page, 1, IMAGE_PAGE, file) == IMAGE_PAGE
+        && fwrite(writer->data, 1, paddedLength, file) == paddedLength
+        && fwrite(writer->relocations, sizeof(uint64_t), writer->relocationCount, file) == writer->relocationCount
+        && fwrite(writer->fixups, sizeof(uint64_t), writer->fixupCount, file) == writer->fixupCount
+        && fwrite(writer->tables, sizeof(uint64_t), writer->tableCount, file) == writer->tableCount;
+    if (fclose(file) != 0 || !ok) {
+        printf("Image error: cannot write '%s'\n", path);
+        return false;
+    }
+    return true;
+}
+
+/*
+ * Writes an image of everything reachable from frame to path.
+ */
+bool dumpImage(char *path, Frame *frame) {
+    ImageWriter writer;
+    memset(&writer, 0, sizeof(writer));
+    writer.indices = newPtrMap();
+    writer.bufferIndices = newPtrMap();
+    bool ok = discover(&writer, frame, IMAGE_FRAME) && discoverAll(&writer);
+    if (ok) {
+        writer.data = calloc(1, roundUp(writer.dataLength, IMAGE_PAGE) + 1);
+        ok = writer.data != NULL;
+    }
+    for (size_t i = 0; ok && i < writer.objectCount; i++) {
+        ok = copyObject(&writer, &writer.objects[i]);
+    }
+    if (ok) {
+        ok = writeImageFile(&writer, path, frame);
+    } else {
+        printf("Image error: cannot build image\n");
+    }
+    free(writer.objects);
+    free(writer.data);
+    free(writer.relocations);
+    free(writer.fixups);
+    free(writer.tables);
+    free(writer.buffers);
+    freePtrMap(writer.indices);
+    freePtrMap(writer.bufferIndices);
+    return ok;
+}
+
+/*
+ * Replaces the saved entries of a hash table value with a table holding them.
+ */
+static void rebuildTable(Value *value) {
+    uint64_t *saved = (uint64_t *) value->h;
+    HashTable *table = newHashTable((hashKind) saved[0]);
+    Value **entries = (Value **) (saved + 2);
+    for (uint64_t i = 0; i < saved[1]; i++) {
+        hashTablePut(table, entries[2 * i], entries[2 * i + 1]);
+    }
+    value->h = table;
+}
+
+/*
+ * Returns whether size bytes from offset lie in a block of length bytes.
+ */
+static bool fits(uint64_t offset, uint64_t size, uint64_t length) {
+    return offset <= length && size <= length - offset;
+}
+
+/*
+ * Checks, before anything is patched, that every slot the tables name lies
+ * in the data block, that every pointer slot points into it, that every
+ * primitive index is in the primitive table and that every saved hash table
+ * is whole, so that a damaged image cannot make loading write anywhere else.
+ */
+static bool validImage(ImageHeader *header, char *data, uint64_t *relocations, uint64_t *fixups, uint64_t *tables) {
+    uint64_t length = header->dataLength;
+    uint64_t top = header->top - header->base;
+    if (top % 8 != 0 || !fits(top, sizeof(Frame), length)) {
+        return false;
+    }
+    for (uint64_t i = 0; i < header->relocationCount; i++) {
+        uint64_t address;
+        if (!fits(relocations[i], sizeof(address), length)) {
+            return false;
+        }
+        memcpy(&address, data + relocations[i], sizeof(address));
+        if (!fits(address - header->base, 0, length)) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->fixupCount; i++) {
+        if (!fits(fixups[2 * i], sizeof(Primitive), length) || fixups[2 * i + 1] >= header->primitiveCount) {
+            return false;
+        }
+    }
+    for (uint64_t i = 0; i < header->tableCount; i++) {
+        if (tables[i] % 8 != 0 || !fits(tables[i], sizeof(Value), length)) {
+            return false;
+        }
+        Value *value = (Value *) (data + tables[i]);
+        uint64_t entries = (uint64_t) (uintptr_t) value->h - header->base;
+        if (value->type != HASH_TYPE || entries % 8 != 0 || !fits(entries, 2 * sizeof(uint64_t), length)) {
+            return false;
+        }
+        uint64_t *saved = (uint64_t *) (data + entries);
+        uint64_t room = (length - entries) / sizeof(uint64_t) - 2;
+        if ((saved[0] != EQ_HASH && saved[0] != EQUAL_HASH) || saved[1] > room / 2) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Maps an image and returns its global frame.
+ */
+Frame *loadImage(char *path) {
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        printf("Image error: cannot open '%s'\n", path);
+        return NULL;
+    }
+    ImageHeader header;
+    struct stat info;
+    if (fstat(fd, &info) == -1 || pread(fd, &header, sizeof(header), 0) != sizeof(header)
+            || memcmp(header.magic, IMAGE_MAGIC, sizeof(IMAGE_MAGIC)) != 0) {
+        printf("Image error: '%s' is not an image\n", path);
+        close(fd);
+        return NULL;
+    }
+    uint64_t size = info.st_size;
+    if (header.dataLength > size || header.relocationCount > size / sizeof(uint64_t)
+            || header.fixupCount > size / (2 * sizeof(uint64_t)) || header.tableCount > size / sizeof(uint64_t)) {
+        printf("Image error: '%s' is damaged\n", path);
+        close(fd);
+        return NULL;
+    }
+    uint64_t paddedLength = roundUp(header.dataLength, IMAGE_PAGE);
+    uint64_t expectedSize = IMAGE_PAGE + paddedLength + (header.relocationCount + 2 * header.fixupCount + header.tableCount) * sizeof(uint64_t);
+    if (header.valueSize != sizeof(Value) || header.frameSize != sizeof(Frame)
+            || header.primitiveCount != (uint64_t) primitiveCount() || size != expectedSize) {
+        printf("Image error: '%s' was made by a different build\n", path);
+        close(fd);
+        return NULL;
+    }
+    // Loading patches pointer and primitive slots and fills hash tables in
+    // place, and the program may later set! globals or mutate saved values,
+    // so the mapping has to be writable.  It is private so that those writes
+    // go to copy-on-write pages of this process and never reach the file,
+    // which other interpreters may be mapping too; untouched pages stay
+    // shared with the page cache.
+    void *hint = (void *) (uintptr_t) (header.base - IMAGE_PAGE);
+    char *mapping = mmap(hint, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        printf("Image error: cannot map '%s'\n", path);
+        return NULL;
+    }
+    char *data = mapping + IMAGE_PAGE;
+    uint64_t *relocations = (uint64_t *) (data + paddedLength);
+    uint64_t *fixups = relocations + header.relocationCount;
+    uint64_t *tables = fixups + 2 * header.fixupCount;
+    if (!validImage(&header, data, relocations, fixups, tables)) {
+        printf("Image error: '%s' is damaged\n", path);
+        munmap(mapping, size);
+        return NULL;
+    }
+    uint64_t delta = (uint64_t) (uintptr_t) data - header.base;
+    if (delta != 0) {
+        for (uint64_t i = 0; i < header.relocationCount; i++) {
+            uint64_t address;
+            memcpy(&address, data + relocations[i], sizeof(address));
+            address += delta;
+            memcpy(data + relocations[i], &address, sizeof(address));
+        }
+    }
+    for (uint64_t i = 0; i < header.fixupCount; i++) {
+        Primitive function = primitiveAt(fixups[2 * i + 1]);
+        memcpy(data + fixups[2 * i], &function, sizeof(function));
+    }
+    // Keys are where they will stay now, so hash tables can be filled.
+    for (uint64_t i = 0; i < header.tableCount; i++) {
+        rebuildTable((Value *) (data + tables[i]));
+    }
+    return (Frame *) (data + (header.top - header.base));
+}
@@ -0,0 +1,55 @@
+#include <stdbool.h>
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef IMAGE_H
+#define IMAGE_H
+
+/*
+ * Heap images let the interpreter start with a prelude already loaded,
+ * without tokenizing, parsing or evaluating it again.
+ *
+ * An image is a snapshot of everything reachable from the global frame:
+ * frames, values (including closures and their parse trees), strings, the
+ * element arrays of vectors, f64vectors and s64vectors and the digits of
+ * bignums, laid out in one contiguous block as if it lived at a fixed base
+ * address.
+ *
+ *   page 0     header: the magic "SCMIMG2", the base address, the length of
+ *              the data block, the address of the global frame, the number
+ *              of relocations, primitive fixups and hash tables, and the
+ *              sizes of a Value and a Frame plus the number of builtin
+ *              primitives (so an image from a different build is rejected)
+ *   page 1...  the data block, padded to a whole page
+ *   then       relocations: the offset (in the data block) of every
+ *              pointer slot, as 64-bit integers
+ *   then       primitive fixups: (offset, primitive table index) pairs for
+ *              every primitive function pointer slot
+ *   then       hash tables: the offset of every hash table value
+ *
+ * Loading maps the file privately at the base address, so pages are shared
+ * with the page cache until something writes to them.  If the kernel puts
+ * the mapping somewhere else, every pointer slot is shifted by the
+ * difference.  Primitive slots are always patched, since function addresses
+ * move from run to run.  Every slot offset, pointer and primitive index is
+ * checked before anything is patched, and a damaged image is rejected.
+ * Image memory is never freed by the collector.
+ *
+ * A hash table is saved as its kind, its count and its keys and values,
+ * since eq? tables hash keys by address and the keys move.  Loading puts the
+ * entries in a new table once every pointer has been relocated.
+ */
+
+/*
+ * Writes an image of everything reachable from frame to path.  Returns false
+ * (after printing a message) if the file cannot be written.
+ */
+bool dumpImage(char *path, Frame *frame);
+
+/*
+ * Maps an image and returns its global frame, or NULL (after printing a
+ * message) if the file is missing, malformed or from a different build.
+ */
+Frame *loadImage(char *path);
+
+#endif
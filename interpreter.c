@@ -3,8 +3,23 @@
 #include "linkedlist.h"
 #include "value.h"
 #include "talloc.h"
+#include "loader.h"
+#include "serialize.h"
+#include "profile.h"
+#include "location.h"
+#include "gcstats.h"
+#include "census.h"
+#include "trace.h"
+#include "perfcounters.h"
+#include "hashtable.h"
+#include "bignum.h"
+#include "numvector.h"
+#include "output.h"
+#include "analysis.h"
+#include "region.h"
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include "interpreter.h"
 #include <stdbool.h>
 
@@ -12,6 +27,17 @@
 Frame * top;
 // Flag that toggles whether using the else operator will throw an error
 bool inCond = false;
+// Global frame, saved while top points at an isolated child frame.
+static Frame *globalFrame = NULL;
+// The isolated child frame, which takes set!s of globals while it exists.
+static Frame *isolatedFrame = NULL;
+// Bumped whenever a binding is added to a frame that already existed (by
+// define, or by a set! shadowing a global), which may hide one a running
+// loop looked up.
+static unsigned long bindingGeneration = 0;
+// The innermost combination being evaluated, for locating errors.  Atoms
+// have no locations of their own, so they are reported by the combination.
+static Value *currentExpression = NULL;
 
 /*
  * Prints a simple error trace and exits the program upon discovering unparsable input
@@ -19,6 +45,7 @@ bool inCond = false;
 void raiseEvalError(char* message, bool condition) {
 	if (condition) {
 		printf("Evaluation Error: %s\n", message);
+		reportLocation(currentExpression);
 		texit(1);
 	}
 }
@@ -27,7 +54,7 @@ void raiseEvalError(char* message, bool condition) {
  * Mutates an inputted BOOL_TYPE value to represent 'true'
  */
 void makeTrue(Value *boolean) {
-    boolean->s = talloc(3*sizeof(char));
+    boolean->s = tallocKind(3*sizeof(char), STRING_ALLOCATION);
     strcpy(boolean->s, "#t");
 }
 
@@ -35,7 +62,7 @@ void makeTrue(Value *boolean) {
  * Mutates an inputted BOOL_TYPE value to represent 'false'
  */
 void makeFalse(Value *boolean) {
-    boolean->s = talloc(3*sizeof(char));
+    boolean->s = tallocKind(3*sizeof(char), STRING_ALLOCATION);
     strcpy(boolean->s, "#f");
 }
 
@@ -44,12 +71,12 @@ void makeFalse(Value *boolean) {
  */
 void printValue(Value *value) {
 	if (value->type == CONS_TYPE) {
-		printf("(");
+		outputChar('(');
 		printTree(value);
-		printf(")\n");
+		outputString(")\n");
 	} else if (value->type != VOID_TYPE) {
 		printTree(value);
-		printf("\n");
+		outputChar('\n');
 	}
 }
 
@@ -68,7 +95,7 @@ Value *lookUpSymbol(Value *symbol, Frame *frame) {
 		remaining = cdr(remaining);
 	}
 	if (frame->parent == NULL) {
-		char* errorString = talloc(sizeof(char) * 32);
+		char* errorString = tallocKind(sizeof(char) * (strlen(symbol->s) + 20), STRING_ALLOCATION);
 		sprintf(errorString, "Undefined symbol '%s'", symbol->s);
 		raiseEvalError(errorString, true);
 	}
@@ -78,13 +105,13 @@ Value *lookUpSymbol(Value *symbol, Frame *frame) {
 /* 
  * Binds a symbol name to a primitive function
  */
-void bind(char *name, Value *(*function)(Value *), Frame *frame) {
+void bindPrimitive(char *name, Primitive function, Frame *frame) {
 	Value *value = makeNull();
 	value->type = PRIMITIVE_TYPE;
 	value->pf = function;
 	Value *symbol = makeNull();
 	symbol->type = SYMBOL_TYPE;
-	symbol->s = talloc((strlen(name) + 1) * sizeof(char));
+	symbol->s = tallocKind((strlen(name) + 1) * sizeof(char), STRING_ALLOCATION);
     strcpy(symbol->s, name);
 	Value *binding = cons(symbol, value);
 	frame->bindings = cons(binding, frame->bindings);
@@ -132,6 +159,93 @@ bool checkDuplicates(Value *parameters) {
     return false;
 }
 
+/*
+ * Makes a frame with no bindings, in the region if nothing made while it is
+ * in use can capture it (see analysis.h) or else on the heap.
+ */
+static Frame *newFrame(Frame *parent, bool inRegion) {
+    static Value noBindings = {.type = NULL_TYPE};
+    Frame *frame;
+    if (inRegion) {
+        frame = regionAllocate(sizeof(Frame));
+        frame->bindings = &noBindings;
+    } else {
+        frame = tallocKind(sizeof(Frame), FRAME_ALLOCATION);
+        frame->bindings = makeNull();
+    }
+    frame->parent = parent;
+    return frame;
+}
+
+/*
+ * Like cons(), in the region or on the heap.
+ */
+static Value *frameCons(Value *car, Value *cdr, bool inRegion) {
+    if (!inRegion) {
+        return cons(car, cdr);
+    }
+    Value *pair = regionAllocate(sizeof(Value));
+    pair->type = CONS_TYPE;
+    pair->c.car = car;
+    pair->c.cdr = cdr;
+    return pair;
+}
+
+/*
+ * Adds a binding to a frame made by newFrame(), returning its pair.
+ */
+static Value *bind(Frame *frame, Value *symbol, Value *value, bool inRegion) {
+    Value *pair = frameCons(symbol, value, inRegion);
+    frame->bindings = frameCons(pair, frame->bindings, inRegion);
+    return pair;
+}
+
+/*
+ * Builds the frame a closure keeps: the binding pairs of the free variables
+ * it finds in local frames, shared rather than copied so that set! on either
+ * side is seen by both, in front of the global frame.  Globals are left to
+ * be looked up when the closure runs, since they may not be defined yet.
+ * A closure that captures nothing keeps the global frame itself, so it
+ * holds on to none of the frames it was created in.
+ */
+static Frame *captureVariables(Value *lambda, Frame *frame) {
+    Frame *global = frame;
+    while (global != top && global->parent != NULL) {
+        global = global->parent;
+    }
+    if (global == frame) {
+        return frame;
+    }
+    FreeVariables *variables = freeVariables(lambda);
+    Value *captured = NULL;
+    for (int i = 0; i < variables->count; i++) {
+        char *name = variables->symbols[i]->s;
+        for (Frame *local = frame; local != global; local = local->parent) {
+            Value *remaining = local->bindings;
+            while (remaining->type != NULL_TYPE && strcmp(car(car(remaining))->s, name) != 0) {
+                remaining = cdr(remaining);
+            }
+            if (remaining->type != NULL_TYPE) {
+                Value *pair = car(remaining);
+                if (regionContains(pair)) {
+                    // Only reachable through another name for lambda; the
+                    // closure gets a copy, so it won't see later set!s.
+                    pair = cons(car(pair), cdr(pair));
+                }
+                captured = cons(pair, captured == NULL ? makeNull() : captured);
+                break;
+            }
+        }
+    }
+    if (captured == NULL) {
+        return global;
+    }
+    Frame *flatFrame = tallocKind(sizeof(Frame), FRAME_ALLOCATION);
+    flatFrame->bindings = captured;
+    flatFrame->parent = global;
+    return flatFrame;
+}
+
 /*
  * Evaluates lambda statements
  */
@@ -146,7 +260,7 @@ Value *evalLambda(Value *args, Frame *frame) {
     raiseEvalError("Duplicate argument names", parameters->type == CONS_TYPE && checkDuplicates(parameters));
     newProcedure->cl.parameters = parameters;
     newProcedure->cl.body = body;
-    newProcedure->cl.frame = frame;
+    newProcedure->cl.frame = captureVariables(args, frame);
     return newProcedure;
 }
 
@@ -176,9 +290,9 @@ bool alreadyBound(Value *symbol, Value* bindings) {
  */
 Value *evalLet(Value *args, Frame *frame) {
 	raiseEvalError("Expected at least 2 arguments, recieved 0", args->type == NULL_TYPE);
-	Frame *childFrame = talloc(sizeof(Frame));
-	childFrame->parent = frame;
-	childFrame->bindings = makeNull();
+	bool inRegion = !mayCreateClosures(args);
+	RegionMark mark = regionMark();
+	Frame *childFrame = newFrame(frame, inRegion);
 	Value *remaining = car(args);
 	while (remaining->type != NULL_TYPE) {
 		Value *pair = car(remaining);
@@ -187,8 +301,7 @@ Value *evalLet(Value *args, Frame *frame) {
 		raiseEvalError("No value to assign", cdr(pair)->type == NULL_TYPE);
         raiseEvalError("Duplicate symbol in let", alreadyBound(varSymbol, childFrame->bindings));
 		Value *varValue = eval(car(cdr(pair)), frame);
-		Value *varPair = cons(varSymbol, varValue);
-		childFrame->bindings = cons(varPair, childFrame->bindings);
+		bind(childFrame, varSymbol, varValue, inRegion);
 		remaining = cdr(remaining);
 	}
 	Value *toReturn;
@@ -201,44 +314,75 @@ Value *evalLet(Value *args, Frame *frame) {
 			break;
 		}
 	}
+	if (inRegion) {
+		regionRelease(mark);
+	}
 	return toReturn;
 }
 
 /* 
- * Applies a procedure to arguments.
+ * Calls a closure or primitive with arguments.
  */
-Value *apply(Value *function, Value *args) {
-    raiseEvalError("Applying non-procedure", function->type != CLOSURE_TYPE && function->type != PRIMITIVE_TYPE);
+Value *callProcedure(Value *function, Value *args) {
 	if (function->type == CLOSURE_TYPE) {
-		Frame *childFrame = talloc(sizeof(Frame));
-		childFrame->parent = function->cl.frame;
-		childFrame->bindings = makeNull();
+		bool inRegion = !mayCreateClosures(function->cl.body);
+		RegionMark mark = regionMark();
+		Frame *childFrame = newFrame(function->cl.frame, inRegion);
 		Value *argLabels = function->cl.parameters;
+		Value *result;
         if (argLabels->type == CONS_TYPE || argLabels->type == NULL_TYPE) {
             Value *body = function->cl.body;
             Value *labelRemaining = argLabels;
             Value *valueRemaining = args;
             while (labelRemaining->type != NULL_TYPE && valueRemaining->type != NULL_TYPE) {
                 raiseEvalError("Attempting to bind to non-symbol", car(labelRemaining)->type != SYMBOL_TYPE);
-                Value *bindingPair = cons(car(labelRemaining), car(valueRemaining));
-                childFrame->bindings = cons(bindingPair, childFrame->bindings);
+                bind(childFrame, car(labelRemaining), car(valueRemaining), inRegion);
                 labelRemaining = cdr(labelRemaining);
                 valueRemaining = cdr(valueRemaining);
             }
             raiseEvalError("Argument-parameter mismatch!", labelRemaining->type != NULL_TYPE || valueRemaining->type != NULL_TYPE);
-            return eval(body, childFrame);
+            result = eval(body, childFrame);
         } else {
             raiseEvalError("Expected symbol as variadic parameter label", argLabels->type != SYMBOL_TYPE);
             Value *body = function->cl.body;
-            Value *bindingPair = cons(argLabels, args);
-            childFrame->bindings = cons(bindingPair, childFrame->bindings);
-            return eval(body, childFrame);
+            bind(childFrame, argLabels, args, inRegion);
+            result = eval(body, childFrame);
         }
+		if (inRegion) {
+			regionRelease(mark);
+		}
+		return result;
 	} else {
 		return (function->pf)(args);
 	} 
 }
 
+/* 
+ * Applies a procedure to arguments, keeping the profiler's shadow stack
+ * when profiling and tracing sampled closure calls.
+ */
+Value *apply(Value *function, Value *args) {
+    raiseEvalError("Applying non-procedure", function->type != CLOSURE_TYPE && function->type != PRIMITIVE_TYPE);
+    if (profiling || tracing) {
+        bool traced = tracing && function->type == CLOSURE_TYPE && traceSampleCall();
+        if (profiling) {
+            profileEnter(function);
+        }
+        if (traced) {
+            traceBegin(procedureName(function));
+        }
+        Value *result = callProcedure(function, args);
+        if (traced) {
+            traceEnd();
+        }
+        if (profiling) {
+            profileLeave();
+        }
+        return result;
+    }
+    return callProcedure(function, args);
+}
+
 /*
  * Evaluates define statements
  */
@@ -247,8 +391,12 @@ Value *evalDefine(Value *args) {
     Value *label = car(args);
     raiseEvalError("Assignment to non-symbol value", label->type != SYMBOL_TYPE);
     Value *value = eval(car(cdr(args)), top);
+    if (namingProcedures && value->type == CLOSURE_TYPE) {
+        nameProcedure(value->cl.body, label->s);
+    }
     Value *varPair = cons(label, value);
     top->bindings = cons(varPair, top->bindings);
+    bindingGeneration++;
     Value *returnValue = makeNull();
     returnValue->type = VOID_TYPE;
     return returnValue;
@@ -259,9 +407,9 @@ Value *evalDefine(Value *args) {
  */
 Value *evalLetStar(Value *args, Frame *frame) {
 	raiseEvalError("Expected at least 2 arguments, recieved 0", args->type == NULL_TYPE);
-	Frame *childFrame = talloc(sizeof(Frame));
-	childFrame->parent = frame;
-	childFrame->bindings = makeNull();
+	bool inRegion = !mayCreateClosures(args);
+	RegionMark mark = regionMark();
+	Frame *childFrame = newFrame(frame, inRegion);
 	Value *totalBindings = makeNull();
 	Value *remaining = car(args);
 	while (remaining->type != NULL_TYPE) {
@@ -271,13 +419,9 @@ Value *evalLetStar(Value *args, Frame *frame) {
 		raiseEvalError("No value to assign", cdr(pair)->type == NULL_TYPE);
         raiseEvalError("Duplicate symbol in let*", alreadyBound(varSymbol, totalBindings));
 		Value *varValue = eval(car(cdr(pair)), childFrame);
-		Value *varPair = cons(varSymbol, varValue);
-		childFrame->bindings = cons(varPair, childFrame->bindings);
-		totalBindings = cons(varPair, totalBindings);
-		Frame *tmpFrame = childFrame;
-		childFrame = talloc(sizeof(Frame));
-		childFrame->parent = tmpFrame;
-		childFrame->bindings = makeNull();
+		Value *varPair = bind(childFrame, varSymbol, varValue, inRegion);
+		totalBindings = frameCons(varPair, totalBindings, inRegion);
+		childFrame = newFrame(childFrame, inRegion);
 		remaining = cdr(remaining);
 	}
 	Value *toReturn;
@@ -290,6 +434,9 @@ Value *evalLetStar(Value *args, Frame *frame) {
 			break;
 		}
 	}
+	if (inRegion) {
+		regionRelease(mark);
+	}
 	return toReturn;
 }
 
@@ -298,9 +445,9 @@ Value *evalLetStar(Value *args, Frame *frame) {
  */
 Value *evalLetrec(Value *args, Frame *frame) {
 	raiseEvalError("Expected at least 2 arguments, recieved 0", args->type == NULL_TYPE);
-	Frame *childFrame = talloc(sizeof(Frame));
-	childFrame->parent = frame;
-	childFrame->bindings = makeNull();
+	bool inRegion = !mayCreateClosures(args);
+	RegionMark mark = regionMark();
+	Frame *childFrame = newFrame(frame, inRegion);
 	Value *remaining = car(args);
 	Value *parameters = makeNull();
 	while (remaining->type != NULL_TYPE) {
@@ -310,9 +457,8 @@ Value *evalLetrec(Value *args, Frame *frame) {
 		raiseEvalError("No value to assign", cdr(pair)->type == NULL_TYPE);
         raiseEvalError("Duplicate symbol in let", alreadyBound(varSymbol, childFrame->bindings));
 		Value *varValue = car(cdr(pair)); // Don't evaluate yet!
-		Value *varPair = cons(varSymbol, makeNull());
-		parameters = cons(varValue, parameters);
-		childFrame->bindings = cons(varPair, childFrame->bindings);
+		bind(childFrame, varSymbol, makeNull(), inRegion);
+		parameters = frameCons(varValue, parameters, inRegion);
 		remaining = cdr(remaining);
 	}
 	remaining = childFrame->bindings;
@@ -333,34 +479,48 @@ Value *evalLetrec(Value *args, Frame *frame) {
 			break;
 		}
 	}
+	if (inRegion) {
+		regionRelease(mark);
+	}
 	return toReturn;
 }
 
 /*
- * Evaluates set! statements
+ * Evaluates set! statements.  During an isolated evaluation a global is not
+ * changed but shadowed in the isolated frame, so the change goes away with
+ * it (and a shared prelude's pages stay clean); procedures from the prelude
+ * keep seeing the global value.
  */
 Value *evalSet(Value *args, Frame *frame) {
 	raiseEvalError("Expected 2 arguments, recieved 0", args->type == NULL_TYPE);
 	raiseEvalError("Expected 2 arguments, recieved 1", cdr(args)->type == NULL_TYPE);
 	raiseEvalError("Expected 2 arguments, recieved more", cdr(cdr(args))->type != NULL_TYPE);
 	// Traverse the lookup tree in frame
-	Value *remaining = frame->bindings;
-	while (remaining->type != NULL_TYPE) {
-		Value *pair = car(remaining);
-		if (!strcmp(car(args)->s, car(pair)->s)) {
-			pair->c.cdr = eval(car(cdr(args)), frame);
-			Value* toReturn = makeNull();
-			toReturn->type = VOID_TYPE;
-			return toReturn;
+	for (Frame *scope = frame; scope != NULL; scope = scope->parent) {
+		Value *remaining = scope->bindings;
+		while (remaining->type != NULL_TYPE) {
+			Value *pair = car(remaining);
+			if (!strcmp(car(args)->s, car(pair)->s)) {
+				// The new value is evaluated where the set! is, not where
+				// the variable was bound.
+				Value *value = eval(car(cdr(args)), frame);
+				if (scope == globalFrame && isolatedFrame != NULL) {
+					isolatedFrame->bindings = cons(cons(car(pair), value), isolatedFrame->bindings);
+					bindingGeneration++;
+				} else {
+					pair->c.cdr = value;
+				}
+				Value* toReturn = makeNull();
+				toReturn->type = VOID_TYPE;
+				return toReturn;
+			}
+			remaining = cdr(remaining);
 		}
-		remaining = cdr(remaining);
-	}
-	if (frame->parent == NULL) {
-		char* errorString = talloc(sizeof(char) * 32);
-		sprintf(errorString, "Cannot set! undefined symbol '%s'", car(args)->s);
-		raiseEvalError(errorString, true);
 	}
-	return evalSet(args, frame->parent);
+	char* errorString = tallocKind(sizeof(char) * (strlen(car(args)->s) + 32), STRING_ALLOCATION);
+	sprintf(errorString, "Cannot set! undefined symbol '%s'", car(args)->s);
+	raiseEvalError(errorString, true);
+	return NULL;
 }
 
 /* 
@@ -441,58 +601,80 @@ Value *evalCond(Value *args, Frame *frame) {
 Value *makeSpecialForm(char *form) {
 	Value *symbol = makeNull();
 	symbol->type = SYMBOL_TYPE;
-	symbol->s = talloc((strlen(form) + 1) * sizeof(char));
+	symbol->s = tallocKind((strlen(form) + 1) * sizeof(char), STRING_ALLOCATION);
     strcpy(symbol->s, form);
 	return cons(symbol, symbol);
 }
 
 /*
- * Implements the variatic add procedure
+ * Returns whether a value is a number (an integer of any size or a double)
+ */
+bool isNumber(Value *value) {
+    return value->type == INT_TYPE || value->type == BIGNUM_TYPE || value->type == DOUBLE_TYPE;
+}
+
+/*
+ * Returns a number as a double
+ */
+double numberToDouble(Value *number) {
+    return number->type == DOUBLE_TYPE ? number->d : integerToDouble(number);
+}
+
+/*
+ * Implements the variatic add procedure.  Integers are added in 64 bits
+ * until that overflows, then exactly.
  */ 
 Value *primitiveAdd(Value* args) {
 	Value *remaining = args;
-	Value *count = makeNull();
 	bool isInt = true;
-	int resultI = 0;
+	int64_t resultI = 0;
+	// The exact sum, once it has not fit in resultI.
+	Value *resultBig = NULL;
 	double resultD = 0;
 	while (remaining->type != NULL_TYPE) {
 		Value *summand = car(remaining);
-		raiseEvalError("Expected number in add", summand->type != INT_TYPE && summand->type != DOUBLE_TYPE);
+		raiseEvalError("Expected number in add", !isNumber(summand));
 		if (summand->type == DOUBLE_TYPE) {
 			isInt = false;
 			resultD += summand->d;
 		} else {
-			resultD += summand->i;
-			resultI += summand->i;
+			int64_t sum;
+			resultD += integerToDouble(summand);
+			if (resultBig != NULL) {
+				resultBig = integerAdd(resultBig, summand);
+			} else if (summand->type == BIGNUM_TYPE || __builtin_add_overflow(resultI, summand->i, &sum)) {
+				resultBig = integerAdd(makeInteger(resultI), summand);
+			} else {
+				resultI = sum;
+			}
 		}
 		remaining = cdr(remaining);
 	}
-	if (isInt) {
-		count->type = INT_TYPE;
-		count->i = resultI;
-	} else {
+	if (!isInt) {
+		Value *count = makeNull();
 		count->type = DOUBLE_TYPE;
 		count->d = resultD;
+		return count;
 	}
-	return count;
+	return resultBig != NULL ? resultBig : makeInteger(resultI);
 }
 
 /*
  * Evaluates modulo statements
  */
 Value *primitiveModulo(Value *args) {
-    Value *toReturn = makeNull();
+    Value *toReturn;
     raiseEvalError("Expected 2 arguments, recieved 0", args->type == NULL_TYPE);
     raiseEvalError("Expected 2 arguments, recieved 1", cdr(args)->type == NULL_TYPE);
     raiseEvalError("Expected 2 arguments, recieved more", cdr(cdr(args))->type != NULL_TYPE);
-    raiseEvalError("Expected integer", car(args)->type != INT_TYPE);
-    raiseEvalError("Expected integer", car(cdr(args))->type != INT_TYPE);
-    toReturn->type = INT_TYPE;
-    int modded = car(args)->i % car(cdr(args))->i;
-    if (modded < 0 && car(cdr(args))->i > 0) {
-        modded = modded + car(cdr(args))->i;
+    raiseEvalError("Expected integer", !isInteger(car(args)));
+    raiseEvalError("Expected integer", !isInteger(car(cdr(args))));
+    raiseEvalError("Division by 0.", integerIsZero(car(cdr(args))));
+    Value *divisor = car(cdr(args));
+    integerDivide(car(args), divisor, NULL, &toReturn);
+    if (integerIsNegative(toReturn) && !integerIsNegative(divisor)) {
+        toReturn = integerAdd(toReturn, divisor);
     }
-    toReturn->i = modded;
     return toReturn;
 }
 
@@ -505,8 +687,8 @@ Value *primitiveZero(Value *args) {
     raiseEvalError("Expected 1 argument, recieved more", cdr(args)->type != NULL_TYPE);
     Value *toCheck = car(args);
     toReturn->type = BOOL_TYPE;
-    if (toCheck->type == INT_TYPE) {
-        if (toCheck->i == 0) {
+    if (isInteger(toCheck)) {
+        if (integerIsZero(toCheck)) {
             makeTrue(toReturn);
         } else {
             makeFalse(toReturn);
@@ -524,30 +706,129 @@ Value *primitiveZero(Value *args) {
 }
 
 /*
- * Helper function for equal? that checks if two trees are equal
+ * Checks whether two strings have the same characters
+ */
+static bool stringsAreEqual(Value *string1, Value *string2) {
+    return string1->str.length == string2->str.length
+        && memcmp(string1->str.chars, string2->str.chars, string1->str.length) == 0;
+}
+
+/*
+ * Compares two values of the same type that are not pairs or vectors
+ */
+static bool atomsAreEqual(Value *tree1, Value *tree2) {
+    switch(tree1->type) {
+        case NULL_TYPE: return true;
+        case BOOL_TYPE: return strcmp(tree1->s, tree2->s) == 0;
+        case INT_TYPE: return tree1->i == tree2->i;
+        case BIGNUM_TYPE: return integerCompare(tree1, tree2) == 0;
+        case DOUBLE_TYPE: return tree1->d == tree2->d;
+        case SYMBOL_TYPE: return strcmp(tree1->s, tree2->s) == 0;
+        case STR_TYPE: return stringsAreEqual(tree1, tree2);
+        case CLOSURE_TYPE: return tree1 == tree2;
+        case PTR_TYPE: return tree1->p == tree2->p;
+        case OPEN_TYPE: return true;
+        case CLOSE_TYPE: return true;
+        case VOID_TYPE: return true;
+        case PRIMITIVE_TYPE: return tree1->pf == tree2->pf;
+        case QUOTE_TYPE: return true;
+        case HASH_TYPE: return tree1 == tree2;
+        case STRING_BUILDER_TYPE: return tree1 == tree2;
+        case F64VECTOR_TYPE:
+        case S64VECTOR_TYPE:
+            if (tree1->n.length != tree2->n.length) {
+                return false;
+            }
+            for (int i = 0; i < tree1->n.length; i++) {
+                if (tree1->type == F64VECTOR_TYPE ? tree1->n.f64[i] != tree2->n.f64[i]
+                                                  : tree1->n.s64[i] != tree2->n.s64[i]) {
+                    return false;
+                }
+            }
+            return true;
+        default: return true;
+    }
+}
+
+// Pairs of subtrees treesAreEqual() can hold before it mallocs a bigger stack.
+#define EQUAL_STACK_SIZE 32
+
+/*
+ * Helper function for equal? that checks if two trees are equal.  Cdrs are
+ * followed in a loop and the cars and vector elements still to compare wait
+ * on an explicit stack, so long or deep lists don't overflow the C stack.
  */
 bool treesAreEqual(Value *tree1, Value *tree2) {
-    if (tree1->type != tree2->type) {
-        return false;
-    } else {
-        switch(tree1->type) {
-            case NULL_TYPE: return true;
-            case BOOL_TYPE: return strcmp(tree1->s, tree2->s) == 0;
-            case INT_TYPE: return tree1->i == tree2->i;
-            case DOUBLE_TYPE: return tree1->d == tree2->i;
-            case SYMBOL_TYPE: return strcmp(tree1->s, tree2->s) == 0;
-            case STR_TYPE: return strcmp(tree1->s, tree2->s) == 0;
-            case CONS_TYPE: return treesAreEqual(car(tree1), car(tree2)) && treesAreEqual(cdr(tree1), cdr(tree2));
-            case CLOSURE_TYPE: return tree1 == tree2;
-            case PTR_TYPE: return tree1->p == tree2->p;
-            case OPEN_TYPE: return true;
-            case CLOSE_TYPE: return true;
-            case VOID_TYPE: return true;
-            case PRIMITIVE_TYPE: return tree1->pf == tree2->pf;
-            case QUOTE_TYPE: return true;
+    Value *initial[EQUAL_STACK_SIZE * 2];
+    Value **pending = initial;
+    int count = 0;
+    int capacity = EQUAL_STACK_SIZE;
+    bool equal = true;
+    while (equal) {
+        if (tree1->type != tree2->type) {
+            equal = false;
+            break;
+        }
+        int more = tree1->type == CONS_TYPE ? 1 : tree1->type == VECTOR_TYPE ? tree1->v.length : 0;
+        if (tree1->type == VECTOR_TYPE && tree1->v.length != tree2->v.length) {
+            equal = false;
+            break;
+        }
+        if (count + more > capacity) {
+            while (count + more > capacity) {
+                capacity *= 2;
+            }
+            Value **grown = malloc(capacity * 2 * sizeof(Value *));
+            if (grown == NULL) {
+                outOfMemoryError();
+            }
+            memcpy(grown, pending, count * 2 * sizeof(Value *));
+            if (pending != initial) {
+                free(pending);
+            }
+            pending = grown;
+        }
+        if (tree1->type == CONS_TYPE) {
+            Value *car1 = car(tree1);
+            Value *car2 = car(tree2);
+            // Elements that are atoms are compared on the way past.
+            if (car1->type != car2->type) {
+                equal = false;
+                break;
+            } else if (car1->type == CONS_TYPE || car1->type == VECTOR_TYPE) {
+                pending[count * 2] = car1;
+                pending[count * 2 + 1] = car2;
+                count++;
+            } else if (!atomsAreEqual(car1, car2)) {
+                equal = false;
+                break;
+            }
+            tree1 = cdr(tree1);
+            tree2 = cdr(tree2);
+            continue;
         }
+        if (tree1->type == VECTOR_TYPE) {
+            // Pushed last to first so the first elements are compared first.
+            for (int i = tree1->v.length - 1; i >= 0; i--) {
+                pending[count * 2] = tree1->v.items[i];
+                pending[count * 2 + 1] = tree2->v.items[i];
+                count++;
+            }
+        } else if (!atomsAreEqual(tree1, tree2)) {
+            equal = false;
+            break;
+        }
+        if (count == 0) {
+            break;
+        }
+        count--;
+        tree1 = pending[count * 2];
+        tree2 = pending[count * 2 + 1];
     }
-    return true;
+    if (pending != initial) {
+        free(pending);
+    }
+    return equal;
 }
 
 /*
@@ -622,9 +903,13 @@ Value *primitiveEqualsSign(Value *args) {
     Value *last = NULL;
     while (args->type != NULL_TYPE) {
         Value *now = car(args);
+        raiseEvalError("Expected number", !isNumber(now));
         if (last != NULL) {
-            raiseEvalError("Expected number", now->type != INT_TYPE && now->type != DOUBLE_TYPE);
-            equals = ((now->type == INT_TYPE) ? now->i : now->d) == ((last->type == INT_TYPE) ? last->i : last->d);
+            if (isInteger(now) && isInteger(last)) {
+                equals = integerCompare(now, last) == 0;
+            } else {
+                equals = numberToDouble(now) == numberToDouble(last);
+            }
         }
         args = cdr(args);
         last = now;
@@ -701,86 +986,100 @@ Value *primitiveApply(Value *args) {
 Value *primitiveError(Value *args) {
     raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
     raiseEvalError("Expected string argument, did not recieve", car(args)->type != STR_TYPE);
-    raiseEvalError(car(args)->s, true);
+    raiseEvalError(stringChars(car(args)), true);
     return args;
 }
 
 /*
- * Implements the variatic multiply procedure
+ * Implements the variatic multiply procedure.  Integers are multiplied in
+ * 64 bits until that overflows, then exactly.
  */ 
 Value *primitiveMultiply(Value* args) {
 	Value *remaining = args;
-	Value *count = makeNull();
 	bool isInt = true;
-	int resultI = 1;
+	int64_t resultI = 1;
+	// The exact product, once it has not fit in resultI.
+	Value *resultBig = NULL;
 	double resultD = 1;
 	while (remaining->type != NULL_TYPE) {
 		Value *toMultiply = car(remaining);
-		raiseEvalError("Expected number in multiply", toMultiply->type != INT_TYPE && toMultiply->type != DOUBLE_TYPE);
+		raiseEvalError("Expected number in multiply", !isNumber(toMultiply));
 		if (toMultiply->type == DOUBLE_TYPE) {
 			isInt = false;
 			resultD *= toMultiply->d;
 		} else {
-			resultD *= toMultiply->i;
-			resultI *= toMultiply->i;
+			int64_t product;
+			resultD *= integerToDouble(toMultiply);
+			if (resultBig != NULL) {
+				resultBig = integerMultiply(resultBig, toMultiply);
+			} else if (toMultiply->type == BIGNUM_TYPE || __builtin_mul_overflow(resultI, toMultiply->i, &product)) {
+				resultBig = integerMultiply(makeInteger(resultI), toMultiply);
+			} else {
+				resultI = product;
+			}
 		}
 		remaining = cdr(remaining);
 	}
-	if (isInt) {
-		count->type = INT_TYPE;
-		count->i = resultI;
-	} else {
+	if (!isInt) {
+		Value *count = makeNull();
 		count->type = DOUBLE_TYPE;
 		count->d = resultD;
+		return count;
 	}
-	return count;
+	return resultBig != NULL ? resultBig : makeInteger(resultI);
 }
 
 /*
- * Implements the variatic subtract procedure
+ * Implements the variatic subtract procedure.  Integers are subtracted in
+ * 64 bits until that overflows, then exactly.
  */ 
 Value *primitiveSubtract(Value* args) {
 	Value *remaining = args;
     raiseEvalError("Subtraction requires at least one argument.", remaining->type == NULL_TYPE);
-	Value *count = makeNull();
-    bool oneDigit = true;
-    bool firstIsInt = true;
-	double result = 0;
     Value *first = car(remaining);
+    raiseEvalError("Expected number in subtract", !isNumber(first));
     remaining = cdr(remaining);
-    if (first->type == DOUBLE_TYPE) {
-        firstIsInt = false;
+    if (remaining->type == NULL_TYPE) {
+        if (first->type != DOUBLE_TYPE) {
+            return integerNegate(first);
+        }
+        Value *count = makeNull();
+        count->type = DOUBLE_TYPE;
+        count->d = -first->d;
+        return count;
     }
+    bool isInt = first->type != DOUBLE_TYPE;
+    int64_t resultI = first->type == INT_TYPE ? first->i : 0;
+    // The exact difference, once it has not fit in resultI.
+    Value *resultBig = first->type == BIGNUM_TYPE ? first : NULL;
+	double result = 0;
 	while (remaining->type != NULL_TYPE) {
-        oneDigit = false;
 		Value *toSubtract = car(remaining);
-		raiseEvalError("Expected number in subtract", toSubtract->type != INT_TYPE && toSubtract->type != DOUBLE_TYPE);
+		raiseEvalError("Expected number in subtract", !isNumber(toSubtract));
 		if (toSubtract->type == DOUBLE_TYPE) {
+			isInt = false;
 			result += toSubtract->d;
 		} else {
-			result += toSubtract->i;
+			int64_t difference;
+			result += integerToDouble(toSubtract);
+			if (!isInt) {
+				// The answer will be a double anyway.
+			} else if (resultBig != NULL) {
+				resultBig = integerSubtract(resultBig, toSubtract);
+			} else if (toSubtract->type == BIGNUM_TYPE || __builtin_sub_overflow(resultI, toSubtract->i, &difference)) {
+				resultBig = integerSubtract(makeInteger(resultI), toSubtract);
+			} else {
+				resultI = difference;
+			}
 		}
 		remaining = cdr(remaining);
 	}
-    if (oneDigit) {
-        if (firstIsInt) {
-            count->type = INT_TYPE;
-            count->i = -first->i;
-        }
-        else {
-            count->type = DOUBLE_TYPE;
-            count->d = -first->d;
-        }
-    }
-    else {
-        count->type = DOUBLE_TYPE;
-        if (firstIsInt){
-            count->d = first->i - result;
-        }
-        else {
-            count->d = first->d - result;
-        }
+    if (isInt) {
+        return resultBig != NULL ? resultBig : makeInteger(resultI);
     }
+	Value *count = makeNull();
+    count->type = DOUBLE_TYPE;
+    count->d = numberToDouble(first) - result;
 	return count;
 }
 
@@ -792,44 +1091,28 @@ Value *primitiveDivide(Value* args) {
     raiseEvalError("Division requires at least one argument.", remaining->type == NULL_TYPE);
 	Value *count = makeNull();
     bool oneDigit = true;
-    bool firstIsInt = true;
 	double result = 1;
     Value *first = car(remaining);
+    raiseEvalError("Expected number in divide", !isNumber(first));
     remaining = cdr(remaining);
-    if (first->type == DOUBLE_TYPE) {
-        firstIsInt = false;
-    }
 	while (remaining->type != NULL_TYPE) {
         oneDigit = false;
 		Value *toDivide = car(remaining);
-		raiseEvalError("Expected number in divide", toDivide->type != INT_TYPE && toDivide->type != DOUBLE_TYPE);
+		raiseEvalError("Expected number in divide", !isNumber(toDivide));
 		if (toDivide->type == DOUBLE_TYPE) {
             raiseEvalError("Division by 0.", toDivide->d == 0);
-			result *= toDivide->d;
 		} else {
-            raiseEvalError("Division by 0.", toDivide->i == 0);
-			result *= toDivide->i;
+            raiseEvalError("Division by 0.", integerIsZero(toDivide));
 		}
+		result *= numberToDouble(toDivide);
 		remaining = cdr(remaining);
 	}
+    count->type = DOUBLE_TYPE;
     if (oneDigit) {
-        if (firstIsInt) {
-            count->type = DOUBLE_TYPE;
-            count->d = 1.0/first->i;
-        }
-        else {
-            count->type = DOUBLE_TYPE;
-            count->d = 1.0/first->d;
-        }
+        count->d = 1.0/numberToDouble(first);
     }
     else {
-        count->type = DOUBLE_TYPE;
-        if (firstIsInt){
-            count->d = first->i / result;
-        }
-        else {
-            count->d = first->d / result;
-        }
+        count->d = numberToDouble(first) / result;
     }
 	return count;
 }
@@ -842,35 +1125,21 @@ Value *primitiveLeq(Value* args) {
     raiseEvalError("Expected at least 2 arguments, got 0.", car(remaining)->type == NULL_TYPE);
     raiseEvalError("Expected at least 2 arguments, got 1.", cdr(remaining)->type == NULL_TYPE);
 	Value *previous = car(remaining);
-    raiseEvalError("Expected number in less than or equal to", previous->type != INT_TYPE && previous->type != DOUBLE_TYPE);
+    raiseEvalError("Expected number in less than or equal to", !isNumber(previous));
     remaining = cdr(remaining);
     Value *result = makeNull();
     result->type = BOOL_TYPE;
     result->s = "#t";
 	while (remaining->type != NULL_TYPE) {
 		Value *current = car(remaining);
-		raiseEvalError("Expected number in less than or equal to", current->type != INT_TYPE && current->type != DOUBLE_TYPE);
-		if (current->type == DOUBLE_TYPE) {
-            if (previous->type == DOUBLE_TYPE){
-                if (previous->d > current->d) {
-                    result->s = "#f";
-                }
-            }
-            else {
-                if (previous->i > current->d) {
-                    result->s = "#f";
-                }
+		raiseEvalError("Expected number in less than or equal to", !isNumber(current));
+		if (isInteger(current) && isInteger(previous)) {
+            if (integerCompare(previous, current) > 0) {
+                result->s = "#f";
             }
 		} else {
-			if (previous->type == DOUBLE_TYPE){
-                if (previous->d > current->i) {
-                    result->s = "#f";
-                }
-            }
-            else {
-                if (previous->i > current->i) {
-                    result->s = "#f";
-                }
+            if (numberToDouble(previous) > numberToDouble(current)) {
+                result->s = "#f";
             }
 		}
 		remaining = cdr(remaining);
@@ -896,14 +1165,45 @@ Value *primitivePair(Value *args) {
 }
 
 /*
- * Recursively evaluate all the arguments in a combination and returns them
- * in order
+ * Evaluates all the arguments in a combination, left to right, and returns
+ * them in order
  */
 Value *recursiveEval(Value *remaining, Frame *frame) {
-    if (remaining->type == NULL_TYPE) {
-        return makeNull();
-    } else {
-        return cons(eval(car(remaining), frame), recursiveEval(cdr(remaining), frame));
+    Value *end = makeNull();
+    Value *results = end;
+    Value *last = NULL;
+    while (remaining->type != NULL_TYPE) {
+        Value *pair = cons(eval(car(remaining), frame), end);
+        if (last == NULL) {
+            results = pair;
+        } else {
+            last->c.cdr = pair;
+        }
+        last = pair;
+        remaining = cdr(remaining);
+    }
+    return results;
+}
+
+/*
+ * Helper function for eq? (and eq? hash tables) that checks if two values
+ * are the same object, or the same number, string, symbol or boolean
+ */
+bool valuesAreEq(Value *value1, Value *value2) {
+    if (value1->type != value2->type) {
+        return false;
+    }
+    switch (value1->type) {
+        case NULL_TYPE: return true;
+        case PRIMITIVE_TYPE:
+        case CLOSURE_TYPE: return value1->s == value2->s;
+        case BOOL_TYPE:
+        case SYMBOL_TYPE: return strcmp(value1->s, value2->s) == 0;
+        case STR_TYPE: return stringsAreEqual(value1, value2);
+        case INT_TYPE: return value1->i == value2->i;
+        case BIGNUM_TYPE: return integerCompare(value1, value2) == 0;
+        case DOUBLE_TYPE: return value1->d == value2->d;
+        default: return value1 == value2;
     }
 }
 
@@ -916,133 +1216,1880 @@ Value *primitiveEq(Value *args) {
 	raiseEvalError("Expected 2 arguments, got more than 2", cdr(cdr(args))->type != NULL_TYPE);
     Value *eq = makeNull();
     eq->type = BOOL_TYPE;
-    if (car(args)->type != car(cdr(args))->type) {
-        eq->s = "#f";
-    }
-    else if (car(args)->type == NULL_TYPE) {
+    if (valuesAreEq(car(args), car(cdr(args)))) {
         eq->s = "#t";
     }
-    else if (car(args)->type == CONS_TYPE) {
-        if (&car(args)->c.car == &car(cdr(args))->c.car && &car(args)->c.cdr == &car(cdr(args))->c.cdr){
-            eq->s = "#t";
-        }
-        else {
-            eq->s = "#f";
-        }
-    }
-    else if (car(args)->type == PRIMITIVE_TYPE || car(args)->type == CLOSURE_TYPE) {
-        if (car(args)->s == car(cdr(args))->s) {
-            eq->s = "#t";
-        }
-        else {
-            eq->s = "#f";
-        }
+    else {
+        eq->s = "#f";
     }
-    else if (car(args)->type == BOOL_TYPE || car(args)->type == SYMBOL_TYPE || car(args)->type == STR_TYPE) {
-        if (strcmp(car(args)->s,car(cdr(args))->s)) {
-            eq->s = "#f";
-        }
-        else {
-            eq->s = "#t";
-        }
+	return eq;
+}
+
+/*
+ * Implements the primitive eqv? procedure, the same as eq? since that
+ * already compares numbers, strings and symbols by value
+ */
+Value *primitiveEqv(Value *args) {
+    return primitiveEq(args);
+}
+
+/*
+ * Implements the primitive load procedure, which evaluates every expression
+ * in a source file in the global environment
+ */
+Value *primitiveLoad(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    raiseEvalError("Expected string argument, did not recieve", car(args)->type != STR_TYPE);
+    char *fileName = stringChars(car(args));
+    Value *tree = parseFile(fileName);
+    if (tree == NULL) {
+        char *errorString = tallocKind(strlen(fileName) + 32, STRING_ALLOCATION);
+        sprintf(errorString, "Cannot load '%s'", fileName);
+        raiseEvalError(errorString, true);
     }
-    else if (car(args)->type == INT_TYPE) {
-        if (car(args)->i == car(cdr(args))->i) {
-            eq->s = "#t";
-        }
-        else {
-            eq->s = "#f";
-        }
+    while (tree->type != NULL_TYPE) {
+        eval(car(tree), top);
+        tree = cdr(tree);
     }
-    else if (car(args)->type == DOUBLE_TYPE) {
-        if (car(args)->d == car(cdr(args))->d) {
-            eq->s = "#t";
-        }        
+    Value *returnValue = makeNull();
+    returnValue->type = VOID_TYPE;
+    return returnValue;
+}
+
+/*
+ * Implements the primitive write-binary procedure, which saves a value to a
+ * file in the binary encoding from serialize.h
+ */
+Value *primitiveWriteBinary(Value *args) {
+    raiseEvalError("Expected 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got more", cdr(cdr(args))->type != NULL_TYPE);
+    raiseEvalError("Expected string as file name", car(cdr(args))->type != STR_TYPE);
+    raiseEvalError("write-binary: cannot encode value or write file", !writeBinaryFile(car(args), stringChars(car(cdr(args)))));
+    Value *returnValue = makeNull();
+    returnValue->type = VOID_TYPE;
+    return returnValue;
+}
+
+/*
+ * Implements the primitive read-binary procedure, which reads back a value
+ * saved by write-binary
+ */
+Value *primitiveReadBinary(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    raiseEvalError("Expected string as file name", car(args)->type != STR_TYPE);
+    Value *value = readBinaryFile(stringChars(car(args)));
+    raiseEvalError("read-binary: cannot read file or file is malformed", value == NULL);
+    return value;
+}
+
+/*
+ * Checks that a vector and an index into it were given, returning the index
+ */
+int vectorIndex(Value *vector, Value *index) {
+    raiseEvalError("Expected vector", vector->type != VECTOR_TYPE);
+    raiseEvalError("Expected integer index", index->type != INT_TYPE);
+    raiseEvalError("Vector index out of range", index->i < 0 || index->i >= vector->v.length);
+    return index->i;
+}
+
+/*
+ * Evaluates make-vector statements, returning a vector of the given length
+ * filled with the second argument (or 0)
+ */
+Value *primitiveMakeVector(Value *args) {
+    raiseEvalError("Expected 1 or 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 or 2 arguments, got more", cdr(args)->type != NULL_TYPE && cdr(cdr(args))->type != NULL_TYPE);
+    raiseEvalError("Expected non-negative integer length", car(args)->type != INT_TYPE || car(args)->i < 0);
+    raiseEvalError("Vector length too large", car(args)->i > INT_MAX);
+    Value *fill;
+    if (cdr(args)->type != NULL_TYPE) {
+        fill = car(cdr(args));
+    } else {
+        fill = makeNull();
+        fill->type = INT_TYPE;
+        fill->i = 0;
     }
-	return eq;
+    return makeVector(car(args)->i, fill);
 }
 
 /*
- * Sets up builtins and special forms to be bound properly
+ * Evaluates vector statements, returning a vector of the arguments
  */
-Frame *setUpBindings() {
-	Frame *top = talloc(sizeof(Frame));
-	top->parent = NULL;
-	Value *head = makeNull();
-    head = cons(makeSpecialForm("if"), head);
-	head = cons(makeSpecialForm("quote"), head);
-	head = cons(makeSpecialForm("let"), head);
-    head = cons(makeSpecialForm("define"), head);
-    head = cons(makeSpecialForm("lambda"), head);
-    head = cons(makeSpecialForm("let*"), head);
-    head = cons(makeSpecialForm("letrec"), head);
-    head = cons(makeSpecialForm("cond"), head);
-    head = cons(makeSpecialForm("set!"), head);
-    head = cons(makeSpecialForm("and"), head);
-    head = cons(makeSpecialForm("or"), head);
-    head = cons(makeSpecialForm("begin"), head);
-    head = cons(makeSpecialForm("else"), head);
-	top->bindings = head;
-	bind("+", primitiveAdd, top);
-	bind("cons", primitiveCons, top);
-	bind("car", primitiveCar, top);
-	bind("cdr", primitiveCdr, top);
-	bind("null?", primitiveNull, top);
-    bind("apply", primitiveApply, top);
-    bind("modulo", primitiveModulo, top);
-    bind("zero?", primitiveZero, top);
-    bind("equal?", primitiveEqual, top);
-    bind("list", primitiveList, top);
-    bind("append", primitiveAppend, top);
-    bind("=", primitiveEqualsSign, top);
-    bind("error", primitiveError, top);
-    bind("*", primitiveMultiply, top);
-    bind("-", primitiveSubtract, top);
-    bind("/", primitiveDivide, top);
-    bind("<=", primitiveLeq, top);
-    bind("eq?", primitiveEq, top);
-    bind("pair?", primitivePair, top);
-    bind("apply", primitiveApply, top);
-	return top;
+Value *primitiveVector(Value *args) {
+    return listToVector(args);
 }
 
 /*
- * Handles a list of S-expressions (ie a Scheme program), calls eval()
- * on each S-expression in the top-level (global) environment, and
- * prints each result in turn.
+ * Evaluates vector-ref statements
  */
-void interpret(Value *tree) {
-	if (top == NULL) {
-		// Initialize bindings the first time
-		top = setUpBindings();
-	}
-	Value *remaining = tree;
-	while (remaining->type != NULL_TYPE) {
-		printValue(eval(car(remaining), top));
-		remaining = cdr(remaining);
-        sweep(remaining, top); //collect garbage
-	}
+Value *primitiveVectorRef(Value *args) {
+    raiseEvalError("Expected 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got more than 2", cdr(cdr(args))->type != NULL_TYPE);
+    return car(args)->v.items[vectorIndex(car(args), car(cdr(args)))];
 }
 
 /*
- * Takes a parse tree of a single S-expression and an environment frame in
- * which to evaluate the expression, then returns a pointer to a Value 
- * representing the evaluated value. 
+ * Evaluates vector-set! statements
  */
-Value *eval(Value *expr, Frame *frame){
-	switch (expr->type) {
-		case INT_TYPE:
-			return expr;
-			break;
-		case STR_TYPE:
-			return expr;
-			break;
-		case DOUBLE_TYPE:
-			return expr;
-			break;
-		case NULL_TYPE:
-			return expr;
-			break;
+Value *primitiveVectorSet(Value *args) {
+    raiseEvalError("Expected 3 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got 2", cdr(cdr(args))->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got more than 3", cdr(cdr(cdr(args)))->type != NULL_TYPE);
+    car(args)->v.items[vectorIndex(car(args), car(cdr(args)))] = car(cdr(cdr(args)));
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates vector-length statements
+ */
+Value *primitiveVectorLength(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    raiseEvalError("Expected vector", car(args)->type != VECTOR_TYPE);
+    Value *toReturn = makeNull();
+    toReturn->type = INT_TYPE;
+    toReturn->i = car(args)->v.length;
+    return toReturn;
+}
+
+/*
+ * Evaluates vector->list statements
+ */
+Value *primitiveVectorToList(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    raiseEvalError("Expected vector", car(args)->type != VECTOR_TYPE);
+    Value *vector = car(args);
+    Value *list = makeNull();
+    for (int i = vector->v.length - 1; i >= 0; i--) {
+        list = cons(vector->v.items[i], list);
+    }
+    return list;
+}
+
+/*
+ * Evaluates list->vector statements
+ */
+Value *primitiveListToVector(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *list = car(args);
+    while (list->type == CONS_TYPE) {
+        list = cdr(list);
+    }
+    raiseEvalError("Expected a proper list", list->type != NULL_TYPE);
+    return listToVector(car(args));
+}
+
+/*
+ * Evaluates vector-fill! statements
+ */
+Value *primitiveVectorFill(Value *args) {
+    raiseEvalError("Expected 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got more than 2", cdr(cdr(args))->type != NULL_TYPE);
+    raiseEvalError("Expected vector", car(args)->type != VECTOR_TYPE);
+    Value *vector = car(args);
+    for (int i = 0; i < vector->v.length; i++) {
+        vector->v.items[i] = car(cdr(args));
+    }
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates vector? statements
+ */
+Value *primitiveIsVector(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    if (car(args)->type == VECTOR_TYPE) {
+        makeTrue(result);
+    } else {
+        makeFalse(result);
+    }
+    return result;
+}
+
+/*
+ * Returns the kind of table asked for by make-hash-table's argument: eq? or
+ * equal?, or one of the symbols eq, eqv and equal.  eqv? would be the same
+ * as eq?, which already compares numbers by value.
+ */
+hashKind hashKindOf(Value *equality) {
+    if (equality->type == PRIMITIVE_TYPE && (equality->pf == primitiveEq || equality->pf == primitiveEqv)) {
+        return EQ_HASH;
+    } else if (equality->type == PRIMITIVE_TYPE && equality->pf == primitiveEqual) {
+        return EQUAL_HASH;
+    } else if (equality->type == SYMBOL_TYPE && (!strcmp(equality->s, "eq") || !strcmp(equality->s, "eqv"))) {
+        return EQ_HASH;
+    }
+    raiseEvalError("Expected eq?, eqv?, equal? or one of eq, eqv and equal",
+                   equality->type != SYMBOL_TYPE || strcmp(equality->s, "equal"));
+    return EQUAL_HASH;
+}
+
+/*
+ * Checks that a hash table was given, returning it
+ */
+HashTable *hashTableArgument(Value *table) {
+    raiseEvalError("Expected hash table", table->type != HASH_TYPE);
+    return table->h;
+}
+
+/*
+ * Evaluates make-hash-table statements, returning an empty table comparing
+ * keys with equal? unless told otherwise
+ */
+Value *primitiveMakeHashTable(Value *args) {
+    raiseEvalError("Expected 0 or 1 arguments, got more", args->type != NULL_TYPE && cdr(args)->type != NULL_TYPE);
+    Value *table = makeNull();
+    table->type = HASH_TYPE;
+    table->h = newHashTable(args->type == NULL_TYPE ? EQUAL_HASH : hashKindOf(car(args)));
+    return table;
+}
+
+/*
+ * Evaluates hash-table-ref statements, returning the value of a key.  If the
+ * key is missing, a third argument that is a procedure is called with no
+ * arguments for the result, and any other is returned as it is.
+ */
+Value *primitiveHashTableRef(Value *args) {
+    raiseEvalError("Expected 2 or 3 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 or 3 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    Value *rest = cdr(cdr(args));
+    raiseEvalError("Expected 2 or 3 arguments, got more", rest->type != NULL_TYPE && cdr(rest)->type != NULL_TYPE);
+    Value *value = hashTableGet(hashTableArgument(car(args)), car(cdr(args)));
+    if (value == NULL) {
+        raiseEvalError("Key not found in hash table", rest->type == NULL_TYPE);
+        value = car(rest);
+        if (value->type == CLOSURE_TYPE || value->type == PRIMITIVE_TYPE) {
+            value = apply(value, makeNull());
+        }
+    }
+    return value;
+}
+
+/*
+ * Evaluates hash-table-set! statements
+ */
+Value *primitiveHashTableSet(Value *args) {
+    raiseEvalError("Expected 3 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got 2", cdr(cdr(args))->type == NULL_TYPE);
+    raiseEvalError("Expected 3 arguments, got more than 3", cdr(cdr(cdr(args)))->type != NULL_TYPE);
+    hashTablePut(hashTableArgument(car(args)), car(cdr(args)), car(cdr(cdr(args))));
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates hash-table-delete! statements
+ */
+Value *primitiveHashTableDelete(Value *args) {
+    raiseEvalError("Expected 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got more than 2", cdr(cdr(args))->type != NULL_TYPE);
+    hashTableRemove(hashTableArgument(car(args)), car(cdr(args)));
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates hash-table-count statements, returning the number of keys
+ */
+Value *primitiveHashTableCount(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *toReturn = makeNull();
+    toReturn->type = INT_TYPE;
+    toReturn->i = hashTableArgument(car(args))->count;
+    return toReturn;
+}
+
+/*
+ * Conses a (key . value) pair onto the list in context
+ */
+static void collectEntry(Value *key, Value *value, void *context) {
+    Value **entries = context;
+    *entries = cons(cons(key, value), *entries);
+}
+
+/*
+ * Returns a table's entries as a list of (key . value) pairs
+ */
+Value *hashTableEntries(Value *table) {
+    Value *entries = makeNull();
+    forEachHashEntry(hashTableArgument(table), collectEntry, &entries);
+    return entries;
+}
+
+/*
+ * Evaluates hash-table->alist statements
+ */
+Value *primitiveHashTableToAlist(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    return hashTableEntries(car(args));
+}
+
+/*
+ * Evaluates hash-table-keys statements
+ */
+Value *primitiveHashTableKeys(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *keys = makeNull();
+    for (Value *entry = hashTableEntries(car(args)); entry->type == CONS_TYPE; entry = cdr(entry)) {
+        keys = cons(car(car(entry)), keys);
+    }
+    return keys;
+}
+
+/*
+ * Evaluates hash-table-values statements
+ */
+Value *primitiveHashTableValues(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *values = makeNull();
+    for (Value *entry = hashTableEntries(car(args)); entry->type == CONS_TYPE; entry = cdr(entry)) {
+        values = cons(cdr(car(entry)), values);
+    }
+    return values;
+}
+
+/*
+ * Evaluates hash-table-walk statements, calling a procedure with each key
+ * and value.  The entries are gathered first, so the procedure may change
+ * the table.
+ */
+Value *primitiveHashTableWalk(Value *args) {
+    raiseEvalError("Expected 2 arguments, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got 1", cdr(args)->type == NULL_TYPE);
+    raiseEvalError("Expected 2 arguments, got more than 2", cdr(cdr(args))->type != NULL_TYPE);
+    Value *procedure = car(cdr(args));
+    raiseEvalError("Expected procedure/primitive", procedure->type != CLOSURE_TYPE && procedure->type != PRIMITIVE_TYPE);
+    for (Value *entry = hashTableEntries(car(args)); entry->type == CONS_TYPE; entry = cdr(entry)) {
+        apply(procedure, cons(car(car(entry)), cons(cdr(car(entry)), makeNull())));
+    }
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates hash-table? statements
+ */
+Value *primitiveIsHashTable(Value *args) {
+    raiseEvalError("Expected 1 argument, got 0", args->type == NULL_TYPE);
+    raiseEvalError("Expected 1 argument, got more", cdr(args)->type != NULL_TYPE);
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    if (car(args)->type == HASH_TYPE) {
+        makeTrue(result);
+    } else {
+        makeFalse(result);
+    }
+    return result;
+}
+
+/*
+ * Checks that between min and max arguments were given
+ */
+static void checkArgumentCount(Value *args, int min, int max) {
+    int count = 0;
+    for (Value *rest = args; rest->type == CONS_TYPE; rest = cdr(rest)) {
+        count++;
+    }
+    raiseEvalError("Too few arguments", count < min);
+    raiseEvalError("Too many arguments", count > max);
+}
+
+/*
+ * Checks that a value is an f64vector or s64vector, as type says
+ */
+static Value *numericVectorArgument(Value *value, valueType type) {
+    raiseEvalError(type == F64VECTOR_TYPE ? "Expected f64vector" : "Expected s64vector", value->type != type);
+    return value;
+}
+
+/*
+ * Stores a Scheme number into an f64vector or s64vector
+ */
+static void setNumericElement(Value *vector, int index, Value *element) {
+    if (vector->type == F64VECTOR_TYPE) {
+        raiseEvalError("Expected number", !isNumber(element));
+        vector->n.f64[index] = numberToDouble(element);
+    } else {
+        raiseEvalError("Expected 64-bit integer", element->type != INT_TYPE);
+        vector->n.s64[index] = element->i;
+    }
+}
+
+/*
+ * Boxes an element of an f64vector or s64vector
+ */
+static Value *numericElement(Value *vector, int index) {
+    if (vector->type == S64VECTOR_TYPE) {
+        return makeInteger(vector->n.s64[index]);
+    }
+    Value *element = makeNull();
+    element->type = DOUBLE_TYPE;
+    element->d = vector->n.f64[index];
+    return element;
+}
+
+/*
+ * Creates an f64vector or s64vector holding the elements of a proper list
+ */
+static Value *listToNumericVector(Value *list, valueType type) {
+    int count = 0;
+    Value *rest = list;
+    for (; rest->type == CONS_TYPE; rest = cdr(rest)) {
+        count++;
+    }
+    raiseEvalError("Expected a proper list", rest->type != NULL_TYPE);
+    Value *vector = makeNumericVector(type, count);
+    for (int i = 0; i < count; i++) {
+        setNumericElement(vector, i, car(list));
+        list = cdr(list);
+    }
+    return vector;
+}
+
+/*
+ * Evaluates make-f64vector and make-s64vector statements, filling the
+ * vector with the second argument (or 0)
+ */
+static Value *makeNumericVectorOf(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 2);
+    raiseEvalError("Expected non-negative integer length", car(args)->type != INT_TYPE || car(args)->i < 0);
+    raiseEvalError("Vector length too large", car(args)->i > INT_MAX);
+    Value *vector = makeNumericVector(type, car(args)->i);
+    Value *fill = cdr(args)->type != NULL_TYPE ? car(cdr(args)) : makeInteger(0);
+    if (vector->n.length > 0) {
+        setNumericElement(vector, 0, fill);
+    }
+    // Copying the bits works for either element type.
+    for (int i = 1; i < vector->n.length; i++) {
+        vector->n.s64[i] = vector->n.s64[0];
+    }
+    return vector;
+}
+
+/*
+ * Checks that an f64vector or s64vector and an index into it were given,
+ * returning the index
+ */
+static int numericVectorIndex(Value *vector, Value *index, valueType type) {
+    numericVectorArgument(vector, type);
+    raiseEvalError("Expected integer index", index->type != INT_TYPE);
+    raiseEvalError("Vector index out of range", index->i < 0 || index->i >= vector->n.length);
+    return index->i;
+}
+
+/*
+ * Evaluates f64vector-ref and s64vector-ref statements
+ */
+static Value *numericVectorRef(Value *args, valueType type) {
+    checkArgumentCount(args, 2, 2);
+    return numericElement(car(args), numericVectorIndex(car(args), car(cdr(args)), type));
+}
+
+/*
+ * Evaluates f64vector-set! and s64vector-set! statements
+ */
+static Value *numericVectorSet(Value *args, valueType type) {
+    checkArgumentCount(args, 3, 3);
+    setNumericElement(car(args), numericVectorIndex(car(args), car(cdr(args)), type), car(cdr(cdr(args))));
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates f64vector-length and s64vector-length statements
+ */
+static Value *numericVectorLength(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 1);
+    return makeInteger(numericVectorArgument(car(args), type)->n.length);
+}
+
+/*
+ * Evaluates f64vector->list and s64vector->list statements
+ */
+static Value *numericVectorToList(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 1);
+    Value *vector = numericVectorArgument(car(args), type);
+    Value *list = makeNull();
+    for (int i = vector->n.length - 1; i >= 0; i--) {
+        list = cons(numericElement(vector, i), list);
+    }
+    return list;
+}
+
+/*
+ * Evaluates f64vector? and s64vector? statements
+ */
+static Value *isNumericVector(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 1);
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    if (car(args)->type == type) {
+        makeTrue(result);
+    } else {
+        makeFalse(result);
+    }
+    return result;
+}
+
+typedef enum {
+    ELEMENTWISE_ADD,
+    ELEMENTWISE_SUBTRACT,
+    ELEMENTWISE_MULTIPLY,
+} elementwiseOperation;
+
+/*
+ * Evaluates the element-wise -add, -sub and -mul statements, returning a
+ * new vector
+ */
+static Value *numericVectorElementwise(Value *args, valueType type, elementwiseOperation operation) {
+    checkArgumentCount(args, 2, 2);
+    Value *a = numericVectorArgument(car(args), type);
+    Value *b = numericVectorArgument(car(cdr(args)), type);
+    raiseEvalError("Vectors must have the same length", a->n.length != b->n.length);
+    Value *result = makeNumericVector(type, a->n.length);
+    int length = a->n.length;
+    if (type == F64VECTOR_TYPE) {
+        switch (operation) {
+            case ELEMENTWISE_ADD: f64Add(result->n.f64, a->n.f64, b->n.f64, length); break;
+            case ELEMENTWISE_SUBTRACT: f64Subtract(result->n.f64, a->n.f64, b->n.f64, length); break;
+            case ELEMENTWISE_MULTIPLY: f64Multiply(result->n.f64, a->n.f64, b->n.f64, length); break;
+        }
+        return result;
+    }
+    bool fits = true;
+    switch (operation) {
+        case ELEMENTWISE_ADD: fits = s64Add(result->n.s64, a->n.s64, b->n.s64, length); break;
+        case ELEMENTWISE_SUBTRACT: fits = s64Subtract(result->n.s64, a->n.s64, b->n.s64, length); break;
+        case ELEMENTWISE_MULTIPLY: fits = s64Multiply(result->n.s64, a->n.s64, b->n.s64, length); break;
+    }
+    raiseEvalError("Integer overflow in s64vector", !fits);
+    return result;
+}
+
+/*
+ * Evaluates f64vector-scale and s64vector-scale statements, returning a new
+ * vector
+ */
+static Value *numericVectorScale(Value *args, valueType type) {
+    checkArgumentCount(args, 2, 2);
+    Value *vector = numericVectorArgument(car(args), type);
+    Value *factor = car(cdr(args));
+    Value *result = makeNumericVector(type, vector->n.length);
+    if (type == F64VECTOR_TYPE) {
+        raiseEvalError("Expected number", !isNumber(factor));
+        f64Scale(result->n.f64, vector->n.f64, numberToDouble(factor), vector->n.length);
+    } else {
+        raiseEvalError("Expected 64-bit integer", factor->type != INT_TYPE);
+        raiseEvalError("Integer overflow in s64vector", !s64Scale(result->n.s64, vector->n.s64, factor->i, vector->n.length));
+    }
+    return result;
+}
+
+/*
+ * Converts a 128-bit integer to a Scheme integer
+ */
+static Value *wideToInteger(__int128 n) {
+    Value *shift = makeInteger((int64_t) 1 << 32);
+    Value *result = makeInteger((int64_t) (n >> 64));
+    result = integerAdd(integerMultiply(result, shift), makeInteger((uint64_t) n >> 32));
+    return integerAdd(integerMultiply(result, shift), makeInteger((uint64_t) n & 0xffffffff));
+}
+
+/*
+ * Adds up the products a[i] * b[i] (or just a[i] if b is NULL) exactly.  The
+ * total is kept in 128 bits, spilling into a bignum only when that
+ * overflows, so this costs little more than the 64-bit kernels.
+ */
+static Value *exactS64Sum(int64_t *a, int64_t *b, int length) {
+    Value *total = makeInteger(0);
+    __int128 partial = 0;
+    for (int i = 0; i < length; i++) {
+        __int128 term = b == NULL ? a[i] : (__int128) a[i] * b[i];
+        __int128 next;
+        if (__builtin_add_overflow(partial, term, &next)) {
+            total = integerAdd(total, wideToInteger(partial));
+            next = term;
+        }
+        partial = next;
+    }
+    return integerAdd(total, wideToInteger(partial));
+}
+
+/*
+ * Evaluates f64vector-dot and s64vector-dot statements.  An s64vector dot
+ * product that overflows is worked out again exactly.
+ */
+static Value *numericVectorDot(Value *args, valueType type) {
+    checkArgumentCount(args, 2, 2);
+    Value *a = numericVectorArgument(car(args), type);
+    Value *b = numericVectorArgument(car(cdr(args)), type);
+    raiseEvalError("Vectors must have the same length", a->n.length != b->n.length);
+    if (type == F64VECTOR_TYPE) {
+        Value *result = makeNull();
+        result->type = DOUBLE_TYPE;
+        result->d = f64Dot(a->n.f64, b->n.f64, a->n.length);
+        return result;
+    }
+    int64_t dot;
+    if (s64Dot(&dot, a->n.s64, b->n.s64, a->n.length)) {
+        return makeInteger(dot);
+    }
+    return exactS64Sum(a->n.s64, b->n.s64, a->n.length);
+}
+
+/*
+ * Evaluates f64vector-sum and s64vector-sum statements.  An s64vector sum
+ * that overflows is worked out again exactly.
+ */
+static Value *numericVectorSum(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 1);
+    Value *vector = numericVectorArgument(car(args), type);
+    if (type == F64VECTOR_TYPE) {
+        Value *result = makeNull();
+        result->type = DOUBLE_TYPE;
+        result->d = f64Sum(vector->n.f64, vector->n.length);
+        return result;
+    }
+    int64_t sum;
+    if (s64Sum(&sum, vector->n.s64, vector->n.length)) {
+        return makeInteger(sum);
+    }
+    return exactS64Sum(vector->n.s64, NULL, vector->n.length);
+}
+
+/*
+ * Evaluates the -min and -max statements
+ */
+static Value *numericVectorExtreme(Value *args, valueType type, bool max) {
+    checkArgumentCount(args, 1, 1);
+    Value *vector = numericVectorArgument(car(args), type);
+    raiseEvalError("Expected a non-empty vector", vector->n.length == 0);
+    if (type == S64VECTOR_TYPE) {
+        return makeInteger(max ? s64Max(vector->n.s64, vector->n.length) : s64Min(vector->n.s64, vector->n.length));
+    }
+    Value *result = makeNull();
+    result->type = DOUBLE_TYPE;
+    result->d = max ? f64Max(vector->n.f64, vector->n.length) : f64Min(vector->n.f64, vector->n.length);
+    return result;
+}
+
+/*
+ * Evaluates f64vector-prefix-sum and s64vector-prefix-sum statements,
+ * returning a new vector of running totals
+ */
+static Value *numericVectorPrefixSum(Value *args, valueType type) {
+    checkArgumentCount(args, 1, 1);
+    Value *vector = numericVectorArgument(car(args), type);
+    Value *result = makeNumericVector(type, vector->n.length);
+    if (type == F64VECTOR_TYPE) {
+        f64PrefixSum(result->n.f64, vector->n.f64, vector->n.length);
+    } else {
+        raiseEvalError("Integer overflow in s64vector", !s64PrefixSum(result->n.s64, vector->n.s64, vector->n.length));
+    }
+    return result;
+}
+
+/*
+ * The f64vector and s64vector primitives, each passing its element type to
+ * the functions above.
+ */
+#define NUMERIC_VECTOR_PRIMITIVES(Name, type) \
+    Value *primitiveMake##Name(Value *args) { return makeNumericVectorOf(args, type); } \
+    Value *primitive##Name(Value *args) { return listToNumericVector(args, type); } \
+    Value *primitive##Name##Ref(Value *args) { return numericVectorRef(args, type); } \
+    Value *primitive##Name##Set(Value *args) { return numericVectorSet(args, type); } \
+    Value *primitive##Name##Length(Value *args) { return numericVectorLength(args, type); } \
+    Value *primitive##Name##ToList(Value *args) { return numericVectorToList(args, type); } \
+    Value *primitiveListTo##Name(Value *args) { \
+        checkArgumentCount(args, 1, 1); \
+        return listToNumericVector(car(args), type); \
+    } \
+    Value *primitiveIs##Name(Value *args) { return isNumericVector(args, type); } \
+    Value *primitive##Name##Add(Value *args) { return numericVectorElementwise(args, type, ELEMENTWISE_ADD); } \
+    Value *primitive##Name##Sub(Value *args) { return numericVectorElementwise(args, type, ELEMENTWISE_SUBTRACT); } \
+    Value *primitive##Name##Mul(Value *args) { return numericVectorElementwise(args, type, ELEMENTWISE_MULTIPLY); } \
+    Value *primitive##Name##Scale(Value *args) { return numericVectorScale(args, type); } \
+    Value *primitive##Name##Dot(Value *args) { return numericVectorDot(args, type); } \
+    Value *primitive##Name##Sum(Value *args) { return numericVectorSum(args, type); } \
+    Value *primitive##Name##Min(Value *args) { return numericVectorExtreme(args, type, false); } \
+    Value *primitive##Name##Max(Value *args) { return numericVectorExtreme(args, type, true); } \
+    Value *primitive##Name##PrefixSum(Value *args) { return numericVectorPrefixSum(args, type); }
+
+NUMERIC_VECTOR_PRIMITIVES(F64Vector, F64VECTOR_TYPE)
+NUMERIC_VECTOR_PRIMITIVES(S64Vector, S64VECTOR_TYPE)
+
+/*
+ * Checks that a value is a string
+ */
+static Value *stringArgument(Value *value) {
+    raiseEvalError("Expected string", value->type != STR_TYPE);
+    return value;
+}
+
+/*
+ * Checks that a value is an index into a string, or just past its end if
+ * allowEnd is set, returning the index
+ */
+static int stringIndex(Value *string, Value *index, bool allowEnd) {
+    raiseEvalError("Expected integer index", index->type != INT_TYPE);
+    raiseEvalError("String index out of range",
+                   index->i < 0 || index->i > string->str.length || (index->i == string->str.length && !allowEnd));
+    return index->i;
+}
+
+/*
+ * Evaluates string-length statements.  Strings carry their length, so this
+ * does not count the characters.
+ */
+Value *primitiveStringLength(Value *args) {
+    checkArgumentCount(args, 1, 1);
+    return makeInteger(stringArgument(car(args))->str.length);
+}
+
+/*
+ * Evaluates string-ref statements.  There is no character type, so the
+ * character comes back as a string of length one, sharing the buffer.
+ */
+Value *primitiveStringRef(Value *args) {
+    checkArgumentCount(args, 2, 2);
+    Value *string = stringArgument(car(args));
+    return makeSubstring(string, stringIndex(string, car(cdr(args)), false), 1);
+}
+
+/*
+ * Evaluates substring statements, taking the characters from start up to end
+ * (or the end of the string).  The result shares the string's buffer rather
+ * than copying it.
+ */
+Value *primitiveSubstring(Value *args) {
+    checkArgumentCount(args, 2, 3);
+    Value *string = stringArgument(car(args));
+    int start = stringIndex(string, car(cdr(args)), true);
+    int end = string->str.length;
+    if (cdr(cdr(args))->type != NULL_TYPE) {
+        end = stringIndex(string, car(cdr(cdr(args))), true);
+    }
+    raiseEvalError("Substring end before start", end < start);
+    return makeSubstring(string, start, end - start);
+}
+
+/*
+ * Evaluates string-append statements, copying every argument once into a
+ * buffer of the total length
+ */
+Value *primitiveStringAppend(Value *args) {
+    int64_t length = 0;
+    for (Value *rest = args; rest->type == CONS_TYPE; rest = cdr(rest)) {
+        length += stringArgument(car(rest))->str.length;
+    }
+    raiseEvalError("String too long", length > INT_MAX);
+    Value *result = makeNull();
+    result->type = STR_TYPE;
+    result->str.buffer = tallocKind(length + 1, STRING_ALLOCATION);
+    result->str.chars = result->str.buffer;
+    result->str.length = length;
+    char *end = result->str.buffer;
+    for (Value *rest = args; rest->type == CONS_TYPE; rest = cdr(rest)) {
+        memcpy(end, car(rest)->str.chars, car(rest)->str.length);
+        end += car(rest)->str.length;
+    }
+    *end = '\0';
+    return result;
+}
+
+/*
+ * Evaluates string? statements
+ */
+Value *primitiveIsString(Value *args) {
+    checkArgumentCount(args, 1, 1);
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    if (car(args)->type == STR_TYPE) {
+        makeTrue(result);
+    } else {
+        makeFalse(result);
+    }
+    return result;
+}
+
+/*
+ * Checks that a value is a string builder
+ */
+static Value *stringBuilderArgument(Value *value) {
+    raiseEvalError("Expected string builder", value->type != STRING_BUILDER_TYPE);
+    return value;
+}
+
+/*
+ * Evaluates make-string-builder statements, optionally given how many
+ * characters to make room for
+ */
+Value *primitiveMakeStringBuilder(Value *args) {
+    checkArgumentCount(args, 0, 1);
+    int64_t capacity = 16;
+    if (args->type != NULL_TYPE) {
+        raiseEvalError("Expected non-negative integer capacity", car(args)->type != INT_TYPE || car(args)->i < 0);
+        raiseEvalError("String too long", car(args)->i > INT_MAX - 1);
+        capacity = car(args)->i;
+    }
+    Value *builder = makeNull();
+    builder->type = STRING_BUILDER_TYPE;
+    builder->sb.buffer = tallocKind(capacity + 1, STRING_ALLOCATION);
+    builder->sb.buffer[0] = '\0';
+    builder->sb.length = 0;
+    builder->sb.capacity = capacity;
+    return builder;
+}
+
+/*
+ * Evaluates string-builder-append! statements, adding each string to the end
+ * of the builder.  The buffer at least doubles whenever it has to grow, so
+ * appends take amortized time proportional to what they add.
+ */
+Value *primitiveStringBuilderAppend(Value *args) {
+    raiseEvalError("Expected at least 1 argument, got 0", args->type == NULL_TYPE);
+    Value *builder = stringBuilderArgument(car(args));
+    int64_t length = builder->sb.length;
+    for (Value *rest = cdr(args); rest->type == CONS_TYPE; rest = cdr(rest)) {
+        length += stringArgument(car(rest))->str.length;
+    }
+    raiseEvalError("String too long", length > INT_MAX - 1);
+    if (length > builder->sb.capacity) {
+        int64_t capacity = (int64_t) builder->sb.capacity * 2;
+        if (capacity < length) {
+            capacity = length;
+        } else if (capacity > INT_MAX - 1) {
+            capacity = INT_MAX - 1;
+        }
+        // The old buffer stays as it is, since strings taken from the
+        // builder may still share it.
+        char *buffer = tallocKind(capacity + 1, STRING_ALLOCATION);
+        memcpy(buffer, builder->sb.buffer, builder->sb.length);
+        builder->sb.buffer = buffer;
+        builder->sb.capacity = capacity;
+    }
+    char *end = builder->sb.buffer + builder->sb.length;
+    for (Value *rest = cdr(args); rest->type == CONS_TYPE; rest = cdr(rest)) {
+        memcpy(end, car(rest)->str.chars, car(rest)->str.length);
+        end += car(rest)->str.length;
+    }
+    *end = '\0';
+    builder->sb.length = length;
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates string-builder->string statements.  The string shares the
+ * builder's buffer: later appends only write past its end, so it never sees
+ * them.
+ */
+Value *primitiveStringBuilderToString(Value *args) {
+    checkArgumentCount(args, 1, 1);
+    Value *builder = stringBuilderArgument(car(args));
+    Value *string = makeNull();
+    string->type = STR_TYPE;
+    string->str.buffer = builder->sb.buffer;
+    string->str.chars = builder->sb.buffer;
+    string->str.length = builder->sb.length;
+    return string;
+}
+
+/*
+ * Evaluates string-builder-length statements
+ */
+Value *primitiveStringBuilderLength(Value *args) {
+    checkArgumentCount(args, 1, 1);
+    return makeInteger(stringBuilderArgument(car(args))->sb.length);
+}
+
+/*
+ * Evaluates string-builder? statements
+ */
+Value *primitiveIsStringBuilder(Value *args) {
+    checkArgumentCount(args, 1, 1);
+    Value *result = makeNull();
+    result->type = BOOL_TYPE;
+    if (car(args)->type == STRING_BUILDER_TYPE) {
+        makeTrue(result);
+    } else {
+        makeFalse(result);
+    }
+    return result;
+}
+
+/*
+ * Evaluates gc statements: asks for a collection as soon as the current
+ * top-level form has finished, since values in use by C code are only
+ * reachable from the collector's roots between forms.
+ */
+Value *primitiveGc(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    requestCollection();
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates gc-stats statements, returning an association list of
+ * allocation and collection statistics
+ */
+Value *primitiveGcStats(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    return gcStatsList();
+}
+
+/*
+ * Evaluates heap-census statements, returning the live heap grouped by type
+ * and allocation site
+ */
+Value *primitiveHeapCensus(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    Census *census = takeCensus();
+    Value *list = censusList(census);
+    freeCensus(census);
+    return list;
+}
+
+/*
+ * Evaluates heap-snapshot statements, remembering the heap for heap-diff
+ */
+Value *primitiveHeapSnapshot(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    takeHeapSnapshot();
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    return toReturn;
+}
+
+/*
+ * Evaluates heap-diff statements, returning how the heap has changed since
+ * the last heap-snapshot
+ */
+Value *primitiveHeapDiff(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    Value *diff = heapDiffList();
+    raiseEvalError("heap-diff: no heap-snapshot taken", diff == NULL);
+    return diff;
+}
+
+/*
+ * Evaluates perf-counters statements, returning the hardware counter totals
+ * for each phase, or the empty list if counters are not running
+ */
+Value *primitivePerfCounters(Value *args) {
+    raiseEvalError("Expected 0 arguments, got more", args->type != NULL_TYPE);
+    return perfCountersList();
+}
+
+/*
+ * The builtin primitives, in the order they are bound into the top frame.
+ */
+static struct {
+	char *name;
+	Primitive function;
+} primitives[] = {
+	{"+", primitiveAdd},
+	{"cons", primitiveCons},
+	{"car", primitiveCar},
+	{"cdr", primitiveCdr},
+	{"null?", primitiveNull},
+	{"apply", primitiveApply},
+	{"modulo", primitiveModulo},
+	{"zero?", primitiveZero},
+	{"equal?", primitiveEqual},
+	{"list", primitiveList},
+	{"append", primitiveAppend},
+	{"=", primitiveEqualsSign},
+	{"error", primitiveError},
+	{"*", primitiveMultiply},
+	{"-", primitiveSubtract},
+	{"/", primitiveDivide},
+	{"<=", primitiveLeq},
+	{"eq?", primitiveEq},
+	{"eqv?", primitiveEqv},
+	{"pair?", primitivePair},
+	{"load", primitiveLoad},
+	{"write-binary", primitiveWriteBinary},
+	{"read-binary", primitiveReadBinary},
+	{"gc", primitiveGc},
+	{"gc-stats", primitiveGcStats},
+	{"heap-census", primitiveHeapCensus},
+	{"heap-snapshot", primitiveHeapSnapshot},
+	{"heap-diff", primitiveHeapDiff},
+	{"perf-counters", primitivePerfCounters},
+	{"make-vector", primitiveMakeVector},
+	{"vector", primitiveVector},
+	{"vector-ref", primitiveVectorRef},
+	{"vector-set!", primitiveVectorSet},
+	{"vector-length", primitiveVectorLength},
+	{"vector->list", primitiveVectorToList},
+	{"list->vector", primitiveListToVector},
+	{"vector-fill!", primitiveVectorFill},
+	{"vector?", primitiveIsVector},
+	{"make-hash-table", primitiveMakeHashTable},
+	{"hash-table-ref", primitiveHashTableRef},
+	{"hash-table-set!", primitiveHashTableSet},
+	{"hash-table-delete!", primitiveHashTableDelete},
+	{"hash-table-count", primitiveHashTableCount},
+	{"hash-table->alist", primitiveHashTableToAlist},
+	{"hash-table-keys", primitiveHashTableKeys},
+	{"hash-table-values", primitiveHashTableValues},
+	{"hash-table-walk", primitiveHashTableWalk},
+	{"hash-table?", primitiveIsHashTable},
+	{"make-f64vector", primitiveMakeF64Vector},
+	{"f64vector", primitiveF64Vector},
+	{"f64vector-ref", primitiveF64VectorRef},
+	{"f64vector-set!", primitiveF64VectorSet},
+	{"f64vector-length", primitiveF64VectorLength},
+	{"f64vector->list", primitiveF64VectorToList},
+	{"list->f64vector", primitiveListToF64Vector},
+	{"f64vector?", primitiveIsF64Vector},
+	{"f64vector-add", primitiveF64VectorAdd},
+	{"f64vector-sub", primitiveF64VectorSub},
+	{"f64vector-mul", primitiveF64VectorMul},
+	{"f64vector-scale", primitiveF64VectorScale},
+	{"f64vector-dot", primitiveF64VectorDot},
+	{"f64vector-sum", primitiveF64VectorSum},
+	{"f64vector-min", primitiveF64VectorMin},
+	{"f64vector-max", primitiveF64VectorMax},
+	{"f64vector-prefix-sum", primitiveF64VectorPrefixSum},
+	{"make-s64vector", primitiveMakeS64Vector},
+	{"s64vector", primitiveS64Vector},
+	{"s64vector-ref", primitiveS64VectorRef},
+	{"s64vector-set!", primitiveS64VectorSet},
+	{"s64vector-length", primitiveS64VectorLength},
+	{"s64vector->list", primitiveS64VectorToList},
+	{"list->s64vector", primitiveListToS64Vector},
+	{"s64vector?", primitiveIsS64Vector},
+	{"s64vector-add", primitiveS64VectorAdd},
+	{"s64vector-sub", primitiveS64VectorSub},
+	{"s64vector-mul", primitiveS64VectorMul},
+	{"s64vector-scale", primitiveS64VectorScale},
+	{"s64vector-dot", primitiveS64VectorDot},
+	{"s64vector-sum", primitiveS64VectorSum},
+	{"s64vector-min", primitiveS64VectorMin},
+	{"s64vector-max", primitiveS64VectorMax},
+	{"s64vector-prefix-sum", primitiveS64VectorPrefixSum},
+	{"string-length", primitiveStringLength},
+	{"string-ref", primitiveStringRef},
+	{"substring", primitiveSubstring},
+	{"string-append", primitiveStringAppend},
+	{"string?", primitiveIsString},
+	{"make-string-builder", primitiveMakeStringBuilder},
+	{"string-builder-append!", primitiveStringBuilderAppend},
+	{"string-builder->string", primitiveStringBuilderToString},
+	{"string-builder-length", primitiveStringBuilderLength},
+	{"string-builder?", primitiveIsStringBuilder},
+};
+
+#define PRIMITIVE_COUNT ((int) (sizeof(primitives) / sizeof(primitives[0])))
+
+/*
+ * Returns the position of a builtin primitive in the primitive table, or -1
+ */
+int primitiveIndex(Primitive function) {
+	for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+		if (primitives[i].function == function) {
+			return i;
+		}
+	}
+	return -1;
+}
+
+/*
+ * Returns the builtin primitive at a position in the primitive table, or NULL
+ */
+Primitive primitiveAt(int index) {
+	if (index < 0 || index >= PRIMITIVE_COUNT) {
+		return NULL;
+	}
+	return primitives[index].function;
+}
+
+/*
+ * Returns the name of the builtin primitive at a position in the primitive
+ * table, or NULL
+ */
+char *primitiveName(int index) {
+	if (index < 0 || index >= PRIMITIVE_COUNT) {
+		return NULL;
+	}
+	return primitives[index].name;
+}
+
+/*
+ * Returns the allocation site for a call to a primitive: its name, or
+ * "primitive" if it is not in the table.  The last answer is cached, since
+ * the same primitive tends to be called over and over.
+ */
+static char *primitiveSite(Primitive function) {
+	static Primitive lastFunction = NULL;
+	static char *lastSite = NULL;
+	if (function != lastFunction) {
+		char *name = primitiveName(primitiveIndex(function));
+		lastFunction = function;
+		lastSite = name != NULL ? name : "primitive";
+	}
+	return lastSite;
+}
+
+/*
+ * Returns the number of builtin primitives
+ */
+int primitiveCount() {
+	return PRIMITIVE_COUNT;
+}
+
+/*
+ * Sets up builtins and special forms to be bound properly
+ */
+Frame *setUpBindings() {
+	Frame *top = tallocKind(sizeof(Frame), FRAME_ALLOCATION);
+	top->parent = NULL;
+	Value *head = makeNull();
+    head = cons(makeSpecialForm("if"), head);
+	head = cons(makeSpecialForm("quote"), head);
+	head = cons(makeSpecialForm("let"), head);
+    head = cons(makeSpecialForm("define"), head);
+    head = cons(makeSpecialForm("lambda"), head);
+    head = cons(makeSpecialForm("let*"), head);
+    head = cons(makeSpecialForm("letrec"), head);
+    head = cons(makeSpecialForm("cond"), head);
+    head = cons(makeSpecialForm("set!"), head);
+    head = cons(makeSpecialForm("and"), head);
+    head = cons(makeSpecialForm("or"), head);
+    head = cons(makeSpecialForm("begin"), head);
+    head = cons(makeSpecialForm("do"), head);
+    head = cons(makeSpecialForm("else"), head);
+	top->bindings = head;
+	for (int i = 0; i < PRIMITIVE_COUNT; i++) {
+		bindPrimitive(primitives[i].name, primitives[i].function, top);
+	}
+	return top;
+}
+
+/*
+ * Returns the global environment, setting it up the first time
+ */
+Frame *globalEnvironment() {
+	if (top == NULL) {
+		top = setUpBindings();
+	}
+	return top;
+}
+
+/*
+ * Replaces the global environment, e.g. with one loaded from a heap image
+ */
+void setGlobalEnvironment(Frame *frame) {
+	top = frame;
+}
+
+/*
+ * Handles a list of S-expressions (ie a Scheme program), calls eval()
+ * on each S-expression in the top-level (global) environment, and
+ * prints each result in turn.
+ */
+void interpret(Value *tree) {
+	if (top == NULL) {
+		// Initialize bindings the first time
+		allocationSite = "bindings";
+		top = setUpBindings();
+	}
+	Value *remaining = tree;
+	while (remaining->type != NULL_TYPE) {
+		allocationSite = "eval";
+		if (tracing) {
+			traceBegin("eval");
+		}
+		if (countingPerf) {
+			perfBegin(EVAL_PHASE);
+		}
+		// A form that is a lone symbol is located by itself.
+		currentExpression = car(remaining);
+		printValue(eval(car(remaining), top));
+		if (countingPerf) {
+			perfEnd();
+		}
+		if (tracing) {
+			traceEnd();
+		}
+		remaining = cdr(remaining);
+        if (!collectionDue()) {
+            continue;
+        }
+        if (profiling) {
+            profileEnterNamed("[gc]");
+        }
+        if (tracing) {
+            traceBegin("gc");
+        }
+        if (countingPerf) {
+            perfBegin(GC_PHASE);
+        }
+        sweep(remaining, top); //collect garbage
+        if (countingPerf) {
+            perfEnd();
+        }
+        if (tracing) {
+            traceEnd();
+        }
+        if (profiling) {
+            profileLeave();
+        }
+	}
+}
+
+/*
+ * Handles a list of S-expressions like interpret(), but inside a child frame
+ * of the global environment which is thrown away afterwards.
+ */
+void interpretIsolated(Value *tree) {
+	if (top == NULL) {
+		top = setUpBindings();
+	}
+	globalFrame = top;
+	Frame *childFrame = tallocKind(sizeof(Frame), FRAME_ALLOCATION);
+	childFrame->parent = globalFrame;
+	childFrame->bindings = makeNull();
+	isolatedFrame = childFrame;
+	top = childFrame;
+	interpret(tree);
+	endIsolation();
+}
+
+/*
+ * Frees everything and forgets the global environment, so the next
+ * interpret() starts from fresh bindings.
+ */
+void resetInterpreter() {
+	tfree();
+	regionReset();
+	top = NULL;
+	globalFrame = NULL;
+	isolatedFrame = NULL;
+	inCond = false;
+	currentExpression = NULL;
+	allocationSite = "eval";
+	if (profiling) {
+		profileReset();
+	}
+	if (tracing) {
+		traceUnwind();
+	}
+	if (countingPerf) {
+		perfUnwind();
+	}
+}
+
+/*
+ * Restores the global frame after an isolated evaluation and collects
+ * everything that is no longer reachable from it.
+ */
+void endIsolation() {
+	static Value nothing = {.type = NULL_TYPE};
+	if (globalFrame != NULL) {
+		top = globalFrame;
+		globalFrame = NULL;
+	}
+	isolatedFrame = NULL;
+	inCond = false;
+	currentExpression = NULL;
+	allocationSite = "eval";
+	regionReset();
+	if (profiling) {
+		profileReset();
+	}
+	if (tracing) {
+		traceUnwind();
+	}
+	if (countingPerf) {
+		perfUnwind();
+	}
+	if (top != NULL) {
+		sweep(&nothing, top);
+	}
+}
+
+/*
+ * The operators of counter expressions and tests (see analysis.h).
+ */
+typedef enum {
+    ADD_OPERATOR,
+    SUBTRACT_OPERATOR,
+    EQUALS_OPERATOR,
+    LEQ_OPERATOR,
+    OPERATOR_COUNT,
+} loopOperator;
+
+static char *operatorNames[OPERATOR_COUNT] = {"+", "-", "=", "<="};
+static Primitive operatorPrimitives[OPERATOR_COUNT] = {primitiveAdd, primitiveSubtract, primitiveEqualsSign, primitiveLeq};
+
+/*
+ * A do or named let running, with the binding pair of each variable and the
+ * values they get next time round while those are being worked out.
+ */
+typedef struct Loop {
+    LoopAnalysis *analysis;
+    Frame *frame;
+    Value **bindings;
+    // Whether a counter's value is an integer the loop made, which nothing
+    // else has seen and so can be overwritten.
+    bool *owned;
+    // Whether counters are still kept in owned integers.  Cleared for good
+    // once a counter might have been passed to something other than the
+    // arithmetic primitives, e.g. because + was redefined.
+    bool counting;
+    // The next value of each variable, or NULL if it is nextIntegers[i].
+    Value **nextValues;
+    int64_t *nextIntegers;
+    // The binding pair each operator had when bindingGeneration was
+    // generation, or NULL if it had none.  A set! changes the pair's value,
+    // so only a new binding means looking them up again.
+    Value *operators[OPERATOR_COUNT];
+    unsigned long generation;
+} Loop;
+
+/*
+ * Returns the binding pair of a symbol seen from a frame, or NULL.
+ */
+static Value *findBinding(char *name, Frame *frame) {
+    for (; frame != NULL; frame = frame->parent) {
+        for (Value *remaining = frame->bindings; remaining->type != NULL_TYPE; remaining = cdr(remaining)) {
+            if (!strcmp(car(car(remaining))->s, name)) {
+                return car(remaining);
+            }
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns whether an operator is still bound to the primitive it names,
+ * looking the operators up again if a binding was added since last time.
+ */
+static bool operatorIntact(Loop *loop, loopOperator operator) {
+    if (loop->generation != bindingGeneration) {
+        for (int i = 0; i < OPERATOR_COUNT; i++) {
+            loop->operators[i] = findBinding(operatorNames[i], loop->frame);
+        }
+        loop->generation = bindingGeneration;
+    }
+    Value *pair = loop->operators[operator];
+    return pair != NULL && cdr(pair)->type == PRIMITIVE_TYPE && cdr(pair)->pf == operatorPrimitives[operator];
+}
+
+/*
+ * Evaluates a counter expression (see analysis.h) with 64-bit arithmetic,
+ * allocating nothing.  Returns false if one of its operators is no longer
+ * the primitive it names; otherwise clears *integers if some variable isn't
+ * an integer or the arithmetic overflows, in which case eval() has to work
+ * the value out instead.
+ */
+static bool countStep(Loop *loop, Value *expr, int64_t *result, bool *integers) {
+    if (expr->type == INT_TYPE) {
+        *result = expr->i;
+        return true;
+    } else if (expr->type == SYMBOL_TYPE) {
+        Value *value = lookUpSymbol(expr, loop->frame);
+        if (value->type == INT_TYPE) {
+            *result = value->i;
+        } else {
+            *integers = false;
+        }
+        return true;
+    }
+    loopOperator operator = strcmp(car(expr)->s, "+") == 0 ? ADD_OPERATOR : SUBTRACT_OPERATOR;
+    int64_t left = 0, right = 0;
+    if (!operatorIntact(loop, operator)
+        || !countStep(loop, car(cdr(expr)), &left, integers)
+        || !countStep(loop, car(cdr(cdr(expr))), &right, integers)) {
+        return false;
+    }
+    if (*integers) {
+        bool overflow = operator == ADD_OPERATOR ? __builtin_add_overflow(left, right, result)
+                                                 : __builtin_sub_overflow(left, right, result);
+        *integers = !overflow;
+    }
+    return true;
+}
+
+/*
+ * Binds a loop's variables to their initial values, evaluated in the frame
+ * around the loop.  The loop's arrays, and its frame if it runs in place,
+ * come from the region.
+ */
+static void startLoop(Loop *loop, LoopAnalysis *analysis, Value *bindings, Frame *frame) {
+    int count = analysis->count;
+    loop->analysis = analysis;
+    loop->frame = newFrame(frame, analysis->inPlace);
+    loop->bindings = regionAllocate(count * sizeof(Value *));
+    loop->owned = regionAllocate(count * sizeof(bool));
+    loop->counting = analysis->inPlace && !profiling;
+    loop->nextValues = regionAllocate(count * sizeof(Value *));
+    loop->nextIntegers = regionAllocate(count * sizeof(int64_t));
+    int i = 0;
+    for (Value *remaining = bindings; remaining->type != NULL_TYPE; remaining = cdr(remaining)) {
+        Value *value = eval(car(cdr(car(remaining))), frame);
+        loop->bindings[i] = bind(loop->frame, car(car(remaining)), value, analysis->inPlace);
+        loop->owned[i] = false;
+        i++;
+    }
+    // The operators are looked up on first use, from the loop's own frame.
+    loop->generation = bindingGeneration - 1;
+}
+
+/*
+ * Works out the next value of a loop variable, without allocating if it is
+ * a counter expression of integers.
+ */
+static void evalLoopStep(Loop *loop, int i, Value *step) {
+    if (loop->counting && isCounterExpression(step)) {
+        bool integers = true;
+        if (!countStep(loop, step, &loop->nextIntegers[i], &integers)) {
+            loop->counting = false;
+        } else if (integers) {
+            loop->nextValues[i] = NULL;
+            return;
+        }
+    }
+    loop->nextValues[i] = eval(step, loop->frame);
+}
+
+/*
+ * Evaluates a loop's test, without allocating if it is a counter test of
+ * integers, and returns whether it passed.
+ */
+static bool loopTestPasses(Loop *loop, Value *test) {
+    if (loop->counting && isCounterTest(test)) {
+        loopOperator operator = strcmp(car(test)->s, "=") == 0 ? EQUALS_OPERATOR : LEQ_OPERATOR;
+        int64_t left = 0, right = 0;
+        bool integers = true;
+        if (!operatorIntact(loop, operator)
+            || !countStep(loop, car(cdr(test)), &left, &integers)
+            || !countStep(loop, car(cdr(cdr(test))), &right, &integers)) {
+            loop->counting = false;
+        } else if (integers) {
+            return operator == EQUALS_OPERATOR ? left == right : left <= right;
+        }
+    }
+    Value *result = eval(test, loop->frame);
+    return !(result->type == BOOL_TYPE && !strcmp(result->s, "#f"));
+}
+
+/*
+ * Gives a loop's variables their next values.  A loop running in place
+ * assigns its bindings, overwriting counters it owns; any other loop gets
+ * a new frame, since a closure may still hold on to the old one.
+ */
+static void advanceLoop(Loop *loop, Frame *outer) {
+    int count = loop->analysis->count;
+    if (!loop->analysis->inPlace) {
+        Frame *next = newFrame(outer, false);
+        for (int i = 0; i < count; i++) {
+            loop->bindings[i] = bind(next, car(loop->bindings[i]), loop->nextValues[i], false);
+        }
+        loop->frame = next;
+        return;
+    }
+    for (int i = 0; i < count; i++) {
+        Value *binding = loop->bindings[i];
+        if (loop->nextValues[i] != NULL) {
+            binding->c.cdr = loop->nextValues[i];
+            loop->owned[i] = false;
+        } else if (loop->counting && loop->owned[i]) {
+            cdr(binding)->i = loop->nextIntegers[i];
+        } else {
+            binding->c.cdr = makeInteger(loop->nextIntegers[i]);
+            loop->owned[i] = loop->analysis->counters[i];
+        }
+    }
+}
+
+/*
+ * Checks the bindings of a named let or the variable specs of a do, each a
+ * symbol and an initial value, followed in a do by an optional step.
+ */
+static void checkLoopVariables(Value *bindings, bool isDo) {
+    Value *remaining;
+    for (remaining = bindings; remaining->type != NULL_TYPE; remaining = cdr(remaining)) {
+        raiseEvalError("Expected a list of bindings", remaining->type != CONS_TYPE || car(remaining)->type != CONS_TYPE);
+        Value *binding = car(remaining);
+        raiseEvalError("Assignment to non-symbol value", car(binding)->type != SYMBOL_TYPE);
+        raiseEvalError("No value to assign", cdr(binding)->type != CONS_TYPE);
+        Value *step = cdr(cdr(binding));
+        raiseEvalError("do: expected a variable, an initial value and a step",
+                       isDo && step->type != NULL_TYPE && (step->type != CONS_TYPE || cdr(step)->type != NULL_TYPE));
+    }
+    for (remaining = bindings; remaining->type != NULL_TYPE; remaining = cdr(remaining)) {
+        raiseEvalError(isDo ? "Duplicate symbol in do" : "Duplicate symbol in let", alreadyBound(car(car(remaining)), cdr(remaining)));
+    }
+}
+
+/*
+ * Evaluates do loops, as a C loop.  When the loop makes no closures its
+ * variables are assigned in place each time round, in one frame in the
+ * region, and its counters (see analysis.h) in integers of its own.
+ */
+Value *evalDo(Value *args, Frame *frame) {
+    raiseEvalError("do: bad syntax (missing variables or test)", args->type == NULL_TYPE || cdr(args)->type == NULL_TYPE);
+    Value *clause = car(cdr(args));
+    raiseEvalError("do: expected a test and results", clause->type != CONS_TYPE);
+    checkLoopVariables(car(args), true);
+    LoopAnalysis *analysis = analyzeDo(args);
+    RegionMark mark = regionMark();
+    Loop loop;
+    startLoop(&loop, analysis, car(args), frame);
+    while (!loopTestPasses(&loop, car(clause))) {
+        for (Value *commands = cdr(cdr(args)); commands->type != NULL_TYPE; commands = cdr(commands)) {
+            eval(car(commands), loop.frame);
+        }
+        int i = 0;
+        for (Value *specs = car(args); specs->type != NULL_TYPE; specs = cdr(specs)) {
+            Value *step = cdr(cdr(car(specs)));
+            if (step->type == NULL_TYPE) {
+                loop.nextValues[i] = cdr(loop.bindings[i]);
+            } else {
+                evalLoopStep(&loop, i, car(step));
+            }
+            i++;
+        }
+        advanceLoop(&loop, frame);
+    }
+    Value *toReturn = makeNull();
+    toReturn->type = VOID_TYPE;
+    for (Value *results = cdr(clause); results->type != NULL_TYPE; results = cdr(results)) {
+        toReturn = eval(car(results), loop.frame);
+    }
+    regionRelease(mark);
+    return toReturn;
+}
+
+/*
+ * Returns whether if, cond and begin still mean the special forms in a
+ * named let's body, so that it can be run in place.
+ */
+static bool tailFormsIntact(Value *args, Frame *frame) {
+    char *forms[] = {"if", "cond", "begin"};
+    for (int i = 0; i < 3; i++) {
+        if (!strcmp(car(args)->s, forms[i])) {
+            return false;
+        }
+        for (Value *bindings = car(cdr(args)); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+            if (!strcmp(car(car(bindings))->s, forms[i])) {
+                return false;
+            }
+        }
+        Value symbol = {.type = SYMBOL_TYPE, .s = forms[i]};
+        Value *value = lookUpSymbol(&symbol, frame);
+        if (value->type != SYMBOL_TYPE || strcmp(value->s, forms[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/*
+ * Runs a named let's body once, in place, following tail positions through
+ * if, cond and begin the way their eval functions would.  Returns true when
+ * it ends in a call of the loop, whose arguments have become the variables'
+ * next values; otherwise sets *result to the loop's result.
+ */
+static bool runLoopBody(Loop *loop, Value *name, Value *body, Value **result) {
+    for (; cdr(body)->type != NULL_TYPE; body = cdr(body)) {
+        eval(car(body), loop->frame);
+    }
+    Value *expr = car(body);
+    while (true) {
+        Value *args = expr->type == CONS_TYPE ? cdr(expr) : NULL;
+        if (isForm(expr, "if") && args->type == CONS_TYPE && car(args)->type != NULL_TYPE && cdr(args)->type == CONS_TYPE) {
+            if (loopTestPasses(loop, car(args))) {
+                expr = car(cdr(args));
+            } else if (cdr(cdr(args))->type != NULL_TYPE) {
+                expr = car(cdr(cdr(args)));
+            } else {
+                *result = makeNull();
+                (*result)->type = VOID_TYPE;
+                return false;
+            }
+        } else if (isForm(expr, "cond")) {
+            Value *chosen = NULL;
+            for (; args->type != NULL_TYPE && chosen == NULL; args = cdr(args)) {
+                inCond = true;
+                Value *clause = car(args);
+                if (cdr(clause)->type == NULL_TYPE) {
+                    inCond = false;
+                    *result = eval(car(clause), loop->frame);
+                    return false;
+                } else if (loopTestPasses(loop, car(clause))) {
+                    chosen = car(cdr(clause));
+                }
+            }
+            inCond = false;
+            if (chosen == NULL) {
+                *result = makeNull();
+                (*result)->type = VOID_TYPE;
+                return false;
+            }
+            expr = chosen;
+        } else if (isForm(expr, "begin")) {
+            if (args->type == NULL_TYPE) {
+                *result = makeNull();
+                return false;
+            }
+            for (; cdr(args)->type != NULL_TYPE; args = cdr(args)) {
+                eval(car(args), loop->frame);
+            }
+            expr = car(args);
+        } else if (isForm(expr, name->s)) {
+            for (int i = 0; args->type != NULL_TYPE; args = cdr(args), i++) {
+                evalLoopStep(loop, i, car(args));
+            }
+            return true;
+        } else {
+            *result = eval(expr, loop->frame);
+            return false;
+        }
+    }
+}
+
+/*
+ * Evaluates a named let as an ordinary procedure bound to its name, called
+ * with the initial values.
+ */
+static Value *callNamedLet(Value *args, Frame *frame) {
+    Value *name = car(args);
+    Value *parameters = makeNull();
+    Value *values = makeNull();
+    Value *lastParameter = NULL;
+    Value *lastValue = NULL;
+    for (Value *bindings = car(cdr(args)); bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+        Value *parameter = cons(car(car(bindings)), makeNull());
+        Value *value = cons(eval(car(cdr(car(bindings))), frame), makeNull());
+        if (lastParameter == NULL) {
+            parameters = parameter;
+            values = value;
+        } else {
+            lastParameter->c.cdr = parameter;
+            lastValue->c.cdr = value;
+        }
+        lastParameter = parameter;
+        lastValue = value;
+    }
+    Value *body = cdr(cdr(args));
+    if (cdr(body)->type == NULL_TYPE) {
+        body = car(body);
+    } else {
+        Value *begin = makeNull();
+        begin->type = SYMBOL_TYPE;
+        begin->s = "begin";
+        body = cons(begin, body);
+    }
+    Value *procedure = makeNull();
+    procedure->type = CLOSURE_TYPE;
+    procedure->cl.parameters = parameters;
+    procedure->cl.body = body;
+    Frame *loopFrame = newFrame(frame, false);
+    bind(loopFrame, name, procedure, false);
+    procedure->cl.frame = captureVariables(cons(parameters, cons(body, makeNull())), loopFrame);
+    if (namingProcedures) {
+        nameProcedure(body, name->s);
+    }
+    return apply(procedure, values);
+}
+
+/*
+ * Evaluates named let statements.  One that only calls itself in tail
+ * position and makes no closures runs in place, like a do; any other is
+ * called as a procedure.
+ */
+Value *evalNamedLet(Value *args, Frame *frame) {
+    raiseEvalError("let: bad syntax (missing binding pairs or body)", cdr(args)->type == NULL_TYPE || cdr(cdr(args))->type == NULL_TYPE);
+    checkLoopVariables(car(cdr(args)), false);
+    LoopAnalysis *analysis = analyzeNamedLet(args);
+    if (!analysis->inPlace || !tailFormsIntact(args, frame)) {
+        return callNamedLet(args, frame);
+    }
+    RegionMark mark = regionMark();
+    Loop loop;
+    startLoop(&loop, analysis, car(cdr(args)), frame);
+    Value *result;
+    while (runLoopBody(&loop, car(args), cdr(cdr(args)), &result)) {
+        advanceLoop(&loop, frame);
+    }
+    regionRelease(mark);
+    return result;
+}
+
+/*
+ * Evaluates a special form, recording it as the site of whatever it
+ * allocates
+ */
+Value *evalSpecialForm(char *form, Value *expr, Value *args, Frame *frame) {
+    if (!strcmp(form, "if")) {
+        allocationSite = "evalIf";
+        return evalIf(args, frame);
+    } else if (!strcmp(form, "quote")) {
+        allocationSite = "evalQuote";
+        return evalQuote(args, frame);
+    } else if (!strcmp(form, "let")) {
+        if (args->type == CONS_TYPE && car(args)->type == SYMBOL_TYPE) {
+            allocationSite = "evalNamedLet";
+            return evalNamedLet(args, frame);
+        }
+        allocationSite = "evalLet";
+        return evalLet(args, frame);
+    } else if (!strcmp(form, "define")) {
+        allocationSite = "evalDefine";
+        return evalDefine(args);
+    } else if (!strcmp(form, "lambda")) {
+        allocationSite = "evalLambda";
+        return evalLambda(args, frame);
+    } else if (!strcmp(form, "let*")) {
+        allocationSite = "evalLetStar";
+        return evalLetStar(args, frame);
+    } else if (!strcmp(form, "letrec")) {
+        allocationSite = "evalLetrec";
+        return evalLetrec(args, frame);
+    } else if (!strcmp(form, "set!")) {
+        allocationSite = "evalSet";
+        return evalSet(args, frame);
+    } else if (!strcmp(form, "and")) {
+        allocationSite = "evalAnd";
+        return evalAnd(args, frame);
+    } else if (!strcmp(form, "or")) {
+        allocationSite = "evalOr";
+        return evalOr(args, frame);
+    } else if (!strcmp(form, "begin")) {
+        allocationSite = "evalBegin";
+        return evalBegin(args, frame);
+    } else if (!strcmp(form, "cond")) {
+        allocationSite = "evalCond";
+        return evalCond(args, frame);
+    } else if (!strcmp(form, "do")) {
+        allocationSite = "evalDo";
+        return evalDo(args, frame);
+    } else if (!strcmp(form, "else")) {
+        if (inCond) {
+            return expr;
+        }
+        raiseEvalError("else: not allowed outside of cond.", true);
+    }
+    raiseEvalError("Unrecognized special form.", true);
+    return NULL;
+}
+
+/*
+ * Returns whether a call is a two-argument call of +, -, <= or =, which
+ * eval runs without building an argument list.  The procedure has already
+ * been looked up, so a program that rebinds one of these names never gets
+ * here.  While profiling, calls go through apply() so they are still
+ * counted.
+ */
+static bool isBinaryArithmetic(Value *function, Value *args) {
+    if (function->type != PRIMITIVE_TYPE || profiling) {
+        return false;
+    }
+    Primitive pf = function->pf;
+    if (pf != primitiveAdd && pf != primitiveSubtract && pf != primitiveLeq && pf != primitiveEqualsSign) {
+        return false;
+    }
+    return args->type == CONS_TYPE && cdr(args)->type == CONS_TYPE && cdr(cdr(args))->type == NULL_TYPE;
+}
+
+/*
+ * Evaluates a call isBinaryArithmetic() accepted.  Two integers or two
+ * doubles are handled here; anything else, including integers whose sum
+ * or difference overflows, goes to the variadic primitive.
+ */
+static Value *evalBinaryArithmetic(Value *function, Value *expr, Value *args, Frame *frame) {
+    allocationSite = "recursiveEval";
+    Value *left = eval(car(args), frame);
+    Value *right = eval(car(cdr(args)), frame);
+    currentExpression = expr;
+    Primitive pf = function->pf;
+    allocationSite = primitiveSite(pf);
+    Value *result;
+    if (left->type == INT_TYPE && right->type == INT_TYPE) {
+        int64_t n;
+        if (pf == primitiveLeq || pf == primitiveEqualsSign) {
+            result = makeNull();
+            result->type = BOOL_TYPE;
+            result->s = (pf == primitiveLeq ? left->i <= right->i : left->i == right->i) ? "#t" : "#f";
+            return result;
+        }
+        bool overflow = pf == primitiveAdd ? __builtin_add_overflow(left->i, right->i, &n)
+                                           : __builtin_sub_overflow(left->i, right->i, &n);
+        if (!overflow) {
+            return makeInteger(n);
+        }
+    } else if (left->type == DOUBLE_TYPE && right->type == DOUBLE_TYPE) {
+        result = makeNull();
+        if (pf == primitiveLeq || pf == primitiveEqualsSign) {
+            result->type = BOOL_TYPE;
+            result->s = (pf == primitiveLeq ? left->d <= right->d : left->d == right->d) ? "#t" : "#f";
+        } else {
+            result->type = DOUBLE_TYPE;
+            result->d = pf == primitiveAdd ? left->d + right->d : left->d - right->d;
+        }
+        return result;
+    }
+    return apply(function, cons(left, cons(right, makeNull())));
+}
+
+/*
+ * Takes a parse tree of a single S-expression and an environment frame in
+ * which to evaluate the expression, then returns a pointer to a Value 
+ * representing the evaluated value. 
+ */
+Value *eval(Value *expr, Frame *frame){
+	switch (expr->type) {
+		case INT_TYPE:
+			return expr;
+			break;
+		case BIGNUM_TYPE:
+			return expr;
+			break;
+		case STR_TYPE:
+			return expr;
+			break;
+		case STRING_BUILDER_TYPE:
+			return expr;
+			break;
+		case DOUBLE_TYPE:
+			return expr;
+			break;
+		case NULL_TYPE:
+			return expr;
+			break;
 		case BOOL_TYPE:
 			return expr;
 			break;
@@ -1053,6 +3100,16 @@ Value *eval(Value *expr, Frame *frame){
 			return lookUpSymbol(expr, frame);
 			break;
         case CLOSURE_TYPE:
+            return expr;
+            break;
+        case VECTOR_TYPE:
+            return expr;
+            break;
+        case F64VECTOR_TYPE:
+        case S64VECTOR_TYPE:
+            return expr;
+            break;
+        case HASH_TYPE:
             return expr;
             break;
 		case PRIMITIVE_TYPE:
@@ -1061,49 +3118,28 @@ Value *eval(Value *expr, Frame *frame){
 		case CONS_TYPE: {// THIS IS WHERE THE FUN BEGINS
 			Value *first = car(expr);
 			Value *args = cdr(expr);
+			Value *callerExpression = currentExpression;
+			currentExpression = expr;
 			raiseEvalError("Null Pointer", first->type == NULL_TYPE);
 			Value *firstEval = eval(first, frame);
+			currentExpression = expr;
 			raiseEvalError("Attempting to call non-function", firstEval->type != SYMBOL_TYPE && firstEval->type != CLOSURE_TYPE && firstEval->type != PRIMITIVE_TYPE);
+            char *callerSite = allocationSite;
+            Value *result;
             if (firstEval->type == SYMBOL_TYPE) {
-                if (!strcmp(firstEval->s, "if")) {
-                    return evalIf(args, frame);
-                } else if (!strcmp(firstEval->s, "quote")) {
-                    return evalQuote(args, frame);
-                } else if (!strcmp(firstEval->s, "let")) {
-                    return evalLet(args, frame);
-                } else if (!strcmp(firstEval->s, "define")) {
-                    return evalDefine(args);  
-                } else if (!strcmp(firstEval->s, "lambda")) {
-                    return evalLambda(args, frame);
-                } else if (!strcmp(firstEval->s, "let*")) {
-                    return evalLetStar(args, frame);
-                } else if (!strcmp(firstEval->s, "letrec")) {
-                    return evalLetrec(args, frame);
-                } else if (!strcmp(firstEval->s, "set!")) {
-                    return evalSet(args, frame);
-                } else if (!strcmp(firstEval->s, "and")) {
-                    return evalAnd(args, frame);
-                } else if (!strcmp(firstEval->s, "or")) {
-                    return evalOr(args, frame);
-                } else if (!strcmp(firstEval->s, "begin")) {
-                    return evalBegin(args, frame);
-                } else if (!strcmp(firstEval->s, "cond")) {
-                    return evalCond(args, frame);
-                } else if (!strcmp(firstEval->s, "else")) {
-                	if (inCond) {
-                		return expr;
-                	}
-                	raiseEvalError("else: not allowed outside of cond.", true);
-                } else {
-                    raiseEvalError("Unrecognized special form.", true);
-                }
+                result = evalSpecialForm(firstEval->s, expr, args, frame);
+            } else if (isBinaryArithmetic(firstEval, args)) {
+                result = evalBinaryArithmetic(firstEval, expr, args, frame);
             } else {
-                Value *remaining = args;
-                Value *results = recursiveEval(remaining, frame);
-                return apply(firstEval, results);
+                allocationSite = "recursiveEval";
+                Value *results = recursiveEval(args, frame);
+                currentExpression = expr;
+                allocationSite = firstEval->type == PRIMITIVE_TYPE ? primitiveSite(firstEval->pf) : "apply";
+                result = apply(firstEval, results);
             }
-            raiseEvalError("This shouldn't occur.", true);
-            return NULL;
+            allocationSite = callerSite;
+            currentExpression = callerExpression;
+            return result;
 		}
 		case PTR_TYPE:
 			raiseEvalError("Poorly formed tree!", true);
@@ -1,5 +1,6 @@
 #ifndef INTERPRETER_H
 #define INTERPRETER_H
+#include <stdbool.h>
 #include "value.h"
 
 struct Frame {
@@ -8,6 +9,11 @@ struct Frame {
 };
 typedef struct Frame Frame;
 
+/*
+ * A C implementation of a Scheme primitive function.
+ */
+typedef struct Value *(*Primitive)(struct Value *);
+
 /*
  * Handles a list of S-expressions (ie a Scheme program), calls eval()
  * on each S-expression in the top-level (global) environment, and
@@ -15,6 +21,27 @@ typedef struct Frame Frame;
  */
 void interpret(struct Value *tree);
 
+/*
+ * Like interpret(), but evaluates the program in a fresh child frame of the
+ * global environment so that anything it defines is discarded afterwards.
+ * A set! of a global binds the new value in the child frame instead.
+ */
+void interpretIsolated(struct Value *tree);
+
+/*
+ * Finishes an isolated evaluation (including one abandoned part way through
+ * by an error): restores the global environment and garbage collects
+ * everything the program allocated.
+ */
+void endIsolation();
+
+/*
+ * Frees everything talloc'ed and discards the global environment, leaving
+ * the interpreter as it was at startup.  Used to run many programs in one
+ * process (see golden_test.c).
+ */
+void resetInterpreter();
+
 /*
  * Takes a parse tree of a single S-exrpression and an environment frame in
  * which to evaluate the expression, then returns a pointer to a Value 
@@ -22,4 +49,49 @@ void interpret(struct Value *tree);
  */
 struct Value *eval(struct Value *expr, Frame *frame);
 
+/*
+ * Returns whether two values are the same according to eq?: the same
+ * object, or equal numbers, strings, symbols or booleans.
+ */
+bool valuesAreEq(struct Value *value1, struct Value *value2);
+
+/*
+ * Returns whether two values are the same according to equal?.
+ */
+bool treesAreEqual(struct Value *tree1, struct Value *tree2);
+
+/*
+ * Returns the global (top-level) environment, setting up the builtins and
+ * special forms the first time it is needed.
+ */
+Frame *globalEnvironment();
+
+/*
+ * Replaces the global environment, e.g. with one loaded from a heap image.
+ */
+void setGlobalEnvironment(Frame *frame);
+
+/*
+ * Returns the position of a builtin primitive in the table of primitives, or
+ * -1 if the function is not a builtin.  Positions are stable for a given
+ * build, so they can stand in for function pointers in saved heaps.
+ */
+int primitiveIndex(Primitive function);
+
+/*
+ * Returns the builtin primitive at a position in the table, or NULL.
+ */
+Primitive primitiveAt(int index);
+
+/*
+ * Returns the Scheme name of the builtin primitive at a position in the
+ * table, or NULL.
+ */
+char *primitiveName(int index);
+
+/*
+ * Returns the number of builtin primitives.
+ */
+int primitiveCount();
+
 #endif
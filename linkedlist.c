@@ -2,6 +2,7 @@
 #include "value.h"
 #include "linkedlist.h"
 #include "talloc.h"
+#include "flonum.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <assert.h>
@@ -11,7 +12,7 @@
  * Create an empty list (a new Value object of type NULL_TYPE).
  */
 Value *makeNull() {
-	Value *returnValue = talloc(sizeof(Value));
+	Value *returnValue = tallocKind(sizeof(Value), VALUE_ALLOCATION);
 	returnValue->type = NULL_TYPE;
 	return returnValue;
 }
@@ -22,7 +23,7 @@ Value *makeNull() {
 Value *cons(Value *car, Value *cdr) {
     assert(car != NULL);
     assert(cdr != NULL);
-	Value *returnValue = talloc(sizeof(Value));
+	Value *returnValue = tallocKind(sizeof(Value), CONS_ALLOCATION);
 	returnValue->type = CONS_TYPE;
 	returnValue->c.car = car;
 	returnValue->c.cdr = cdr;
@@ -30,44 +31,119 @@ Value *cons(Value *car, Value *cdr) {
 }
 
 /*
- * Print a representation of the contents of a linked list.
+ * Create a vector (a new Value object of type VECTOR_TYPE).
  */
-void displayHelper(Value *list, bool prefixWithSpace, bool expectingList) {
-    assert(list != NULL);
-    if (prefixWithSpace && (list->type != NULL_TYPE || !expectingList) && list->type != CONS_TYPE) {
-        printf(" ");
+Value *makeVector(int length, Value *fill) {
+    assert(length >= 0);
+    assert(fill != NULL);
+	Value *returnValue = tallocKind(sizeof(Value), VALUE_ALLOCATION);
+	returnValue->type = VECTOR_TYPE;
+	returnValue->v.length = length;
+	returnValue->v.items = NULL;
+	if (length > 0) {
+		returnValue->v.items = tallocKind(length * sizeof(Value *), VECTOR_ALLOCATION);
+	}
+	for (int i = 0; i < length; i++) {
+		returnValue->v.items[i] = fill;
+	}
+	return returnValue;
+}
+
+/*
+ * Create an f64vector or s64vector (as type says) of the given length, with
+ * its elements uninitialized.
+ */
+Value *makeNumericVector(valueType type, int length) {
+    assert(type == F64VECTOR_TYPE || type == S64VECTOR_TYPE);
+    assert(length >= 0);
+    Value *returnValue = tallocKind(sizeof(Value), VALUE_ALLOCATION);
+    returnValue->type = type;
+    returnValue->n.length = length;
+    returnValue->n.f64 = NULL;
+    if (length > 0) {
+        // Both element types are 8 bytes.
+        returnValue->n.f64 = tallocKind(length * sizeof(double), VECTOR_ALLOCATION);
+    }
+    return returnValue;
+}
+
+/*
+ * Create a string holding a copy of length characters.
+ */
+Value *makeString(char *chars, int length) {
+    assert(length >= 0);
+    Value *returnValue = tallocKind(sizeof(Value), VALUE_ALLOCATION);
+    returnValue->type = STR_TYPE;
+    returnValue->str.buffer = tallocKind(length + 1, STRING_ALLOCATION);
+    memcpy(returnValue->str.buffer, chars, length);
+    returnValue->str.buffer[length] = '\0';
+    returnValue->str.chars = returnValue->str.buffer;
+    returnValue->str.length = length;
+    return returnValue;
+}
+
+/*
+ * Create a string of length characters of another string from start on,
+ * sharing its buffer.
+ */
+Value *makeSubstring(Value *string, int start, int length) {
+    assert(string->type == STR_TYPE);
+    assert(start >= 0 && length >= 0 && start + length <= string->str.length);
+    Value *returnValue = tallocKind(sizeof(Value), VALUE_ALLOCATION);
+    returnValue->type = STR_TYPE;
+    returnValue->str.buffer = string->str.buffer;
+    returnValue->str.chars = string->str.chars + start;
+    returnValue->str.length = length;
+    return returnValue;
+}
+
+/*
+ * Returns the characters of a string followed by a NUL, copying them if
+ * something else follows them in the buffer.
+ */
+char *stringChars(Value *string) {
+    assert(string->type == STR_TYPE);
+    if (string->str.chars[string->str.length] == '\0') {
+        return string->str.chars;
     }
+    return makeString(string->str.chars, string->str.length)->str.chars;
+}
+
+/*
+ * Create a vector holding the elements of a list.
+ */
+Value *listToVector(Value *list) {
+    int count = 0;
+    for (Value *rest = list; rest->type == CONS_TYPE; rest = rest->c.cdr) {
+        count++;
+    }
+    Value *vector = makeVector(count, list);
+    for (int i = 0; i < count; i++) {
+        vector->v.items[i] = list->c.car;
+        list = list->c.cdr;
+    }
+    return vector;
+}
+
+/*
+ * Print a value as display() does, without the ". " that marks the tail of
+ * an improper list when expectingList is set.
+ */
+static void displayAtom(Value *list, bool expectingList) {
+    char *dot = expectingList ? ". " : "";
 	if (list->type == INT_TYPE) {
-        if (expectingList) {
-            printf(". %i", list->i);
-        } else {
-            printf("%i",list->i);
-        }
+        printf("%s%lld", dot, (long long) list->i);
 	}
 	else if (list->type == DOUBLE_TYPE) {
-        if (expectingList) {
-            printf(". %f", list->d);
-        } else {
-		    printf("%f",list->d);
-        }
+        char text[FLONUM_LENGTH];
+        formatDouble(list->d, text);
+        printf("%s%s", dot, text);
 	}
-	else if (list->type == STR_TYPE || list->type == SYMBOL_TYPE) {
-        if (expectingList) {
-            printf(". %s", list->s);
-        } else {
-            printf("%s",list->s);
-        }
+	else if (list->type == STR_TYPE) {
+        printf("%s%.*s", dot, list->str.length, list->str.chars);
 	}
-	else if (list->type == CONS_TYPE) {
-        if (expectingList) {
-        	displayHelper(list->c.car, true, false);
-		    displayHelper(list->c.cdr, true, true);
-        } else {
-            printf("(");
-            displayHelper(list->c.car, false, false);
-            displayHelper(list->c.cdr, true, true);
-            printf(")");
-        }
+	else if (list->type == SYMBOL_TYPE) {
+        printf("%s%s", dot, list->s);
 	}
 	else if (list->type == NULL_TYPE) {
 		if (!expectingList) {
@@ -75,20 +151,84 @@ void displayHelper(Value *list, bool prefixWithSpace, bool expectingList) {
 		}
 	} 
     else if (list->type == PTR_TYPE) {
-        if (expectingList) {
-            printf(". %p", list->p);
-        } else {
-            printf("%p", list->p);
+        printf("%s%p", dot, list->p);
+    }
+}
+
+/*
+ * A list still to be displayed: the rest of its spine from list on, or its
+ * close paren if list is NULL.
+ */
+typedef struct DisplayTask {
+    Value *list;
+    bool prefixWithSpace;
+} DisplayTask;
+
+/*
+ * Print a representation of the contents of a linked list.  The spine of
+ * each list is walked in a loop; only lists nested in a car wait on an
+ * explicit stack, so long lists need no C stack.
+ */
+static void displayList(Value *list) {
+    DisplayTask *stack = NULL;
+    int count = 0;
+    int capacity = 0;
+    // As ever, even the first element of the outermost list gets a space.
+    bool prefixWithSpace = true;
+    while (true) {
+        // Display the spine of list, which is the tail of an open list.
+        while (list->type == CONS_TYPE) {
+            Value *item = list->c.car;
+            if (item->type != CONS_TYPE) {
+                if (prefixWithSpace) {
+                    printf(" ");
+                }
+                displayAtom(item, false);
+                prefixWithSpace = true;
+                list = list->c.cdr;
+                continue;
+            }
+            // A nested list: come back for the rest of this one afterwards.
+            if (count + 2 > capacity) {
+                capacity = capacity == 0 ? 64 : capacity * 2;
+                stack = realloc(stack, capacity * sizeof(DisplayTask));
+                if (stack == NULL) {
+                    outOfMemoryError();
+                }
+            }
+            stack[count++] = (DisplayTask) {list->c.cdr, true};
+            stack[count++] = (DisplayTask) {NULL, false};
+            printf("(");
+            list = item;
+            prefixWithSpace = false;
+        }
+        if (list->type != NULL_TYPE) {
+            printf(" ");
+            displayAtom(list, true);
         }
+        if (count == 0) {
+            break;
+        }
+        // Close the nested list, then pick up its parent where it left off.
+        count--;
+        printf(")");
+        count--;
+        list = stack[count].list;
+        prefixWithSpace = stack[count].prefixWithSpace;
     }
+    free(stack);
 }
+
 void display(Value *list) {
 	assert(list != NULL);
 	//assert(list->type == CONS_TYPE || list->type == NULL_TYPE);
     if (list->type == NULL_TYPE) {
         printf("()\n");
+    } else if (list->type == CONS_TYPE) {
+        displayList(list);
+	   printf("\n");
     } else {
-        displayHelper(list, false, true);
+        displayAtom(list, true);
 	   printf("\n");
     }
 }
@@ -126,12 +266,13 @@ bool isNull(Value *value) {
 int length(Value *value) {
 	assert(value != NULL);
 	assert(value->type == CONS_TYPE || value->type == NULL_TYPE);
-	if (value->type == NULL_TYPE) {
-		return 0;
-	}
-	else {
-		return 1+length(value->c.cdr);
+	int count = 0;
+	while (value->type == CONS_TYPE) {
+		count++;
+		value = value->c.cdr;
 	}
+	assert(value->type == NULL_TYPE);
+	return count;
 }
 /*
  * Create a new linked list whose entries correspond to the given list's
@@ -139,17 +280,14 @@ int length(Value *value) {
  *
  * (Uses assertions to ensure that this is a legitimate operation.)
  */
-Value *reverseHelper(Value *list, Value *soFar) {
-    assert(list != NULL);
-	if (list->type == NULL_TYPE) {
-		return soFar;
-	}
-	soFar = cons(list->c.car, soFar);
-	return reverseHelper(list->c.cdr, soFar);
-}
-
 Value *reverse(Value *list) {
     assert(list != NULL);
 	assert(list->type == CONS_TYPE || list->type == NULL_TYPE);
-	return reverseHelper(list, makeNull());	
+	Value *soFar = makeNull();
+	while (list->type == CONS_TYPE) {
+		soFar = cons(list->c.car, soFar);
+		list = list->c.cdr;
+	}
+	assert(list->type == NULL_TYPE);
+	return soFar;
 }
@@ -14,6 +14,40 @@ Value *makeNull();
  */
 Value *cons(Value *car, Value *cdr);
 
+/*
+ * Create a vector (a new Value object of type VECTOR_TYPE) of the given
+ * length, with every element set to fill.
+ */
+Value *makeVector(int length, Value *fill);
+
+/*
+ * Create a vector holding the elements of a proper list, in order.
+ */
+Value *listToVector(Value *list);
+
+/*
+ * Create an f64vector or s64vector (as type says) of the given length, with
+ * its elements uninitialized.
+ */
+Value *makeNumericVector(valueType type, int length);
+
+/*
+ * Create a string holding a copy of length characters.
+ */
+Value *makeString(char *chars, int length);
+
+/*
+ * Create a string of length characters of another string from start on,
+ * sharing its buffer.
+ */
+Value *makeSubstring(Value *string, int start, int length);
+
+/*
+ * Returns the characters of a string followed by a NUL, copying them if
+ * the string is a substring that does not end where its buffer does.
+ */
+char *stringChars(Value *string);
+
 /*
  * Print a representation of the contents of a linked list.
  */
@@ -1,6 +1,5 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <string.h>
 #include "value.h"
 #include "linkedlist.h"
 
@@ -9,10 +8,7 @@ int main(void) {
     val1->type = INT_TYPE;
     val1->i = 23;
 
-    Value *val2 = malloc(sizeof(Value));
-    val2->type = STR_TYPE;
-    val2->s = malloc(10 * sizeof(char));
-    strcpy(val2->s, "tofu");
+    Value *val2 = makeString("tofu", 4);
 
     Value *head = makeNull();
     head = cons(val1, head);
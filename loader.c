@@ -0,0 +1,144 @@
+#include "loader.h"
+#include "serialize.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "location.h"
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC "SCMCACH2"
+#define CACHE_SUFFIX "c"
+// mkstemp() replaces the Xs, so concurrent writers never share a file.
+#define TEMPORARY_SUFFIX ".XXXXXX"
+
+/*
+ * What a cache was made from. A cache is only used if every field matches
+ * the source as it is now.
+ */
+typedef struct CacheKey {
+    char magic[8];
+    uint64_t size;
+    int64_t modifiedSeconds;
+    int64_t modifiedNanoseconds;
+    uint64_t hash;
+} CacheKey;
+
+/*
+ * 64-bit FNV-1a hash of a buffer.
+ */
+static uint64_t hashContents(unsigned char *contents, size_t length) {
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < length; i++) {
+        hash ^= contents[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+/*
+ * Returns the tree stored in a cache file if its key matches, or NULL.
+ */
+static Value *readCache(char *cachePath, CacheKey *key, int file) {
+    size_t length;
+    unsigned char *contents = readWholeFile(cachePath, &length);
+    if (contents == NULL) {
+        return NULL;
+    }
+    Value *tree = NULL;
+    size_t used;
+    if (length >= sizeof(CacheKey) && memcmp(contents, key, sizeof(CacheKey)) == 0) {
+        tree = readLocatedTree(contents + sizeof(CacheKey), length - sizeof(CacheKey), &used, file);
+    }
+    free(contents);
+    return tree;
+}
+
+/*
+ * Writes a tree to a cache file. The file is written under a unique temporary
+ * name in the same directory and renamed into place, so a reader never sees
+ * half of it. Failure (say, in a read-only directory) just means there is no
+ * cache next time.
+ */
+static void writeCache(char *cachePath, CacheKey *key, Value *tree) {
+    size_t size = strlen(cachePath) + sizeof(TEMPORARY_SUFFIX);
+    char *temporaryPath = malloc(size);
+    if (temporaryPath == NULL) {
+        return;
+    }
+    snprintf(temporaryPath, size, "%s%s", cachePath, TEMPORARY_SUFFIX);
+    int fd = mkstemp(temporaryPath);
+    if (fd != -1) {
+        // mkstemp() makes the file private; give it the mode fopen() would.
+        mode_t mask = umask(0);
+        umask(mask);
+        fchmod(fd, 0666 & ~mask);
+    }
+    FILE *file = fd == -1 ? NULL : fdopen(fd, "wb");
+    if (fd != -1 && file == NULL) {
+        close(fd);
+        remove(temporaryPath);
+    }
+    if (file != NULL) {
+        bool ok = fwrite(key, sizeof(CacheKey), 1, file) == 1 && writeLocatedTree(tree, file);
+        if (fclose(file) == 0 && ok) {
+            rename(temporaryPath, cachePath);
+        } else {
+            remove(temporaryPath);
+        }
+    }
+    free(temporaryPath);
+}
+
+/*
+ * Returns the parse tree of a Scheme source file, or NULL if it cannot be
+ * read.
+ */
+Value *parseFile(char *path) {
+    size_t length;
+    unsigned char *contents = readWholeFile(path, &length);
+    struct stat info;
+    if (contents == NULL || stat(path, &info) == -1) {
+        free(contents);
+        return NULL;
+    }
+    CacheKey key;
+    memset(&key, 0, sizeof(key));
+    memcpy(key.magic, CACHE_MAGIC, sizeof(key.magic));
+    key.size = length;
+    key.modifiedSeconds = info.st_mtim.tv_sec;
+    key.modifiedNanoseconds = info.st_mtim.tv_nsec;
+    key.hash = hashContents(contents, length);
+
+    size_t cachePathSize = strlen(path) + sizeof(CACHE_SUFFIX);
+    char *cachePath = malloc(cachePathSize);
+    if (cachePath == NULL) {
+        free(contents);
+        return NULL;
+    }
+    snprintf(cachePath, cachePathSize, "%s%s", path, CACHE_SUFFIX);
+    if (tracing) {
+        traceBegin("read-cache");
+    }
+    Value *tree = readCache(cachePath, &key, sourceFile(path));
+    if (tracing) {
+        traceEnd();
+    }
+    if (tree == NULL && length == 0) {
+        tree = makeNull();
+    } else if (tree == NULL) {
+        FILE *source = fmemopen(contents, length, "r");
+        tree = parse(tokenizeStream(source, path));
+        fclose(source);
+        writeCache(cachePath, &key, tree);
+    }
+    free(cachePath);
+    free(contents);
+    return tree;
+}
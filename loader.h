@@ -0,0 +1,19 @@
+#include "value.h"
+
+#ifndef LOADER_H
+#define LOADER_H
+
+/*
+ * Returns the parse tree of a Scheme source file, or NULL if it cannot be
+ * read.
+ *
+ * The tree is cached next to the source (lists.scm is cached in lists.scmc)
+ * in the binary encoding from serialize.h, source locations included, after
+ * a header holding the
+ * source's size, modification time and a hash of its contents.  While all
+ * three still match, later calls decode the cache instead of tokenizing and
+ * parsing the source again.
+ */
+Value *parseFile(char *path);
+
+#endif
@@ -0,0 +1,115 @@
+#include "location.h"
+#include "ptrmap.h"
+#include "talloc.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define MAX_FILES 65536
+#define COLUMN_BITS 20
+#define LINE_BITS 28
+
+#define FILTER_SHIFT 20
+#define FILTER_BITS (1 << FILTER_SHIFT)
+
+static PtrMap *locations = NULL;
+static char *files[MAX_FILES];
+static int fileCount = 0;
+
+/*
+ * One bit per hash of every address ever given a location.  Most of what the
+ * collector frees never had one, and checking this (which stays in cache) is
+ * much cheaper than probing the table.  Bits are only cleared when the table
+ * empties, so in a long run it just lets more frees through to the table.
+ */
+static uint64_t filter[FILTER_BITS / 64];
+
+static size_t filterBit(const void *pointer) {
+    uint64_t hash = (uint64_t) (uintptr_t) pointer * 0x9e3779b97f4a7c15ULL;
+    return hash >> (64 - FILTER_SHIFT);
+}
+
+/*
+ * Drops the location of a value the collector is about to free.
+ */
+static void forgetLocation(void *pointer) {
+    size_t bit = filterBit(pointer);
+    if (!(filter[bit / 64] & ((uint64_t) 1 << (bit % 64)))) {
+        return;
+    }
+    ptrMapRemove(locations, pointer);
+    if (ptrMapCount(locations) == 0) {
+        memset(filter, 0, sizeof(filter));
+    }
+}
+
+static void remember(Value *value, void *packed) {
+    size_t bit = filterBit(value);
+    filter[bit / 64] |= (uint64_t) 1 << (bit % 64);
+    ptrMapPut(locations, value, packed);
+}
+
+int sourceFile(char *name) {
+    for (int i = fileCount - 1; i >= 0; i--) {
+        if (strcmp(files[i], name) == 0) {
+            return i;
+        }
+    }
+    if (fileCount == MAX_FILES) {
+        return MAX_FILES - 1;
+    }
+    files[fileCount] = strdup(name);
+    return fileCount++;
+}
+
+char *sourceFileName(int file) {
+    return files[file];
+}
+
+/*
+ * Packs a location into a word.  Zero is never a packed location (lines
+ * start at 1), so it can mean "none".  Very long lines and files saturate
+ * rather than wrapping.
+ */
+static uintptr_t pack(int file, int line, int column) {
+    uintptr_t maxLine = ((uintptr_t) 1 << LINE_BITS) - 1;
+    uintptr_t maxColumn = ((uintptr_t) 1 << COLUMN_BITS) - 1;
+    uintptr_t packedLine = (uintptr_t) line < maxLine ? (uintptr_t) line : maxLine;
+    uintptr_t packedColumn = (uintptr_t) column < maxColumn ? (uintptr_t) column : maxColumn;
+    return ((uintptr_t) file << (LINE_BITS + COLUMN_BITS)) | (packedLine << COLUMN_BITS) | packedColumn;
+}
+
+void setLocation(Value *value, int file, int line, int column) {
+    if (locations == NULL) {
+        locations = newPtrMap();
+        addFreeHook(forgetLocation);
+    }
+    remember(value, (void *) pack(file, line, column));
+}
+
+void copyLocation(Value *to, Value *from) {
+    void *packed;
+    if (locations != NULL && ptrMapGet(locations, from, &packed)) {
+        remember(to, packed);
+    }
+}
+
+bool getLocation(Value *value, SourceLocation *location) {
+    void *word;
+    if (locations == NULL || !ptrMapGet(locations, value, &word)) {
+        return false;
+    }
+    uintptr_t packed = (uintptr_t) word;
+    location->file = files[packed >> (LINE_BITS + COLUMN_BITS)];
+    location->line = (packed >> COLUMN_BITS) & (((uintptr_t) 1 << LINE_BITS) - 1);
+    location->column = packed & (((uintptr_t) 1 << COLUMN_BITS) - 1);
+    return true;
+}
+
+void reportLocation(Value *value) {
+    SourceLocation location;
+    if (value != NULL && getLocation(value, &location)) {
+        printf("  at %s:%d:%d\n", location.file, location.line, location.column);
+    }
+}
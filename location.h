@@ -0,0 +1,58 @@
+#include <stdbool.h>
+#include "value.h"
+
+#ifndef LOCATION_H
+#define LOCATION_H
+
+/*
+ * Source locations for tokens and parse trees.
+ *
+ * The tokenizer records where each open parenthesis and quote is, and the
+ * parser moves that onto the first pair of the form it starts, so every
+ * combination in a parse tree can be located without Values getting any
+ * bigger.  Atoms inside lists are left out: they are most of the tokens, and
+ * an error in one is reported at the combination around it.  An atom that
+ * is a form of its own is located.  Locations live in a side table keyed by
+ * Value address, packed into one word: a file number, the line and the
+ * column (both counted from 1).  The collector tells the table when it frees
+ * a Value, so a recycled address never inherits an old location.
+ */
+typedef struct SourceLocation {
+    char *file;
+    int line;
+    int column;
+} SourceLocation;
+
+/*
+ * Returns the number for a file name, for setLocation().  Names are copied
+ * and kept for the rest of the run.
+ */
+int sourceFile(char *name);
+
+/*
+ * Returns the name of a file numbered by sourceFile().
+ */
+char *sourceFileName(int file);
+
+/*
+ * Records where a value came from.
+ */
+void setLocation(Value *value, int file, int line, int column);
+
+/*
+ * Gives a value the same location as another, if the other has one.
+ */
+void copyLocation(Value *to, Value *from);
+
+/*
+ * Looks up where a value came from.  Returns false if nobody recorded it.
+ */
+bool getLocation(Value *value, SourceLocation *location);
+
+/*
+ * Prints "  at file:line:column" to stdout, under the error message, if the
+ * value's location is known.
+ */
+void reportLocation(Value *value);
+
+#endif
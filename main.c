@@ -4,9 +4,20 @@
 #include "talloc.h"
 #include "value.h"
 #include "linkedlist.h"
+#include "server.h"
+#include "image.h"
+#include "loader.h"
+#include "profile.h"
+#include "gcstats.h"
+#include "census.h"
+#include "trace.h"
+#include "perfcounters.h"
+#include "output.h"
 #include <unistd.h>
 #include <stdio.h>
 #include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
 
 /* 
  * Returns true if the number of open and close parentheses match in an expression
@@ -44,10 +55,114 @@ bool parenthesesMatch(Value *tokens) {
 	return toReturn;
 }
 
-int main(void) {
+/*
+ * Parses (or reads the cached parse of) a whole source file and interprets
+ * it in the global environment.
+ */
+void loadFile(char *path) {
+	Value *tree = parseFile(path);
+	if (tree == NULL) {
+		printf("Error: cannot open '%s'\n", path);
+		texit(1);
+	}
+	interpret(tree);
+}
+
+/*
+ * Prints command line usage and exits.
+ */
+void usage() {
+	printf("Usage: interpreter [--image <file>] [--dump-image <file>] [--server <socket>] [--workers <n>] [--profile <file>] [--trace <file>] [--trace-sample <n>] [file ...]\n");
+	texit(1);
+}
+
+int main(int argc, char **argv) {
+	initOutput();
+	atexit(writeStatsReport);
+	addTeardownHook(writeCensusReport);
+	startPerfCounters();
+	if (getenv("SCHEME_GC_THRESHOLD") != NULL) {
+		setCollectionThreshold(strtoull(getenv("SCHEME_GC_THRESHOLD"), NULL, 10));
+	}
+	char *socketPath = NULL;
+	char *imagePath = NULL;
+	char *dumpPath = NULL;
+	char *profilePath = NULL;
+	char *tracePath = NULL;
+	int traceSample = 0;
+	int workerCount = 0;
+	int i = 1;
+	for (; i < argc && argv[i][0] == '-'; i++) {
+		if (!strcmp(argv[i], "--server") && i + 1 < argc) {
+			socketPath = argv[++i];
+		} else if (!strcmp(argv[i], "--image") && i + 1 < argc) {
+			imagePath = argv[++i];
+		} else if (!strcmp(argv[i], "--dump-image") && i + 1 < argc) {
+			dumpPath = argv[++i];
+		} else if (!strcmp(argv[i], "--profile") && i + 1 < argc) {
+			profilePath = argv[++i];
+		} else if (!strcmp(argv[i], "--trace") && i + 1 < argc) {
+			tracePath = argv[++i];
+		} else if (!strcmp(argv[i], "--trace-sample") && i + 1 < argc) {
+			traceSample = atoi(argv[++i]);
+			if (traceSample < 1) {
+				usage();
+			}
+		} else if (!strcmp(argv[i], "--workers") && i + 1 < argc) {
+			workerCount = atoi(argv[++i]);
+			if (workerCount < 1) {
+				usage();
+			}
+		} else {
+			usage();
+		}
+	}
+	if (imagePath != NULL) {
+		Frame *frame = loadImage(imagePath);
+		if (frame == NULL) {
+			texit(1);
+		}
+		setGlobalEnvironment(frame);
+	}
+	if (profilePath != NULL) {
+		if (!startProfiling(profilePath)) {
+			texit(1);
+		}
+	}
+	if (tracePath != NULL) {
+		if (!startTracing(tracePath, traceSample)) {
+			texit(1);
+		}
+		if (traceSample > 0) {
+			startNaming();
+		}
+	}
+	if (namingProcedures && imagePath != NULL) {
+		nameProcedures(globalEnvironment());
+	}
+	// Any remaining arguments are files to load before anything else.
+	for (; i < argc; i++) {
+		loadFile(argv[i]);
+	}
+	if (dumpPath != NULL) {
+		bool dumped = dumpImage(dumpPath, globalEnvironment());
+		tfree();
+		return dumped ? 0 : 1;
+	}
+	if (workerCount > 0) {
+		int status = runWorkerPool(workerCount, socketPath);
+		tfree();
+		return status;
+	}
+	if (socketPath != NULL) {
+		int status = runServer(socketPath);
+		tfree();
+		return status;
+	}
 	if (isatty(fileno(stdin)) == 1) {
 		// We're in a terminal!
 		printf("> ");
+		flushOutput();
 		char next = fgetc(stdin);
 		while (next != EOF) {
 			ungetc(next, stdin);
@@ -55,12 +170,14 @@ int main(void) {
 			// check if list has even parentheses. If not, continue.
 			while (!parenthesesMatch(list)) {
 				printf(". ");
+				flushOutput();
 				Value *moreTokens = tokenize();
 				list = joinList(list, moreTokens);
 			}
 		    Value *tree = parse(list);
 		    interpret(tree);
 		    printf("> ");
+		    flushOutput();
 		    next = fgetc(stdin);
 		}
 		tfree();
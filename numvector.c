@@ -0,0 +1,656 @@
+#include "numvector.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define X86_KERNELS
+#endif
+
+/*
+ * One implementation of every kernel that has more than a scalar version.
+ */
+typedef struct Kernels {
+    char *name;
+    void (*f64Add)(double *out, double *a, double *b, int length);
+    void (*f64Subtract)(double *out, double *a, double *b, int length);
+    void (*f64Multiply)(double *out, double *a, double *b, int length);
+    void (*f64Scale)(double *out, double *a, double k, int length);
+    double (*f64Dot)(double *a, double *b, int length);
+    double (*f64Sum)(double *a, int length);
+    double (*f64Min)(double *a, int length);
+    double (*f64Max)(double *a, int length);
+    void (*f64PrefixSum)(double *out, double *a, int length);
+    bool (*s64Add)(int64_t *out, int64_t *a, int64_t *b, int length);
+    bool (*s64Subtract)(int64_t *out, int64_t *a, int64_t *b, int length);
+    bool (*s64Sum)(int64_t *result, int64_t *a, int length);
+    int64_t (*s64Min)(int64_t *a, int length);
+    int64_t (*s64Max)(int64_t *a, int length);
+} Kernels;
+
+/*
+ * Scalar kernels.  The vector kernels below finish off with these.
+ */
+
+static void scalarF64Add(double *out, double *a, double *b, int length) {
+    for (int i = 0; i < length; i++) {
+        out[i] = a[i] + b[i];
+    }
+}
+
+static void scalarF64Subtract(double *out, double *a, double *b, int length) {
+    for (int i = 0; i < length; i++) {
+        out[i] = a[i] - b[i];
+    }
+}
+
+static void scalarF64Multiply(double *out, double *a, double *b, int length) {
+    for (int i = 0; i < length; i++) {
+        out[i] = a[i] * b[i];
+    }
+}
+
+static void scalarF64Scale(double *out, double *a, double k, int length) {
+    for (int i = 0; i < length; i++) {
+        out[i] = a[i] * k;
+    }
+}
+
+static double scalarF64Dot(double *a, double *b, int length) {
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+static double scalarF64Sum(double *a, int length) {
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += a[i];
+    }
+    return sum;
+}
+
+static double scalarF64Min(double *a, int length) {
+    double min = a[0];
+    for (int i = 1; i < length; i++) {
+        min = a[i] < min ? a[i] : min;
+    }
+    return min;
+}
+
+static double scalarF64Max(double *a, int length) {
+    double max = a[0];
+    for (int i = 1; i < length; i++) {
+        max = a[i] > max ? a[i] : max;
+    }
+    return max;
+}
+
+static void scalarF64PrefixSum(double *out, double *a, int length) {
+    double sum = 0;
+    for (int i = 0; i < length; i++) {
+        sum += a[i];
+        out[i] = sum;
+    }
+}
+
+static bool scalarS64Add(int64_t *out, int64_t *a, int64_t *b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (__builtin_add_overflow(a[i], b[i], &out[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool scalarS64Subtract(int64_t *out, int64_t *a, int64_t *b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (__builtin_sub_overflow(a[i], b[i], &out[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool scalarS64Sum(int64_t *result, int64_t *a, int length) {
+    int64_t sum = 0;
+    for (int i = 0; i < length; i++) {
+        if (__builtin_add_overflow(sum, a[i], &sum)) {
+            return false;
+        }
+    }
+    *result = sum;
+    return true;
+}
+
+static int64_t scalarS64Min(int64_t *a, int length) {
+    int64_t min = a[0];
+    for (int i = 1; i < length; i++) {
+        min = a[i] < min ? a[i] : min;
+    }
+    return min;
+}
+
+static int64_t scalarS64Max(int64_t *a, int length) {
+    int64_t max = a[0];
+    for (int i = 1; i < length; i++) {
+        max = a[i] > max ? a[i] : max;
+    }
+    return max;
+}
+
+static Kernels scalarKernels = {
+    "scalar",
+    scalarF64Add, scalarF64Subtract, scalarF64Multiply, scalarF64Scale,
+    scalarF64Dot, scalarF64Sum, scalarF64Min, scalarF64Max, scalarF64PrefixSum,
+    scalarS64Add, scalarS64Subtract, scalarS64Sum, scalarS64Min, scalarS64Max,
+};
+
+#ifdef X86_KERNELS
+
+/*
+ * SSE2 kernels, two lanes at a time.  Every x86-64 CPU has SSE2.  It has no
+ * 64-bit integer comparison, so s64 min and max stay scalar.
+ */
+
+static void sse2F64Add(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_pd(out + i, _mm_add_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    scalarF64Add(out + i, a + i, b + i, length - i);
+}
+
+static void sse2F64Subtract(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_pd(out + i, _mm_sub_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    scalarF64Subtract(out + i, a + i, b + i, length - i);
+}
+
+static void sse2F64Multiply(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+    }
+    scalarF64Multiply(out + i, a + i, b + i, length - i);
+}
+
+static void sse2F64Scale(double *out, double *a, double k, int length) {
+    __m128d factor = _mm_set1_pd(k);
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        _mm_storeu_pd(out + i, _mm_mul_pd(_mm_loadu_pd(a + i), factor));
+    }
+    scalarF64Scale(out + i, a + i, k, length - i);
+}
+
+static double sse2Total(__m128d sums) {
+    return _mm_cvtsd_f64(_mm_add_sd(sums, _mm_unpackhi_pd(sums, sums)));
+}
+
+static double sse2F64Dot(double *a, double *b, int length) {
+    // Two accumulators, so one addition need not wait for the last.
+    __m128d sums0 = _mm_setzero_pd();
+    __m128d sums1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sums0 = _mm_add_pd(sums0, _mm_mul_pd(_mm_loadu_pd(a + i), _mm_loadu_pd(b + i)));
+        sums1 = _mm_add_pd(sums1, _mm_mul_pd(_mm_loadu_pd(a + i + 2), _mm_loadu_pd(b + i + 2)));
+    }
+    return sse2Total(_mm_add_pd(sums0, sums1)) + scalarF64Dot(a + i, b + i, length - i);
+}
+
+static double sse2F64Sum(double *a, int length) {
+    __m128d sums0 = _mm_setzero_pd();
+    __m128d sums1 = _mm_setzero_pd();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        sums0 = _mm_add_pd(sums0, _mm_loadu_pd(a + i));
+        sums1 = _mm_add_pd(sums1, _mm_loadu_pd(a + i + 2));
+    }
+    return sse2Total(_mm_add_pd(sums0, sums1)) + scalarF64Sum(a + i, length - i);
+}
+
+static double sse2F64Min(double *a, int length) {
+    if (length < 2) {
+        return scalarF64Min(a, length);
+    }
+    __m128d mins = _mm_loadu_pd(a);
+    int i = 2;
+    for (; i + 2 <= length; i += 2) {
+        mins = _mm_min_pd(mins, _mm_loadu_pd(a + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, mins);
+    double min = lanes[0] < lanes[1] ? lanes[0] : lanes[1];
+    return i < length && a[i] < min ? a[i] : min;
+}
+
+static double sse2F64Max(double *a, int length) {
+    if (length < 2) {
+        return scalarF64Max(a, length);
+    }
+    __m128d maxes = _mm_loadu_pd(a);
+    int i = 2;
+    for (; i + 2 <= length; i += 2) {
+        maxes = _mm_max_pd(maxes, _mm_loadu_pd(a + i));
+    }
+    double lanes[2];
+    _mm_storeu_pd(lanes, maxes);
+    double max = lanes[0] > lanes[1] ? lanes[0] : lanes[1];
+    return i < length && a[i] > max ? a[i] : max;
+}
+
+static void sse2F64PrefixSum(double *out, double *a, int length) {
+    __m128d zero = _mm_setzero_pd();
+    __m128d carry = zero;
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128d x = _mm_loadu_pd(a + i);
+        // (x0, x1) + (0, x0) = (x0, x0 + x1), then add what came before.
+        x = _mm_add_pd(_mm_add_pd(x, _mm_unpacklo_pd(zero, x)), carry);
+        _mm_storeu_pd(out + i, x);
+        carry = _mm_unpackhi_pd(x, x);
+    }
+    if (i < length) {
+        out[i] = _mm_cvtsd_f64(carry) + a[i];
+    }
+}
+
+/*
+ * Returns whether any lane of a mask has its sign bit set.
+ */
+static bool sse2AnySign(__m128i mask) {
+    return _mm_movemask_pd(_mm_castsi128_pd(mask)) != 0;
+}
+
+static bool sse2S64Add(int64_t *out, int64_t *a, int64_t *b, int length) {
+    // A sum overflowed if its sign differs from both operands'.
+    __m128i overflow = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+        __m128i sum = _mm_add_epi64(x, y);
+        overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(x, sum), _mm_xor_si128(y, sum)));
+        _mm_storeu_si128((__m128i *) (out + i), sum);
+    }
+    return !sse2AnySign(overflow) && scalarS64Add(out + i, a + i, b + i, length - i);
+}
+
+static bool sse2S64Subtract(int64_t *out, int64_t *a, int64_t *b, int length) {
+    // A difference overflowed if the operands' signs differ and its sign
+    // differs from the first operand's.
+    __m128i overflow = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+        __m128i y = _mm_loadu_si128((__m128i *) (b + i));
+        __m128i difference = _mm_sub_epi64(x, y);
+        overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(x, y), _mm_xor_si128(x, difference)));
+        _mm_storeu_si128((__m128i *) (out + i), difference);
+    }
+    return !sse2AnySign(overflow) && scalarS64Subtract(out + i, a + i, b + i, length - i);
+}
+
+static bool sse2S64Sum(int64_t *result, int64_t *a, int length) {
+    __m128i sums = _mm_setzero_si128();
+    __m128i overflow = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 2 <= length; i += 2) {
+        __m128i x = _mm_loadu_si128((__m128i *) (a + i));
+        __m128i sum = _mm_add_epi64(sums, x);
+        overflow = _mm_or_si128(overflow, _mm_and_si128(_mm_xor_si128(sums, sum), _mm_xor_si128(x, sum)));
+        sums = sum;
+    }
+    int64_t lanes[2];
+    _mm_storeu_si128((__m128i *) lanes, sums);
+    int64_t rest;
+    return !sse2AnySign(overflow) && scalarS64Sum(&rest, a + i, length - i)
+        && !__builtin_add_overflow(lanes[0], lanes[1], result) && !__builtin_add_overflow(*result, rest, result);
+}
+
+static Kernels sse2Kernels = {
+    "sse2",
+    sse2F64Add, sse2F64Subtract, sse2F64Multiply, sse2F64Scale,
+    sse2F64Dot, sse2F64Sum, sse2F64Min, sse2F64Max, sse2F64PrefixSum,
+    sse2S64Add, sse2S64Subtract, sse2S64Sum, scalarS64Min, scalarS64Max,
+};
+
+/*
+ * AVX2 kernels, four lanes at a time, compiled for AVX2 whatever the rest
+ * of the program is compiled for and only called if the CPU has it.
+ */
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void avx2F64Add(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_add_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalarF64Add(out + i, a + i, b + i, length - i);
+}
+
+AVX2 static void avx2F64Subtract(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_sub_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalarF64Subtract(out + i, a + i, b + i, length - i);
+}
+
+AVX2 static void avx2F64Multiply(double *out, double *a, double *b, int length) {
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+    }
+    scalarF64Multiply(out + i, a + i, b + i, length - i);
+}
+
+AVX2 static void avx2F64Scale(double *out, double *a, double k, int length) {
+    __m256d factor = _mm256_set1_pd(k);
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        _mm256_storeu_pd(out + i, _mm256_mul_pd(_mm256_loadu_pd(a + i), factor));
+    }
+    scalarF64Scale(out + i, a + i, k, length - i);
+}
+
+AVX2 static double avx2Total(__m256d sums) {
+    __m128d pairs = _mm_add_pd(_mm256_castpd256_pd128(sums), _mm256_extractf128_pd(sums, 1));
+    return _mm_cvtsd_f64(_mm_add_sd(pairs, _mm_unpackhi_pd(pairs, pairs)));
+}
+
+AVX2 static double avx2F64Dot(double *a, double *b, int length) {
+    __m256d sums0 = _mm256_setzero_pd();
+    __m256d sums1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        sums0 = _mm256_add_pd(sums0, _mm256_mul_pd(_mm256_loadu_pd(a + i), _mm256_loadu_pd(b + i)));
+        sums1 = _mm256_add_pd(sums1, _mm256_mul_pd(_mm256_loadu_pd(a + i + 4), _mm256_loadu_pd(b + i + 4)));
+    }
+    return avx2Total(_mm256_add_pd(sums0, sums1)) + scalarF64Dot(a + i, b + i, length - i);
+}
+
+AVX2 static double avx2F64Sum(double *a, int length) {
+    __m256d sums0 = _mm256_setzero_pd();
+    __m256d sums1 = _mm256_setzero_pd();
+    int i = 0;
+    for (; i + 8 <= length; i += 8) {
+        sums0 = _mm256_add_pd(sums0, _mm256_loadu_pd(a + i));
+        sums1 = _mm256_add_pd(sums1, _mm256_loadu_pd(a + i + 4));
+    }
+    return avx2Total(_mm256_add_pd(sums0, sums1)) + scalarF64Sum(a + i, length - i);
+}
+
+AVX2 static double avx2F64Min(double *a, int length) {
+    if (length < 4) {
+        return scalarF64Min(a, length);
+    }
+    __m256d mins = _mm256_loadu_pd(a);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        mins = _mm256_min_pd(mins, _mm256_loadu_pd(a + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, mins);
+    double min = scalarF64Min(lanes, 4);
+    if (i < length) {
+        double rest = scalarF64Min(a + i, length - i);
+        min = rest < min ? rest : min;
+    }
+    return min;
+}
+
+AVX2 static double avx2F64Max(double *a, int length) {
+    if (length < 4) {
+        return scalarF64Max(a, length);
+    }
+    __m256d maxes = _mm256_loadu_pd(a);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        maxes = _mm256_max_pd(maxes, _mm256_loadu_pd(a + i));
+    }
+    double lanes[4];
+    _mm256_storeu_pd(lanes, maxes);
+    double max = scalarF64Max(lanes, 4);
+    if (i < length) {
+        double rest = scalarF64Max(a + i, length - i);
+        max = rest > max ? rest : max;
+    }
+    return max;
+}
+
+AVX2 static void avx2F64PrefixSum(double *out, double *a, int length) {
+    __m256d zero = _mm256_setzero_pd();
+    __m256d carry = zero;
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256d x = _mm256_loadu_pd(a + i);
+        // Add x shifted up one lane, then the result shifted up two.
+        x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(2, 1, 0, 0)), zero, 0x1));
+        x = _mm256_add_pd(x, _mm256_blend_pd(_mm256_permute4x64_pd(x, _MM_SHUFFLE(1, 0, 0, 0)), zero, 0x3));
+        x = _mm256_add_pd(x, carry);
+        _mm256_storeu_pd(out + i, x);
+        carry = _mm256_permute4x64_pd(x, _MM_SHUFFLE(3, 3, 3, 3));
+    }
+    double sum = _mm256_cvtsd_f64(carry);
+    for (; i < length; i++) {
+        sum += a[i];
+        out[i] = sum;
+    }
+}
+
+AVX2 static bool avx2AnySign(__m256i mask) {
+    return _mm256_movemask_pd(_mm256_castsi256_pd(mask)) != 0;
+}
+
+AVX2 static bool avx2S64Add(int64_t *out, int64_t *a, int64_t *b, int length) {
+    __m256i overflow = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+        __m256i sum = _mm256_add_epi64(x, y);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(x, sum), _mm256_xor_si256(y, sum)));
+        _mm256_storeu_si256((__m256i *) (out + i), sum);
+    }
+    return !avx2AnySign(overflow) && scalarS64Add(out + i, a + i, b + i, length - i);
+}
+
+AVX2 static bool avx2S64Subtract(int64_t *out, int64_t *a, int64_t *b, int length) {
+    __m256i overflow = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        __m256i y = _mm256_loadu_si256((__m256i *) (b + i));
+        __m256i difference = _mm256_sub_epi64(x, y);
+        overflow = _mm256_or_si256(overflow,
+                                   _mm256_and_si256(_mm256_xor_si256(x, y), _mm256_xor_si256(x, difference)));
+        _mm256_storeu_si256((__m256i *) (out + i), difference);
+    }
+    return !avx2AnySign(overflow) && scalarS64Subtract(out + i, a + i, b + i, length - i);
+}
+
+AVX2 static bool avx2S64Sum(int64_t *result, int64_t *a, int length) {
+    __m256i sums = _mm256_setzero_si256();
+    __m256i overflow = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        __m256i sum = _mm256_add_epi64(sums, x);
+        overflow = _mm256_or_si256(overflow, _mm256_and_si256(_mm256_xor_si256(sums, sum), _mm256_xor_si256(x, sum)));
+        sums = sum;
+    }
+    int64_t lanes[5];
+    _mm256_storeu_si256((__m256i *) lanes, sums);
+    return !avx2AnySign(overflow) && scalarS64Sum(&lanes[4], a + i, length - i) && scalarS64Sum(result, lanes, 5);
+}
+
+AVX2 static int64_t avx2S64Min(int64_t *a, int length) {
+    if (length < 4) {
+        return scalarS64Min(a, length);
+    }
+    __m256i mins = _mm256_loadu_si256((__m256i *) a);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        mins = _mm256_blendv_epi8(mins, x, _mm256_cmpgt_epi64(mins, x));
+    }
+    int64_t lanes[5];
+    _mm256_storeu_si256((__m256i *) lanes, mins);
+    lanes[4] = length > i ? scalarS64Min(a + i, length - i) : lanes[0];
+    return scalarS64Min(lanes, 5);
+}
+
+AVX2 static int64_t avx2S64Max(int64_t *a, int length) {
+    if (length < 4) {
+        return scalarS64Max(a, length);
+    }
+    __m256i maxes = _mm256_loadu_si256((__m256i *) a);
+    int i = 4;
+    for (; i + 4 <= length; i += 4) {
+        __m256i x = _mm256_loadu_si256((__m256i *) (a + i));
+        maxes = _mm256_blendv_epi8(maxes, x, _mm256_cmpgt_epi64(x, maxes));
+    }
+    int64_t lanes[5];
+    _mm256_storeu_si256((__m256i *) lanes, maxes);
+    lanes[4] = length > i ? scalarS64Max(a + i, length - i) : lanes[0];
+    return scalarS64Max(lanes, 5);
+}
+
+static Kernels avx2Kernels = {
+    "avx2",
+    avx2F64Add, avx2F64Subtract, avx2F64Multiply, avx2F64Scale,
+    avx2F64Dot, avx2F64Sum, avx2F64Min, avx2F64Max, avx2F64PrefixSum,
+    avx2S64Add, avx2S64Subtract, avx2S64Sum, avx2S64Min, avx2S64Max,
+};
+
+#endif
+
+static Kernels *kernels = NULL;
+
+/*
+ * Picks the widest kernels the CPU has and SCHEME_SIMD allows.
+ */
+static Kernels *currentKernels() {
+    if (kernels != NULL) {
+        return kernels;
+    }
+    kernels = &scalarKernels;
+#ifdef X86_KERNELS
+    char *limit = getenv("SCHEME_SIMD");
+    __builtin_cpu_init();
+    if ((limit == NULL || strcmp(limit, "avx2") == 0) && __builtin_cpu_supports("avx2")) {
+        kernels = &avx2Kernels;
+    } else if (limit == NULL || strcmp(limit, "scalar") != 0) {
+        kernels = &sse2Kernels;
+    }
+#endif
+    return kernels;
+}
+
+char *numericKernelName() {
+    return currentKernels()->name;
+}
+
+void f64Add(double *out, double *a, double *b, int length) {
+    currentKernels()->f64Add(out, a, b, length);
+}
+
+void f64Subtract(double *out, double *a, double *b, int length) {
+    currentKernels()->f64Subtract(out, a, b, length);
+}
+
+void f64Multiply(double *out, double *a, double *b, int length) {
+    currentKernels()->f64Multiply(out, a, b, length);
+}
+
+void f64Scale(double *out, double *a, double k, int length) {
+    currentKernels()->f64Scale(out, a, k, length);
+}
+
+double f64Dot(double *a, double *b, int length) {
+    return currentKernels()->f64Dot(a, b, length);
+}
+
+double f64Sum(double *a, int length) {
+    return currentKernels()->f64Sum(a, length);
+}
+
+double f64Min(double *a, int length) {
+    return currentKernels()->f64Min(a, length);
+}
+
+double f64Max(double *a, int length) {
+    return currentKernels()->f64Max(a, length);
+}
+
+void f64PrefixSum(double *out, double *a, int length) {
+    currentKernels()->f64PrefixSum(out, a, length);
+}
+
+bool s64Add(int64_t *out, int64_t *a, int64_t *b, int length) {
+    return currentKernels()->s64Add(out, a, b, length);
+}
+
+bool s64Subtract(int64_t *out, int64_t *a, int64_t *b, int length) {
+    return currentKernels()->s64Subtract(out, a, b, length);
+}
+
+bool s64Multiply(int64_t *out, int64_t *a, int64_t *b, int length) {
+    for (int i = 0; i < length; i++) {
+        if (__builtin_mul_overflow(a[i], b[i], &out[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool s64Scale(int64_t *out, int64_t *a, int64_t k, int length) {
+    for (int i = 0; i < length; i++) {
+        if (__builtin_mul_overflow(a[i], k, &out[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool s64Dot(int64_t *result, int64_t *a, int64_t *b, int length) {
+    int64_t sum = 0;
+    for (int i = 0; i < length; i++) {
+        int64_t product;
+        if (__builtin_mul_overflow(a[i], b[i], &product) || __builtin_add_overflow(sum, product, &sum)) {
+            return false;
+        }
+    }
+    *result = sum;
+    return true;
+}
+
+bool s64Sum(int64_t *result, int64_t *a, int length) {
+    return currentKernels()->s64Sum(result, a, length);
+}
+
+int64_t s64Min(int64_t *a, int length) {
+    return currentKernels()->s64Min(a, length);
+}
+
+int64_t s64Max(int64_t *a, int length) {
+    return currentKernels()->s64Max(a, length);
+}
+
+bool s64PrefixSum(int64_t *out, int64_t *a, int length) {
+    int64_t sum = 0;
+    for (int i = 0; i < length; i++) {
+        if (__builtin_add_overflow(sum, a[i], &sum)) {
+            return false;
+        }
+        out[i] = sum;
+    }
+    return true;
+}
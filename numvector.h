@@ -0,0 +1,59 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifndef NUMVECTOR_H
+#define NUMVECTOR_H
+
+/*
+ * Bulk kernels over the unboxed arrays of f64vectors and s64vectors.
+ *
+ * Each kernel has a scalar version and, on x86-64, SSE2 and AVX2 versions.
+ * The widest one the CPU supports is picked the first time a kernel runs,
+ * unless SCHEME_SIMD names a narrower one ("sse2" or "scalar").  Sums, dot
+ * products and prefix sums of doubles add in a different order depending on
+ * the kernel, so their last bits can differ between machines.
+ *
+ * There is no 64-bit integer multiply in SSE2 or AVX2, so the s64 multiply,
+ * scale and dot kernels are scalar everywhere.  The s64 kernels return false
+ * if a result, or for a reduction any partial sum, does not fit in 64 bits,
+ * leaving the output unspecified.
+ *
+ * Arrays may overlap only if they are the same array.
+ */
+
+/*
+ * Returns the kernels in use: "avx2", "sse2" or "scalar".
+ */
+char *numericKernelName();
+
+/*
+ * out[i] = a[i] + b[i], a[i] - b[i], a[i] * b[i] or a[i] * k.
+ */
+void f64Add(double *out, double *a, double *b, int length);
+void f64Subtract(double *out, double *a, double *b, int length);
+void f64Multiply(double *out, double *a, double *b, int length);
+void f64Scale(double *out, double *a, double k, int length);
+bool s64Add(int64_t *out, int64_t *a, int64_t *b, int length);
+bool s64Subtract(int64_t *out, int64_t *a, int64_t *b, int length);
+bool s64Multiply(int64_t *out, int64_t *a, int64_t *b, int length);
+bool s64Scale(int64_t *out, int64_t *a, int64_t k, int length);
+
+/*
+ * Reductions.  Min and max need at least one element.
+ */
+double f64Dot(double *a, double *b, int length);
+double f64Sum(double *a, int length);
+double f64Min(double *a, int length);
+double f64Max(double *a, int length);
+bool s64Dot(int64_t *result, int64_t *a, int64_t *b, int length);
+bool s64Sum(int64_t *result, int64_t *a, int length);
+int64_t s64Min(int64_t *a, int length);
+int64_t s64Max(int64_t *a, int length);
+
+/*
+ * out[i] = a[0] + ... + a[i].
+ */
+void f64PrefixSum(double *out, double *a, int length);
+bool s64PrefixSum(int64_t *out, int64_t *a, int length);
+
+#endif
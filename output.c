@@ -0,0 +1,42 @@
+#include "output.h"
+#include <stdio.h>
+
+#define OUTPUT_BUFFER_SIZE (1 << 20)
+
+static char buffer[OUTPUT_BUFFER_SIZE];
+
+void initOutput() {
+    setvbuf(stdout, buffer, _IOFBF, OUTPUT_BUFFER_SIZE);
+}
+
+void flushOutput() {
+    fflush(stdout);
+}
+
+void outputChars(char *chars, size_t length) {
+    fwrite(chars, 1, length, stdout);
+}
+
+void outputString(char *string) {
+    fputs(string, stdout);
+}
+
+void outputChar(char c) {
+    putc(c, stdout);
+}
+
+void outputInteger(int64_t i) {
+    // Digits are written backwards from the end; the magnitude is unsigned
+    // so that INT64_MIN negates.
+    char digits[24];
+    char *start = digits + sizeof(digits);
+    uint64_t magnitude = i < 0 ? -(uint64_t) i : (uint64_t) i;
+    do {
+        *--start = '0' + magnitude % 10;
+        magnitude /= 10;
+    } while (magnitude != 0);
+    if (i < 0) {
+        *--start = '-';
+    }
+    outputChars(start, digits + sizeof(digits) - start);
+}
@@ -0,0 +1,38 @@
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef OUTPUT_H
+#define OUTPUT_H
+
+/*
+ * Buffered standard output for printing results.
+ *
+ * Results go to stdout, which initOutput() gives a large buffer so that
+ * printing a long list costs a few write()s rather than one per atom, even
+ * at a terminal.  Messages printed with printf() share the buffer, so they
+ * stay in order with the results.  Nothing reaches the file descriptor until
+ * the buffer fills or is flushed: by flushOutput() wherever someone may be
+ * waiting for it (the REPL prompt), by exit(), and by whatever redirects
+ * stdout (see server.c and golden_test.c).
+ */
+
+/*
+ * Installs the buffer.  Must run before anything is printed.
+ */
+void initOutput();
+
+/*
+ * Writes out whatever is buffered.
+ */
+void flushOutput();
+
+/*
+ * Buffer length characters, a NUL-terminated string, one character or an
+ * integer in decimal.
+ */
+void outputChars(char *chars, size_t length);
+void outputString(char *string);
+void outputChar(char c);
+void outputInteger(int64_t i);
+
+#endif
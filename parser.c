@@ -2,7 +2,14 @@
 #include "value.h"
 #include "linkedlist.h"
 #include "talloc.h"
+#include "location.h"
+#include "trace.h"
+#include "perfcounters.h"
+#include "bignum.h"
+#include "output.h"
+#include "flonum.h"
 #include <stdio.h>
+#include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 
@@ -11,9 +18,10 @@
 /*
  * Prints a simple error trace and exits the program upon discovering unparsable input
  */
-void raiseParseError(char* message, bool condition) {
+void raiseParseError(char* message, bool condition, Value *where) {
 	if (!condition) {
 		printf("Syntax error: %s\n", message);
+		reportLocation(where);
 		texit(1);
 	}
 }
@@ -26,7 +34,7 @@ Value *addToParseTree(Value *tree, int *depth, Value *token) {
 	if (token->type == CLOSE_TYPE) {
 		// recurse up the level
 		(*depth)--;
-		raiseParseError("too many close parentheses.", (*depth) >= 0);
+		raiseParseError("too many close parentheses.", (*depth) >= 0, token);
 		Value *tmpList = makeNull();
 		Value *top = car(tree);
 		// Pop off the stack
@@ -35,18 +43,28 @@ Value *addToParseTree(Value *tree, int *depth, Value *token) {
 			tree = cdr(tree);
 			top = car(tree);
 		}
+		if (!strcmp(top->s, "#(")) {
+			// a vector literal, which evaluates to itself
+			tmpList = listToVector(tmpList);
+		}
+		// the list starts where its open paren did
+		copyLocation(tmpList, top);
 		// skip past open type we just read
 		tree = cdr(tree); 
         if (tree->type != NULL_TYPE && car(tree)->type == QUOTE_TYPE) {
             //if the tree is not null, we need to check for a quote
+            Value *quote = car(tree);
             tree = cdr(tree); //skip past the quote
             Value *quoteExpansion = makeNull();
             quoteExpansion = cons(tmpList, quoteExpansion);
             Value *quoteSymbol = makeNull();
             quoteSymbol->type = SYMBOL_TYPE;
-            quoteSymbol->s = talloc(sizeof(char) * 6);
+            quoteSymbol->s = tallocKind(sizeof(char) * 6, STRING_ALLOCATION);
             strcpy(quoteSymbol->s, "quote");
             tmpList = cons(quoteSymbol, quoteExpansion);
+            copyLocation(tmpList, quote);
+            copyLocation(quoteExpansion, quote);
+            copyLocation(quoteSymbol, quote);
 
         }
 		// Push tmpList onto the tree
@@ -59,15 +77,19 @@ Value *addToParseTree(Value *tree, int *depth, Value *token) {
     } else {
 		// continue push to tree, checking for quotes
         if (tree->type != NULL_TYPE && car(tree)->type == QUOTE_TYPE) {
+            Value *quote = car(tree);
             //skip past the quote
             tree = cdr(tree);
             Value *quoteExpansion = makeNull();
             quoteExpansion = cons(token, quoteExpansion);
+            copyLocation(quoteExpansion, quote);
             Value *quoteSymbol = makeNull();
              quoteSymbol->type = SYMBOL_TYPE;
-            quoteSymbol->s = talloc(sizeof(char) * 6);
+            quoteSymbol->s = tallocKind(sizeof(char) * 6, STRING_ALLOCATION);
             strcpy(quoteSymbol->s, "quote");
+            copyLocation(quoteSymbol, quote);
             quoteExpansion = cons(quoteSymbol, quoteExpansion);
+            copyLocation(quoteExpansion, quote);
             tree = cons(quoteExpansion, tree);
         } else {
             tree = cons(token, tree);
@@ -80,6 +102,14 @@ Value *addToParseTree(Value *tree, int *depth, Value *token) {
  * Returns the pointer to a parse tree representing the program.
  */
 Value *parse(Value *tokens) {
+    char *callerSite = allocationSite;
+    allocationSite = "parse";
+    if (tracing) {
+        traceBegin("parse");
+    }
+    if (countingPerf) {
+        perfBegin(PARSE_PHASE);
+    }
 	Value *tree = makeNull();
     int depth = 0;
 	
@@ -90,95 +120,148 @@ Value *parse(Value *tokens) {
         tree = addToParseTree(tree, &depth, token);
         current = cdr(current);
     }
-    raiseParseError("not enough close parentheses.", depth == 0);
-	return reverse(tree);
+    if (depth != 0) {
+        // point at the innermost paren left open
+        while (car(tree)->type != OPEN_TYPE) {
+            tree = cdr(tree);
+        }
+        raiseParseError("not enough close parentheses.", false, car(tree));
+    }
+    tree = reverse(tree);
+    allocationSite = callerSite;
+    if (countingPerf) {
+        perfEnd();
+    }
+    if (tracing) {
+        traceEnd();
+    }
+	return tree;
 }
 /*
- * Recursively prints a parse tree
+ * Writes the shortest text that reads back as the same double.
  */
-void printTreeHelper(Value *tree, bool prefixWithSpace, bool expectingList, bool atBeginning) {
-    assert(tree != NULL);
-    if (prefixWithSpace && !atBeginning && (tree->type != NULL_TYPE || !expectingList) && tree->type != CONS_TYPE) {
-        printf(" ");
-    }
-	if (tree->type == INT_TYPE) {
-        if (expectingList) {
-            printf(". %i", tree->i);
-        } else {
-            printf("%i",tree->i);
-        }
-	}
-	else if (tree->type == DOUBLE_TYPE) {
-        if (expectingList) {
-            printf(". %f", tree->d);
-        } else {
-		    printf("%f",tree->d);
-        }
-	}
-	else if (tree->type == STR_TYPE) {
-        if (expectingList) {
-            printf(". \"%s\"", tree->s);
-        } else {
-            printf("\"%s\"",tree->s);
-        }
-	}
-    else if (tree->type == SYMBOL_TYPE) {
-        if (expectingList) {
-            printf(". %s", tree->s);
-        } else {
-            printf("%s",tree->s);
-        }
-	} 
-	else if (tree->type == BOOL_TYPE) {
-		if (expectingList) {
-            printf(". %s", tree->s);
-        } else {
-            printf("%s",tree->s);
+static void printDouble(double d) {
+    char text[FLONUM_LENGTH];
+    outputChars(text, formatDouble(d, text));
+}
+
+/*
+ * Prints a value that has no elements to print.  Only the empty list and
+ * quotes leave out the dot when they end an improper list.
+ */
+static void printAtom(Value *tree, bool expectingList) {
+    if (tree->type == NULL_TYPE) {
+        if (!expectingList) {
+            outputString("()");
         }
-	}
-	else if (tree->type == CONS_TYPE) {
-        if (expectingList) {
-            if(atBeginning) {
-                printTreeHelper(tree->c.car, true, false, true);
-                printTreeHelper(tree->c.cdr, true, true, false);
-            }
-            else {
-                printTreeHelper(tree->c.car, true, false, false);
-                printTreeHelper(tree->c.cdr, true, true, false);
+        return;
+    } else if (tree->type == QUOTE_TYPE) {
+        outputChar('\'');
+        return;
+    }
+    char *text = NULL;
+    switch (tree->type) {
+        case INT_TYPE:
+        case BIGNUM_TYPE:
+        case DOUBLE_TYPE:
+        case STR_TYPE:
+        case SYMBOL_TYPE:
+        case BOOL_TYPE:
+        case F64VECTOR_TYPE:
+        case S64VECTOR_TYPE:
+            break;
+        case CLOSURE_TYPE:
+        case PRIMITIVE_TYPE:
+            text = "#procedure";
+            break;
+        case HASH_TYPE:
+            text = "#hash-table";
+            break;
+        case STRING_BUILDER_TYPE:
+            text = "#string-builder";
+            break;
+        default:
+            return;
+    }
+    if (expectingList) {
+        outputString(". ");
+    }
+    if (tree->type == INT_TYPE) {
+        outputInteger(tree->i);
+    } else if (tree->type == BIGNUM_TYPE) {
+        char *digits = integerToString(tree);
+        outputString(digits);
+        free(digits);
+    } else if (tree->type == DOUBLE_TYPE) {
+        printDouble(tree->d);
+    } else if (tree->type == STR_TYPE) {
+        outputChar('"');
+        outputChars(tree->str.chars, tree->str.length);
+        outputChar('"');
+    } else if (tree->type == SYMBOL_TYPE || tree->type == BOOL_TYPE) {
+        outputString(tree->s);
+    } else if (tree->type == F64VECTOR_TYPE || tree->type == S64VECTOR_TYPE) {
+        outputString(tree->type == F64VECTOR_TYPE ? "#f64(" : "#s64(");
+        for (int i = 0; i < tree->n.length; i++) {
+            if (i > 0) {
+                outputChar(' ');
             }
-        } else {
-            if (atBeginning) {
-                printf("(");
+            if (tree->type == F64VECTOR_TYPE) {
+                printDouble(tree->n.f64[i]);
             } else {
-                printf(" (");
+                outputInteger(tree->n.s64[i]);
             }
-            printTreeHelper(tree->c.car, false, false, false);
-            printTreeHelper(tree->c.cdr, true, true, false);
-            printf(")");
-        }
-	}
-	else if (tree->type == NULL_TYPE) {
-		if (!expectingList) {
-			printf("()");
-		}
-	}
-    else if (tree->type == CLOSURE_TYPE) {
-        if (expectingList) {
-            printf(". #procedure");
-        } else {
-            printf("#procedure");
         }
+        outputChar(')');
+    } else {
+        outputString(text);
     }
-    else if (tree->type == PRIMITIVE_TYPE) {
-        if (expectingList) {
-            printf(". #procedure");
-        } else {
-            printf("#procedure");
+}
+
+/*
+ * What is left to print, kept on an explicit stack rather than the C stack
+ * so that long and deeply nested lists print in bounded C stack space.
+ */
+typedef enum {
+    // tree, as the flags say.  Lists come in two parts: the elements of an
+    // open list are printed with expectingList set, so that a tail which is
+    // not a list gets a dot.
+    PRINT_TREE,
+    // The elements of the vector tree from index on.
+    PRINT_ITEMS,
+    PRINT_CLOSE,
+} printStep;
+
+typedef struct PrintTask {
+    printStep step;
+    Value *tree;
+    int index;
+    bool prefixWithSpace;
+    bool expectingList;
+    bool atBeginning;
+} PrintTask;
+
+typedef struct PrintStack {
+    PrintTask *tasks;
+    int count;
+    int capacity;
+} PrintStack;
+
+static void pushTask(PrintStack *stack, PrintTask task) {
+    if (stack->count == stack->capacity) {
+        stack->capacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        PrintTask *tasks = realloc(stack->tasks, stack->capacity * sizeof(PrintTask));
+        if (tasks == NULL) {
+            free(stack->tasks);
+            outOfMemoryError();
         }
+        stack->tasks = tasks;
     }
-    else if (tree->type == QUOTE_TYPE) {
-        printf("'");
-    }
+    stack->tasks[stack->count++] = task;
+}
+
+static void pushTree(PrintStack *stack, Value *tree, bool prefixWithSpace, bool expectingList, bool atBeginning) {
+    pushTask(stack, (PrintTask) {PRINT_TREE, tree, 0, prefixWithSpace, expectingList, atBeginning});
 }
 
 /*
@@ -188,8 +271,47 @@ void printTreeHelper(Value *tree, bool prefixWithSpace, bool expectingList, bool
 void printTree(Value *tree) {
     assert(tree != NULL);
     if (tree->type == NULL_TYPE) {
-        printf("()");
-    } else {
-        printTreeHelper(tree, false, tree->type == CONS_TYPE, true);
+        outputString("()");
+        return;
+    }
+    PrintStack stack = {NULL, 0, 0};
+    pushTree(&stack, tree, false, tree->type == CONS_TYPE, true);
+    while (stack.count > 0) {
+        PrintTask task = stack.tasks[--stack.count];
+        tree = task.tree;
+        if (task.step == PRINT_CLOSE) {
+            outputChar(')');
+            continue;
+        } else if (task.step == PRINT_ITEMS) {
+            if (task.index < tree->v.length) {
+                pushTask(&stack, (PrintTask) {PRINT_ITEMS, tree, task.index + 1});
+                pushTree(&stack, tree->v.items[task.index], task.index > 0, false, task.index == 0);
+            } else {
+                outputChar(')');
+            }
+            continue;
+        }
+        if (task.prefixWithSpace && !task.atBeginning && (tree->type != NULL_TYPE || !task.expectingList)
+            && tree->type != CONS_TYPE) {
+            outputChar(' ');
+        }
+        if (tree->type == CONS_TYPE) {
+            // The cdr goes on first so that the car comes off first.
+            if (task.expectingList) {
+                pushTree(&stack, tree->c.cdr, true, true, false);
+                pushTree(&stack, tree->c.car, true, false, task.atBeginning);
+            } else {
+                outputString(task.atBeginning ? "(" : " (");
+                pushTask(&stack, (PrintTask) {PRINT_CLOSE});
+                pushTree(&stack, tree->c.cdr, true, true, false);
+                pushTree(&stack, tree->c.car, false, false, false);
+            }
+        } else if (tree->type == VECTOR_TYPE) {
+            outputString(task.expectingList ? ". #(" : "#(");
+            pushTask(&stack, (PrintTask) {PRINT_ITEMS, tree, 0});
+        } else {
+            printAtom(tree, task.expectingList);
+        }
     }
+    free(stack.tasks);
 }
@@ -0,0 +1,177 @@
+#define _GNU_SOURCE
+#include "perfcounters.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+#define COUNTER_COUNT 7
+// Phases that can be nested inside each other at once.
+#define MAX_NESTING 64
+
+bool countingPerf = false;
+
+static struct {
+    char *name;
+    uint32_t type;
+    uint64_t config;
+} counters[COUNTER_COUNT] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"branch_misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"l1d_misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                       | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    {"llc_misses", PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                       | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)},
+    // Software counters, which the kernel provides even without a PMU.
+    {"task_clock_ns", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page_faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+};
+
+static char *phaseNames[PHASE_COUNT] = {"other", "tokenize", "parse", "eval", "gc"};
+
+static int fds[COUNTER_COUNT];
+static uint64_t totals[PHASE_COUNT][COUNTER_COUNT];
+static uint64_t lastReading[COUNTER_COUNT];
+static perfPhase phases[MAX_NESTING];
+static int nesting = 0;
+static char *outputPath = NULL;
+
+static int openCounter(uint32_t type, uint64_t config) {
+    struct perf_event_attr attr;
+    memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = type;
+    attr.config = config;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+/*
+ * Charges what each counter has advanced by since the last reading to the
+ * phase running now.
+ */
+static void charge() {
+    int depth = nesting < MAX_NESTING ? nesting : MAX_NESTING;
+    perfPhase current = depth > 0 ? phases[depth - 1] : OTHER_PHASE;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        uint64_t value;
+        if (fds[i] != -1 && read(fds[i], &value, sizeof(value)) == sizeof(value)) {
+            totals[current][i] += value - lastReading[i];
+            lastReading[i] = value;
+        }
+    }
+}
+
+static void writePerfCounters() {
+    FILE *out = fopen(outputPath, "w");
+    if (out == NULL) {
+        return;
+    }
+    if (!countingPerf) {
+        fprintf(out, "{}\n");
+        fclose(out);
+        return;
+    }
+    charge();
+    fprintf(out, "{");
+    for (int phase = 0; phase < PHASE_COUNT; phase++) {
+        fprintf(out, "%s\"%s\": {", phase > 0 ? ", " : "", phaseNames[phase]);
+        for (int i = 0; i < COUNTER_COUNT; i++) {
+            fprintf(out, "%s\"%s\": ", i > 0 ? ", " : "", counters[i].name);
+            if (fds[i] == -1) {
+                fprintf(out, "null");
+            } else {
+                fprintf(out, "%llu", (unsigned long long) totals[phase][i]);
+            }
+        }
+        fprintf(out, "}");
+    }
+    fprintf(out, "}\n");
+    fclose(out);
+}
+
+bool startPerfCounters() {
+    outputPath = getenv("SCHEME_PERF_COUNTERS");
+    if (outputPath == NULL) {
+        return true;
+    }
+    atexit(writePerfCounters);
+    int opened = 0;
+    for (int i = 0; i < COUNTER_COUNT; i++) {
+        fds[i] = openCounter(counters[i].type, counters[i].config);
+        if (fds[i] != -1) {
+            opened++;
+        }
+    }
+    if (opened == 0) {
+        perror("Performance counters unavailable");
+        return false;
+    }
+    countingPerf = true;
+    charge();
+    return true;
+}
+
+void perfBegin(perfPhase phase) {
+    charge();
+    if (nesting < MAX_NESTING) {
+        phases[nesting] = phase;
+    }
+    nesting++;
+}
+
+void perfEnd() {
+    if (nesting > 0) {
+        charge();
+        nesting--;
+    }
+}
+
+void perfUnwind() {
+    charge();
+    nesting = 0;
+}
+
+static Value *makeSymbol(char *name) {
+    Value *symbol = makeNull();
+    symbol->type = SYMBOL_TYPE;
+    symbol->s = tallocKind(strlen(name) + 1, STRING_ALLOCATION);
+    strcpy(symbol->s, name);
+    return symbol;
+}
+
+static Value *makeCount(uint64_t count) {
+    Value *value = makeNull();
+    if (count <= INT64_MAX) {
+        value->type = INT_TYPE;
+        value->i = (int64_t) count;
+    } else {
+        value->type = DOUBLE_TYPE;
+        value->d = (double) count;
+    }
+    return value;
+}
+
+Value *perfCountersList() {
+    Value *list = makeNull();
+    if (!countingPerf) {
+        return list;
+    }
+    charge();
+    for (int phase = PHASE_COUNT - 1; phase >= 0; phase--) {
+        Value *counts = makeNull();
+        for (int i = COUNTER_COUNT - 1; i >= 0; i--) {
+            if (fds[i] != -1) {
+                counts = cons(cons(makeSymbol(counters[i].name), makeCount(totals[phase][i])), counts);
+            }
+        }
+        list = cons(cons(makeSymbol(phaseNames[phase]), counts), list);
+    }
+    return list;
+}
@@ -0,0 +1,73 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "value.h"
+
+#ifndef PERFCOUNTERS_H
+#define PERFCOUNTERS_H
+
+/*
+ * Hardware performance counters, per phase of the interpreter's work.
+ *
+ * When SCHEME_PERF_COUNTERS names a file, startPerfCounters() opens Linux
+ * perf_event counters for this process (user space only) and the
+ * interpreter marks the start and end of each phase.  Whatever the counters
+ * advance by is charged to the innermost phase running, so a file loaded
+ * while evaluating counts as tokenize and parse, not eval.  At exit the
+ * totals are written to the file as one line of JSON:
+ *
+ *   {"other": {"cycles": N, "instructions": N, "branch_misses": N,
+ *    "l1d_misses": N, "llc_misses": N, "task_clock_ns": N, "page_faults": N},
+ *    "tokenize": {...}, "parse": {...}, "eval": {...}, "gc": {...}}
+ *
+ * A counter the kernel or the hardware does not provide is written as null.
+ * Many virtual machines have no hardware counters at all, which leaves just
+ * the two software ones; if not even those can be opened the file holds {}.
+ * Reading the counters costs a few system calls per phase, so they are off
+ * unless asked for.
+ */
+typedef enum {
+    OTHER_PHASE,
+    TOKENIZE_PHASE,
+    PARSE_PHASE,
+    EVAL_PHASE,
+    GC_PHASE,
+    PHASE_COUNT,
+} perfPhase;
+
+/*
+ * Whether counters are running.
+ */
+extern bool countingPerf;
+
+/*
+ * Opens the counters if SCHEME_PERF_COUNTERS is set.  Returns false if it
+ * is set but no counter could be opened, after printing why; the program
+ * carries on without them.
+ */
+bool startPerfCounters();
+
+/*
+ * Starts charging counts to a phase, until the matching perfEnd().
+ */
+void perfBegin(perfPhase phase);
+
+/*
+ * Goes back to charging counts to the phase that was running before the
+ * matching perfBegin().
+ */
+void perfEnd();
+
+/*
+ * Goes back to charging counts to no phase, after an evaluation was
+ * abandoned by an error.
+ */
+void perfUnwind();
+
+/*
+ * Returns the totals so far as an association list from phase name to an
+ * association list from counter name to count, leaving out unavailable
+ * counters.  Returns the empty list if no counters are running.
+ */
+Value *perfCountersList();
+
+#endif
@@ -0,0 +1,244 @@
+#include "profile.h"
+#include "interpreter.h"
+#include "linkedlist.h"
+#include "ptrmap.h"
+#include "location.h"
+#include "talloc.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <signal.h>
+#include <sys/time.h>
+
+// Entries kept on the shadow stack; deeper calls are counted but not named.
+#define MAX_DEPTH 65536
+// Frames recorded per sample, keeping the innermost ones.
+#define MAX_SAMPLE_DEPTH 256
+// Size of the sample log, in words.
+#define LOG_WORDS (1 << 22)
+#define INTERVAL_USEC 1000
+
+bool profiling = false;
+bool namingProcedures = false;
+
+static char *volatile shadowStack[MAX_DEPTH];
+static volatile int depth = 0;
+
+/*
+ * Samples are appended to the log as a frame count followed by that many
+ * name pointers, outermost first.  The signal handler may not allocate, so
+ * the log is allocated up front and samples that do not fit are dropped.
+ */
+static uintptr_t *sampleLog = NULL;
+static size_t logLength = 0;
+static unsigned long droppedSamples = 0;
+
+static PtrMap *names = NULL;
+static char *outputPath = NULL;
+
+static void takeSample(int signum) {
+    int kept = depth < MAX_DEPTH ? depth : MAX_DEPTH;
+    int first = kept > MAX_SAMPLE_DEPTH ? kept - MAX_SAMPLE_DEPTH : 0;
+    size_t frames = kept - first + (first > 0);
+    if (logLength + 1 + frames > LOG_WORDS) {
+        droppedSamples++;
+        return;
+    }
+    sampleLog[logLength++] = frames;
+    if (first > 0) {
+        sampleLog[logLength++] = (uintptr_t) "...";
+    }
+    for (int i = first; i < kept; i++) {
+        sampleLog[logLength++] = (uintptr_t) shadowStack[i];
+    }
+}
+
+static int compareStrings(const void *a, const void *b) {
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*
+ * Turns one sample into a folded stack line (without the count).
+ */
+static char *foldSample(uintptr_t *frames, size_t count) {
+    if (count == 0) {
+        return strdup("[toplevel]");
+    }
+    size_t length = 0;
+    for (size_t i = 0; i < count; i++) {
+        length += strlen((char *) frames[i]) + 1;
+    }
+    char *folded = malloc(length);
+    if (folded == NULL) {
+        return NULL;
+    }
+    char *end = folded;
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0) {
+            *end++ = ';';
+        }
+        size_t nameLength = strlen((char *) frames[i]);
+        memcpy(end, (char *) frames[i], nameLength);
+        end += nameLength;
+    }
+    *end = '\0';
+    return folded;
+}
+
+/*
+ * Stops the timer and writes the folded stacks, identical stacks merged.
+ */
+static void writeProfile() {
+    struct itimerval off;
+    memset(&off, 0, sizeof(off));
+    setitimer(ITIMER_PROF, &off, NULL);
+    profiling = false;
+
+    size_t sampleCount = 0;
+    for (size_t position = 0; position < logLength; position += 1 + sampleLog[position]) {
+        sampleCount++;
+    }
+    char **stacks = malloc((sampleCount + 1) * sizeof(char *));
+    FILE *out = fopen(outputPath, "w");
+    if (stacks == NULL || out == NULL) {
+        fprintf(stderr, "Profile error: cannot write %s\n", outputPath);
+        free(stacks);
+        return;
+    }
+    size_t position = 0;
+    for (size_t i = 0; i < sampleCount; i++) {
+        stacks[i] = foldSample(sampleLog + position + 1, sampleLog[position]);
+        position += 1 + sampleLog[position];
+    }
+    qsort(stacks, sampleCount, sizeof(char *), compareStrings);
+    for (size_t i = 0; i < sampleCount;) {
+        size_t run = 1;
+        while (i + run < sampleCount && strcmp(stacks[i], stacks[i + run]) == 0) {
+            run++;
+        }
+        fprintf(out, "%s %zu\n", stacks[i], run);
+        for (size_t j = 0; j < run; j++) {
+            free(stacks[i + j]);
+        }
+        i += run;
+    }
+    fclose(out);
+    free(stacks);
+    if (droppedSamples > 0) {
+        fprintf(stderr, "Profile: %lu samples dropped (log full)\n", droppedSamples);
+    }
+}
+
+/*
+ * Names are never freed, since samples may point at them; the collector
+ * only makes us forget which body they belonged to.
+ */
+static void forgetName(void *body) {
+    ptrMapRemove(names, body);
+}
+
+void startNaming() {
+    if (namingProcedures) {
+        return;
+    }
+    names = newPtrMap();
+    for (int i = 0; i < primitiveCount(); i++) {
+        ptrMapPut(names, (void *) primitiveAt(i), primitiveName(i));
+    }
+    addFreeHook(forgetName);
+    namingProcedures = true;
+}
+
+bool startProfiling(char *path) {
+    sampleLog = malloc(LOG_WORDS * sizeof(uintptr_t));
+    if (sampleLog == NULL) {
+        fprintf(stderr, "Profile error: out of memory\n");
+        return false;
+    }
+    startNaming();
+    outputPath = path;
+
+    // Restart interrupted reads rather than failing them.
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = takeSample;
+    action.sa_flags = SA_RESTART;
+    sigemptyset(&action.sa_mask);
+    struct itimerval timer;
+    timer.it_interval.tv_sec = 0;
+    timer.it_interval.tv_usec = INTERVAL_USEC;
+    timer.it_value = timer.it_interval;
+    if (sigaction(SIGPROF, &action, NULL) == -1 || setitimer(ITIMER_PROF, &timer, NULL) == -1) {
+        perror("Profile error");
+        return false;
+    }
+    profiling = true;
+    atexit(writeProfile);
+    return true;
+}
+
+void nameProcedure(Value *body, char *name) {
+    ptrMapPut(names, body, strdup(name));
+}
+
+void nameProcedures(Frame *frame) {
+    for (Value *bindings = frame->bindings; bindings->type != NULL_TYPE; bindings = cdr(bindings)) {
+        Value *binding = car(bindings);
+        if (cdr(binding)->type == CLOSURE_TYPE) {
+            nameProcedure(cdr(binding)->cl.body, car(binding)->s);
+        }
+    }
+}
+
+static void push(char *name) {
+    if (depth < MAX_DEPTH) {
+        shadowStack[depth] = name;
+    }
+    depth++;
+}
+
+/*
+ * Names a closure nobody defined after where its body is, if known.
+ */
+static char *nameAnonymous(Value *body) {
+    SourceLocation location;
+    if (!getLocation(body, &location)) {
+        return "lambda";
+    }
+    char *name = malloc(strlen(location.file) + 32);
+    if (name == NULL) {
+        return "lambda";
+    }
+    sprintf(name, "lambda@%s:%d:%d", location.file, location.line, location.column);
+    ptrMapPut(names, body, name);
+    return name;
+}
+
+char *procedureName(Value *procedure) {
+    char *name;
+    if (procedure->type == CLOSURE_TYPE) {
+        if (!ptrMapGet(names, procedure->cl.body, (void **) &name)) {
+            name = nameAnonymous(procedure->cl.body);
+        }
+    } else if (!ptrMapGet(names, (void *) procedure->pf, (void **) &name)) {
+        name = "primitive";
+    }
+    return name;
+}
+
+void profileEnter(Value *procedure) {
+    push(procedureName(procedure));
+}
+
+void profileEnterNamed(char *name) {
+    push(name);
+}
+
+void profileLeave() {
+    depth--;
+}
+
+void profileReset() {
+    depth = 0;
+}
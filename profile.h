@@ -0,0 +1,86 @@
+#include <stdbool.h>
+#include "value.h"
+#include "interpreter.h"
+
+#ifndef PROFILE_H
+#define PROFILE_H
+
+/*
+ * A sampling profiler for Scheme code.
+ *
+ * While profiling, apply() keeps a shadow stack of the procedures it is in
+ * the middle of calling, each named by the define that bound it (closures
+ * nobody defined are named after the location of their body, like
+ * "lambda@file.scm:3:5"), or by its builtin name.  A SIGPROF timer copies
+ * the shadow stack into a preallocated sample log every millisecond of CPU
+ * time (or every timer tick, if the kernel's are longer), and at exit the
+ * samples are written in the folded format flamegraph.pl and similar tools
+ * read: one line per distinct stack, outermost call first, separated by
+ * semicolons, then a space and the number of samples.  Time spent outside
+ * any procedure is charged to [toplevel], and garbage collection to [gc].
+ *
+ * When profiling is off the only cost is a test of the profiling flag.
+ */
+
+/*
+ * Whether the profiler is running.
+ */
+extern bool profiling;
+
+/*
+ * Whether closures are being named as they are defined (while profiling or
+ * tracing).
+ */
+extern bool namingProcedures;
+
+/*
+ * Starts sampling, and arranges for the folded stacks to be written to path
+ * when the program exits.  Returns false (after printing a message) if the
+ * timer cannot be started.
+ */
+bool startProfiling(char *path);
+
+/*
+ * Starts keeping the names of procedures, for procedureName(), without
+ * sampling.  startProfiling() calls it.
+ */
+void startNaming();
+
+/*
+ * Returns the name a procedure goes by in stacks and traces.  The name is
+ * never freed.
+ */
+char *procedureName(Value *procedure);
+
+/*
+ * Names the closures whose body is body, for stacks that include them.
+ */
+void nameProcedure(Value *body, char *name);
+
+/*
+ * Names every closure bound in a frame after its binding, for closures that
+ * were defined before profiling started (e.g. in a heap image).
+ */
+void nameProcedures(Frame *frame);
+
+/*
+ * Pushes a procedure (a closure or primitive) onto the shadow stack.
+ */
+void profileEnter(Value *procedure);
+
+/*
+ * Pushes a named pseudo-procedure, such as [gc], onto the shadow stack.
+ */
+void profileEnterNamed(char *name);
+
+/*
+ * Pops the innermost entry off the shadow stack.
+ */
+void profileLeave();
+
+/*
+ * Empties the shadow stack, after an evaluation was abandoned by an error.
+ */
+void profileReset();
+
+#endif
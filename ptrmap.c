@@ -0,0 +1,142 @@
+#include "ptrmap.h"
+#include "talloc.h"
+#include <stdint.h>
+#include <stdlib.h>
+#include <stdio.h>
+
+#define INITIAL_CAPACITY 64
+
+typedef struct PtrMapEntry {
+    const void *key;
+    void *value;
+} PtrMapEntry;
+
+struct PtrMap {
+    PtrMapEntry *entries;
+    size_t capacity;
+    size_t count;
+};
+
+/*
+ * Print an error message indicating the program is out of memory.
+ */
+static void ptrMapOutOfMemory() {
+    printf("Out of memory!");
+    texit(1);
+}
+
+/*
+ * Spreads the bits of a pointer over the table; the low bits of heap
+ * pointers are mostly zero because of alignment.
+ */
+static size_t slotFor(PtrMap *map, const void *key) {
+    uint64_t hash = (uint64_t) (uintptr_t) key;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 33;
+    return hash & (map->capacity - 1);
+}
+
+PtrMap *newPtrMap() {
+    PtrMap *map = malloc(sizeof(PtrMap));
+    if (map == NULL) {
+        ptrMapOutOfMemory();
+    }
+    map->capacity = INITIAL_CAPACITY;
+    map->count = 0;
+    map->entries = calloc(map->capacity, sizeof(PtrMapEntry));
+    if (map->entries == NULL) {
+        ptrMapOutOfMemory();
+    }
+    return map;
+}
+
+void freePtrMap(PtrMap *map) {
+    free(map->entries);
+    free(map);
+}
+
+bool ptrMapGet(PtrMap *map, const void *key, void **value) {
+    size_t slot = slotFor(map, key);
+    while (map->entries[slot].key != NULL) {
+        if (map->entries[slot].key == key) {
+            if (value != NULL) {
+                *value = map->entries[slot].value;
+            }
+            return true;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    return false;
+}
+
+/*
+ * Doubles the table, re-inserting every entry.
+ */
+static void grow(PtrMap *map) {
+    PtrMapEntry *oldEntries = map->entries;
+    size_t oldCapacity = map->capacity;
+    map->capacity *= 2;
+    map->entries = calloc(map->capacity, sizeof(PtrMapEntry));
+    if (map->entries == NULL) {
+        ptrMapOutOfMemory();
+    }
+    for (size_t i = 0; i < oldCapacity; i++) {
+        if (oldEntries[i].key != NULL) {
+            size_t slot = slotFor(map, oldEntries[i].key);
+            while (map->entries[slot].key != NULL) {
+                slot = (slot + 1) & (map->capacity - 1);
+            }
+            map->entries[slot] = oldEntries[i];
+        }
+    }
+    free(oldEntries);
+}
+
+void ptrMapPut(PtrMap *map, const void *key, void *value) {
+    // Keep the load factor under 3/4 so probe sequences stay short.
+    if ((map->count + 1) * 4 > map->capacity * 3) {
+        grow(map);
+    }
+    size_t slot = slotFor(map, key);
+    while (map->entries[slot].key != NULL) {
+        if (map->entries[slot].key == key) {
+            map->entries[slot].value = value;
+            return;
+        }
+        slot = (slot + 1) & (map->capacity - 1);
+    }
+    map->entries[slot].key = key;
+    map->entries[slot].value = value;
+    map->count++;
+}
+
+void ptrMapRemove(PtrMap *map, const void *key) {
+    size_t mask = map->capacity - 1;
+    size_t slot = slotFor(map, key);
+    while (map->entries[slot].key != key) {
+        if (map->entries[slot].key == NULL) {
+            return;
+        }
+        slot = (slot + 1) & mask;
+    }
+    // Shift later members of the probe run back instead of leaving a
+    // tombstone, so lookups never have to skip deleted entries.
+    size_t hole = slot;
+    size_t next = (hole + 1) & mask;
+    while (map->entries[next].key != NULL) {
+        size_t home = slotFor(map, map->entries[next].key);
+        if (((next - home) & mask) >= ((next - hole) & mask)) {
+            map->entries[hole] = map->entries[next];
+            hole = next;
+        }
+        next = (next + 1) & mask;
+    }
+    map->entries[hole].key = NULL;
+    map->entries[hole].value = NULL;
+    map->count--;
+}
+
+size_t ptrMapCount(PtrMap *map) {
+    return map->count;
+}
@@ -0,0 +1,46 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef PTRMAP_H
+#define PTRMAP_H
+
+/*
+ * A hash map from pointers to pointer-sized values, for side tables that
+ * describe heap objects without making them any bigger.  It uses open
+ * addressing with linear probing and lives outside the talloc heap (it is
+ * malloc'ed), so the garbage collector never frees it.
+ */
+typedef struct PtrMap PtrMap;
+
+/*
+ * Create an empty map.
+ */
+PtrMap *newPtrMap();
+
+/*
+ * Free a map and its table (but not the keys or values).
+ */
+void freePtrMap(PtrMap *map);
+
+/*
+ * Look up a key.  Returns true and stores the value in *value (if value is
+ * not NULL) when the key is present.
+ */
+bool ptrMapGet(PtrMap *map, const void *key, void **value);
+
+/*
+ * Add a key, or replace its value if it is already present.
+ */
+void ptrMapPut(PtrMap *map, const void *key, void *value);
+
+/*
+ * Remove a key if it is present.
+ */
+void ptrMapRemove(PtrMap *map, const void *key);
+
+/*
+ * The number of keys in the map.
+ */
+size_t ptrMapCount(PtrMap *map);
+
+#endif
@@ -0,0 +1,74 @@
+#include "region.h"
+#include "talloc.h"
+#include <stdint.h>
+#include <stdlib.h>
+
+// Bytes in each chunk, enough for a few hundred nested frames.
+#define CHUNK_SIZE (64 * 1024)
+#define ALIGNMENT 16
+
+typedef struct RegionChunk {
+    struct RegionChunk *previous;
+    struct RegionChunk *next;
+    size_t used;
+    _Alignas(ALIGNMENT) char bytes[CHUNK_SIZE];
+} RegionChunk;
+
+// The chunk being allocated from; later chunks are empty and kept for reuse.
+static RegionChunk *current = NULL;
+
+void *regionAllocate(size_t size) {
+    size = (size + ALIGNMENT - 1) & ~(size_t) (ALIGNMENT - 1);
+    if (current == NULL || current->used + size > CHUNK_SIZE) {
+        RegionChunk *next = current == NULL ? NULL : current->next;
+        if (next == NULL) {
+            next = malloc(sizeof(RegionChunk));
+            if (next == NULL || size > CHUNK_SIZE) {
+                outOfMemoryError();
+            }
+            next->previous = current;
+            next->next = NULL;
+            if (current != NULL) {
+                current->next = next;
+            }
+        }
+        next->used = 0;
+        current = next;
+    }
+    void *pointer = current->bytes + current->used;
+    current->used += size;
+    return pointer;
+}
+
+RegionMark regionMark() {
+    return (RegionMark) {current, current == NULL ? 0 : current->used};
+}
+
+void regionRelease(RegionMark mark) {
+    if (mark.chunk == NULL) {
+        regionReset();
+        return;
+    }
+    current = mark.chunk;
+    current->used = mark.used;
+}
+
+void regionReset() {
+    if (current == NULL) {
+        return;
+    }
+    while (current->previous != NULL) {
+        current = current->previous;
+    }
+    current->used = 0;
+}
+
+bool regionContains(void *pointer) {
+    for (RegionChunk *chunk = current; chunk != NULL; chunk = chunk->previous) {
+        uintptr_t start = (uintptr_t) chunk->bytes;
+        if ((uintptr_t) pointer >= start && (uintptr_t) pointer < start + chunk->used) {
+            return true;
+        }
+    }
+    return false;
+}
@@ -0,0 +1,53 @@
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifndef REGION_H
+#define REGION_H
+
+/*
+ * A stack-like region for frames that cannot outlive the call or let that
+ * made them (see analysis.h).  Memory is bumped out of malloc'ed chunks and
+ * handed back all at once by releasing to a mark taken earlier, so these
+ * frames cost neither a talloc() nor any work from the collector.  Chunks
+ * are kept for reuse once released.
+ *
+ * Nothing in the region is a root: whatever it points to must be reachable
+ * some other way by the time the collector runs, which holds because
+ * collections only happen between top-level forms, when the region is empty.
+ */
+
+/*
+ * A point to release the region back to.
+ */
+typedef struct RegionMark {
+    struct RegionChunk *chunk;
+    size_t used;
+} RegionMark;
+
+/*
+ * Allocates size bytes, aligned for any Value or Frame.
+ */
+void *regionAllocate(size_t size);
+
+/*
+ * Returns the current top of the region.
+ */
+RegionMark regionMark();
+
+/*
+ * Frees everything allocated since the mark was taken.
+ */
+void regionRelease(RegionMark mark);
+
+/*
+ * Frees everything in the region, e.g. after an error abandoned the calls
+ * that would have released it.
+ */
+void regionReset();
+
+/*
+ * Returns whether a pointer is to memory currently allocated in the region.
+ */
+bool regionContains(void *pointer);
+
+#endif
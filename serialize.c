@@ -0,0 +1,501 @@
+#include "serialize.h"
+#include "value.h"
+#include "linkedlist.h"
+#include "talloc.h"
+#include "ptrmap.h"
+#include "location.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define TAG_NULL 0
+#define TAG_CONS 1
+#define TAG_INT 2
+#define TAG_DOUBLE 3
+#define TAG_STR 4
+#define TAG_SYMBOL 5
+#define TAG_BOOL 6
+#define TAG_REFERENCE 7
+#define TAG_VECTOR 8
+#define TAG_BIGNUM 9
+#define TAG_F64VECTOR 10
+#define TAG_S64VECTOR 11
+
+#define BINARY_MAGIC "SCMBIN1\n"
+
+/*
+ * A growable stack of pointers, used so that neither direction recurses on
+ * long lists.
+ */
+typedef struct PointerStack {
+    void **items;
+    size_t count;
+    size_t capacity;
+} PointerStack;
+
+static bool push(PointerStack *stack, void *item) {
+    if (stack->count == stack->capacity) {
+        size_t newCapacity = stack->capacity == 0 ? 64 : stack->capacity * 2;
+        void **newItems = realloc(stack->items, newCapacity * sizeof(void *));
+        if (newItems == NULL) {
+            return false;
+        }
+        stack->items = newItems;
+        stack->capacity = newCapacity;
+    }
+    stack->items[stack->count++] = item;
+    return true;
+}
+
+/*
+ * A growable byte buffer. Values are encoded into memory and written out in
+ * one go rather than a byte at a time.
+ */
+typedef struct ByteBuffer {
+    unsigned char *bytes;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} ByteBuffer;
+
+static void reserveBytes(ByteBuffer *buffer, size_t needed) {
+    if (buffer->failed || buffer->length + needed <= buffer->capacity) {
+        return;
+    }
+    size_t newCapacity = buffer->capacity == 0 ? 4096 : buffer->capacity;
+    while (newCapacity < buffer->length + needed) {
+        newCapacity *= 2;
+    }
+    unsigned char *newBytes = realloc(buffer->bytes, newCapacity);
+    if (newBytes == NULL) {
+        buffer->failed = true;
+        return;
+    }
+    buffer->bytes = newBytes;
+    buffer->capacity = newCapacity;
+}
+
+static void writeByte(ByteBuffer *buffer, unsigned char byte) {
+    reserveBytes(buffer, 1);
+    if (!buffer->failed) {
+        buffer->bytes[buffer->length++] = byte;
+    }
+}
+
+static void writeBytes(ByteBuffer *buffer, void *bytes, size_t length) {
+    reserveBytes(buffer, length);
+    if (!buffer->failed) {
+        memcpy(buffer->bytes + buffer->length, bytes, length);
+        buffer->length += length;
+    }
+}
+
+static void writeLength(ByteBuffer *buffer, uint64_t length) {
+    while (length >= 0x80) {
+        writeByte(buffer, (length & 0x7f) | 0x80);
+        length >>= 7;
+    }
+    writeByte(buffer, length);
+}
+
+static void writeFixed(ByteBuffer *buffer, uint64_t bits) {
+    unsigned char bytes[8];
+    for (int i = 0; i < 8; i++) {
+        bytes[i] = (bits >> (8 * i)) & 0xff;
+    }
+    writeBytes(buffer, bytes, 8);
+}
+
+/*
+ * Encodes a value graph into a buffer. Returns false if it holds something
+ * that cannot be encoded. If locations is not NULL, the line and column of
+ * every value that has a location are added to it, after their index, and
+ * *located counts them.
+ */
+static bool encode(Value *root, ByteBuffer *buffer, ByteBuffer *locations, uint64_t *located) {
+    PointerStack stack = {NULL, 0, 0};
+    PtrMap *indices = newPtrMap();
+    uintptr_t nextIndex = 0;
+    bool ok = push(&stack, root);
+    while (ok && stack.count > 0) {
+        Value *value = stack.items[--stack.count];
+        void *index;
+        if (value->type == NULL_TYPE) {
+            writeByte(buffer, TAG_NULL);
+            continue;
+        } else if (ptrMapGet(indices, value, &index)) {
+            writeByte(buffer, TAG_REFERENCE);
+            writeLength(buffer, (uintptr_t) index);
+            continue;
+        }
+        SourceLocation location;
+        if (locations != NULL && getLocation(value, &location)) {
+            writeLength(locations, nextIndex);
+            writeLength(locations, location.line);
+            writeLength(locations, location.column);
+            (*located)++;
+        }
+        ptrMapPut(indices, value, (void *) nextIndex++);
+        switch (value->type) {
+            case CONS_TYPE:
+                writeByte(buffer, TAG_CONS);
+                // The car is popped (and so written) first.
+                ok = push(&stack, value->c.cdr) && push(&stack, value->c.car);
+                break;
+            case INT_TYPE:
+                writeByte(buffer, TAG_INT);
+                writeFixed(buffer, (uint64_t) value->i);
+                break;
+            case DOUBLE_TYPE: {
+                uint64_t bits;
+                memcpy(&bits, &value->d, sizeof(bits));
+                writeByte(buffer, TAG_DOUBLE);
+                writeFixed(buffer, bits);
+                break;
+            }
+            case STR_TYPE:
+                writeByte(buffer, TAG_STR);
+                writeLength(buffer, value->str.length);
+                writeBytes(buffer, value->str.chars, value->str.length);
+                break;
+            case SYMBOL_TYPE:
+            case BOOL_TYPE: {
+                size_t length = strlen(value->s);
+                writeByte(buffer, value->type == SYMBOL_TYPE ? TAG_SYMBOL : TAG_BOOL);
+                writeLength(buffer, length);
+                writeBytes(buffer, value->s, length);
+                break;
+            }
+            case BIGNUM_TYPE: {
+                writeByte(buffer, TAG_BIGNUM);
+                writeByte(buffer, value->b.negative);
+                writeLength(buffer, value->b.length);
+                for (int i = 0; i < value->b.length; i++) {
+                    unsigned char bytes[4];
+                    for (int j = 0; j < 4; j++) {
+                        bytes[j] = (value->b.digits[i] >> (8 * j)) & 0xff;
+                    }
+                    writeBytes(buffer, bytes, 4);
+                }
+                break;
+            }
+            case F64VECTOR_TYPE:
+            case S64VECTOR_TYPE:
+                writeByte(buffer, value->type == F64VECTOR_TYPE ? TAG_F64VECTOR : TAG_S64VECTOR);
+                writeLength(buffer, value->n.length);
+                for (int i = 0; i < value->n.length; i++) {
+                    uint64_t bits;
+                    memcpy(&bits, &value->n.f64[i], sizeof(bits));
+                    writeFixed(buffer, bits);
+                }
+                break;
+            case VECTOR_TYPE:
+                writeByte(buffer, TAG_VECTOR);
+                writeLength(buffer, value->v.length);
+                // Pushed last to first, so the first element is written first.
+                for (int i = value->v.length - 1; ok && i >= 0; i--) {
+                    ok = push(&stack, value->v.items[i]);
+                }
+                break;
+            default:
+                ok = false;
+        }
+    }
+    free(stack.items);
+    freePtrMap(indices);
+    return ok && !buffer->failed;
+}
+
+/*
+ * Writes the encoding of a tree to a file.
+ */
+bool writeTree(Value *tree, FILE *file) {
+    ByteBuffer buffer = {NULL, 0, 0, false};
+    bool ok = encode(tree, &buffer, NULL, NULL) && fwrite(buffer.bytes, 1, buffer.length, file) == buffer.length;
+    free(buffer.bytes);
+    return ok;
+}
+
+/*
+ * Writes the encoding of a tree followed by its source locations.
+ */
+bool writeLocatedTree(Value *tree, FILE *file) {
+    ByteBuffer buffer = {NULL, 0, 0, false};
+    ByteBuffer locations = {NULL, 0, 0, false};
+    uint64_t located = 0;
+    bool ok = encode(tree, &buffer, &locations, &located);
+    writeLength(&buffer, located);
+    writeBytes(&buffer, locations.bytes, locations.length);
+    ok = ok && !buffer.failed && !locations.failed && fwrite(buffer.bytes, 1, buffer.length, file) == buffer.length;
+    free(buffer.bytes);
+    free(locations.bytes);
+    return ok;
+}
+
+/*
+ * Writes a binary data file.
+ */
+bool writeBinaryFile(Value *value, char *path) {
+    ByteBuffer buffer = {NULL, 0, 0, false};
+    writeBytes(&buffer, BINARY_MAGIC, 8);
+    bool ok = encode(value, &buffer, NULL, NULL);
+    if (ok) {
+        FILE *file = fopen(path, "wb");
+        ok = file != NULL && fwrite(buffer.bytes, 1, buffer.length, file) == buffer.length;
+        if (file != NULL && fclose(file) != 0) {
+            ok = false;
+        }
+    }
+    free(buffer.bytes);
+    return ok;
+}
+
+/*
+ * Reads a LEB128 length at *position, advancing it. Returns false if the
+ * buffer ends first.
+ */
+static bool readLength(unsigned char *buffer, size_t length, size_t *position, uint64_t *result) {
+    *result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+        if (*position >= length) {
+            return false;
+        }
+        unsigned char byte = buffer[(*position)++];
+        *result |= (uint64_t) (byte & 0x7f) << shift;
+        if (!(byte & 0x80)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static uint64_t readFixed(unsigned char *bytes) {
+    uint64_t bits = 0;
+    for (int i = 0; i < 8; i++) {
+        bits |= (uint64_t) bytes[i] << (8 * i);
+    }
+    return bits;
+}
+
+/*
+ * Decodes one tree from a buffer. The stack holds the slots (car or cdr
+ * fields, or the result) still waiting for a value, in encoding order, and
+ * decoded collects every numbered value for back-references to find.
+ */
+static Value *decode(unsigned char *buffer, size_t length, size_t *used, PointerStack *decodedValues) {
+    Value *result = NULL;
+    PointerStack stack = {NULL, 0, 0};
+    PointerStack decoded = *decodedValues;
+    size_t position = 0;
+    bool ok = push(&stack, &result);
+    while (ok && stack.count > 0) {
+        Value **slot = stack.items[--stack.count];
+        if (position >= length) {
+            ok = false;
+            break;
+        }
+        unsigned char tag = buffer[position++];
+        if (tag == TAG_REFERENCE) {
+            uint64_t index;
+            if (!readLength(buffer, length, &position, &index) || index >= decoded.count) {
+                ok = false;
+                break;
+            }
+            *slot = decoded.items[index];
+            continue;
+        }
+        Value *value = makeNull();
+        if (tag == TAG_NULL) {
+            // makeNull() already made it
+        } else if (tag == TAG_CONS) {
+            value->type = CONS_TYPE;
+            ok = push(&stack, &value->c.cdr) && push(&stack, &value->c.car);
+        } else if (tag == TAG_INT || tag == TAG_DOUBLE) {
+            if (length - position < 8) {
+                ok = false;
+                break;
+            }
+            uint64_t bits = readFixed(buffer + position);
+            position += 8;
+            if (tag == TAG_INT) {
+                value->type = INT_TYPE;
+                value->i = (int64_t) bits;
+            } else {
+                value->type = DOUBLE_TYPE;
+                memcpy(&value->d, &bits, sizeof(bits));
+            }
+        } else if (tag == TAG_STR || tag == TAG_SYMBOL || tag == TAG_BOOL) {
+            uint64_t stringLength;
+            if (!readLength(buffer, length, &position, &stringLength) || length - position < stringLength) {
+                ok = false;
+                break;
+            }
+            char *chars = tallocKind(stringLength + 1, STRING_ALLOCATION);
+            memcpy(chars, buffer + position, stringLength);
+            chars[stringLength] = '\0';
+            position += stringLength;
+            if (tag == TAG_STR) {
+                value->type = STR_TYPE;
+                value->str.buffer = chars;
+                value->str.chars = chars;
+                value->str.length = stringLength;
+            } else {
+                value->type = tag == TAG_SYMBOL ? SYMBOL_TYPE : BOOL_TYPE;
+                value->s = chars;
+            }
+        } else if (tag == TAG_BIGNUM) {
+            uint64_t digitCount;
+            // One base-2^32 digit always fits in an integer, so a bignum has at least two.
+            if (position >= length || buffer[position] > 1) {
+                ok = false;
+                break;
+            }
+            bool negative = buffer[position++];
+            if (!readLength(buffer, length, &position, &digitCount) || digitCount < 2
+                    || (length - position) / 4 < digitCount) {
+                ok = false;
+                break;
+            }
+            value->type = BIGNUM_TYPE;
+            value->b.negative = negative;
+            value->b.length = digitCount;
+            value->b.digits = tallocKind(digitCount * sizeof(uint32_t), BIGNUM_ALLOCATION);
+            for (uint64_t i = 0; i < digitCount; i++) {
+                unsigned char *bytes = buffer + position + 4 * i;
+                value->b.digits[i] = bytes[0] | bytes[1] << 8 | bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+            }
+            position += 4 * digitCount;
+            ok = value->b.digits[digitCount - 1] != 0;
+        } else if (tag == TAG_F64VECTOR || tag == TAG_S64VECTOR) {
+            uint64_t vectorLength;
+            if (!readLength(buffer, length, &position, &vectorLength) || (length - position) / 8 < vectorLength) {
+                ok = false;
+                break;
+            }
+            value->type = tag == TAG_F64VECTOR ? F64VECTOR_TYPE : S64VECTOR_TYPE;
+            value->n.length = vectorLength;
+            value->n.f64 = NULL;
+            if (vectorLength > 0) {
+                value->n.f64 = tallocKind(vectorLength * sizeof(double), VECTOR_ALLOCATION);
+            }
+            for (uint64_t i = 0; i < vectorLength; i++) {
+                uint64_t bits = readFixed(buffer + position + 8 * i);
+                memcpy(&value->n.f64[i], &bits, sizeof(bits));
+            }
+            position += 8 * vectorLength;
+        } else if (tag == TAG_VECTOR) {
+            uint64_t vectorLength;
+            // Every element takes at least a byte, which bounds the length.
+            if (!readLength(buffer, length, &position, &vectorLength) || length - position < vectorLength) {
+                ok = false;
+                break;
+            }
+            value->type = VECTOR_TYPE;
+            value->v.length = vectorLength;
+            value->v.items = NULL;
+            if (vectorLength > 0) {
+                value->v.items = tallocKind(vectorLength * sizeof(Value *), VECTOR_ALLOCATION);
+            }
+            for (int i = value->v.length - 1; ok && i >= 0; i--) {
+                ok = push(&stack, &value->v.items[i]);
+            }
+        } else {
+            ok = false;
+            break;
+        }
+        if (tag != TAG_NULL) {
+            ok = ok && push(&decoded, value);
+        }
+        *slot = value;
+    }
+    free(stack.items);
+    *decodedValues = decoded;
+    if (!ok) {
+        return NULL;
+    }
+    *used = position;
+    return result;
+}
+
+Value *readTree(unsigned char *buffer, size_t length, size_t *used) {
+    PointerStack decoded = {NULL, 0, 0};
+    Value *tree = decode(buffer, length, used, &decoded);
+    free(decoded.items);
+    return tree;
+}
+
+/*
+ * Decodes a tree written by writeLocatedTree(), recording its locations
+ * against a source file.
+ */
+Value *readLocatedTree(unsigned char *buffer, size_t length, size_t *used, int file) {
+    PointerStack decoded = {NULL, 0, 0};
+    size_t position;
+    Value *tree = decode(buffer, length, &position, &decoded);
+    uint64_t located;
+    if (tree != NULL && !readLength(buffer, length, &position, &located)) {
+        tree = NULL;
+    }
+    for (uint64_t i = 0; tree != NULL && i < located; i++) {
+        uint64_t index, line, column;
+        if (!readLength(buffer, length, &position, &index) || index >= decoded.count ||
+            !readLength(buffer, length, &position, &line) ||
+            !readLength(buffer, length, &position, &column)) {
+            tree = NULL;
+        } else {
+            setLocation(decoded.items[index], file, line, column);
+        }
+    }
+    free(decoded.items);
+    if (tree != NULL) {
+        *used = position;
+    }
+    return tree;
+}
+
+/*
+ * Reads a whole file into a malloc'ed buffer.
+ */
+unsigned char *readWholeFile(char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+    struct stat info;
+    if (fstat(fileno(file), &info) == -1) {
+        fclose(file);
+        return NULL;
+    }
+    unsigned char *contents = malloc(info.st_size + 1);
+    if (contents == NULL || fread(contents, 1, info.st_size, file) != (size_t) info.st_size) {
+        free(contents);
+        fclose(file);
+        return NULL;
+    }
+    fclose(file);
+    *length = info.st_size;
+    return contents;
+}
+
+/*
+ * Reads back a file written by writeBinaryFile().
+ */
+Value *readBinaryFile(char *path) {
+    size_t length;
+    unsigned char *contents = readWholeFile(path, &length);
+    if (contents == NULL) {
+        return NULL;
+    }
+    Value *value = NULL;
+    size_t used;
+    if (length >= 8 && memcmp(contents, BINARY_MAGIC, 8) == 0) {
+        value = readTree(contents + 8, length - 8, &used);
+        if (value != NULL && used != length - 8) {
+            value = NULL;
+        }
+    }
+    free(contents);
+    return value;
+}
@@ -0,0 +1,88 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "value.h"
+
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+/*
+ * A compact binary encoding of data and parse trees, so that they can be
+ * saved and read back exactly, without going through the printer, the
+ * tokenizer and the parser.
+ *
+ * Every value starts with a one-byte tag:
+ *
+ *   0 empty list
+ *   1 pair, followed by its car and then its cdr
+ *   2 integer, followed by 8 bytes (little-endian, two's complement)
+ *   3 double, followed by its 8 IEEE 754 bytes (little-endian)
+ *   4 string  \
+ *   5 symbol   > followed by a length (as below) and that many bytes
+ *   6 boolean /
+ *   7 back-reference, followed by the index (as below) of an earlier value
+ *   8 vector, followed by its length (as below) and then its elements
+ *   9 bignum, followed by a sign byte (1 if negative), a number of digits
+ *     (as below) and that many 4-byte digits (little-endian, least
+ *     significant first)
+ *  10 f64vector \ followed by a length (as below) and that many 8-byte
+ *  11 s64vector / elements (little-endian, as for doubles and integers)
+ *
+ * Values other than the empty list and back-references are numbered from 0
+ * in the order their tags appear, a pair before its car and cdr and a vector
+ * before its elements.  A value that appears more than once in the graph is
+ * written in full the first time and as a back-reference after that, so
+ * shared structure stays shared and circular lists can be written.
+ *
+ * Lengths and indices are unsigned LEB128: 7 bits per byte, low bits first,
+ * with the high bit set on every byte but the last.
+ *
+ * Neither direction recurses, so lists of any length can be encoded.
+ */
+
+/*
+ * Writes the encoding of a tree to a file.  Returns false if the tree holds
+ * something that cannot be encoded (such as a procedure) or the write fails.
+ */
+bool writeTree(Value *tree, FILE *file);
+
+/*
+ * Writes the encoding of a tree followed by the source locations (see
+ * location.h) of its values: a count, then for each located value its index,
+ * line and column, all as LEB128.  The file name is not written; the reader
+ * supplies it.
+ */
+bool writeLocatedTree(Value *tree, FILE *file);
+
+/*
+ * Decodes one tree from a buffer of length bytes, storing how many bytes it
+ * used in *used.  Returns NULL if the buffer does not hold a well-formed tree.
+ */
+Value *readTree(unsigned char *buffer, size_t length, size_t *used);
+
+/*
+ * Decodes a tree written by writeLocatedTree(), recording its locations
+ * against a file numbered by sourceFile().  Returns NULL if the buffer is
+ * malformed.
+ */
+Value *readLocatedTree(unsigned char *buffer, size_t length, size_t *used, int file);
+
+/*
+ * Writes a binary data file: the 8 bytes "SCMBIN1\n" followed by the
+ * encoding of value.  Returns false if value cannot be encoded or the file
+ * cannot be written.
+ */
+bool writeBinaryFile(Value *value, char *path);
+
+/*
+ * Reads back a file written by writeBinaryFile().  Returns NULL if the file
+ * cannot be read or is malformed.
+ */
+Value *readBinaryFile(char *path);
+
+/*
+ * Reads a whole file into a malloc'ed buffer, storing its length in *length.
+ * Returns NULL if it cannot be read.
+ */
+unsigned char *readWholeFile(char *path, size_t *length);
+
+#endif
@@ -0,0 +1,717 @@
+#include "server.h"
+#include "tokenizer.h"
+#include "parser.h"
+#include "interpreter.h"
+#include "talloc.h"
+#include "value.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+
+#define MAX_EVENTS 64
+#define MAX_REQUEST_LENGTH (64 * 1024 * 1024)
+#define FRAME_HEADER_LENGTH 4
+
+/*
+ * A connected client, the bytes it has sent that have not been handled yet,
+ * and the response frame it has not taken all of yet (output is NULL when
+ * there is none). Clients live outside the talloc heap so the collector
+ * never sees them.
+ */
+typedef struct Client {
+	int fd;
+	char *buffer;
+	size_t length;
+	size_t capacity;
+	char *output;
+	size_t outputLength;
+	size_t outputSent;
+} Client;
+
+/*
+ * Set by the signal handler to ask the event loop to stop.
+ */
+static volatile sig_atomic_t stopRequested = 0;
+
+/*
+ * Temporary file that captures stdout while a request is evaluated. Each
+ * process (the server or one pool worker) opens its own.
+ */
+static int captureFd = -1;
+
+/*
+ * Process ids of the pool workers, so the supervisor can stop them.
+ */
+static pid_t *workers = NULL;
+static int workerCount = 0;
+
+void handleStopSignal(int signal) {
+	stopRequested = 1;
+}
+
+/*
+ * Puts a file descriptor into non-blocking mode.
+ */
+bool setNonBlocking(int fd) {
+	int flags = fcntl(fd, F_GETFL, 0);
+	return flags != -1 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+/*
+ * Stores a frame length as a 4-byte big-endian header.
+ */
+void encodeLength(char *header, size_t length) {
+	header[0] = (length >> 24) & 0xff;
+	header[1] = (length >> 16) & 0xff;
+	header[2] = (length >> 8) & 0xff;
+	header[3] = length & 0xff;
+}
+
+/*
+ * Reads a frame length back out of a 4-byte big-endian header.
+ */
+size_t decodeLength(char *header) {
+	unsigned char *bytes = (unsigned char *) header;
+	return ((size_t) bytes[0] << 24) | ((size_t) bytes[1] << 16) | ((size_t) bytes[2] << 8) | bytes[3];
+}
+
+/*
+ * Reads exactly length bytes from a blocking descriptor. Returns false on
+ * end of file or error.
+ */
+bool readExactly(int fd, char *buffer, size_t length) {
+	while (length > 0) {
+		ssize_t received = read(fd, buffer, length);
+		if (received > 0) {
+			buffer += received;
+			length -= received;
+		} else if (received == -1 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Writes all of data to a (possibly non-blocking) pipe or socket, waiting for
+ * it to become writable when its buffer is full. Returns false if the other
+ * end went away. Only for descriptors a single peer reads, such as the pipes
+ * between pool workers and their supervisor; the event loop queues output
+ * per client instead (see flushClient()).
+ */
+bool writeAll(int fd, char *data, size_t length) {
+	while (length > 0) {
+		ssize_t written = write(fd, data, length);
+		if (written > 0) {
+			data += written;
+			length -= written;
+		} else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			struct pollfd waitFor = {.fd = fd, .events = POLLOUT};
+			poll(&waitFor, 1, -1);
+		} else if (written == -1 && errno == EINTR) {
+			continue;
+		} else {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Evaluates one request's source in an isolated frame, redirecting stdout and
+ * stderr so that everything printed (results, error messages and their
+ * source locations alike) lands in the capture file.  Locations are given
+ * against sourceName, counting from the line and column where the source
+ * starts in it.
+ */
+void evaluateRequest(char *source, size_t length, char *sourceName, int line, int column) {
+	ftruncate(captureFd, 0);
+	lseek(captureFd, 0, SEEK_SET);
+	if (length == 0) {
+		return;
+	}
+	fflush(stdout);
+	fflush(stderr);
+	int savedStdout = dup(STDOUT_FILENO);
+	int savedStderr = dup(STDERR_FILENO);
+	dup2(captureFd, STDOUT_FILENO);
+	dup2(captureFd, STDERR_FILENO);
+	FILE *input = fmemopen(source, length, "r");
+	jmp_buf recovery;
+	if (setjmp(recovery) == 0) {
+		setRecoveryPoint(&recovery);
+		Value *tree = parse(tokenizeStreamAt(input, sourceName, line, column));
+		interpretIsolated(tree);
+	}
+	setRecoveryPoint(NULL);
+	endIsolation();
+	fclose(input);
+	fflush(stdout);
+	fflush(stderr);
+	dup2(savedStdout, STDOUT_FILENO);
+	dup2(savedStderr, STDERR_FILENO);
+	close(savedStdout);
+	close(savedStderr);
+}
+
+/*
+ * Reads the captured output of the last request into a malloc'ed response
+ * frame. Returns NULL if it cannot.
+ */
+char *captureResponse(size_t *frameLength) {
+	off_t outputLength = lseek(captureFd, 0, SEEK_END);
+	char *frame = malloc(FRAME_HEADER_LENGTH + outputLength);
+	if (frame == NULL) {
+		return NULL;
+	}
+	encodeLength(frame, outputLength);
+	if (pread(captureFd, frame + FRAME_HEADER_LENGTH, outputLength, 0) != outputLength) {
+		free(frame);
+		return NULL;
+	}
+	*frameLength = FRAME_HEADER_LENGTH + outputLength;
+	return frame;
+}
+
+/*
+ * Sends the captured output of the last request back as a response frame.
+ */
+bool sendResponse(int fd) {
+	size_t frameLength;
+	char *frame = captureResponse(&frameLength);
+	bool sent = frame != NULL && writeAll(fd, frame, frameLength);
+	free(frame);
+	return sent;
+}
+
+/*
+ * Writes as much of a client's pending response as its socket will take
+ * without blocking, so a client that stops reading only holds up itself.
+ * Returns false if the client went away.
+ */
+bool flushClient(Client *client) {
+	while (client->outputSent < client->outputLength) {
+		ssize_t written = write(client->fd, client->output + client->outputSent,
+				client->outputLength - client->outputSent);
+		if (written > 0) {
+			client->outputSent += written;
+		} else if (written == -1 && errno == EINTR) {
+			continue;
+		} else if (written == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+			return true;
+		} else {
+			return false;
+		}
+	}
+	free(client->output);
+	client->output = NULL;
+	client->outputLength = 0;
+	client->outputSent = 0;
+	return true;
+}
+
+/*
+ * Handles the complete request frames sitting in a client's buffer, one at
+ * a time, stopping while a response is still waiting to be sent.
+ * Returns false if the client should be disconnected.
+ */
+bool handleFrames(Client *client) {
+	size_t offset = 0;
+	while (client->output == NULL && client->length - offset >= FRAME_HEADER_LENGTH) {
+		size_t requestLength = decodeLength(client->buffer + offset);
+		if (requestLength > MAX_REQUEST_LENGTH) {
+			return false;
+		}
+		if (client->length - offset - FRAME_HEADER_LENGTH < requestLength) {
+			break;
+		}
+		evaluateRequest(client->buffer + offset + FRAME_HEADER_LENGTH, requestLength, "<request>", 1, 1);
+		client->output = captureResponse(&client->outputLength);
+		if (client->output == NULL || !flushClient(client)) {
+			return false;
+		}
+		offset += FRAME_HEADER_LENGTH + requestLength;
+	}
+	memmove(client->buffer, client->buffer + offset, client->length - offset);
+	client->length -= offset;
+	return true;
+}
+
+/*
+ * Reads whatever a client has sent and serves any complete requests.
+ * Returns false if the client should be disconnected.
+ */
+bool readFromClient(Client *client) {
+	while (true) {
+		if (client->length == client->capacity) {
+			size_t newCapacity = client->capacity == 0 ? 4096 : client->capacity * 2;
+			char *newBuffer = realloc(client->buffer, newCapacity);
+			if (newBuffer == NULL) {
+				return false;
+			}
+			client->buffer = newBuffer;
+			client->capacity = newCapacity;
+		}
+		ssize_t received = read(client->fd, client->buffer + client->length, client->capacity - client->length);
+		if (received > 0) {
+			client->length += received;
+		} else if (received == 0) {
+			return false;
+		} else if (errno == EINTR) {
+			continue;
+		} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+			return handleFrames(client);
+		} else {
+			return false;
+		}
+	}
+}
+
+/*
+ * Waits for a client to become writable while it has a response pending,
+ * and for it to send more otherwise. Returns false on failure.
+ */
+bool watchClient(int epollFd, Client *client) {
+	struct epoll_event event = {.events = client->output != NULL ? EPOLLOUT : EPOLLIN, .data.ptr = client};
+	return epoll_ctl(epollFd, EPOLL_CTL_MOD, client->fd, &event) != -1;
+}
+
+void closeClient(int epollFd, Client *client) {
+	epoll_ctl(epollFd, EPOLL_CTL_DEL, client->fd, NULL);
+	close(client->fd);
+	free(client->buffer);
+	free(client->output);
+	free(client);
+}
+
+/*
+ * Accepts every pending connection on the listening socket.
+ */
+void acceptClients(int epollFd, int listenFd) {
+	while (true) {
+		int fd = accept(listenFd, NULL, NULL);
+		if (fd == -1) {
+			return;
+		}
+		Client *client = calloc(1, sizeof(Client));
+		if (client == NULL || !setNonBlocking(fd)) {
+			free(client);
+			close(fd);
+			continue;
+		}
+		client->fd = fd;
+		struct epoll_event event = {.events = EPOLLIN, .data.ptr = client};
+		if (epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event) == -1) {
+			close(fd);
+			free(client);
+		}
+	}
+}
+
+/*
+ * Creates a non-blocking listening socket bound to socketPath, replacing any
+ * stale socket file left behind there. Returns -1 on failure.
+ */
+int listenOn(char *socketPath) {
+	struct sockaddr_un address;
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	if (strlen(socketPath) >= sizeof(address.sun_path)) {
+		printf("Server error: socket path too long\n");
+		return -1;
+	}
+	strcpy(address.sun_path, socketPath);
+	int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (fd == -1) {
+		perror("Server error: socket");
+		return -1;
+	}
+	unlink(socketPath);
+	if (bind(fd, (struct sockaddr *) &address, sizeof(address)) == -1 || listen(fd, SOMAXCONN) == -1 || !setNonBlocking(fd)) {
+		perror("Server error: bind");
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+/*
+ * Opens this process's capture file. Returns false on failure.
+ */
+bool openCapture() {
+	FILE *capture = tmpfile();
+	if (capture == NULL) {
+		perror("Server error: tmpfile");
+		return false;
+	}
+	captureFd = fileno(capture);
+	return true;
+}
+
+/*
+ * Routes SIGINT and SIGTERM to handleStopSignal(). The handler is installed
+ * without SA_RESTART so that blocking calls return EINTR and notice it.
+ */
+void installSignalHandlers() {
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = handleStopSignal;
+	sigemptyset(&action.sa_mask);
+	sigaction(SIGINT, &action, NULL);
+	sigaction(SIGTERM, &action, NULL);
+	signal(SIGPIPE, SIG_IGN);
+}
+
+/*
+ * Runs the event loop on an already listening socket until asked to stop.
+ * Several pool workers may share the same listening socket; each wakes up
+ * exclusively so a connection is only accepted by one of them.
+ */
+int serveSocket(int listenFd) {
+	int epollFd = epoll_create1(0);
+	if (epollFd == -1 || !openCapture()) {
+		perror("Server error");
+		return 1;
+	}
+	struct epoll_event listenEvent = {.events = EPOLLIN | EPOLLEXCLUSIVE, .data.ptr = NULL};
+	epoll_ctl(epollFd, EPOLL_CTL_ADD, listenFd, &listenEvent);
+
+	struct epoll_event events[MAX_EVENTS];
+	while (!stopRequested) {
+		int ready = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+		for (int i = 0; i < ready; i++) {
+			Client *client = events[i].data.ptr;
+			if (client == NULL) {
+				acceptClients(epollFd, listenFd);
+			} else if ((events[i].events & (EPOLLERR | EPOLLHUP)) && !(events[i].events & EPOLLIN)) {
+				closeClient(epollFd, client);
+			} else {
+				// Once a pending response has gone out, any requests that
+				// arrived behind it are served before reading more.
+				bool ok = events[i].events & EPOLLOUT ? flushClient(client) && handleFrames(client) : readFromClient(client);
+				if (!ok || !watchClient(epollFd, client)) {
+					closeClient(epollFd, client);
+				}
+			}
+		}
+	}
+	close(epollFd);
+	close(captureFd);
+	return 0;
+}
+
+/*
+ * Serves jobs (see sendJob()) from one descriptor, writing framed responses
+ * to another, until the job side is closed. This is how stdin pool workers
+ * talk to their supervisor.
+ */
+int serveStream(int inFd, int outFd) {
+	if (!openCapture()) {
+		return 1;
+	}
+	char position[2 * FRAME_HEADER_LENGTH];
+	char header[FRAME_HEADER_LENGTH];
+	while (readExactly(inFd, position, sizeof(position)) && readExactly(inFd, header, FRAME_HEADER_LENGTH)) {
+		size_t length = decodeLength(header);
+		char *source = malloc(length + 1);
+		if (source == NULL || !readExactly(inFd, source, length)) {
+			free(source);
+			return 1;
+		}
+		evaluateRequest(source, length, "<stdin>", decodeLength(position), decodeLength(position + FRAME_HEADER_LENGTH));
+		free(source);
+		if (!sendResponse(outFd)) {
+			return 1;
+		}
+	}
+	close(captureFd);
+	return 0;
+}
+
+/*
+ * Serves requests on a Unix domain socket until asked to stop.
+ */
+int runServer(char *socketPath) {
+	// Everything loaded so far is the prelude; never sweep it again.
+	freezeHeap();
+	int listenFd = listenOn(socketPath);
+	if (listenFd == -1) {
+		return 1;
+	}
+	installSignalHandlers();
+	int status = serveSocket(listenFd);
+	close(listenFd);
+	unlink(socketPath);
+	return status;
+}
+
+/*
+ * Forks a worker that runs serve with the given descriptors, after closing
+ * every descriptor in toClose. Returns the child's pid, or -1.
+ */
+pid_t forkWorker(int listenFd, int jobFd, int resultFd, int *toClose, int closeCount) {
+	fflush(stdout);
+	pid_t pid = fork();
+	if (pid != 0) {
+		return pid;
+	}
+	for (int i = 0; i < closeCount; i++) {
+		close(toClose[i]);
+	}
+	int status;
+	if (listenFd != -1) {
+		status = serveSocket(listenFd);
+	} else {
+		status = serveStream(jobFd, resultFd);
+	}
+	fflush(stdout);
+	// Skip tfree(): freeing the inherited heap would only copy its pages.
+	_exit(status);
+}
+
+/*
+ * Sends one job to a worker: the line and column of stdin it starts at, in
+ * the same 4-byte form as a frame length, then a request frame.
+ */
+bool sendJob(int fd, char *job, size_t length, int line, int column) {
+	char header[3 * FRAME_HEADER_LENGTH];
+	encodeLength(header, line);
+	encodeLength(header + FRAME_HEADER_LENGTH, column);
+	encodeLength(header + 2 * FRAME_HEADER_LENGTH, length);
+	return writeAll(fd, header, sizeof(header)) && writeAll(fd, job, length);
+}
+
+/*
+ * Reads one response frame from a worker and copies it to stdout.
+ */
+bool printResult(int fd) {
+	char header[FRAME_HEADER_LENGTH];
+	if (!readExactly(fd, header, FRAME_HEADER_LENGTH)) {
+		return false;
+	}
+	size_t length = decodeLength(header);
+	char *output = malloc(length + 1);
+	if (output == NULL || !readExactly(fd, output, length)) {
+		free(output);
+		return false;
+	}
+	fwrite(output, 1, length, stdout);
+	free(output);
+	return true;
+}
+
+/*
+ * Splits stdin into top-level forms and hands them to the workers in turn,
+ * printing results in the order the forms appeared. Each worker has at most
+ * one job in flight, so job k's result is always collected before job
+ * k + workerCount is sent to the same worker.
+ */
+int distributeStdin(int *jobFds, int *resultFds) {
+	size_t capacity = 4096;
+	size_t length = 0;
+	char *job = malloc(capacity);
+	long sent = 0;
+	long printed = 0;
+	int depth = 0;
+	bool inString = false;
+	bool isEscaped = false;
+	bool inComment = false;
+	bool inAtom = false;
+	bool hasDatum = false;
+	// Where the next character is, and where the job being built starts.
+	int line = 1;
+	int column = 1;
+	int jobLine = 1;
+	int jobColumn = 1;
+	int status = 0;
+	int c = 0;
+	while (job != NULL && c != EOF) {
+		c = fgetc(stdin);
+		bool complete = false;
+		if (c != EOF) {
+			if (length == capacity) {
+				capacity *= 2;
+				job = realloc(job, capacity);
+				if (job == NULL) {
+					break;
+				}
+			}
+			job[length++] = c;
+			if (c == '\n') {
+				line++;
+				column = 1;
+			} else {
+				column++;
+			}
+		}
+		if (c == EOF) {
+			complete = hasDatum;
+		} else if (inComment) {
+			inComment = c != '\n';
+		} else if (inString) {
+			if (isEscaped) {
+				isEscaped = false;
+			} else if (c == '\\') {
+				isEscaped = true;
+			} else if (c == '"') {
+				inString = false;
+				complete = depth == 0;
+			}
+		} else if (c == ';') {
+			inComment = true;
+		} else if (c == '"') {
+			inString = true;
+			hasDatum = true;
+		} else if (c == '(') {
+			depth++;
+			hasDatum = true;
+		} else if (c == ')') {
+			depth--;
+			complete = depth <= 0;
+		} else if (c == ' ' || c == '\n' || c == '\t' || c == '\r') {
+			complete = depth == 0 && inAtom;
+			inAtom = false;
+		} else {
+			hasDatum = true;
+			inAtom = depth == 0 && c != '\'';
+		}
+		if (complete) {
+			int worker = sent % workerCount;
+			if (sent >= workerCount) {
+				if (!printResult(resultFds[printed % workerCount])) {
+					status = 1;
+					break;
+				}
+				printed++;
+			}
+			if (!sendJob(jobFds[worker], job, length, jobLine, jobColumn)) {
+				status = 1;
+				break;
+			}
+			sent++;
+			length = 0;
+			jobLine = line;
+			jobColumn = column;
+			depth = 0;
+			inAtom = false;
+			hasDatum = false;
+		}
+	}
+	free(job);
+	while (status == 0 && printed < sent) {
+		if (!printResult(resultFds[printed % workerCount])) {
+			status = 1;
+		}
+		printed++;
+	}
+	return status;
+}
+
+/*
+ * Waits for every worker to exit, forwarding a stop request to them if the
+ * supervisor receives one.
+ */
+void waitForWorkers() {
+	int remaining = workerCount;
+	bool forwarded = false;
+	while (remaining > 0) {
+		if (waitpid(-1, NULL, 0) > 0) {
+			remaining--;
+		} else if (errno == EINTR && stopRequested && !forwarded) {
+			for (int i = 0; i < workerCount; i++) {
+				kill(workers[i], SIGTERM);
+			}
+			forwarded = true;
+		} else if (errno == ECHILD) {
+			break;
+		}
+	}
+}
+
+/*
+ * Forks a pool of workers sharing the loaded global environment.
+ */
+int runWorkerPool(int count, char *socketPath) {
+	// The prelude is shared copy-on-write from here on, so the collector
+	// must neither free nor relink any of it in the workers.
+	freezeHeap();
+	workerCount = count;
+	workers = calloc(count, sizeof(pid_t));
+	int *jobFds = calloc(count, sizeof(int));
+	int *resultFds = calloc(count, sizeof(int));
+	int listenFd = -1;
+	if (workers == NULL || jobFds == NULL || resultFds == NULL) {
+		printf("Out of memory!");
+		return 1;
+	}
+	if (socketPath != NULL) {
+		listenFd = listenOn(socketPath);
+		if (listenFd == -1) {
+			return 1;
+		}
+	}
+	installSignalHandlers();
+	int status = 0;
+	for (int i = 0; i < count; i++) {
+		int jobPipe[2] = {-1, -1};
+		int resultPipe[2] = {-1, -1};
+		if (socketPath == NULL && (pipe(jobPipe) == -1 || pipe(resultPipe) == -1)) {
+			perror("Server error: pipe");
+			return 1;
+		}
+		// The worker must not hold the supervisor's ends of earlier pipes,
+		// or it would keep its siblings from seeing end of file.
+		int toClose[2 * count + 2];
+		int closeCount = 0;
+		for (int j = 0; j < i && socketPath == NULL; j++) {
+			toClose[closeCount++] = jobFds[j];
+			toClose[closeCount++] = resultFds[j];
+		}
+		if (socketPath == NULL) {
+			toClose[closeCount++] = jobPipe[1];
+			toClose[closeCount++] = resultPipe[0];
+		}
+		workers[i] = forkWorker(listenFd, jobPipe[0], resultPipe[1], toClose, closeCount);
+		if (workers[i] == -1) {
+			perror("Server error: fork");
+			return 1;
+		}
+		if (socketPath == NULL) {
+			close(jobPipe[0]);
+			close(resultPipe[1]);
+			jobFds[i] = jobPipe[1];
+			resultFds[i] = resultPipe[0];
+		}
+	}
+	if (socketPath == NULL) {
+		status = distributeStdin(jobFds, resultFds);
+		fflush(stdout);
+		for (int i = 0; i < count; i++) {
+			close(jobFds[i]);
+			close(resultFds[i]);
+		}
+	}
+	waitForWorkers();
+	if (socketPath != NULL) {
+		close(listenFd);
+		unlink(socketPath);
+	}
+	free(workers);
+	free(jobFds);
+	free(resultFds);
+	return status;
+}
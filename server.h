@@ -0,0 +1,38 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+/*
+ * Serves evaluation requests on a Unix domain socket at socketPath until the
+ * process receives SIGINT or SIGTERM.  The global environment (including
+ * anything loaded before calling this) stays warm between requests.
+ *
+ * Every request and response is framed as a 4-byte big-endian length
+ * followed by that many bytes.  A request holds Scheme source; its forms are
+ * evaluated in a child frame of the global environment, so definitions do
+ * not leak into later requests (a set! of a global only shadows it for the
+ * rest of the request), and everything the request allocated is collected
+ * once it finishes.  The response holds whatever evaluating the
+ * request printed, including any error message and its source location.
+ * A client that is slow to read its responses only delays itself: its next
+ * request waits until the last response has been taken.
+ *
+ * Returns the process exit status.
+ */
+int runServer(char *socketPath);
+
+/*
+ * Freezes the heap built so far (the prelude) and forks
+ * workerCount workers that share it copy-on-write.
+ *
+ * With a socketPath, every worker serves the same listening socket exactly
+ * like runServer(), and the kernel hands each new connection to one of them.
+ * Without one, stdin is split into top-level forms and each form is a job,
+ * given to the workers round-robin and evaluated in isolation against the
+ * prelude; results are printed in the order the forms appeared, and errors
+ * are located by their line and column in stdin.
+ *
+ * Returns the process exit status.
+ */
+int runWorkerPool(int workerCount, char *socketPath);
+
+#endif
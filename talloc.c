@@ -4,6 +4,9 @@
 #include <stdio.h>
 #include <stdbool.h>
 #include "linkedlist.h"
+#include "gcstats.h"
+#include "hashtable.h"
+#include "ptrmap.h"
 
 bool debugGC = false;
 /*
@@ -14,171 +17,308 @@ void outOfMemoryError() {
     texit(1);
 }
 /*
- * Create an empty list (a new Value object of type NULL_TYPE).
+ * Called with each pointer just before it is freed, so side tables keyed by
+ * address can forget it.
  */
-Value *makeNullTalloc() {
-	Value *returnValue = malloc(sizeof(Value));
-    if (returnValue == NULL) {
-        outOfMemoryError();
+#define MAX_FREE_HOOKS 4
+static void (*freeHooks[MAX_FREE_HOOKS])(void *);
+static int freeHookCount = 0;
+
+void addFreeHook(void (*hook)(void *)) {
+    if (freeHookCount < MAX_FREE_HOOKS) {
+        freeHooks[freeHookCount++] = hook;
+    }
+}
+
+static void runFreeHooks(void *pointer) {
+    for (int i = 0; i < freeHookCount; i++) {
+        freeHooks[i](pointer);
     }
-	returnValue->type = NULL_TYPE;
-	return returnValue;
 }
 
 /*
- * Create a nonempty list (a new Value object of type CONS_TYPE).
+ * Called at the start of tfree(), while the heap is still intact.
  */
-Value *consTalloc(Value *car, Value *cdr) {
-	Value *returnValue = malloc(sizeof(Value));
-    if (returnValue == NULL) {
-        outOfMemoryError();
+#define MAX_TEARDOWN_HOOKS 4
+static void (*teardownHooks[MAX_TEARDOWN_HOOKS])();
+static int teardownHookCount = 0;
+
+void addTeardownHook(void (*hook)()) {
+    if (teardownHookCount < MAX_TEARDOWN_HOOKS) {
+        teardownHooks[teardownHookCount++] = hook;
     }
-	returnValue->type = CONS_TYPE;
-	returnValue->c.car = car;
-	returnValue->c.cdr = cdr;
-	return returnValue;
 }
 
+/*
+ * One entry of the active list: a talloc'ed block and what it is for.
+ */
+typedef struct Allocation {
+    void *p;
+    size_t size;
+    allocationKind kind;
+    char *site;
+    struct Allocation *next;
+} Allocation;
+
+char *allocationSite = "eval";
+
 /*
  * The head of our list's memory.
  */
-static Value *head;
+static Allocation *head = NULL;
+
+/*
+ * The newest entry of the active list at the time of the last freezeHeap().
+ * It and everything after it are permanent.
+ */
+static Allocation *frozen = NULL;
+
+/*
+ * Bytes allocated since the last collection, and how many there must be
+ * before interpret() collects again (0 collects after every form).
+ */
+static size_t allocatedSinceCollection = 0;
+static size_t collectionThreshold = 0;
+static bool collectionRequested = false;
 
 /*
  * A malloc-like function that allocates memory, tracking all allocated
  * pointers in the "active list."  
  */
 void *talloc(size_t size) {
-	if (head == NULL) {
-		head = makeNullTalloc();
-	} 
-	Value *memoryRecord = malloc(sizeof(Value));
-    if (memoryRecord == NULL) {
-        outOfMemoryError();
+	return tallocKind(size, RAW_ALLOCATION);
+}
+
+/*
+ * Like talloc(), recording what the memory is for.
+ */
+void *tallocKind(size_t size, allocationKind kind) {
+	Allocation *record = malloc(sizeof(Allocation));
+	if (record == NULL) {
+		outOfMemoryError();
+	}
+	record->p = malloc(size);
+	if (record->p == NULL) {
+		outOfMemoryError();
+	}
+	record->size = size;
+	record->kind = kind;
+	record->site = allocationSite;
+	record->next = head;
+	head = record;
+	allocatedSinceCollection += size;
+	noteAllocation(kind, size);
+	return record->p;
+}
+
+/*
+ * The collector's marking state: every talloc'ed pointer found reachable so
+ * far, and the values found but not yet scanned.  Both are malloc'ed, so
+ * marking allocates nothing the sweep would see.
+ */
+typedef struct Marker {
+    PtrMap *marked;
+    Value **pending;
+    int pendingCount;
+    int pendingCapacity;
+} Marker;
+
+/*
+ * Marks a pointer, returning false if it was marked already.
+ */
+static bool mark(Marker *marker, void *pointer) {
+    if (pointer == NULL || ptrMapGet(marker->marked, pointer, NULL)) {
+        return false;
+    }
+    ptrMapPut(marker->marked, pointer, NULL);
+    return true;
+}
+
+/*
+ * Marks a value and, the first time, queues it to have its contents marked.
+ */
+static void markValue(Marker *marker, Value *value) {
+    if (!mark(marker, value)) {
+        return;
+    }
+    if (marker->pendingCount == marker->pendingCapacity) {
+        marker->pendingCapacity = marker->pendingCapacity == 0 ? 256 : marker->pendingCapacity * 2;
+        marker->pending = realloc(marker->pending, marker->pendingCapacity * sizeof(Value *));
+        if (marker->pending == NULL) {
+            outOfMemoryError();
+        }
     }
-	memoryRecord->type = PTR_TYPE;
-	memoryRecord->p = malloc(size);
-	head = consTalloc(memoryRecord, head);
-	return memoryRecord->p;
-}
-Value *getReachableInTree(Value *toAddTo, Value *tree);
-Value *getReachableInFrame(Value *toAddTo, Frame *frame) {
-    while (frame != NULL) {
-        toAddTo = getReachableInTree(toAddTo, frame->bindings);
-        Value *newFrameRecord = makeNullTalloc();
-        newFrameRecord->type = PTR_TYPE;
-        newFrameRecord->p = frame;
-        toAddTo = consTalloc(newFrameRecord, toAddTo);
+    marker->pending[marker->pendingCount++] = value;
+}
+
+/*
+ * Marks a frame, its bindings and its ancestors, stopping at the first one
+ * already marked (whose ancestors have been marked with it).
+ */
+static void markFrame(Marker *marker, Frame *frame) {
+    while (frame != NULL && mark(marker, frame)) {
+        markValue(marker, frame->bindings);
         frame = frame->parent;
     }
-    return toAddTo;
 }
-bool containsSamePointer(Value *toCheck, Value *list) {
-    while (list->type == CONS_TYPE) {
-        if (toCheck->p == list->c.car->p) {
-            return true;
+
+static void markEntry(Value *key, Value *value, void *context) {
+    markValue(context, key);
+    markValue(context, value);
+}
+
+/*
+ * Marks what a value points to.  A list's cdr spine is followed here in a
+ * loop, so only the cars wait on the pending stack.
+ */
+static void markContents(Marker *marker, Value *value) {
+    while (value->type == CONS_TYPE) {
+        markValue(marker, value->c.car);
+        value = value->c.cdr;
+        if (!mark(marker, value)) {
+            return;
         }
-        list = list->c.cdr;
-    }
-    return false;
-}
-
-Value *getReachableInTree(Value *toAddTo, Value *tree) {
-    Value *newRecord = makeNullTalloc();
-    newRecord->type = PTR_TYPE;
-    newRecord->p = tree;
-    //Avoid doubly recursing
-    if (containsSamePointer(newRecord, toAddTo)) {
-        //won't be a part of our end list, so we need to free it now
-        free(newRecord);
-        return toAddTo;
     }
-    toAddTo = consTalloc(newRecord, toAddTo);
-    if (tree->type == CONS_TYPE) {
-        toAddTo = getReachableInTree(toAddTo, tree->c.car);
-        toAddTo = getReachableInTree(toAddTo, tree->c.cdr);
-    } else if (tree->type == STR_TYPE || tree->type == SYMBOL_TYPE || tree->type == BOOL_TYPE) {
-        Value *newStringRecord = makeNullTalloc();
-        newStringRecord->type = PTR_TYPE;
-        newStringRecord->p = tree->s;
-        toAddTo = consTalloc(newStringRecord, toAddTo);
-    } else if (tree->type == CLOSURE_TYPE) {
-        toAddTo = getReachableInTree(toAddTo, tree->cl.parameters);
-        toAddTo = getReachableInTree(toAddTo, tree->cl.body);
-        toAddTo = getReachableInFrame(toAddTo, tree->cl.frame); 
+    if (value->type == SYMBOL_TYPE || value->type == BOOL_TYPE) {
+        mark(marker, value->s);
+    } else if (value->type == STR_TYPE) {
+        mark(marker, value->str.buffer);
+    } else if (value->type == STRING_BUILDER_TYPE) {
+        mark(marker, value->sb.buffer);
+    } else if (value->type == VECTOR_TYPE) {
+        mark(marker, value->v.items);
+        for (int i = 0; i < value->v.length; i++) {
+            markValue(marker, value->v.items[i]);
+        }
+    } else if (value->type == BIGNUM_TYPE) {
+        mark(marker, value->b.digits);
+    } else if (value->type == F64VECTOR_TYPE || value->type == S64VECTOR_TYPE) {
+        mark(marker, value->n.f64);
+    } else if (value->type == HASH_TYPE) {
+        mark(marker, value->h);
+        mark(marker, value->h->slots);
+        mark(marker, value->h->oldSlots);
+        forEachHashEntry(value->h, markEntry, marker);
+    } else if (value->type == CLOSURE_TYPE) {
+        markValue(marker, value->cl.parameters);
+        markValue(marker, value->cl.body);
+        markFrame(marker, value->cl.frame);
     }
-    return toAddTo;
 }
+
 /*
  * Sweep through all pointers in the given tree and frame, freeing unreachable ones
  */
 void sweep(Value *tree, Frame *frame) {
-    if (debugGC) {
-        printf("Beginning GC..\n");
-    }
-    Value *reachable = makeNullTalloc();
-    reachable = getReachableInTree(reachable, tree);
-    reachable = getReachableInFrame(reachable, frame);
-    //we now have all the reachable pointers in a list, so we will crossreference
-    //this list with our list of allocated pointers
-    if (debugGC) {
-        printf("Found reachable elements, removing unreachable.\n");
+    Collection collection = {0};
+    collection.startMs = gcClockMs();
+    Marker marker = {newPtrMap(), NULL, 0, 0};
+    markValue(&marker, tree);
+    markFrame(&marker, frame);
+    while (marker.pendingCount > 0) {
+        markContents(&marker, marker.pending[--marker.pendingCount]);
     }
-    Value *remaining = head;
-    Value *last = NULL;
-    int freed = 0;
-    int notFreed = 0;
-    int total = 0;
-    while (remaining->type == CONS_TYPE) {
-        if (!containsSamePointer(remaining->c.car, reachable)) {
+    //we now have all the reachable pointers in a set, so we will crossreference
+    //it with our list of allocated pointers
+    Allocation *remaining = head;
+    Allocation **link = &head;
+    while (remaining != NULL && remaining != frozen) {
+        collection.scannedObjects++;
+        collection.scannedBytes += remaining->size;
+        if (!ptrMapGet(marker.marked, remaining->p, NULL)) {
             //remove this entry
-            freed++;
-            free(remaining->c.car->p);
-            free(remaining->c.car);
-            Value *tmp = remaining;
-            if (last == NULL) {
-                //we're still at the head of the list
-                head = remaining->c.cdr;
-            } else {
-                last->c.cdr = remaining->c.cdr;
-            }
-            remaining = remaining->c.cdr;
-            free(tmp);
+            collection.freedObjects++;
+            collection.freedBytes += remaining->size;
+            noteFree(remaining->size);
+            runFreeHooks(remaining->p);
+            free(remaining->p);
+            *link = remaining->next;
+            free(remaining);
+            remaining = *link;
         } else {
-            notFreed++;
-            last = remaining;
-            remaining = remaining->c.cdr;
+            collection.retainedObjects++;
+            collection.retainedBytes += remaining->size;
+            link = &remaining->next;
+            remaining = remaining->next;
         }
-        total++;
     }
+    collection.marked = ptrMapCount(marker.marked);
+    freePtrMap(marker.marked);
+    free(marker.pending);
+    collection.pauseMs = gcClockMs() - collection.startMs;
+    collection.heapBytesAfter = gcStats.heapBytes;
+    noteCollection(&collection);
+    allocatedSinceCollection = 0;
+    collectionRequested = false;
     if (debugGC) {
-        printf("%i freed, %i remaining out of %i\n", freed, notFreed, total);
+        fprintf(stderr, "GC: %llu freed, %llu remaining out of %llu in %.3f ms\n",
+                (unsigned long long) collection.freedObjects, (unsigned long long) collection.retainedObjects,
+                (unsigned long long) collection.scannedObjects, collection.pauseMs);
     }
-    //tear down the temporary list we used to keep track of the pointers
-    //re-use remaining
-    remaining = reachable;
-    while (remaining->type == CONS_TYPE) {
-        free(remaining->c.car);
-        Value *tmp = remaining;
-        remaining = remaining->c.cdr;
-        free(tmp);
-    }
-    free(remaining); //remove last null in list
 }
+
+/*
+ * Whether interpret() should collect at its next chance.
+ */
+bool collectionDue() {
+    return collectionRequested || allocatedSinceCollection >= collectionThreshold;
+}
+
+/*
+ * Asks for a collection at the next chance, whatever the threshold.
+ */
+void requestCollection() {
+    collectionRequested = true;
+}
+
+/*
+ * Sets how many bytes must be allocated between collections.
+ */
+void setCollectionThreshold(size_t bytes) {
+    collectionThreshold = bytes;
+}
+
 /*
  * Free all pointers allocated by talloc, as well as whatever memory you
  * malloc'ed to create/update the active list.
  */
 void tfree() {
-	while (head->type == CONS_TYPE) {
-		free(head->c.car->p);		
-		free(head->c.car);
-		Value *tmp = head;
-		head = head->c.cdr;
+	for (int i = 0; i < teardownHookCount; i++) {
+		teardownHooks[i]();
+	}
+	while (head != NULL) {
+		runFreeHooks(head->p);
+		free(head->p);
+		Allocation *tmp = head;
+		head = head->next;
 		free(tmp);
 	}
-	free(head);
-	head = NULL;
+	frozen = NULL;
+}
+
+/*
+ * Calls visit on every live allocation, newest first.
+ */
+void forEachAllocation(void (*visit)(void *, size_t, allocationKind, char *, void *), void *context) {
+    for (Allocation *entry = head; entry != NULL; entry = entry->next) {
+        visit(entry->p, entry->size, entry->kind, entry->site, context);
+    }
+}
+
+/*
+ * Marks everything allocated so far as permanent.
+ */
+void freezeHeap() {
+    frozen = head;
+}
+
+/*
+ * Where texit() should jump to instead of exiting, if anywhere.
+ */
+static jmp_buf *recoveryPoint = NULL;
+
+void setRecoveryPoint(jmp_buf *point) {
+    recoveryPoint = point;
 }
 
 /*
@@ -186,6 +326,10 @@ void tfree() {
  * tfree() and then exit().  
  */
 void texit(int status) {
+    if (recoveryPoint != NULL) {
+        fflush(stdout);
+        longjmp(*recoveryPoint, status + 1);
+    }
 	tfree();
 	exit(status);
 }
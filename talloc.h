@@ -1,6 +1,9 @@
 #include <stdlib.h>
+#include <setjmp.h>
+#include <stdbool.h>
 #include "value.h"
 #include "interpreter.h"
+#include "gcstats.h"
 
 #ifndef TALLOC_H
 #define TALLOC_H
@@ -15,6 +18,25 @@
  */
 void *talloc(size_t size);
 
+/*
+ * Like talloc(), recording what the memory is for in the allocation
+ * statistics (see gcstats.h).  Plain talloc() counts as raw.
+ */
+void *tallocKind(size_t size, allocationKind kind);
+
+/*
+ * Where new allocations come from, for the heap census (see census.h): the
+ * name of the primitive or special form being evaluated.  eval() keeps it up
+ * to date; it must point at a string that is never freed.
+ */
+extern char *allocationSite;
+
+/*
+ * Calls visit with the pointer, size, kind and site of every live talloc'ed
+ * block, passing context through.  visit must not allocate.
+ */
+void forEachAllocation(void (*visit)(void *, size_t, allocationKind, char *, void *), void *context);
+
 /*
  * Free all pointers allocated by talloc, as well as whatever memory you
  * malloc'ed to create/update the active list.
@@ -29,10 +51,62 @@ void tfree();
  */
 void texit(int status);
 
+/*
+ * Print an error message indicating the program is out of memory, and
+ * texit().
+ */
+void outOfMemoryError();
+
+/*
+ * Registers a point that texit() jumps back to (with setjmp() returning the
+ * exit status plus one) instead of freeing everything and exiting.  This lets
+ * a long-running process survive an error in one request.  Pass NULL to
+ * restore the default behaviour.
+ */
+void setRecoveryPoint(jmp_buf *point);
+
 /*
  * A function that sweeps through a frame and a value to find all reachable
  * elements, and garbage collects all other unreachable elements allocated
  * through talloc.
  */
 void sweep(Value *tree, Frame *frame);
+
+/*
+ * Marks everything allocated so far as permanent: later sweeps neither free
+ * it nor touch its bookkeeping.  Used once a prelude has been loaded, so that
+ * forked workers keep sharing those pages with their parent.
+ */
+void freezeHeap();
+
+/*
+ * Registers a function to be called with each talloc'ed pointer just before
+ * it is freed (up to four of them).
+ */
+void addFreeHook(void (*hook)(void *));
+
+/*
+ * Registers a function to be called at the start of tfree(), before anything
+ * is freed (up to four of them).
+ */
+void addTeardownHook(void (*hook)());
+
+/*
+ * Whether interpret() should collect between top-level forms: when a
+ * collection was requested, or at least the collection threshold has been
+ * allocated since the last one.
+ */
+bool collectionDue();
+
+/*
+ * Asks for a collection at the next point it is safe to collect (between
+ * top-level forms).
+ */
+void requestCollection();
+
+/*
+ * Sets how many bytes must be allocated since the last collection before
+ * interpret() collects again.  The default, 0, collects after every form.
+ */
+void setCollectionThreshold(size_t bytes);
 #endif
@@ -1,5 +1,4 @@
 #include <stdio.h>
-#include <string.h>
 #include "value.h"
 #include "talloc.h"
 #include "linkedlist.h"
@@ -9,10 +8,7 @@ int main(void) {
    val1->type = INT_TYPE;
    val1->i = 23;
 
-   Value *val2 = talloc(sizeof(Value));
-   val2->type = STR_TYPE;
-   val2->s = talloc(10 * sizeof(char));
-   strcpy(val2->s, "tofu");
+   Value *val2 = makeString("tofu", 4);
 
    Value *head = makeNull();
    head = cons(val1, head);
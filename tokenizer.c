@@ -3,17 +3,76 @@
 #include "linkedlist.h"
 #include "tokenizer.h"
 #include "talloc.h"
+#include "location.h"
+#include "trace.h"
+#include "perfcounters.h"
+#include "bignum.h"
+#include "flonum.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
+#include <errno.h>
  
+/*
+ * A stream being tokenized, with the position of the last character read
+ * and of the start of the token being built.  depth counts the parentheses
+ * left open, so the one close parenthesis too many can be located.
+ */
+typedef struct Cursor {
+    FILE *stream;
+    int file;
+    int line;
+    int column;
+    int previousColumn;
+    int tokenLine;
+    int tokenColumn;
+    int depth;
+} Cursor;
+
+/*
+ * Reads a character, keeping track of the line and column.
+ */
+static int readChar(Cursor *cursor) {
+    int c = fgetc(cursor->stream);
+    if (c == '\n') {
+        cursor->line++;
+        cursor->previousColumn = cursor->column;
+        cursor->column = 0;
+    } else if (c != EOF) {
+        cursor->column++;
+    }
+    return c;
+}
+
+/*
+ * Puts back the character just read.
+ */
+static void pushBack(Cursor *cursor, int c) {
+    ungetc(c, cursor->stream);
+    if (c == '\n') {
+        cursor->line--;
+        cursor->column = cursor->previousColumn;
+    } else if (c != EOF) {
+        cursor->column--;
+    }
+}
+
+/*
+ * Notes that a token starts at the character just read.
+ */
+static void markToken(Cursor *cursor) {
+    cursor->tokenLine = cursor->line;
+    cursor->tokenColumn = cursor->column;
+}
+
 /*
  * Prints a simple error trace and exits the program upon discovering untokenizable input
  */
-void raiseError(char* message, bool condition, int location, char charRead) {
+void raiseError(char* message, bool condition, int location, char charRead, Cursor *cursor) {
     if (!condition) {
         printf("Untokenizable input on character '%c' at %i: %s\n", charRead, location, message);
+        printf("  at %s:%d:%d\n", sourceFileName(cursor->file), cursor->line, cursor->column);
         texit(1);
     }
 }
@@ -23,10 +82,10 @@ void raiseError(char* message, bool condition, int location, char charRead) {
  * Returns a string of all the characters in the list concatenated together.
  */ 
 char *join(Value *list, int length) {
-    char *string = talloc(sizeof(char) * (length + 1));
+    char *string = tallocKind(sizeof(char) * (length + 1), STRING_ALLOCATION);
     string[length] = '\0';
     for (int i = length - 1; i >= 0; i--) {
-        string[i] = car(list)->s[0];
+        string[i] = car(list)->str.chars[0];
         list = cdr(list);
     }
     return string;
@@ -74,29 +133,87 @@ bool isDigit(char c) {
     return false;
 }
 
+/*
+ * The text of a number token, read into a buffer as it goes rather than
+ * into a list of one-character strings, and kept NUL-terminated.
+ */
+typedef struct NumberText {
+    char *chars;
+    int length;
+    int capacity;
+} NumberText;
+
+/*
+ * Adds a character to a number's text.
+ */
+static void addToNumber(NumberText *text, char c) {
+    if (text->length + 1 >= text->capacity) {
+        text->capacity = text->capacity == 0 ? 32 : text->capacity * 2;
+        char *chars = tallocKind(text->capacity, STRING_ALLOCATION);
+        if (text->length > 0) {
+            memcpy(chars, text->chars, text->length);
+        }
+        text->chars = chars;
+    }
+    text->chars[text->length++] = c;
+    text->chars[text->length] = '\0';
+}
+
+/*
+ * Adds the number read so far to the token list, as a double or an integer
+ * (a bignum if it does not fit in 64 bits), and empties the text.
+ */
+static Value *endNumber(Value *list, NumberText *text, bool isDouble, Cursor *cursor) {
+    Value *newValue = makeNull();
+    if (cursor->depth == 0) {
+        // a form of its own
+        setLocation(newValue, cursor->file, cursor->tokenLine, cursor->tokenColumn);
+    }
+    if (isDouble) {
+        newValue->type = DOUBLE_TYPE;
+        newValue->d = parseDouble(text->chars);
+    } else {
+        newValue->type = INT_TYPE;
+        errno = 0;
+        newValue->i = strtoll(text->chars, NULL, 10);
+        if (errno == ERANGE) {
+            newValue->type = BIGNUM_TYPE;
+            newValue->b = parseInteger(text->chars)->b;
+        }
+    }
+    text->length = 0;
+    return cons(newValue, list);
+}
+
 /* 
  * Returns a value object that stores as single character as a string
  */
 Value *buildString(char c, Value *currentString, int *currentStringLength) {
     Value *newChar = makeNull();
     newChar->type = STR_TYPE; 
-    newChar->s = talloc(sizeof(char) * 2);
-    newChar->s[0] = c;
-    newChar->s[1] = '\0';
+    newChar->str.buffer = tallocKind(sizeof(char) * 2, STRING_ALLOCATION);
+    newChar->str.buffer[0] = c;
+    newChar->str.buffer[1] = '\0';
+    newChar->str.chars = newChar->str.buffer;
+    newChar->str.length = 1;
     currentString = cons(newChar, currentString);
     *currentStringLength = *currentStringLength + 1;
     return currentString;
 }
 
-Value *endString(Value *list, Value *currentString, int *currentStringLength, valueType type) {
+Value *endString(Value *list, Value *currentString, int *currentStringLength, valueType type, Cursor *cursor) {
     Value *newValue = makeNull();
     newValue->type = type;
-    if (type == STR_TYPE || type == SYMBOL_TYPE || type == BOOL_TYPE) {
+    if (cursor->depth == 0) {
+        // a form of its own
+        setLocation(newValue, cursor->file, cursor->tokenLine, cursor->tokenColumn);
+    }
+    if (type == STR_TYPE) {
+        newValue->str.buffer = join(currentString, *currentStringLength);
+        newValue->str.chars = newValue->str.buffer;
+        newValue->str.length = *currentStringLength;
+    } else if (type == SYMBOL_TYPE || type == BOOL_TYPE) {
         newValue->s = join(currentString, *currentStringLength);
-    } else if (type == DOUBLE_TYPE) {
-        newValue->d = atof(join(currentString, *currentStringLength));
-    } else if (type == INT_TYPE) {
-        newValue->i = atoi(join(currentString, *currentStringLength));
     }
     *currentStringLength = 0;
     list = cons(newValue, list);
@@ -109,11 +226,17 @@ Value *endString(Value *list, Value *currentString, int *currentStringLength, va
 void displayTokens(Value *list) {
     while (list->type != NULL_TYPE) {
         if (car(list)->type == STR_TYPE) {
-            printf("\"%s\":string", car(list)->s);
+            printf("\"%.*s\":string", car(list)->str.length, car(list)->str.chars);
         } else if (car(list)->type == DOUBLE_TYPE) {
-            printf("%f:double", car(list)->d);
+            char text[FLONUM_LENGTH];
+            formatDouble(car(list)->d, text);
+            printf("%s:double", text);
         } else if (car(list)->type == INT_TYPE) {
-            printf("%i:integer", car(list)->i);
+            printf("%lld:integer", (long long) car(list)->i);
+        } else if (car(list)->type == BIGNUM_TYPE) {
+            char *digits = integerToString(car(list));
+            printf("%s:integer", digits);
+            free(digits);
         } else if (car(list)->type == OPEN_TYPE) {
             printf("%s:open", car(list)->s);
         } else if (car(list)->type == CLOSE_TYPE) {
@@ -131,13 +254,34 @@ void displayTokens(Value *list) {
 /* 
  * Takes in a character stream, returns a list of every tokenizable symbol
  * in the stream or gracefully exits if a non-tokenizable symbol is encountered.
+ * Open parentheses and quotes are located against sourceName, for the parser
+ * to pass on to the forms they start, and so are atoms outside any list;
+ * other atoms are not.
  */
-Value *tokenize() {
-    int inputStatus = isatty(fileno(stdin));
+Value *tokenizeStream(FILE *stream, char *sourceName) {
+    return tokenizeStreamAt(stream, sourceName, 1, 1);
+}
+
+/*
+ * Same as tokenizeStream(), for a stream whose first character is at the
+ * given line and column of sourceName.
+ */
+Value *tokenizeStreamAt(FILE *stream, char *sourceName, int line, int column) {
+    int inputStatus = isatty(fileno(stream));
+    Cursor cursor = {stream, sourceFile(sourceName), line, column - 1, 0, line, column - 1, 0};
+    char *callerSite = allocationSite;
+    allocationSite = "tokenize";
+    if (tracing) {
+        traceBegin("tokenize");
+    }
+    if (countingPerf) {
+        perfBegin(TOKENIZE_PHASE);
+    }
     char charRead;
     Value *list = makeNull();
     Value *currentString = makeNull();
     int currentStringLength = 0;
+    NumberText number = {NULL, 0, 0};
     charRead = 'a';
     int totalRead  = 0;
     bool inString  = false;
@@ -145,10 +289,11 @@ Value *tokenize() {
     bool inComment = false;
     bool inNumber  = false;
     bool inDecimal = false;
+    bool inExponent = false;
     bool isEscaped = false;
     while ((inputStatus == 1 && charRead != 10 && charRead != EOF) || (inputStatus == 0 && charRead != EOF)) {
         totalRead++;
-        charRead = fgetc(stdin);
+        charRead = readChar(&cursor);
         if (inComment) {
             if (charRead == '\n') {
                 inComment = false;
@@ -169,11 +314,11 @@ Value *tokenize() {
                         currentString = buildString('\'', currentString, &currentStringLength);
                     } else {
                         // Invalid escaped character
-                        raiseError("Invalid escaped character", false, totalRead, charRead);
+                        raiseError("Invalid escaped character", false, totalRead, charRead, &cursor);
                     }
                     isEscaped = false;
                 } else if (charRead == '"') {
-                    list = endString(list, currentString, &currentStringLength, STR_TYPE);
+                    list = endString(list, currentString, &currentStringLength, STR_TYPE, &cursor);
                     currentString = makeNull();
                     inString = false;
                 } else if (charRead == '\\') {
@@ -185,101 +330,123 @@ Value *tokenize() {
             // Symbols
             } else if (inSymbol) {
                 if (charRead == ' ' || charRead == '(' || charRead == ')' || charRead == EOF || charRead == '\n' || charRead == '\r') {
-                    list = endString(list, currentString, &currentStringLength, SYMBOL_TYPE);
+                    list = endString(list, currentString, &currentStringLength, SYMBOL_TYPE, &cursor);
                     currentString = makeNull();
                     inSymbol = false;
                     if (!(inputStatus == 1 && charRead == 10)) {
-                        ungetc(charRead, stdin);
+                        pushBack(&cursor, charRead);
                     }
                     totalRead--;
                 } else {
-                    raiseError("Invalid symbol", isInSubsequentSymbol(charRead), totalRead, charRead);
+                    raiseError("Invalid symbol", isInSubsequentSymbol(charRead), totalRead, charRead, &cursor);
                     currentString = buildString(charRead, currentString, &currentStringLength);
                 }
 
             // Numbers
             } else if (inNumber) {
                 if (charRead == ' ' || charRead == '(' || charRead == ')' || charRead == EOF || charRead == '\n' || charRead == '\r') {
-                    raiseError("Invalid number", !(currentStringLength >= 1 && car(currentString)->s[0] == '.'), totalRead, charRead);
-                    if (inDecimal) {
-                        list = endString(list, currentString, &currentStringLength, DOUBLE_TYPE);
-                        currentString = makeNull();
-                    } else {
-                        list = endString(list, currentString, &currentStringLength, INT_TYPE);
-                        currentString = makeNull();
-                    }
+                    raiseError("Invalid number", isDigit(number.chars[number.length - 1]), totalRead, charRead, &cursor);
+                    list = endNumber(list, &number, inDecimal, &cursor);
                     if (!(inputStatus == 1 && charRead == 10)) {
-                        ungetc(charRead, stdin);
+                        pushBack(&cursor, charRead);
                     }
                     totalRead--;
                     inNumber = false;
                     inDecimal = false;
+                    inExponent = false;
                 } else {
+                    char previous = number.chars[number.length - 1];
                     if (!inDecimal && charRead == '.') {
                         inDecimal = true;
-                        currentString = buildString(charRead, currentString, &currentStringLength);
-                    } else {
-                        raiseError("Invalid number", isDigit(charRead), totalRead, charRead);
-                        currentString = buildString(charRead, currentString, &currentStringLength);
+                    } else if (!inExponent && (charRead == 'e' || charRead == 'E') && isDigit(previous)) {
+                        // An exponent makes a double, even without a point.
+                        inDecimal = true;
+                        inExponent = true;
+                    } else if (!((charRead == '+' || charRead == '-') && (previous == 'e' || previous == 'E'))) {
+                        raiseError("Invalid number", isDigit(charRead), totalRead, charRead, &cursor);
                     }
+                    addToNumber(&number, charRead);
                 }
 
             // Handle Parentheses
             } else if (charRead == '(') {
                 Value *newValue = makeNull();
                 newValue->type = OPEN_TYPE;
-                newValue->s = talloc(sizeof(char) * 2);
+                setLocation(newValue, cursor.file, cursor.line, cursor.column);
+                cursor.depth++;
+                newValue->s = tallocKind(sizeof(char) * 2, STRING_ALLOCATION);
                 strcpy(newValue->s, "(");
                 list = cons(newValue, list);
             } else if (charRead == ')') {
                 Value *newValue = makeNull();
                 newValue->type = CLOSE_TYPE;
-                newValue->s = talloc(sizeof(char) * 2);
+                if (--cursor.depth < 0) {
+                    // the parser will reject this one
+                    setLocation(newValue, cursor.file, cursor.line, cursor.column);
+                }
+                newValue->s = tallocKind(sizeof(char) * 2, STRING_ALLOCATION);
                 strcpy(newValue->s, ")");
                 list = cons(newValue, list);   
             } else if (charRead == '\'') {
                 Value *newValue = makeNull();
                 newValue->type = QUOTE_TYPE;
-                newValue->s = talloc(sizeof(char) * 2);
+                setLocation(newValue, cursor.file, cursor.line, cursor.column);
+                newValue->s = tallocKind(sizeof(char) * 2, STRING_ALLOCATION);
                 strcpy(newValue->s, "(");
                 list = cons(newValue, list);
             } 
             // Else detect if we should flip on any new flags
             else if (isDigit(charRead)) {
+                markToken(&cursor);
                 inNumber = true;
-                currentString = buildString(charRead, currentString, &currentStringLength);
+                addToNumber(&number, charRead);
 
             } else if (charRead == '.') {
+                markToken(&cursor);
                 inNumber = true;
                 inDecimal = true;
-                currentString = buildString(charRead, currentString, &currentStringLength);
+                addToNumber(&number, charRead);
 
             } else if (charRead == '+' || charRead == '-') {
-                currentString = buildString(charRead, currentString, &currentStringLength);
-                char nextChar = fgetc(stdin);
+                markToken(&cursor);
+                char nextChar = readChar(&cursor);
                 if (nextChar == ' ' || nextChar == '(' || nextChar == ')' || nextChar == EOF || nextChar == '\n' || nextChar == '\r') {
-                    list = endString(list, currentString, &currentStringLength, SYMBOL_TYPE);
+                    currentString = buildString(charRead, currentString, &currentStringLength);
+                    list = endString(list, currentString, &currentStringLength, SYMBOL_TYPE, &cursor);
                     currentString = makeNull();
                 } else {
                     inNumber = true;
+                    addToNumber(&number, charRead);
                 }
-                ungetc(nextChar, stdin);
+                pushBack(&cursor, nextChar);
 
             } else if (charRead == '#') {
-                char nextChar = fgetc(stdin);
+                markToken(&cursor);
+                char nextChar = readChar(&cursor);
                 if (nextChar == 't' || nextChar == 'f') {
                     currentString = buildString(charRead, currentString, &currentStringLength);
                     currentString = buildString(nextChar, currentString, &currentStringLength);
-                    list = endString(list, currentString, &currentStringLength, BOOL_TYPE);
+                    list = endString(list, currentString, &currentStringLength, BOOL_TYPE, &cursor);
+                } else if (nextChar == '(') {
+                    // the open paren of a vector literal
+                    Value *newValue = makeNull();
+                    newValue->type = OPEN_TYPE;
+                    setLocation(newValue, cursor.file, cursor.tokenLine, cursor.tokenColumn);
+                    cursor.depth++;
+                    newValue->s = tallocKind(sizeof(char) * 3, STRING_ALLOCATION);
+                    strcpy(newValue->s, "#(");
+                    list = cons(newValue, list);
                 } else {
-                    raiseError("Incorrect Boolean", false, totalRead, charRead);
+                    raiseError("Incorrect Boolean", false, totalRead, charRead, &cursor);
                 }
             } else if (charRead == ';') {
                 inComment = true;
 
             } else if (charRead == '"' && !isEscaped) {
+                markToken(&cursor);
                 inString = true;
             } else if (isInInitialSymbol(charRead)) {
+                markToken(&cursor);
                 inSymbol = true;
                 currentString = buildString(charRead, currentString, &currentStringLength);
 
@@ -287,9 +454,24 @@ Value *tokenize() {
             } else if (charRead == '\n' || charRead == '\t' || charRead == ' ' || charRead == '\r' || charRead == EOF) {
                 continue;
             } else {
-                raiseError("Input not recognized", false, totalRead, charRead);
+                raiseError("Input not recognized", false, totalRead, charRead, &cursor);
             }
         }
     }
-    return reverse(list);
+    list = reverse(list);
+    allocationSite = callerSite;
+    if (countingPerf) {
+        perfEnd();
+    }
+    if (tracing) {
+        traceEnd();
+    }
+    return list;
+}
+
+/* 
+ * Tokenizes standard input.
+ */
+Value *tokenize() {
+    return tokenizeStream(stdin, "<stdin>");
 }
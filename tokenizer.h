@@ -1,3 +1,4 @@
+#include <stdio.h>
 #include "value.h"
 #ifndef TOKENIZER_H
 #define TOKENIZER_H
@@ -5,6 +6,18 @@
 /* 
  * Takes in a character stream, returns a list of every tokenizable symbol
  * in the stream or gracefully exits if a non-tokenizable symbol is encountered.
+ * Forms are located (see location.h) against sourceName.
+ */
+Value *tokenizeStream(FILE *stream, char *sourceName);
+
+/*
+ * Same as tokenizeStream(), for a stream that starts at the given line and
+ * column (both counted from 1) of sourceName, such as one form cut out of it.
+ */
+Value *tokenizeStreamAt(FILE *stream, char *sourceName, int line, int column);
+
+/* 
+ * Same as tokenizeStream(), reading from standard input.
  */
 Value *tokenize();
 
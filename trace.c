@@ -0,0 +1,172 @@
+#define _GNU_SOURCE
+#include "trace.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Events each thread buffers before writing them out.
+#define RING_EVENTS 65536
+
+bool tracing = false;
+
+typedef struct TraceEvent {
+    uint64_t ns;
+    char *name;
+    char phase;
+} TraceEvent;
+
+/*
+ * One thread's events.  Only that thread adds to the ring or writes it out
+ * (until exit, when every thread's ring is written), so no locks are needed;
+ * rings are pushed onto the list of all of them with a compare-and-swap.
+ */
+typedef struct TraceRing {
+    TraceEvent events[RING_EVENTS];
+    size_t head;
+    size_t tail;
+    int openSpans;
+    long tid;
+    struct TraceRing *next;
+} TraceRing;
+
+static __thread TraceRing *ring = NULL;
+static __thread int callsUntilSample = 0;
+static TraceRing *rings = NULL;
+
+static FILE *output = NULL;
+static bool wroteEvent = false;
+static uint64_t startNs = 0;
+static int sampleEvery = 0;
+static pid_t tracedProcess;
+
+static uint64_t nowNs() {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static void writeJsonString(FILE *out, char *text) {
+    fputc('"', out);
+    for (char *c = text; *c != '\0'; c++) {
+        if (*c == '"' || *c == '\\') {
+            fprintf(out, "\\%c", *c);
+        } else if ((unsigned char) *c < 0x20) {
+            fprintf(out, "\\u%04x", *c);
+        } else {
+            fputc(*c, out);
+        }
+    }
+    fputc('"', out);
+}
+
+/*
+ * Writes out and empties a ring.
+ */
+static void drain(TraceRing *events) {
+    while (events->tail != events->head) {
+        TraceEvent *event = &events->events[events->tail % RING_EVENTS];
+        fputs(__atomic_exchange_n(&wroteEvent, true, __ATOMIC_RELAXED) ? ",\n" : "\n", output);
+        fprintf(output, "{\"ph\": \"%c\", \"ts\": %.3f, \"pid\": %d, \"tid\": %ld",
+                event->phase, (event->ns - startNs) / 1000.0, (int) tracedProcess, events->tid);
+        if (event->phase == 'B') {
+            fputs(", \"name\": ", output);
+            writeJsonString(output, event->name);
+        }
+        fputc('}', output);
+        events->tail++;
+    }
+}
+
+static void writeTrace() {
+    if (getpid() != tracedProcess) {
+        return;
+    }
+    // Close whatever an error left open, so the spans still nest.
+    traceUnwind();
+    for (TraceRing *events = rings; events != NULL; events = events->next) {
+        drain(events);
+    }
+    fprintf(output, "\n]}\n");
+    fclose(output);
+    tracing = false;
+}
+
+bool startTracing(char *path, int sampleRate) {
+    output = fopen(path, "w");
+    if (output == NULL) {
+        perror("Trace error");
+        return false;
+    }
+    fprintf(output, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+    startNs = nowNs();
+    sampleEvery = sampleRate;
+    tracedProcess = getpid();
+    tracing = true;
+    atexit(writeTrace);
+    return true;
+}
+
+static TraceRing *threadRing() {
+    if (ring == NULL) {
+        ring = calloc(1, sizeof(TraceRing));
+        if (ring == NULL) {
+            return NULL;
+        }
+        ring->tid = syscall(SYS_gettid);
+        ring->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+        while (!__atomic_compare_exchange_n(&rings, &ring->next, ring, false,
+                                            __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+    }
+    return ring;
+}
+
+static void record(char phase, char *name) {
+    TraceRing *events = threadRing();
+    if (events == NULL) {
+        return;
+    }
+    if (events->head - events->tail == RING_EVENTS) {
+        drain(events);
+    }
+    TraceEvent *event = &events->events[events->head % RING_EVENTS];
+    event->ns = nowNs();
+    event->name = name;
+    event->phase = phase;
+    events->head++;
+}
+
+void traceBegin(char *name) {
+    record('B', name);
+    if (ring != NULL) {
+        ring->openSpans++;
+    }
+}
+
+void traceEnd() {
+    if (ring != NULL && ring->openSpans > 0) {
+        record('E', NULL);
+        ring->openSpans--;
+    }
+}
+
+bool traceSampleCall() {
+    if (sampleEvery <= 0) {
+        return false;
+    }
+    if (callsUntilSample > 0) {
+        callsUntilSample--;
+        return false;
+    }
+    callsUntilSample = sampleEvery - 1;
+    return true;
+}
+
+void traceUnwind() {
+    while (ring != NULL && ring->openSpans > 0) {
+        traceEnd();
+    }
+}
@@ -0,0 +1,58 @@
+#include <stdbool.h>
+
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Event tracing in the Chrome trace format, which chrome://tracing and
+ * Perfetto open directly.
+ *
+ * The interpreter marks the start and end of each phase of its work
+ * (tokenize, parse, reading a parse cache, each top-level eval, each
+ * garbage collection) and, if asked, of one in every n closure calls.  Each
+ * thread appends its events to a ring buffer of its own, so recording one
+ * is a clock read and a few stores with no locking; the thread writes the
+ * ring out to the file itself when it fills, and at exit whatever is left
+ * in every ring is written and the file closed.
+ *
+ * Spans left open by an error are closed by traceUnwind(), so the nesting
+ * stays right in the server.  Forked workers exit without writing their
+ * rings, so only the main process is traced.
+ *
+ * When tracing is off the only cost is a test of the tracing flag.
+ */
+
+/*
+ * Whether events are being recorded.
+ */
+extern bool tracing;
+
+/*
+ * Starts recording events, to be written to path, with a span for one in
+ * every sampleEvery closure calls (none if it is 0).  Returns false (after
+ * printing a message) if the file cannot be opened.
+ */
+bool startTracing(char *path, int sampleEvery);
+
+/*
+ * Begins a span.  name must stay valid until the program exits.
+ */
+void traceBegin(char *name);
+
+/*
+ * Ends the innermost open span.
+ */
+void traceEnd();
+
+/*
+ * Whether to trace this closure call, counting it towards the sample rate.
+ */
+bool traceSampleCall();
+
+/*
+ * Ends every span the current thread has open, after an evaluation was
+ * abandoned by an error.
+ */
+void traceUnwind();
+
+#endif
@@ -1,6 +1,8 @@
 #ifndef VALUE_H
 #define VALUE_H
 
+#include <stdint.h>
+#include <stdbool.h>
 #include "interpreter.h"
 
 typedef enum {
@@ -18,14 +20,36 @@ typedef enum {
    PRIMITIVE_TYPE,
    VOID_TYPE,
    QUOTE_TYPE,
+   VECTOR_TYPE,
+   HASH_TYPE,
+   BIGNUM_TYPE,
+   F64VECTOR_TYPE,
+   S64VECTOR_TYPE,
+   STRING_BUILDER_TYPE,
 } valueType;
 struct Value {
    valueType type;
    union {
       void *p;
-      int i;
+      int64_t i;
       double d;
+      /* The NUL-terminated name of a symbol or boolean. */
       char *s;
+      /* A string: length characters at chars, not necessarily followed by
+       * a NUL, somewhere in the talloc'ed buffer.  Substrings share their
+       * parent's buffer. */
+      struct String {
+         char *chars;
+         char *buffer;
+         int length;
+      } str;
+      /* A string builder: length characters in a talloc'ed buffer with room
+       * for capacity of them plus a NUL, which always follows the last. */
+      struct StringBuilder {
+         char *buffer;
+         int length;
+         int capacity;
+      } sb;
       struct ConsCell {
          struct Value *car;
          struct Value *cdr;
@@ -35,6 +59,29 @@ struct Value {
          struct Value *body;
          struct Frame *frame;
       } cl;
+      /* A vector's elements, in one talloc'ed array (NULL when empty). */
+      struct Vector {
+         struct Value **items;
+         int length;
+      } v;
+      /* An integer too big for i (see bignum.h): its magnitude in base 2^32,
+       * least significant digit first, in one talloc'ed array. */
+      struct Bignum {
+         uint32_t *digits;
+         int length;
+         bool negative;
+      } b;
+      /* An f64vector's or s64vector's elements, unboxed in one talloc'ed
+       * array (NULL when empty). */
+      struct NumericVector {
+         union {
+            double *f64;
+            int64_t *s64;
+         };
+         int length;
+      } n;
+      /* A hash table (see hashtable.h). */
+      struct HashTable *h;
 	  /* A pointer to a C implementation of a Scheme primitive function.
 	   * Note: 'pf' is the variable name I chose for the function pointer.
 	   */ 